@@ -0,0 +1,288 @@
+#!/usr/bin/env python
+"""
+Benchmarks for the overhead which line profiling adds to each line
+event, i.e. the cost of the trace callbacks (``inner_trace_callback()``
+via ``legacy_trace_callback()`` or the :py:mod:`sys.monitoring`
+callbacks), in nanoseconds per event.
+
+Starting from a baseline case, one dimension is varied at a time:
+
+* ``core``: legacy trace function vs. :py:mod:`sys.monitoring` (see
+  :envvar:`LINE_PROFILER_CORE`); the other dimensions are measured
+  for each available core
+* ``nlines``: number of lines in the loop of the profiled function
+* ``nthreads``: number of threads running it concurrently
+* ``nprofilers``: number of active profiler instances profiling it
+* ``nfuncs``: number of (other) functions registered with each
+  profiler
+
+Each case runs in a fresh subprocess, timing the same workload with
+and without profiling (interleaved, keeping the fastest of several
+repeats) and dividing the difference by the number of line events.
+
+Usage:
+    Measure, and optionally save the results::
+
+        python benchmarks/bench_overhead.py [--quick] [-o results.json]
+
+    Compare against results saved earlier (e.g. from the base branch),
+    exiting with status 1 if a case got slower by more than the
+    threshold (relative)::
+
+        python benchmarks/bench_overhead.py --compare base.json \\
+            [--threshold 0.1]
+"""
+
+from __future__ import annotations
+
+import argparse
+import contextlib
+import json
+import os
+import subprocess
+import sys
+import threading
+import time
+
+BASELINE = dict(nlines=10, nthreads=1, nprofilers=1, nfuncs=1)
+VARIATIONS = dict(
+    nlines=[1, 100],
+    nthreads=[4],
+    nprofilers=[4],
+    nfuncs=[1000],
+)
+# Line events per thread per repeat
+NEVENTS = 200_000
+NEVENTS_QUICK = 20_000
+
+
+def make_function(nlines, name='work'):
+    """
+    Returns:
+        Function with a loop of ``nlines`` lines (compiled from a
+        distinct "file"), taking the number of iterations
+    """
+    body = ''.join(f'        x += {i}\n' for i in range(nlines))
+    source = f'def {name}(n):\n    x = 0\n    for _ in range(n):\n{body}'
+    source += '    return x\n'
+    namespace = {}
+    exec(compile(source, f'<benchmark:{name}>', 'exec'), namespace)
+    return namespace[name]
+
+
+def run_threads(func, n, nthreads, setup=contextlib.nullcontext):
+    """
+    Returns:
+        Wall time for ``nthreads`` threads to each call ``func(n)``
+        (with the context ``setup()`` entered on each thread)
+    """
+    barrier = threading.Barrier(nthreads + 1)
+
+    def target():
+        with setup():
+            barrier.wait()
+            func(n)
+
+    if nthreads == 1:
+        with setup():
+            start = time.perf_counter()
+            func(n)
+            return time.perf_counter() - start
+    threads = [threading.Thread(target=target) for _ in range(nthreads)]
+    for thread in threads:
+        thread.start()
+    barrier.wait()
+    start = time.perf_counter()
+    for thread in threads:
+        thread.join()
+    return time.perf_counter() - start
+
+
+def run_case(case, nevents, repeats):
+    """
+    Measure a single case in the current process.
+
+    Returns:
+        Dictionary with the overhead per line event (``ns_per_event``),
+        the number of events, and the unprofiled time per event
+    """
+    from line_profiler import LineProfiler
+
+    func = make_function(case['nlines'])
+    niter = max(nevents // (case['nlines'] + 1), 1)
+    profs = [LineProfiler() for _ in range(case['nprofilers'])]
+    others = [
+        make_function(1, f'other_{i}') for i in range(case['nfuncs'] - 1)
+    ]
+    for prof in profs:
+        prof.add_function(func)
+        for other in others:
+            prof.add_function(other)
+
+    @contextlib.contextmanager
+    def profiling():
+        with contextlib.ExitStack() as stack:
+            for prof in profs:
+                stack.enter_context(prof)
+            yield
+
+    def count_events():
+        timings = profs[0].get_stats().timings
+        return sum(
+            nhits for entries in timings.values() for _, nhits, _ in entries
+        )
+
+    # Warm up (e.g. specialization, shard allocation), and count the
+    # events of a run
+    run_threads(func, niter, case['nthreads'])
+    run_threads(func, niter, case['nthreads'], profiling)
+    events = max(count_events(), 1)
+    plain, profiled = float('inf'), float('inf')
+    for _ in range(repeats):
+        plain = min(plain, run_threads(func, niter, case['nthreads']))
+        profiled = min(
+            profiled, run_threads(func, niter, case['nthreads'], profiling)
+        )
+    return {
+        'ns_per_event': (profiled - plain) / events * 1e9,
+        'baseline_ns_per_event': plain / events * 1e9,
+        'events': events,
+    }
+
+
+def available_cores():
+    cores = ['legacy']
+    if isinstance(getattr(sys, 'monitoring', None), type(sys)):
+        cores.append('sysmon')
+    return cores
+
+
+def get_cases(cores):
+    cases = []
+    for core in cores:
+        cases.append(dict(core=core, **BASELINE))
+        for dim, values in VARIATIONS.items():
+            for value in values:
+                cases.append(dict(core=core, **{**BASELINE, dim: value}))
+    return cases
+
+
+def case_id(case):
+    return ','.join(f'{key}={value}' for key, value in case.items())
+
+
+def measure(case, nevents, repeats):
+    """
+    Measure ``case`` in a subprocess (with the requested core).
+    """
+    env = dict(os.environ, LINE_PROFILER_CORE=case['core'])
+    spec = json.dumps(
+        {'case': case, 'nevents': nevents, 'repeats': repeats}
+    )
+    proc = subprocess.run(
+        [sys.executable, __file__, '--run-case', spec],
+        env=env,
+        capture_output=True,
+        text=True,
+    )
+    if proc.returncode:
+        sys.stderr.write(proc.stderr)
+        raise RuntimeError(f'case {case_id(case)!r} failed')
+    return json.loads(proc.stdout.splitlines()[-1])
+
+
+def compare(results, baseline, threshold):
+    """
+    Returns:
+        List of ``(case_id, old, new)`` for the cases which regressed
+    """
+    regressions = []
+    for cid, result in results.items():
+        try:
+            old = baseline[cid]['ns_per_event']
+        except KeyError:
+            continue
+        new = result['ns_per_event']
+        # Note: ignore differences below 1 ns, which are noise
+        if new - old > max(threshold * abs(old), 1):
+            regressions.append((cid, old, new))
+    return regressions
+
+
+def main(args=None):
+    parser = argparse.ArgumentParser(description=__doc__.split('\n\n')[0])
+    parser.add_argument(
+        '--quick',
+        action='store_true',
+        help='Fewer events and repeats (for smoke testing)',
+    )
+    parser.add_argument(
+        '--core',
+        action='append',
+        choices=available_cores(),
+        help='Only measure with this core (can be given multiple times)',
+    )
+    parser.add_argument(
+        '-o', '--output', help='Write the results to this JSON file'
+    )
+    parser.add_argument(
+        '--compare',
+        metavar='BASELINE',
+        help='JSON file of earlier results to compare against',
+    )
+    parser.add_argument(
+        '--threshold',
+        type=float,
+        default=0.1,
+        help='Relative slowdown (per case) considered a regression '
+        '(default: %(default)s)',
+    )
+    parser.add_argument('--run-case', help=argparse.SUPPRESS)
+    args = parser.parse_args(args)
+
+    if args.run_case:
+        spec = json.loads(args.run_case)
+        result = run_case(spec['case'], spec['nevents'], spec['repeats'])
+        print(json.dumps(result))
+        return 0
+
+    nevents = NEVENTS_QUICK if args.quick else NEVENTS
+    repeats = 3 if args.quick else 7
+    baseline = {}
+    if args.compare:
+        with open(args.compare) as f:
+            baseline = json.load(f)['results']
+    results = {}
+    print(f'{"case":<56} {"ns/event":>9} {"change":>8}')
+    for case in get_cases(args.core or available_cores()):
+        cid = case_id(case)
+        results[cid] = result = measure(case, nevents, repeats)
+        line = f'{cid:<56} {result["ns_per_event"]:>9.1f}'
+        if cid in baseline and baseline[cid]['ns_per_event'] > 1:
+            old = baseline[cid]['ns_per_event']
+            line += f' {(result["ns_per_event"] / old - 1) * 100:>+7.1f}%'
+        print(line, flush=True)
+    if args.output:
+        with open(args.output, mode='w') as f:
+            json.dump(
+                {
+                    'python': sys.version,
+                    'platform': sys.platform,
+                    'results': results,
+                },
+                f,
+                indent=2,
+            )
+    if args.compare:
+        regressions = compare(results, baseline, args.threshold)
+        for cid, old, new in regressions:
+            print(
+                f'REGRESSION: {cid}: {old:.1f} -> {new:.1f} ns/event',
+                file=sys.stderr,
+            )
+        return 1 if regressions else 0
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
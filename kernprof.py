@@ -78,6 +78,7 @@ which displays:
                     [--builtin [Y[es] | N[o] | T[rue] | F[alse] | on | off | 1 | 0]]
                     [-s SETUP] [-p {path/to/script | object.dotted.path}[,...]]
                     [--preimports [Y[es] | N[o] | T[rue] | F[alse] | on | off | 1 | 0]]
+                    [--lazy-imports [Y[es] | N[o] | T[rue] | F[alse] | on | off | 1 | 0]]
                     [--prof-imports [Y[es] | N[o] | T[rue] | F[alse] | on | off | 1 | 0]]
                     [-o OUTFILE] [-v] [-q]
                     [--rich [Y[es] | N[o] | T[rue] | F[alse] | on | off | 1 | 0]]
@@ -133,6 +134,13 @@ which displays:
                             profile them, instead of only profiling those that are
                             directly imported in the profiled code. Only works with line
                             profiling (`-l`/`--line-by-line`). (Default: True)
+      --lazy-imports [Y[es] | N[o] | T[rue] | F[alse] | on | off | 1 | 0]
+                            Instead of eagerly importing all profiling targets specified
+                            via `-p` (and walking the packages therein) before running
+                            the profiled code, profile each of them when (and only if) it
+                            is imported, via an import hook; useful for large packages.
+                            Only works with line profiling (`-l`/`--line-by-line`).
+                            (Default: False)
       --prof-imports [Y[es] | N[o] | T[rue] | F[alse] | on | off | 1 | 0]
                             If the script/module profiled is in `--prof-mod`, autoprofile
                             all its imports. Only works with line profiling (`-l`/`--line-
@@ -166,6 +174,52 @@ which displays:
                             every OUTPUT_INTERVAL seconds. Uses the threading module.
                             Minimum value (and the value implied if the bare option is
                             given) is 1 s. (Default: 0 s (disabled))
+      --incremental [Y[es] | N[o] | T[rue] | F[alse] | on | off | 1 | 0]
+                            Write OUTFILE as an incremental log, appending only the
+                            timings changed since the previous output instead of
+                            rewriting the cumulative results at each interval; `python -m
+                            line_profiler` shows the final results, and
+                            `line_profiler.stats_file.StatsLog` gives the results at each
+                            point in time. Only works with line profiling (`-l`/`--line-
+                            by-line`). (Default: False)
+      --workers [Y[es] | N[o] | T[rue] | F[alse] | on | off | 1 | 0]
+                            Also profile the child processes (e.g. `multiprocessing`
+                            workers) started by the profiled code, and merge their
+                            results into OUTFILE: forked children inherit the profiler,
+                            while spawned ones profile the `@profile`-decorated
+                            functions. Only works with line profiling (`-l`/`--line-by-
+                            line`). (Default: False)
+      --live [Y[es] | N[o] | T[rue] | F[alse] | on | off | 1 | 0]
+                            Also keep the current results in the live-counter file
+                            OUTFILE.live, updated every OUTPUT_INTERVAL seconds (1 s if
+                            not given), for watching the profile from another process
+                            with `python -m line_profiler --attach OUTFILE.live`. Only
+                            works with line profiling (`-l`/`--line-by-line`).
+                            (Default: False)
+      --histograms [Y[es] | N[o] | T[rue] | F[alse] | on | off | 1 | 0]
+                            Also keep a histogram of the durations of the hits of each
+                            line, so that the results show their median, 99th
+                            percentile, and maximum. Only works with line profiling
+                            (`-l`/`--line-by-line`). (Default: False)
+      --per-thread [Y[es] | N[o] | T[rue] | F[alse] | on | off | 1 | 0]
+                            Also break the timings of each line down by thread (name).
+                            Only works with line profiling (`-l`/`--line-by-line`).
+                            (Default: False)
+      --self-time [Y[es] | N[o] | T[rue] | F[alse] | on | off | 1 | 0]
+                            Also report the self time of each line, i.e. its time
+                            minus that spent in the profiled code it calls. Only works
+                            with line profiling (`-l`/`--line-by-line`). (Default:
+                            False)
+      --memory [Y[es] | N[o] | T[rue] | F[alse] | on | off | 1 | 0]
+                            Also account the memory allocated by each line, i.e. the
+                            number and total size of the blocks allocated and the bytes
+                            still retained. Only works with line profiling
+                            (`-l`/`--line-by-line`). (Default: False)
+      --counters EVENTS     Also count the hardware events EVENTS (comma-separated, up
+                            to 4 of cycles, instructions, cache-references, cache-
+                            misses, branches, and branch-misses) in each line (Linux
+                            only). Only works with line profiling (`-l`/`--line-by-
+                            line`). (Default: N/A)
 
 NOTE:
 
@@ -184,6 +238,11 @@ NOTE:
 
     To restore the old behavior, pass the :option:`!--no-preimports`
     flag.
+
+    To only profile the targets that the profiled code ends up
+    importing (wherever that happens), without importing the rest or
+    walking the packages up front, pass the :option:`!--lazy-imports`
+    flag (see :py:mod:`line_profiler.autoprofile.lazy_imports`).
 """  # noqa: E501
 
 import atexit
@@ -234,6 +293,18 @@ from line_profiler import _diagnostics as diagnostics
 
 
 DIAGNOSITICS_VERBOSITY = 2
+# `(dest, flag)` of the options which are ignored (with a warning)
+# without line profiling (`-l`/`--line-by-line`)
+_LINE_BY_LINE_ONLY_OPTIONS = (
+    ('incremental', '--incremental'),
+    ('workers', '--workers'),
+    ('live', '--live'),
+    ('histograms', '--histograms'),
+    ('per_thread', '--per-thread'),
+    ('self_time', '--self-time'),
+    ('memory', '--memory'),
+    ('counters', '--counters'),
+)
 
 
 def execfile(filename, globals=None, locals=None):
@@ -289,6 +360,10 @@ class RepeatedTimer:
 
     def __init__(self, interval, dump_func, outfile):
         self._timer = None
+        # Held while calling `dump_func`, so that `stop()` can wait
+        # for an ongoing call
+        self._lock = threading.Lock()
+        self._stopped = False
         self.interval = interval
         self.dump_func = dump_func
         self.outfile = outfile
@@ -299,10 +374,12 @@ class RepeatedTimer:
     def _run(self):
         self.is_running = False
         self.start()
-        self.dump_func(self.outfile)
+        with self._lock:
+            if not self._stopped:
+                self.dump_func(self.outfile)
 
     def start(self):
-        if not self.is_running:
+        if not (self.is_running or self._stopped):
             self.next_call += self.interval
             self._timer = threading.Timer(
                 self.next_call - time.time(), self._run
@@ -311,8 +388,10 @@ class RepeatedTimer:
             self.is_running = True
 
     def stop(self):
-        self._timer.cancel()
-        self.is_running = False
+        with self._lock:
+            self._stopped = True
+            self._timer.cancel()
+            self.is_running = False
 
 
 def find_module_script(module_name, *, static=True, exit_on_error=True):
@@ -672,6 +751,18 @@ def _add_core_parser_arguments(parser):
         'Only works with line profiling (`-l`/`--line-by-line`). '
         f'(Default: {default.conf_dict["preimports"]})',
     )
+    add_argument(
+        prof_opts,
+        '--lazy-imports',
+        action='store_true',
+        help='Instead of eagerly importing all profiling targets '
+        'specified via `-p` (and walking the packages therein) '
+        'before running the profiled code, profile each of them when '
+        '(and only if) it is imported, via an import hook; useful for '
+        'large packages. '
+        'Only works with line profiling (`-l`/`--line-by-line`). '
+        f'(Default: {default.conf_dict["lazy_imports"]})',
+    )
     add_argument(
         prof_opts,
         '--prof-imports',
@@ -771,6 +862,93 @@ def _add_core_parser_arguments(parser):
         'Minimum value (and the value implied if the bare option '
         f'is given) is 1 s. (Default: {def_out_int})',
     )
+    add_argument(
+        out_opts,
+        '--incremental',
+        action='store_true',
+        help='Write OUTFILE as an incremental log, appending only the '
+        'timings changed since the previous output instead of '
+        'rewriting the cumulative results at each interval; '
+        '`python -m line_profiler` shows the final results, and '
+        '`line_profiler.stats_file.StatsLog` gives the results at each '
+        'point in time. Only works with line profiling '
+        '(`-l`/`--line-by-line`). '
+        f'(Default: {default.conf_dict["incremental"]})',
+    )
+    add_argument(
+        out_opts,
+        '--workers',
+        action='store_true',
+        help='Also profile the child processes (e.g. `multiprocessing` '
+        'workers) started by the profiled code, and merge their results '
+        'into OUTFILE: forked children inherit the profiler, while '
+        'spawned ones profile the `@profile`-decorated functions. '
+        'Only works with line profiling (`-l`/`--line-by-line`). '
+        f'(Default: {default.conf_dict["workers"]})',
+    )
+    add_argument(
+        out_opts,
+        '--live',
+        action='store_true',
+        help='Also keep the current results in the live-counter file '
+        'OUTFILE.live, updated every OUTPUT_INTERVAL seconds (1 s if '
+        'not given), for watching the profile from another process '
+        'with `python -m line_profiler --attach OUTFILE.live`. '
+        'Only works with line profiling (`-l`/`--line-by-line`). '
+        f'(Default: {default.conf_dict["live"]})',
+    )
+    add_argument(
+        out_opts,
+        '--histograms',
+        action='store_true',
+        help='Also keep a histogram of the durations of the hits of each '
+        'line, so that the results show their median, 99th percentile, '
+        'and maximum. '
+        'Only works with line profiling (`-l`/`--line-by-line`). '
+        f'(Default: {default.conf_dict["histograms"]})',
+    )
+    add_argument(
+        out_opts,
+        '--per-thread',
+        action='store_true',
+        help='Also break the timings of each line down by thread (name). '
+        'Only works with line profiling (`-l`/`--line-by-line`). '
+        f'(Default: {default.conf_dict["per_thread"]})',
+    )
+    add_argument(
+        out_opts,
+        '--self-time',
+        action='store_true',
+        help='Also report the self time of each line, i.e. its time minus '
+        'that spent in the profiled code it calls. '
+        'Only works with line profiling (`-l`/`--line-by-line`). '
+        f'(Default: {default.conf_dict["self_time"]})',
+    )
+    add_argument(
+        out_opts,
+        '--memory',
+        action='store_true',
+        help='Also account the memory allocated by each line, i.e. the '
+        'number and total size of the blocks allocated and the bytes '
+        'still retained. '
+        'Only works with line profiling (`-l`/`--line-by-line`). '
+        f'(Default: {default.conf_dict["memory"]})',
+    )
+    if default.conf_dict['counters']:
+        def_counters = repr(default.conf_dict['counters'])
+    else:
+        def_counters = 'N/A'
+    add_argument(
+        out_opts,
+        '--counters',
+        metavar='EVENTS',
+        help='Also count the hardware events EVENTS (comma-separated, '
+        'up to 4 of cycles, instructions, cache-references, '
+        'cache-misses, branches, and branch-misses) in each line '
+        '(Linux only). '
+        'Only works with line profiling (`-l`/`--line-by-line`). '
+        f'(Default: {def_counters})',
+    )
 
 
 def _build_parsers(args=None):
@@ -968,7 +1146,8 @@ def main(args=None, *, exit_on_error=True):
             cleanup = no_op
         else:
             cleanup = functools.partial(
-                _remove,
+                _remove_in_process,
+                os.getpid(),
                 tmpdir,
                 recursive=True,
                 missing_ok=True,
@@ -1143,6 +1322,42 @@ def _write_preimports(prof, options, exclude):
         _remove(temp_mod_path)
 
 
+def _install_import_hook(prof, options, exclude):
+    """
+    Called by :py:func:`main()` to handle lazy imports (in place of
+    :py:func:`_write_preimports`); not to be invoked on its own.
+
+    Returns:
+        The installed
+        :py:class:`~line_profiler.autoprofile.lazy_imports.LazyImportHook`,
+        or :py:const:`None` if there is nothing to profile
+    """
+    from line_profiler.autoprofile.lazy_imports import LazyImportHook
+    from line_profiler.autoprofile.autoprofile import (
+        _extend_line_profiler_for_profiling_imports as upgrade_profiler,
+    )
+
+    filtered_targets, recurse_targets = _gather_preimport_targets(
+        options, exclude
+    )
+    if not (filtered_targets or recurse_targets):
+        return None
+    upgrade_profiler(prof)
+    hook = LazyImportHook(
+        prof.add_imported_function_or_module,
+        filtered_targets,
+        recurse_targets,
+        static=options.static,
+    )
+    diagnostics.log.debug(
+        'Installing import hook for lazily profiling '
+        f'{len(filtered_targets) + len(recurse_targets)} target(s)'
+    )
+    if not options.dryrun:
+        hook.install()
+    return hook
+
+
 def _remove(path, *, recursive=False, missing_ok=False):
     path = Path(path)
     if path.is_dir():
@@ -1154,30 +1369,50 @@ def _remove(path, *, recursive=False, missing_ok=False):
         path.unlink(missing_ok=missing_ok)
 
 
-def _dump_filtered_stats(tmpdir, prof, filename):
+def _remove_in_process(pid, path, *args, **kwargs):
+    """
+    Call :py:func:`_remove()` if in the process ``pid``, so that forked
+    children exiting don't delete the parent's files.
+    """
+    if os.getpid() == pid:
+        _remove(path, *args, **kwargs)
+
+
+def _dump_filtered_stats(
+    tmpdir, prof, filename, incremental=False, extra_stats=None
+):
     import os
-    import pickle
+    from line_profiler.stats_file import append_stats
 
     # Build list of known temp file paths
     tempfile_paths = [
         os.path.join(dirpath, fname)
         for dirpath, _, fnames in os.walk(tmpdir)
         for fname in fnames
+        # Skip the worker logs (see `--workers`)
+        if not fname.endswith('.lprof')
     ]
 
-    if not tempfile_paths or isinstance(prof, ContextualProfile):
+    no_filter = not tempfile_paths or isinstance(prof, ContextualProfile)
+    if no_filter and extra_stats is None:
         # - No tempfiles written -> no function lives in tempfiles
         #   -> no need to filter anything
         # - Not using `line_profiler`
         #   -> doesn't matter if the source lines can't be retrieved
         #   -> no need to filter anything
-        prof.dump_stats(filename)
+        if incremental:
+            prof.dump_stats_delta(filename)
+        else:
+            prof.dump_stats(filename)
         return
 
     # Filter the filenames to remove data from tempfiles, which will
     # have been deleted by the time the results are viewed in a
     # separate process
-    stats = prof.get_stats()
+    stats = prof.get_stats_delta() if incremental else prof.get_stats()
+    if extra_stats is not None:
+        # E.g. the results of the workers (see `--workers`)
+        stats += extra_stats
     timings = stats.timings
     for key in set(timings):
         fname = key[0]
@@ -1186,9 +1421,33 @@ def _dump_filtered_stats(tmpdir, prof, filename):
                 del timings[key]
         except OSError:
             del timings[key]
+    for thread_timings in stats.thread_timings.values():
+        for key in set(thread_timings) - set(timings):
+            del thread_timings[key]
+
+    if incremental:
+        append_stats(
+            filename,
+            timings,
+            stats.unit,
+            overhead=stats.overhead,
+            histograms=stats.histograms,
+            thread_timings=stats.thread_timings,
+            self_times=stats.self_times,
+            counters=stats.counters,
+            memory=stats.memory,
+        )
+    else:
+        stats.to_file(filename)
 
-    with open(filename, 'wb') as f:
-        pickle.dump(stats, f, protocol=pickle.HIGHEST_PROTOCOL)
+
+def _parse_counters(counters):
+    """
+    Split the comma-separated event names of :option:`!--counters`.
+    """
+    if not counters:
+        return None
+    return [event.strip() for event in counters.split(',') if event.strip()]
 
 
 def _format_call_message(func, *args, **kwargs):
@@ -1267,7 +1526,13 @@ def _pre_profile(options, module, exit_on_error):
             execfile(setup_file, ns, ns)
 
     if options.line_by_line:
-        prof = line_profiler.LineProfiler()
+        prof = line_profiler.LineProfiler(
+            histograms=options.histograms,
+            per_thread=options.per_thread,
+            self_time=options.self_time,
+            counters=_parse_counters(options.counters),
+            memory=options.memory,
+        )
         options.builtin = True
     elif Profile.__module__ == 'profile':
         raise RuntimeError(
@@ -1303,21 +1568,75 @@ def _pre_profile(options, module, exit_on_error):
         # them
         options.prof_mod = _normalize_profiling_targets(options.prof_mod)
     if not options.prof_mod:
-        options.preimports = False
-    if options.line_by_line and options.preimports:
+        options.preimports = options.lazy_imports = False
+    options.import_hook = None
+    if options.line_by_line and (options.preimports or options.lazy_imports):
         # We assume most items in `.prof_mod` to be import-able without
         # significant side effects, but the same cannot be said if it
         # contains the script file to be run. E.g. the script may not
         # even have a `if __name__ == '__main__': ...` guard. So don't
-        # eager-import it.
+        # eager-import it (or have it profiled by the import hook).
         exclude = set() if module else {script_file}
-        _write_preimports(prof, options, exclude)
+        if options.lazy_imports:
+            options.import_hook = _install_import_hook(prof, options, exclude)
+        else:
+            _write_preimports(prof, options, exclude)
 
     options.global_profiler = global_profiler
     options.install_profiler = install_profiler
+    for dest, flag in _LINE_BY_LINE_ONLY_OPTIONS:
+        if getattr(options, dest) and not options.line_by_line:
+            msg = (
+                f'`{flag}` only works with line profiling '
+                '(`-l`/`--line-by-line`), ignoring it'
+            )
+            warnings.warn(msg)
+            diagnostics.log.warning(msg)
+            setattr(options, dest, False)
+    if options.incremental and not options.dryrun:
+        # Start a new log (the snapshots will be appended to it)
+        open(options.outfile, 'wb').close()
+    if options.live and not options.dryrun:
+        options.publisher = prof.publish_live(
+            options.outfile + '.live', max(options.output_interval or 1, 1)
+        )
+    else:
+        options.publisher = None
+    options.pid = os.getpid()
+    if options.workers and not options.dryrun:
+        from line_profiler.workers import WorkerCollector
+
+        # Note: the logs live in the tempdir, so they are cleaned up
+        # along with it
+        options.collector = WorkerCollector(
+            prof,
+            os.path.join(options.tmpdir, 'workers'),
+            interval=options.output_interval or None,
+            builtin=options.builtin,
+        ).start()
+    else:
+        options.collector = None
     if options.output_interval and not options.dryrun:
+        if options.incremental:
+            # Note: the worker results are only appended at the end,
+            # since they are cumulative
+            dump_func = functools.partial(
+                _dump_filtered_stats, options.tmpdir, prof, incremental=True
+            )
+        elif options.collector:
+
+            def dump_func(outfile):
+                _dump_filtered_stats(
+                    options.tmpdir,
+                    prof,
+                    outfile,
+                    extra_stats=options.collector.get_worker_stats(),
+                )
+
+        else:
+            dump_func = prof.dump_stats
         options.rt = RepeatedTimer(
-            max(options.output_interval, 1), prof.dump_stats, options.outfile
+            max(options.output_interval, 1), dump_func, options.outfile
         )
     else:
         options.rt = None
@@ -1378,10 +1697,30 @@ def _post_profile(options, prof):
     """
     Cleanup setup after executing a main profile
     """
+    if options.import_hook is not None:
+        options.import_hook.uninstall()
     if options.rt is not None:
         options.rt.stop()
+    if options.publisher is not None:
+        options.publisher.stop()
+    if options.collector is not None:
+        options.collector.stop()
+        if os.getpid() != options.pid:
+            # A forked child resuming the profiled code, whose results
+            # are written to its worker log instead
+            return
     if not options.dryrun:
-        _dump_filtered_stats(options.tmpdir, prof, options.outfile)
+        if options.collector is None:
+            extra_stats = None
+        else:
+            extra_stats = options.collector.get_worker_stats()
+        _dump_filtered_stats(
+            options.tmpdir,
+            prof,
+            options.outfile,
+            options.incremental,
+            extra_stats=extra_stats,
+        )
     short_outfile = short_string_path(options.outfile)
     diagnostics.log.info(
         (
@@ -1402,7 +1741,13 @@ def _post_profile(options, prof):
                 stream=options.original_stdout,
                 config=options.config,
             )
-        _call_with_diagnostics(options, prof.print_stats, **kwargs)
+        if options.collector is None:
+            print_stats = prof.print_stats
+        else:  # Include the worker results
+            print_stats = line_profiler.LineStats.from_files(
+                options.outfile
+            ).print
+        _call_with_diagnostics(options, print_stats, **kwargs)
     else:
         py_exe = _python_command()
         if isinstance(prof, ContextualProfile):
@@ -32,6 +32,10 @@
         PyObject_CallMethodObjArgs(obj, name, NULL)
 #endif
 
+#if PY_VERSION_HEX < 0x030900a1  // 3.9.0a1
+#   define PyObject_Vectorcall _PyObject_Vectorcall
+#endif
+
 #if PY_VERSION_HEX < 0x030900a5  // 3.9.0a5
 #   define PyThreadState_GetInterpreter(tstate) \
         ((tstate)->interp)
@@ -93,4 +97,46 @@
     }
 #endif
 
+// Frames as seen by the trace callbacks
+
+/*
+ * The frame executing on the current thread (as an opaque pointer), for
+ * the `sys.monitoring` callbacks, which (unlike legacy trace callbacks)
+ * aren't passed the frame; generator and coroutine frames keep their
+ * address across suspensions.
+ */
+static inline void *lp_current_frame(void)
+{
+#if PY_VERSION_HEX >= 0x030d00a1  // 3.13.0a1
+    return (void *)PyThreadState_Get()->current_frame;
+#elif PY_VERSION_HEX >= 0x030c00a1  // 3.12.0a1
+    return (void *)PyThreadState_Get()->cframe->current_frame;
+#else
+    return NULL;  // `sys.monitoring` unavailable
+#endif
+}
+
+/*
+ * Whether `frame` belongs to a generator, coroutine, or asynchronous
+ * generator, i.e. whether it can be suspended and resumed.
+ */
+static inline int lp_frame_is_resumable(PyFrameObject *frame)
+{
+    PyCodeObject *code = PyFrame_GetCode(frame);
+    int flags = code->co_flags;
+    Py_DECREF(code);
+    return (flags & (CO_GENERATOR | CO_COROUTINE | CO_ASYNC_GENERATOR
+                     | CO_ITERABLE_COROUTINE)) != 0;
+}
+
+// Backport of the code-object scratch-space ("extra") API (PEP 523),
+// which was promoted to the unstable C API in 3.12
+
+#if PY_VERSION_HEX < 0x030c00b1  // 3.12.0b1
+#   define PyUnstable_Eval_RequestCodeExtraIndex \
+        _PyEval_RequestCodeExtraIndex
+#   define PyUnstable_Code_GetExtra _PyCode_GetExtra
+#   define PyUnstable_Code_SetExtra _PyCode_SetExtra
+#endif
+
 #endif // LINE_PROFILER_PYTHON_WRAPPER_H
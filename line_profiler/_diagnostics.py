@@ -102,5 +102,7 @@ USE_LEGACY_TRACE = _MUST_USE_LEGACY_TRACE or _boolean_environ(
     falsy={'new', 'sys.monitoring', 'sysmon'},
     default=_MUST_USE_LEGACY_TRACE,
 )
+# Timer backend (see `line_profiler._line_profiler.set_timer()`)
+TIMER = os.environ.get('LINE_PROFILER_TIMER', '').strip().casefold()
 
 log = _logger.Logger('line_profiler', backend='auto')
@@ -1,22 +1,88 @@
 from __future__ import annotations
 
-from typing import Any, Mapping
+from typing import Any, Mapping, Sequence
+
+COUNTER_EVENTS: tuple[str, ...]
 
 class LineStats:
     timings: Mapping[tuple[str, int, str], list[tuple[int, int, int]]]
     unit: float
+    overhead: float
+    histograms: Mapping[
+        tuple[str, int, str], Mapping[int, tuple[int, Mapping[int, int]]]
+    ]
+    thread_timings: Mapping[
+        str, Mapping[tuple[str, int, str], list[tuple[int, int, int]]]
+    ]
+    self_times: Mapping[tuple[str, int, str], Mapping[int, int]]
+    counters: Mapping[str, Mapping[tuple[str, int, str], Mapping[int, int]]]
+    memory: Mapping[
+        tuple[str, int, str], Mapping[int, tuple[int, int, int]]
+    ]
 
     def __init__(
         self,
         timings: Mapping[tuple[str, int, str], list[tuple[int, int, int]]],
         unit: float,
+        overhead: float = 0.0,
+        histograms: Mapping[
+            tuple[str, int, str], Mapping[int, tuple[int, Mapping[int, int]]]
+        ]
+        | None = None,
+        thread_timings: Mapping[
+            str, Mapping[tuple[str, int, str], list[tuple[int, int, int]]]
+        ]
+        | None = None,
+        self_times: Mapping[tuple[str, int, str], Mapping[int, int]]
+        | None = None,
+        counters: Mapping[
+            str, Mapping[tuple[str, int, str], Mapping[int, int]]
+        ]
+        | None = None,
+        memory: Mapping[
+            tuple[str, int, str], Mapping[int, tuple[int, int, int]]
+        ]
+        | None = None,
     ) -> None: ...
 
 class LineProfiler:
+    timer_unit: float
+    overhead: float
+    histograms: bool
+    per_thread: bool
+    self_time: bool
+    counters: tuple[str, ...]
+    memory: bool
+
+    def __init__(
+        self,
+        *functions: Any,
+        wrap_trace: bool | None = None,
+        set_frame_local_trace: bool | None = None,
+        sample_every: int | None = None,
+        sample_interval: float | None = None,
+        histograms: bool = False,
+        per_thread: bool = False,
+        self_time: bool = False,
+        counters: Sequence[str] | None = None,
+        memory: bool = False,
+    ) -> None: ...
     def enable_by_count(self) -> None: ...
     def disable_by_count(self) -> None: ...
     def add_function(self, func: Any) -> None: ...
     def get_stats(self) -> LineStats: ...
+    def get_stats_delta(self) -> LineStats: ...
     def dump_stats(self, filename: str) -> None: ...
 
+class PassThrough:
+    func: Any
+    target: Any
+
+    def __init__(self, func: Any) -> None: ...
+    def __call__(self, *args: Any, **kwargs: Any) -> Any: ...
+    def __get__(self, instance: Any, owner: Any = None) -> Any: ...
+
 def label(code: Any) -> Any: ...
+def get_timer() -> str: ...
+def set_timer(timer: str) -> str: ...
+def calibrate_overhead(force: bool = False) -> float: ...
@@ -14,45 +14,49 @@ Ignore:
         ./line_profiler/timers.c
 """
 from collections.abc import Callable
+from dis import findlinestarts
 from functools import wraps
-from sys import byteorder
 import sys
 cimport cython
-from cython.operator cimport dereference as deref
+from cython.operator cimport dereference as deref, preincrement as inc
 from cpython.object cimport PyObject_Hash
 from cpython.bytes cimport PyBytes_AS_STRING, PyBytes_GET_SIZE
+from cpython.exc cimport PyErr_Clear
+from cpython.ref cimport Py_INCREF
+from cpython.tuple cimport PyTuple_New, PyTuple_SET_ITEM
 from cpython.version cimport PY_VERSION_HEX
+from libc cimport errno as cerrno
 from libc.stdint cimport int64_t
+from libc.stdlib cimport malloc, free
 
 from libcpp.unordered_map cimport unordered_map
+from libcpp.utility cimport pair
+from libcpp.vector cimport vector
 import functools
 import threading
-import opcode
 import os
 import types
 from warnings import warn
 from weakref import WeakSet
 
 from line_profiler._diagnostics import (
-    WRAP_TRACE, SET_FRAME_LOCAL_TRACE, USE_LEGACY_TRACE
+    WRAP_TRACE, SET_FRAME_LOCAL_TRACE, USE_LEGACY_TRACE, TIMER
 )
 
 from ._map_helpers cimport (
-    last_erase_if_present, line_ensure_entry, LastTime, LastTimeMap,
-    LineTime, LineTimeMap
+    block_get_entry, shard_clear_last, lp_contains, lp_mutex, lp_mutex_lock,
+    lp_mutex_unlock, lp_mutex_reinit, LP_FREE_THREADING, AtomicCounter,
+    BlockInfo, BlockDispatch, BlockRegistry, CodeInfo,
+    InstanceSnapshots, LastTime, LineTime, LineTimeBlock, LineTimeBlockMap,
+    LineMemMap, LP_PERF_MAX_COUNTERS, lp_mem_line, lp_mem_ref,
+    lp_perf_group, ParkedRecord, PointerTable, ThreadShard, ThreadShardMap
 )
 
 
-NOP_VALUE: int = opcode.opmap['NOP']
-
-# The Op code should be 2 bytes as stated in
-# https://docs.python.org/3/library/dis.html
-# if sys.version_info[0:2] >= (3, 11):
-NOP_BYTES_LEN: int = 2
-NOP_BYTES: bytes = NOP_VALUE.to_bytes(NOP_BYTES_LEN, byteorder=byteorder)
-
 # This should be true for Python >=3.11a1
 HAS_CO_QUALNAME: bool = hasattr(types.CodeType, 'co_qualname')
+# This should be true for Python >=3.10a1
+HAS_CO_LINES: bool = hasattr(types.CodeType, 'co_lines')
 
 # Can't line-profile Cython in 3.12 since the old C API was upended
 # without an appropriate replacement (which only came in 3.13);
@@ -82,10 +86,26 @@ cdef extern from "Python_wrapper.h":
     ctypedef long long PY_LONG_LONG
     ctypedef int (*Py_tracefunc)(
         object self, PyFrameObject *py_frame, int what, PyObject *arg)
+    ctypedef void (*freefunc)(void *)
 
     cdef PyCodeObject* PyFrame_GetCode(PyFrameObject* frame)
     cdef int PyCode_Addr2Line(PyCodeObject *co, int byte_offset)
 
+    # Builtins taking their arguments as C arrays (`METH_FASTCALL`), so
+    # that they are called via vectorcall without building tuples
+    ctypedef PyObject *(*PyCFunction)(PyObject *, PyObject *)
+    ctypedef struct PyMethodDef:
+        const char *ml_name
+        PyCFunction ml_meth
+        int ml_flags
+        const char *ml_doc
+    cdef int METH_FASTCALL
+    cdef object PyCFunction_NewEx(
+        PyMethodDef *ml, object self, PyObject *module)
+    cdef PyObject* PyObject_Vectorcall(
+        PyObject *callable, PyObject **args, size_t nargsf,
+        PyObject *kwnames) except NULL
+
     cdef void PyEval_SetTrace(Py_tracefunc func, object arg)
     cdef PyObject* PyObject_Call(
         PyObject *callable, PyObject *args, PyObject *kwargs) except *
@@ -103,8 +123,18 @@ cdef extern from "Python_wrapper.h":
     cdef int PyFrame_GetLineNumber(PyFrameObject *frame)
     cdef void Py_XDECREF(PyObject *o)
 
+    cdef void *lp_current_frame()
+    cdef int lp_frame_is_resumable(PyFrameObject *frame)
+
     cdef unsigned long PyThread_get_thread_ident()
 
+    # Per-code-object scratch space (PEP 523)
+    cdef Py_ssize_t PyUnstable_Eval_RequestCodeExtraIndex(freefunc free_extra)
+    cdef int PyUnstable_Code_GetExtra(
+        PyObject *code, Py_ssize_t index, void **extra)
+    cdef int PyUnstable_Code_SetExtra(
+        PyObject *code, Py_ssize_t index, void *extra)
+
 ctypedef PyCodeObject *PyCodeObjectPtr
 #ctypedef unordered_map[int64, LastTime] LastTimeMap
 #ctypedef unordered_map[int64, LineTime] LineTimeMap
@@ -126,9 +156,54 @@ cdef extern from "c_trace_callbacks.h":  # Legacy tracing
     cdef void set_local_trace(PyObject *manager, PyFrameObject *py_frame)
     cdef Py_uintptr_t monitoring_restart_version()
 
+cdef extern from "thread_locals.h":
+    cdef Py_ssize_t lp_thread_index()
+    cdef void lp_thread_reap(vector[Py_ssize_t] *out) except +
+    cdef void lp_thread_recycle(Py_ssize_t index)
+    cdef PyObject *lp_get_thread_manager()
+    cdef void lp_set_thread_manager(PyObject *manager)
+
+cdef extern from "sampling_clock.h":
+    cdef long long lp_clock_now()
+    cdef int lp_clock_acquire(long long period_us)
+    cdef void lp_clock_release(long long period_us)
+    cdef int lp_clock_after_fork()
+
+cdef extern from "histogram.h":
+    cdef int LP_HIST_BUCKETS
+    cdef int lp_hist_bucket(long long delta) noexcept
+
+cdef extern from "perf_counters.h":
+    cdef int LP_PERF_NUM_EVENTS
+    cdef int lp_perf_event_index(const char *name)
+    cdef const char *lp_perf_event_name(int index)
+    cdef lp_perf_group *lp_perf_open(const int *events, int n)
+    cdef void lp_perf_close(lp_perf_group *group) noexcept
+    cdef void lp_perf_read(
+        lp_perf_group *group, PY_LONG_LONG *values) noexcept nogil
+
+cdef extern from "alloc_hook.h":
+    cdef lp_mem_ref lp_mem_get_current() noexcept nogil
+    cdef void lp_mem_set_current(lp_mem_ref ref) noexcept nogil
+    cdef lp_mem_ref lp_mem_ref_to(lp_mem_line *line) noexcept nogil
+    cdef int lp_mem_hook_acquire() noexcept
+    cdef void lp_mem_hook_release() noexcept
+    cdef LineMemMap *lp_mem_table_new() noexcept
+    cdef void lp_mem_table_retire(LineMemMap *table) noexcept
+    cdef lp_mem_line *lp_mem_table_line(
+        LineMemMap *table, int64 line_hash) noexcept nogil
+    cdef int lp_mem_table_copy(LineMemMap *table, LineMemMap *out) noexcept
+    cdef void lp_mem_after_fork() noexcept
+
+# Names of the hardware events `LineProfiler.counters` can count
+COUNTER_EVENTS = tuple([lp_perf_event_name(i).decode('ascii')
+                        for i in range(LP_PERF_NUM_EVENTS)])
+
 cdef extern from "timers.c":
     PY_LONG_LONG hpTimer()
     double hpTimerUnit()
+    int hpTimerUseTSC(int enable)
+    int hpTimerIsTSC()
 
 #cdef struct LineTime:
 #    int64 code
@@ -140,6 +215,30 @@ cdef extern from "timers.c":
 #    int f_lineno
 #    PY_LONG_LONG time
 
+# Index of the scratch-space slot on code objects where we cache a
+# `CodeInfo` (see `get_code_info()`); the interpreter `free()`s it when
+# the code object is deallocated.
+# Note: this is -1 if the slots are exhausted (each interpreter only
+# hands out a limited number of them), in which case the cached values
+# are just recomputed every time.
+cdef Py_ssize_t _CODE_EXTRA_INDEX = (
+    PyUnstable_Eval_RequestCodeExtraIndex(free))
+# Serializes the filling of said slots, so that threads racing to cache
+# a `CodeInfo` on the same code object can't free each other's
+cdef lp_mutex _CODE_INFO_LOCK
+
+# Which profilers registered which code blocks, so that the trace
+# callbacks only visit the profilers interested in an event; the writes
+# are serialized by `_DISPATCH_LOCK`
+cdef BlockDispatch _BLOCK_DISPATCH
+cdef lp_mutex _DISPATCH_LOCK
+
+# Serializes the (Python-level) bookkeeping of `LineProfiler` instances
+# when adding functions, and the reads thereof when gathering stats;
+# with the GIL gone, the `dict`s and `list`s involved may otherwise be
+# mutated mid-iteration
+_REGISTRATION_LOCK = threading.RLock()
+
 
 cdef inline int64 compute_line_hash(uint64 block_hash, uint64 linenum) noexcept:
     """
@@ -153,22 +252,243 @@ cdef inline int64 compute_line_hash(uint64 block_hash, uint64 linenum) noexcept:
     return block_hash ^ linenum
 
 
-cdef inline object multibyte_rstrip(bytes bytecode):
+cdef void ensure_block_lines(
+        LineTimeBlock *block, int64 block_hash,
+        int first_lineno, int last_lineno, bint histograms=False,
+        int ncounters=0, bint memory=False):
+    """
+    Make sure that ``block`` has slots for the lines ``first_lineno``
+    to ``last_lineno`` (inclusive), zero-initializing the new ones and
+    keeping the existing ones; with ``histograms``, make sure that
+    ``block.hist`` has the histograms of the lines too, with
+    ``ncounters``, that ``block.counts`` has the counts of as many
+    events for each line, and with ``memory``, that ``block.mem`` has a
+    (not yet looked-up) slot for each line.
+    """
+    cdef vector[LineTime] lines
+    cdef vector[unsigned long long] hist
+    cdef vector[PY_LONG_LONG] counts
+    cdef vector[lp_mem_line*] mem
+    cdef size_t nold = block.lines.size()
+    cdef size_t nbuckets = LP_HIST_BUCKETS
+    cdef bint has_hist = not block.hist.empty()
+    cdef bint has_counts = not block.counts.empty()
+    cdef bint has_mem = not block.mem.empty()
+    cdef size_t nold_counters = block.counts.size() // nold if nold else 0
+    cdef int old_first = 0
+    cdef int old_last = -1
+    cdef int lineno
+    cdef size_t i, j
+
+    if first_lineno > last_lineno:
+        return
+    if nold:
+        old_first = block.first_lineno
+        old_last = old_first + <int>nold - 1
+        if (old_first <= first_lineno and last_lineno <= old_last
+                and (has_hist or not histograms)
+                and (has_counts or not ncounters)
+                and (has_mem or not memory)):
+            return
+        first_lineno = min(first_lineno, old_first)
+        last_lineno = max(last_lineno, old_last)
+    lines.reserve(last_lineno - first_lineno + 1)
+    for lineno in range(first_lineno, last_lineno + 1):
+        if nold and old_first <= lineno <= old_last:
+            lines.push_back(block.lines[lineno - old_first])
+        else:
+            lines.push_back(LineTime(
+                compute_line_hash(block_hash, lineno), lineno, 0, 0, 0, 0))
+    if histograms or has_hist:
+        hist.resize(lines.size() * nbuckets)
+        if has_hist:
+            for i in range(nold):
+                lineno = old_first + <int>i
+                for j in range(nbuckets):
+                    hist[(lineno - first_lineno) * nbuckets + j] = (
+                        block.hist[i * nbuckets + j])
+        block.hist.swap(hist)
+    if has_counts:
+        ncounters = nold_counters
+    if ncounters:
+        counts.resize(lines.size() * ncounters)
+        if has_counts:
+            for i in range(nold):
+                lineno = old_first + <int>i
+                for j in range(<size_t>ncounters):
+                    counts[(lineno - first_lineno) * ncounters + j] = (
+                        block.counts[i * ncounters + j])
+        block.counts.swap(counts)
+    if memory or has_mem:
+        mem.resize(lines.size(), NULL)
+        if has_mem:
+            for i in range(nold):
+                mem[old_first + <int>i - first_lineno] = block.mem[i]
+        block.mem.swap(mem)
+    block.first_lineno = first_lineno
+    block.lines.swap(lines)
+
+
+cdef int get_code_lines(object code, vector[int] *linenos) except -1:
+    """
+    Fill ``linenos`` with the distinct line numbers of the instructions
+    in ``code``, in ascending order (with -1 standing for instructions
+    without a line number), by walking the line table once instead of
+    looking up every instruction offset.
+    """
+    cdef vector[int] raw
+    cdef vector[char] seen
+    cdef bint has_unknown = False
+    cdef int lineno, lo = 0, hi = -1
+    cdef size_t i
+
+    if HAS_CO_LINES:
+        for _, _, line in code.co_lines():
+            if line is None:
+                has_unknown = True
+            else:
+                raw.push_back(line)
+    else:  # Python < 3.10
+        for _, line in findlinestarts(code):
+            raw.push_back(line)
+    for i in range(raw.size()):
+        lineno = raw[i]
+        if lineno < 0:
+            has_unknown = True
+        elif hi < lo:
+            lo = hi = lineno
+        else:
+            lo = min(lo, lineno)
+            hi = max(hi, lineno)
+    linenos.clear()
+    if has_unknown:
+        linenos.push_back(-1)
+    if hi < lo:
+        return 0
+    # Dedupe with a bitmap over the spanned lines
+    seen.resize(hi - lo + 1, 0)
+    for i in range(raw.size()):
+        if raw[i] >= 0:
+            seen[raw[i] - lo] = 1
+    for i in range(seen.size()):
+        if seen[i]:
+            linenos.push_back(lo + <int>i)
+    return 0
+
+
+cdef int64 compute_block_hash(object code):
+    """
+    Compute the hash identifying the code block of ``code``: the address
+    of ``code`` for normal Python code, and the hash of ``code`` for
+    Cython functions (which have empty/zero bytecodes, and whose stored
+    copies differ from the code objects seen by the trace callbacks).
+
+    Note:
+        Since the profilers keep the code objects they registered alive,
+        the address of one cannot be reused for another code object
+        while its block is registered; so code objects with identical
+        bytecodes (e.g. from the same source ``exec()``-ed twice) get
+        distinct blocks without having to be altered.
     """
+    cdef object py_bytes_obj = code.co_code
+    cdef char* data = PyBytes_AS_STRING(py_bytes_obj)
+    cdef Py_ssize_t size = PyBytes_GET_SIZE(py_bytes_obj)
+    cdef Py_ssize_t i
+
+    # Loop over every byte to check if any are not NULL
+    # if there are any non-NULL, that indicates we're profiling Python code
+    for i in range(size):
+        if data[i]:
+            return <int64><Py_uintptr_t><PyObject *>code
+    # fallback for Cython functions
+    return hash(code)
+
+
+cdef CodeInfo *get_code_info(object code, bint create=True):
+    """
+    Get the :c:type:`CodeInfo` cached in the scratch space of ``code``,
+    creating it upon first access if ``create`` is true.
+
     Returns:
-        result (tuple[bytes, int])
-        - First item is the bare unpadded bytecode
-        - Second item is the number of :py:data:`NOP_BYTES`
-          ``bytecode`` has been padded with
+        Pointer to the :c:type:`CodeInfo` owned by ``code``, or ``NULL``
+        if it cannot be cached (or isn't and ``create`` is false).
+
+    Note:
+        Since the trace callbacks see (and have to identify) the code
+        object on every event, this saves us from re-scanning and
+        re-hashing the bytecode each time.
+    """
+    cdef void *extra = NULL
+    cdef CodeInfo *info
+    cdef int64 block_hash
+
+    if _CODE_EXTRA_INDEX < 0:
+        return NULL
+    if PyUnstable_Code_GetExtra(
+            <PyObject *>code, _CODE_EXTRA_INDEX, &extra) < 0:
+        PyErr_Clear()
+        return NULL
+    if extra != NULL or not create:
+        return <CodeInfo *>extra
+    # Note: this may call into Python, so don't hold the lock for it
+    block_hash = compute_block_hash(code)
+    info = <CodeInfo *>malloc(sizeof(CodeInfo))
+    if info == NULL:
+        return NULL
+    info.block_hash = block_hash
+    lp_mutex_lock(&_CODE_INFO_LOCK)
+    if PyUnstable_Code_GetExtra(
+            <PyObject *>code, _CODE_EXTRA_INDEX, &extra) < 0:
+        free(info)
+        info = NULL
+    elif extra != NULL:  # Another thread got there first
+        free(info)
+        info = <CodeInfo *>extra
+    elif PyUnstable_Code_SetExtra(
+            <PyObject *>code, _CODE_EXTRA_INDEX, info) < 0:
+        free(info)
+        info = NULL
+    lp_mutex_unlock(&_CODE_INFO_LOCK)
+    if info == NULL:
+        PyErr_Clear()
+    return info
+
+
+cdef inline int64 get_block_hash(object code, bint create=True):
     """
-    npad: int = 0
-    nop_len: int = -NOP_BYTES_LEN
-    nop_bytes: bytes = NOP_BYTES
-    unpadded: bytes = bytecode
-    while unpadded.endswith(nop_bytes):
-        unpadded = unpadded[:nop_len]
-        npad += 1
-    return (unpadded, npad)
+    Cached version of :c:func:`compute_block_hash`.
+    """
+    cdef CodeInfo *info = get_code_info(code, create)
+    if info == NULL:
+        return compute_block_hash(code)
+    return info.block_hash
+
+
+cdef dict get_hist_counts(
+        LineTimeBlock *block, LineTime *entry,
+        LineTimeBlock *base=NULL, LineTime *base_entry=NULL):
+    """
+    Get the non-zero counts (by bucket) in the histogram of the line
+    ``entry`` of ``block``, minus those of the line ``base_entry`` of
+    ``base`` (if any).
+    """
+    cdef size_t nbuckets = LP_HIST_BUCKETS
+    cdef size_t start = (entry - &(block.lines[0])) * nbuckets
+    cdef size_t base_start = 0
+    cdef bint has_base = (base != NULL and base_entry != NULL
+                          and not base.hist.empty())
+    cdef unsigned long long count
+    cdef dict counts = {}
+    cdef size_t j
+    if has_base:
+        base_start = (base_entry - &(base.lines[0])) * nbuckets
+    for j in range(nbuckets):
+        count = block.hist[start + j]
+        if has_base:
+            count -= base.hist[base_start + j]
+        if count:
+            counts[j] = count
+    return counts
 
 
 cdef inline object get_current_callback(int tool_id, int event_id):
@@ -267,51 +587,24 @@ def disable_line_events(trace_func: Callable) -> Callable:
     return wrapper
 
 
-cpdef _code_replace(func, co_code):
-    """
-    Implements :py:mod:`~code.replace` for Python < 3.8
-    """
-    try:
-        code = func.__code__
-    except AttributeError:
-        code = func.__func__.__code__
-    if hasattr(code, 'replace'):
-        # python 3.8+
-        code = _copy_local_sysmon_events(code, code.replace(co_code=co_code))
-    else:
-        # python <3.8
-        co = code
-        code = type(code)(co.co_argcount, co.co_kwonlyargcount,
-                        co.co_nlocals, co.co_stacksize, co.co_flags,
-                        co_code, co.co_consts, co.co_names,
-                        co.co_varnames, co.co_filename, co.co_name,
-                        co.co_firstlineno, co.co_lnotab, co.co_freevars,
-                        co.co_cellvars)
-    return code
-
-
-cpdef _copy_local_sysmon_events(old_code, new_code):
-    """
-    Copy the local events from ``old_code`` over to ``new_code`` where
-    appropriate.
-
-    Returns:
-        code: ``new_code``
-    """
-    try:
-        mon = sys.monitoring
-    except AttributeError:  # Python < 3.12
-        return new_code
-    # Tool ids are integers in the range 0 to 5 inclusive.
-    # https://docs.python.org/3/library/sys.monitoring.html#tool-identifiers
-    NUM_TOOLS = 6  
-    for tool_id in range(NUM_TOOLS):
-        try:
-            events = mon.get_local_events(tool_id, old_code)
-            mon.set_local_events(tool_id, new_code, events)
-        except ValueError:  # Tool ID not in use
-            pass
-    return new_code
+cdef object _MON_DISABLE = None
+cdef int _MON_LINE = 0
+cdef int _MON_PY_RETURN = 0
+cdef int _MON_PY_YIELD = 0
+cdef int _MON_PY_RESUME = 0
+cdef int _MON_RAISE = 0
+cdef int _MON_RERAISE = 0
+# Events for which `sys.monitoring.DISABLE` can't be returned
+cdef int _UNDISABLEABLE_EVENTS = 0
+if _CAN_USE_SYS_MONITORING:
+    _MON_DISABLE = sys.monitoring.DISABLE
+    _MON_LINE = sys.monitoring.events.LINE
+    _MON_PY_RETURN = sys.monitoring.events.PY_RETURN
+    _MON_PY_YIELD = sys.monitoring.events.PY_YIELD
+    _MON_PY_RESUME = sys.monitoring.events.PY_RESUME
+    _MON_RAISE = sys.monitoring.events.RAISE
+    _MON_RERAISE = sys.monitoring.events.RERAISE
+    _UNDISABLEABLE_EVENTS = _MON_RAISE | _MON_RERAISE
 
 
 cpdef int _patch_events(int events, int before, int after) noexcept:
@@ -332,6 +625,166 @@ cpdef int _patch_events(int events, int before, int after) noexcept:
     return ((events | minus) - minus) | plus
 
 
+# Number of live `LineProfiler` instances, which pin the timer (since
+# their timings are in its units)
+cdef AtomicCounter _NUM_PROFILERS
+# type: weakref.WeakSet[LineProfiler]
+# The instances themselves, whose locks are reset in forked children
+_LIVE_PROFILERS = WeakSet()
+
+
+def get_timer():
+    """
+    Returns:
+        timer (str)
+            Name of the timer used by the profilers (see
+            :py:func:`~.set_timer`).
+    """
+    return 'tsc' if hpTimerIsTSC() else 'system'
+
+
+def set_timer(timer):
+    """
+    Select the timer used by the profilers.  The initial selection can
+    also be made with the environment variable
+    :envvar:`LINE_PROFILER_TIMER`.
+
+    Arguments:
+        timer (str)
+            ``'system'`` (default)
+                The system's monotonic clock
+                (:c:func:`!clock_gettime` or
+                :c:func:`!QueryPerformanceCounter`).
+            ``'tsc'``
+                The CPU's time-stamp counter (``rdtsc`` on x86,
+                ``cntvct_el0`` on ARM64), which is much cheaper to read;
+                its rate is calibrated against the system clock.
+
+    Returns:
+        old_timer (str)
+            Name of the previously-selected timer.
+
+    Raises:
+        ValueError
+            If ``timer`` is not one of the above.
+        RuntimeError
+            If :py:class:`LineProfiler` instances exist (since their
+            timings are in units of the current timer), or if the TSC is
+            unavailable or deemed unreliable (e.g. not invariant, or
+            failing to calibrate consistently).
+    """
+    old_timer = get_timer()
+    if timer not in ('system', 'tsc'):
+        raise ValueError(
+            f'timer = {timer!r}: expected either \'system\' or \'tsc\'')
+    if timer == old_timer:
+        return old_timer
+    if _NUM_PROFILERS.get():
+        raise RuntimeError('cannot switch timers while `LineProfiler` '
+                           f'instances exist ({_NUM_PROFILERS.get()})')
+    if hpTimerUseTSC(timer == 'tsc') < 0:
+        raise RuntimeError('the time-stamp counter is unavailable or '
+                           'unreliable on this machine')
+    return old_timer
+
+
+if TIMER and TIMER not in ('default', 'system'):
+    try:
+        set_timer(TIMER)
+    except (ValueError, RuntimeError) as e:
+        warn(f'${{LINE_PROFILER_TIMER}} = {TIMER!r}: {e}; '
+             'falling back to the system timer')
+
+
+# Per-hit overhead (in seconds) included in the line times, by
+# `(core, timer)`; see `calibrate_overhead()`
+_OVERHEADS = {}
+_CALIBRATION_LOCK = threading.RLock()
+_calibrating = False
+_CALIBRATION_NLINES = 10
+_CALIBRATION_SOURCE = (
+    'def calibrate(n):\n    x = 0\n    for _ in range(n):\n'
+    + ''.join(f'        x = {i}\n' for i in range(_CALIBRATION_NLINES)))
+
+
+def calibrate_overhead(force=False):
+    """
+    Estimate the overhead of the profiler which ends up in the times of
+    the profiled lines.
+
+    The trace callbacks read the timer as late and as early as possible,
+    but each hit of a line is still charged with part of the work of
+    delivering the line events (e.g. the dispatching of the event by
+    the interpreter and the bookkeeping before and after the timer
+    reads), which dominates the times of very short lines.  This is
+    measured by profiling a loop of trivial lines and comparing the
+    times reported for them with the time the loop takes without
+    profiling.
+
+    Arguments:
+        force (bool)
+            Whether to measure again even if a value for the current
+            core and timer (see :py:func:`~.get_timer`) is known
+
+    Returns:
+        overhead (float)
+            Overhead in seconds per hit; this is measured at most once
+            per core and timer, when first needed by the stats of a
+            :py:class:`LineProfiler` (see :py:attr:`LineStats.overhead`),
+            e.g. to write them to a file or subtract it from the shown
+            times.
+
+    Note:
+        The estimate is for a single active profiler without sampling;
+        each additional active profiler profiling the same code adds to
+        the real overhead.
+    """
+    global _calibrating
+    key = ('legacy' if USE_LEGACY_TRACE else 'sysmon'), get_timer()
+    with _CALIBRATION_LOCK:
+        if not force and key in _OVERHEADS:
+            return _OVERHEADS[key]
+        if _calibrating:  # The profiler used to calibrate
+            return 0.0
+        _calibrating = True
+        try:
+            overhead = _OVERHEADS[key] = _measure_overhead()
+        finally:
+            _calibrating = False
+    return overhead
+
+
+def _measure_overhead(int nrepeats=5, long niter=500):
+    cdef PY_LONG_LONG start, plain = -1, reported = -1, total
+    namespace = {}
+    exec(compile(_CALIBRATION_SOURCE, '<line_profiler calibration>', 'exec'),
+         namespace)
+    func = namespace['calibrate']
+    prof = LineProfiler(func)
+    nhits = 0
+    for _ in range(nrepeats):
+        start = hpTimer()
+        func(niter)
+        total = hpTimer() - start
+        if plain < 0 or total < plain:
+            plain = total
+        prof.enable_by_count()
+        try:
+            func(niter)
+        finally:
+            prof.disable_by_count()
+        nhits = total = 0
+        for entries in prof.get_stats_delta().timings.values():
+            for _, n, t in entries:
+                nhits += n
+                total += t
+        if reported < 0 or total < reported:
+            reported = total
+    if not nhits:
+        return 0.0
+    return max(reported - plain, 0) * hpTimerUnit() / nhits
+
+
 # Note: this is a regular Python class to allow easy pickling.
 class LineStats(object):
     """
@@ -349,11 +802,149 @@ list[tuple[int, int, int]]]):
 
         unit (float):
             The number of seconds per timer unit.
+
+        overhead (float):
+            The estimated overhead of the profiler (in seconds) included
+            in the time of each hit (see :py:func:`~.calibrate_overhead`),
+            or 0 if unknown; for the stats of a :py:class:`LineProfiler`
+            which hasn't been given one, it is only measured upon first
+            access.
+
+        histograms (dict[tuple[str, int, str], \
+dict[int, tuple[int, dict[int, int]]]]):
+            Mapping from the keys of :py:attr:`.timings` to mappings
+            from line numbers to ``(max_time, counts)`` tuples, where
+            ``max_time`` is the longest hit of the line and ``counts``
+            maps the buckets of the logarithmic histogram of its hits
+            (see :py:mod:`line_profiler.histograms`) to their (non-zero)
+            counts; only filled in by profilers with
+            :py:attr:`LineProfiler.histograms`.
+
+        thread_timings (dict[str, dict[tuple[str, int, str], \
+list[tuple[int, int, int]]]]):
+            Mapping from thread names to the part of :py:attr:`.timings`
+            spent on the threads (the timings of threads of the same
+            name are summed); only filled in by profilers with
+            :py:attr:`LineProfiler.per_thread`.
+
+        self_times (dict[tuple[str, int, str], dict[int, int]]):
+            Mapping from the keys of :py:attr:`.timings` to mappings
+            from line numbers to the self (exclusive) times of the
+            lines, i.e. the part of their ``total_time`` not spent in
+            the profiled code they called; only filled in by profilers
+            with :py:attr:`LineProfiler.self_time`.
+
+        counters (dict[str, dict[tuple[str, int, str], dict[int, int]]]):
+            Mapping from the names of hardware events (e.g.
+            ``'cycles'``) to mappings from the keys of
+            :py:attr:`.timings` to mappings from line numbers to the
+            (inclusive) counts of the events in the lines (leaving out
+            those with none); only filled in by profilers with
+            :py:attr:`LineProfiler.counters`.
+
+        memory (dict[tuple[str, int, str], \
+dict[int, tuple[int, int, int]]]):
+            Mapping from the keys of :py:attr:`.timings` to mappings
+            from line numbers to ``(nallocs, allocated, retained)``
+            tuples: the number of memory blocks allocated while the
+            line was executing, their total size in bytes, and how many
+            of those bytes haven't been freed since; only filled in by
+            profilers with :py:attr:`LineProfiler.memory`.
     """
-    def __init__(self, timings, unit):
+    # Note: defaults for objects pickled by older versions (treat as
+    # read-only); `._overhead` is `None` until measured (see
+    # `.overhead`)
+    _overhead = 0.0
+    histograms = {}
+    thread_timings = {}
+    self_times = {}
+    counters = {}
+    memory = {}
+
+    def __init__(self, timings, unit, overhead=0.0, histograms=None,
+                 thread_timings=None, self_times=None, counters=None,
+                 memory=None):
         self.timings = timings
         self.unit = unit
+        self.overhead = overhead
+        self.histograms = {} if histograms is None else histograms
+        self.thread_timings = (
+            {} if thread_timings is None else thread_timings)
+        self.self_times = {} if self_times is None else self_times
+        self.counters = {} if counters is None else counters
+        self.memory = {} if memory is None else memory
+
+    @property
+    def overhead(self):
+        overhead = self._overhead
+        if overhead is None:
+            overhead = self._overhead = calibrate_overhead()
+        return overhead
+
+    @overhead.setter
+    def overhead(self, overhead):
+        self._overhead = overhead
+
+    def __getstate__(self):
+        # Note: the overhead is that of the profiling process
+        state = self.__dict__.copy()
+        if state.get('_overhead', 0.0) is None:
+            state['_overhead'] = self.overhead
+        return state
+
+    def __setstate__(self, state):
+        state = dict(state)
+        if 'overhead' in state:
+            state['_overhead'] = state.pop('overhead')
+        self.__dict__.update(state)
+
+
+cdef class PassThrough:
+    """
+    PassThrough(func)
+
+    C-level wrapper which only calls :py:attr:`.target` (initially
+    ``func``), so that the wrapped callable can be swapped (e.g. for a
+    profiling wrapper and back) after the wrapper has been handed out;
+    see :py:class:`~line_profiler.explicit_profiler.GlobalProfiler`.
+
+    The wrapper binds like a function when accessed on an instance,
+    pickles by reference (like ``func`` does), and has a
+    :py:attr:`~object.__dict__` for :py:func:`functools.update_wrapper`.
+
+    Example:
+        >>> import functools
+        >>> def func(x):
+        ...     return x + 1
+        >>> wrapper = functools.update_wrapper(PassThrough(func), func)
+        >>> assert wrapper(1) == 2 and wrapper.__name__ == 'func'
+        >>> wrapper.target = lambda x: -x
+        >>> assert wrapper(1) == -1
+        >>> wrapper.target = wrapper.func
+        >>> assert wrapper(1) == 2
+    """
+    cdef readonly object func
+    cdef public object target
+    cdef dict __dict__
+    cdef object __weakref__
 
+    def __init__(self, func):
+        self.func = self.target = func
+
+    def __call__(self, *args, **kwargs):
+        return self.target(*args, **kwargs)
+
+    def __get__(self, instance, owner):
+        if instance is None:
+            return self
+        return types.MethodType(self, instance)
+
+    def __reduce__(self):
+        # Note: pickled as a global by `pickle`, like the function
+        return getattr(self, '__qualname__', self.func.__qualname__)
+
+    def __repr__(self):
+        return '<{} of {!r}>'.format(type(self).__name__, self.func)
 
 cdef class _SysMonitoringState:
     """
@@ -371,6 +962,15 @@ cdef class _SysMonitoringState:
     # int = event id, tuple = <locational info>
     cdef dict disabled
     cdef int events
+    # type: dict[int, tuple[CodeType, int]], int = code id
+    # Code-object-local events of the profiled code objects, as they
+    # would be if not for us (see `.add_code()`); keyed by identity
+    # since distinct code objects may compare equal
+    cdef dict local_events
+    # Whether the line-tracing events are set globally, because some
+    # profiled code (i.e. Cython code) can't take local events
+    cdef bint global_line_events
+    cdef bint active
     cdef Py_uintptr_t restart_version
 
     if _CAN_USE_SYS_MONITORING:
@@ -378,16 +978,30 @@ cdef class _SysMonitoringState:
             frozenset({sys.monitoring.events.LINE,
                        sys.monitoring.events.PY_RETURN,
                        sys.monitoring.events.PY_YIELD,
+                       sys.monitoring.events.PY_RESUME,
                        sys.monitoring.events.RAISE,
                        sys.monitoring.events.RERAISE}))
         line_tracing_events = (sys.monitoring.events.LINE
                                | sys.monitoring.events.PY_RETURN
                                | sys.monitoring.events.PY_YIELD
+                               | sys.monitoring.events.PY_RESUME
                                | sys.monitoring.events.RAISE
                                | sys.monitoring.events.RERAISE)
+        # The line-tracing events which can be set on the profiled code
+        # objects only...
+        local_line_tracing_events = (  # type: ClassVar[int]
+            sys.monitoring.events.LINE
+            | sys.monitoring.events.PY_RETURN
+            | sys.monitoring.events.PY_YIELD
+            | sys.monitoring.events.PY_RESUME)
+        # ... and those which can only be set globally
+        global_line_tracing_events = (  # type: ClassVar[int]
+            sys.monitoring.events.RAISE | sys.monitoring.events.RERAISE)
     else:
         line_tracing_event_set = frozenset({})
         line_tracing_events = 0
+        local_line_tracing_events = 0
+        global_line_tracing_events = 0
 
     def __init__(self, tool_id: int):
         self.tool_id = tool_id
@@ -395,19 +1009,25 @@ cdef class _SysMonitoringState:
         self.callbacks = {}
         self.disabled = {}
         self.events = 0  # NO_EVENTS
+        self.local_events = {}
+        self.global_line_events = False
+        self.active = False
         self.restart_version = monitoring_restart_version()
 
     cpdef register(self, object handle_line,
                    object handle_return, object handle_yield,
-                   object handle_raise, object handle_reraise):
-        # Note: only activating `sys.monitoring` line events for the
-        # profiled code objects in `LineProfiler.add_function()` may
-        # seem like an obvious optimization, but:
-        # - That adds complexity and muddies the logic, because
-        #   `.set_local_events()` can only be called if the tool id is
-        #   in use (e.g. activated via `.use_tool_id()`), and
-        # - That doesn't result in much (< 2%) performance improvement
-        #   in tests
+                   object handle_resume, object handle_raise,
+                   object handle_reraise, object codes=()):
+        """
+        Take over the tool ID, and turn on the line-tracing events for
+        the code objects ``codes`` (see :py:meth:`~.add_code`).
+        """
+        # Note: the line-tracing events are only turned on for the
+        # profiled code objects (as code-object-local events), so that
+        # the rest of the code doesn't call the callbacks at all; the
+        # exceptions are RAISE and RERAISE (which can't be local, but
+        # are rare anyway), and Cython code (whose events are only ever
+        # global)
         mon = sys.monitoring
 
         # Set prior state
@@ -423,16 +1043,90 @@ cdef class _SysMonitoringState:
             mon.use_tool_id(self.tool_id, 'line_profiler')
         else:
             self.events = mon.get_events(self.tool_id)
-        mon.set_events(self.tool_id, self.events | self.line_tracing_events)
+        self.active = True
+        mon.set_events(self.tool_id, self.events | self.own_global_events())
 
         # Register tracebacks and remember the existing ones
         for event_id, callback in [(mon.events.LINE, handle_line),
                                    (mon.events.PY_RETURN, handle_return),
                                    (mon.events.PY_YIELD, handle_yield),
+                                   (mon.events.PY_RESUME, handle_resume),
                                    (mon.events.RAISE, handle_raise),
                                    (mon.events.RERAISE, handle_reraise)]:
             self.callbacks[event_id] = mon.register_callback(
                 self.tool_id, event_id, callback)
+        for code in codes:
+            self.add_code(code)
+
+    cpdef add_code(self, object code):
+        """
+        Turn on the line-tracing events locally for ``code`` while
+        registered.
+
+        Arguments:
+            code (CodeType)
+                Profiled code object.
+
+        Note:
+            This doesn't call :py:func:`sys.monitoring.restart_events`,
+            which would re-enable the locations *all* the tools have
+            :py:data:`~sys.monitoring.DISABLE`-d; instead, no location
+            of ``code`` is disabled in the first place, since its
+            events are dropped (see :py:meth:`~.remove_code`) before
+            the profilers lose interest in it.
+        """
+        mon = sys.monitoring
+        if not self.active:
+            return
+        if id(code) in self.local_events:
+            return
+        if not any(code.co_code):  # Cython code: no local events
+            if not self.global_line_events:
+                self.global_line_events = True
+                mon.set_events(
+                    self.tool_id, self.events | self.own_global_events())
+            return
+        events = mon.get_local_events(self.tool_id, code)
+        self.local_events[id(code)] = code, events
+        mon.set_local_events(
+            self.tool_id, code, events | self.local_line_tracing_events)
+
+    cpdef remove_code(self, object code):
+        """
+        Restore the code-object-local events of ``code`` as they would
+        be if not for us, e.g. because the profilers profiling it have
+        been disabled while others stay active, so that the profiler
+        callbacks don't have to :py:data:`~sys.monitoring.DISABLE` its
+        locations.
+
+        Arguments:
+            code (CodeType)
+                Code object previously passed to :py:meth:`~.add_code`.
+        """
+        try:
+            _, events = self.local_events.pop(id(code))
+        except KeyError:  # Not added, or Cython code
+            return
+        sys.monitoring.set_local_events(self.tool_id, code, events)
+
+    cdef int own_global_events(self):
+        """
+        Returns:
+            The events which we need to be set globally.
+        """
+        if self.global_line_events:
+            return self.line_tracing_events
+        return self.global_line_tracing_events
+
+    cdef int get_wrapped_local_events(self, object code):
+        """
+        Returns:
+            The code-object-local events of ``code`` as set by others.
+        """
+        try:
+            return self.local_events[id(code)][1]
+        except KeyError:
+            return sys.monitoring.get_local_events(self.tool_id, code)
 
     cpdef deregister(self):
         mon = sys.monitoring
@@ -440,35 +1134,53 @@ cdef class _SysMonitoringState:
 
         # Restore prior state
         mon.set_events(self.tool_id, self.events)
+        for code, events in self.local_events.values():
+            mon.set_local_events(self.tool_id, code, events)
+        self.local_events.clear()
+        # Note: `sys.monitoring.restart_events()` isn't called, since the
+        # locations we DISABLE-d are only disabled for our tool ID, and
+        # only those which the wrapped callbacks (if any) also didn't
+        # take
         if self.name is None:
             mon.free_tool_id(self.tool_id)
         self.name = None
         self.events = mon.events.NO_EVENTS
+        self.global_line_events = False
+        self.active = False
 
         # Reset tracebacks
         while wrapped_callbacks:
             mon.register_callback(self.tool_id, *wrapped_callbacks.popitem())
 
-    cdef void call_callback(self, int event_id, object code,
-                            object loc_args, object other_args) noexcept:
+    cdef bint call_callback(
+            self, int event_id, object code, PyObject **args,
+            Py_ssize_t nargs, Py_ssize_t nloc) noexcept:
         """
         Call the appropriate stored callback.  Also take care of the
         restoration of :py:mod:`sys.monitoring` callbacks, tool-ID lock,
         and events should they be unset.
 
+        Returns:
+            Whether the stored callback still takes the event at the
+            location, i.e. whether we mustn't
+            :py:data:`~sys.monitoring.DISABLE` it on its behalf.
+
         Note:
             * This is deliberately made a non-traceable C method so that
               we don't fall info infinite recursion.
-            * ``loc_args`` and ``other_args`` should be tuples.
+            * ``args`` are the ``nargs`` arguments passed to the
+              :py:mod:`sys.monitoring` callback, the first ``nloc`` of
+              which (starting with ``code``) identify the location.
         """
         mon = sys.monitoring
         cdef PyObject *result = NULL
         cdef object callback  # type: Callable | None
         cdef object callback_after  # type: Callable | None
         cdef object code_location  # type: tuple[code, Unpack[tuple]]
-        cdef object arg_tuple  # type: tuple[code, Unpack[tuple]]
         cdef object disabled  # type: set[tuple[code, Unpack[tuple]]]
-        cdef int ev_id, events_before
+        cdef int ev_id, events_before, local_events_before = 0
+        cdef bint has_local_events = id(code) in self.local_events
+        cdef bint wants_event = True
         cdef Py_uintptr_t version = monitoring_restart_version()
         cdef dict callbacks_before = {}
 
@@ -480,23 +1192,24 @@ cdef class _SysMonitoringState:
         # Call the wrapped callback where suitable
         callback = self.callbacks.get(event_id)
         if callback is None:  # No cached callback
-            return
-        code_location = (code,) + loc_args
+            return False
+        code_location = args_to_tuple(args, nloc)
         disabled = self.disabled.setdefault(event_id, set())
         if code_location in disabled:  # Events 'disabled' for the loc
-            return
+            return False
         if not (self.events  # Callback should not receive the event
-                | mon.get_local_events(self.tool_id, code)) & event_id:
-            return
+                | self.get_wrapped_local_events(code)) & event_id:
+            return False
 
         for ev_id in self.line_tracing_event_set:
             callbacks_before[ev_id] = get_current_callback(self.tool_id, ev_id)
 
-        arg_tuple = code_location + other_args
         try:
             events_before = mon.get_events(self.tool_id)
-            result = PyObject_Call(  # Note: DECREF needed below
-                <PyObject *>callback, <PyObject *>arg_tuple, NULL)
+            if has_local_events:
+                local_events_before = mon.get_local_events(self.tool_id, code)
+            result = PyObject_Vectorcall(  # Note: DECREF needed below
+                <PyObject *>callback, args, nargs, NULL)
         else:
             # Since we can't actually disable the event (or line
             # profiling will be interrupted), just mark the location so
@@ -504,6 +1217,7 @@ cdef class _SysMonitoringState:
             # time `sys.monitoring.restart_events()` is called
             if result == <PyObject *>(mon.DISABLE):
                 disabled.add(code_location)
+                wants_event = False
         finally:
             Py_XDECREF(result)
             # Update the events
@@ -517,12 +1231,26 @@ cdef class _SysMonitoringState:
                 # - Remember the updated callback in `self.callbacks`
                 if callback is not callback_after:
                     self.callbacks[ev_id] = callback_after
-            # Reset the tool ID lock if released
+            # Reset the tool ID lock if released (which may also have
+            # cleared the local events)
             if not mon.get_tool(self.tool_id):
                 mon.use_tool_id(self.tool_id, 'line_profiler')
+                for other_code, events in self.local_events.values():
+                    mon.set_local_events(
+                        self.tool_id, other_code,
+                        events | self.local_line_tracing_events)
             # Restore the `sys.monitoring` events if unset
             mon.set_events(self.tool_id,
-                           self.events | self.line_tracing_events)
+                           self.events | self.own_global_events())
+            if has_local_events:
+                events = _patch_events(
+                    self.local_events[id(code)][1], local_events_before,
+                    mon.get_local_events(self.tool_id, code))
+                self.local_events[id(code)] = code, events
+                mon.set_local_events(
+                    self.tool_id, code,
+                    events | self.local_line_tracing_events)
+        return wants_event
 
 
 cdef class _LineProfilerManager:
@@ -539,6 +1267,8 @@ cdef class _LineProfilerManager:
         Callback for |PY_RETURN|_ events
     :py:meth:`~.handle_yield_event`
         Callback for |PY_YIELD|_ events
+    :py:meth:`~.handle_resume_event`
+        Callback for |PY_RESUME|_ events
     :py:meth:`~.handle_raise_event`
         Callback for |RAISE|_ events
     :py:meth:`~.handle_reraise_event`
@@ -551,6 +1281,7 @@ cdef class _LineProfilerManager:
     .. |LINE| replace:: :py:attr:`!sys.monitoring.events.LINE`
     .. |PY_RETURN| replace:: :py:attr:`!sys.monitoring.events.PY_RETURN`
     .. |PY_YIELD| replace:: :py:attr:`!sys.monitoring.events.PY_YIELD`
+    .. |PY_RESUME| replace:: :py:attr:`!sys.monitoring.events.PY_RESUME`
     .. |RAISE| replace:: :py:attr:`!sys.monitoring.events.RAISE`
     .. |RERAISE| replace:: :py:attr:`!sys.monitoring.events.RERAISE`
     .. _LINE: https://docs.python.org/3/library/\
@@ -559,6 +1290,8 @@ sys.monitoring.html#monitoring-event-LINE
 sys.monitoring.html#monitoring-event-PY_RETURN
     .. _PY_YIELD: https://docs.python.org/3/library/\
 sys.monitoring.html#monitoring-event-PY_YIELD
+    .. _PY_RESUME: https://docs.python.org/3/library/\
+sys.monitoring.html#monitoring-event-PY_RESUME
     .. _RAISE: https://docs.python.org/3/library/\
 sys.monitoring.html#monitoring-event-RAISE
     .. _RERAISE: https://docs.python.org/3/library/\
@@ -567,6 +1300,15 @@ sys.monitoring.html#monitoring-event-RERAISE
     cdef TraceCallback *legacy_callback
     cdef _SysMonitoringState mon_state
     cdef public set active_instances  # type: set[LineProfiler]
+    # What the trace callbacks iterate over instead of
+    # `.active_instances`, since (with `sys.monitoring`) they are called
+    # on all threads, concurrently so on free-threaded builds; see
+    # `._publish_instances()`
+    cdef InstanceSnapshots _c_instances
+    # type: set[LineProfiler]
+    # Kept alive for as long as the callbacks may see them in a stale
+    # snapshot
+    cdef set _retired_instances
     cdef int _wrap_trace
     cdef int _set_frame_local_trace
     cdef int recursion_guard
@@ -592,6 +1334,7 @@ sys.monitoring.html#monitoring-event-RERAISE
         self.mon_state = _SysMonitoringState(tool_id)
 
         self.active_instances = set()
+        self._retired_instances = set()
         self.wrap_trace = wrap_trace
         self.set_frame_local_trace = set_frame_local_trace
         self.recursion_guard = 0
@@ -682,12 +1425,19 @@ line_profiler/blob/main/line_profiler/_line_profiler.pyx
         Line-event (|LINE|_) callback passed to
         :py:func:`sys.monitoring.register_callback`.
 
+        Note:
+            What is actually registered is an equivalent builtin (see
+            :py:meth:`~._get_mon_callbacks`).
+
         .. |LINE| replace:: :py:attr:`!sys.monitoring.events.LINE`
         .. _LINE: https://docs.python.org/3/library/\
 sys.monitoring.html#monitoring-event-LINE
         """
-        self._base_callback(
-            1, sys.monitoring.events.LINE, code, lineno, (lineno,), ())
+        cdef object lineno_obj = lineno
+        cdef PyObject *args[2]
+        args[0] = <PyObject *>code
+        args[1] = <PyObject *>lineno_obj
+        return _mon_line_callback(self, args, 2)
 
     @cython.profile(False)
     cpdef handle_return_event(
@@ -701,8 +1451,8 @@ sys.monitoring.html#monitoring-event-LINE
         .. _PY_RETURN: https://docs.python.org/3/library/\
 sys.monitoring.html#monitoring-event-PY_RETURN
         """
-        self._handle_exit_event(
-            sys.monitoring.events.PY_RETURN, code, instruction_offset, retval)
+        return _call_mon_exit_callback(
+            _mon_return_callback, self, code, instruction_offset, retval)
 
     @cython.profile(False)
     cpdef handle_yield_event(
@@ -716,8 +1466,25 @@ sys.monitoring.html#monitoring-event-PY_RETURN
         .. _PY_YIELD: https://docs.python.org/3/library/\
 sys.monitoring.html#monitoring-event-PY_YIELD
         """
-        self._handle_exit_event(
-            sys.monitoring.events.PY_YIELD, code, instruction_offset, retval)
+        return _call_mon_exit_callback(
+            _mon_yield_callback, self, code, instruction_offset, retval)
+
+    @cython.profile(False)
+    cpdef handle_resume_event(self, object code, int instruction_offset):
+        """
+        Resume-event (|PY_RESUME|_) callback passed to
+        :py:func:`sys.monitoring.register_callback`.
+
+        .. |PY_RESUME| replace:: \
+:py:attr:`!sys.monitoring.events.PY_RESUME`
+        .. _PY_RESUME: https://docs.python.org/3/library/\
+sys.monitoring.html#monitoring-event-PY_RESUME
+        """
+        cdef object offset = instruction_offset
+        cdef PyObject *args[2]
+        args[0] = <PyObject *>code
+        args[1] = <PyObject *>offset
+        return _mon_resume_callback(self, args, 2)
 
     @cython.profile(False)
     cpdef handle_raise_event(
@@ -730,8 +1497,8 @@ sys.monitoring.html#monitoring-event-PY_YIELD
         .. _RAISE: https://docs.python.org/3/library/\
 sys.monitoring.html#monitoring-event-RAISE
         """
-        self._handle_exit_event(
-            sys.monitoring.events.RAISE, code, instruction_offset, exception)
+        return _call_mon_exit_callback(
+            _mon_raise_callback, self, code, instruction_offset, exception)
 
     @cython.profile(False)
     cpdef handle_reraise_event(
@@ -744,45 +1511,120 @@ sys.monitoring.html#monitoring-event-RAISE
         .. _RERAISE: https://docs.python.org/3/library/\
 sys.monitoring.html#monitoring-event-RERAISE
         """
-        self._handle_exit_event(
-            sys.monitoring.events.RERAISE, code, instruction_offset, exception)
+        return _call_mon_exit_callback(
+            _mon_reraise_callback, self, code, instruction_offset, exception)
+
+    cdef list _get_mon_callbacks(self):
+        """
+        Returns:
+            The callbacks to pass to
+            :py:func:`sys.monitoring.register_callback` for the
+            line-tracing events, in the same order as in
+            :py:meth:`_SysMonitoringState.register`: builtins bound to
+            the instance which take their arguments via vectorcall, so
+            that the events don't go through the method-call machinery
+            or allocate argument tuples.
+        """
+        cdef size_t i
+        return [PyCFunction_NewEx(&_MON_CALLBACK_DEFS[i], self, NULL)
+                for i in range(_NUM_MON_CALLBACKS)]
 
-    cdef void _handle_exit_event(
-            self, int event_id, object code, int offset, object obj) noexcept:
+    cdef bint _handle_offset_event(
+            self, int event_id, PyObject **args, Py_ssize_t nargs) noexcept:
         """
-        Base for the frame-exit-event (e.g. via returning or yielding)
-        callbacks passed to :py:func:`sys.monitoring.register_callback`.
+        Base for the callbacks passed to
+        :py:func:`sys.monitoring.register_callback` for the events
+        located by instruction offset (e.g. frame exits via returning or
+        yielding), with ``args`` being the ``nargs`` arguments thereto.
 
         Note:
             This is deliberately made a non-traceable C method so that
             we don't fall info infinite recursion.
         """
+        cdef object code = <object>args[0]
+        cdef int offset = <object>args[1]
         cdef int lineno = PyCode_Addr2Line(<PyCodeObject*>code, offset)
-        self._base_callback(0, event_id, code, lineno, (offset,), (obj,))
+        return self._base_callback(event_id, code, lineno, args, nargs, 2)
 
-    cdef void _base_callback(
-            self, int is_line_event, int event_id, object code, int lineno,
-            object loc_args, object other_args) noexcept:
+    cdef bint _base_callback(
+            self, int event_id, object code, int lineno,
+            PyObject **args, Py_ssize_t nargs, Py_ssize_t nloc) noexcept:
         """
         Base for the various callbacks passed to
         :py:func:`sys.monitoring.register_callback`.
 
+        Returns:
+            Whether the callback should return
+            :py:data:`sys.monitoring.DISABLE`, i.e. whether neither the
+            active profilers nor the wrapped callback (if any) are
+            interested in the location.
+
         Note:
             * This is deliberately made a non-traceable C method so that
               we don't fall info infinite recursion.
-            * ``loc_args`` and ``other_args`` should be tuples.
+            * ``args`` are the ``nargs`` arguments to the callback, the
+              first ``nloc`` of which identify the location (see
+              :py:meth:`_SysMonitoringState.call_callback`); they are
+              only packed into tuples as needed when calling the wrapped
+              callback.
         """
-        inner_trace_callback(
-            is_line_event, self.active_instances, code, lineno)
+        cdef int event = _EXIT_FRAME
+        cdef bint wanted
+        if event_id == _MON_LINE:
+            event = _START_LINE
+        elif event_id == _MON_PY_RESUME:
+            event = _RESUME_FRAME
+        wanted = inner_trace_callback(
+            event, self._c_instances.current(), code, lineno,
+            lp_current_frame())
         if self._wrap_trace:
-            self.mon_state.call_callback(event_id, code, loc_args, other_args)
+            if self.mon_state.call_callback(
+                    event_id, code, args, nargs, nloc):
+                wanted = True
+        if wanted or event_id & _UNDISABLEABLE_EVENTS:
+            return False
+        # Note: since the events of the profiled code objects are
+        # dropped when no active profiler wants them (see
+        # `._handle_disable_event()`), this is only for the code which
+        # isn't (and won't be) profiled, e.g. the rest of the code with
+        # the global events for Cython code
+        return True
+
+    cdef int _watch_code(self, code, prof) except -1:
+        """
+        Turn on the line-tracing events for ``code`` if it has been
+        added to ``prof`` and the latter is active.
+        """
+        if USE_LEGACY_TRACE or prof not in self.active_instances:
+            return 0
+        self.mon_state.add_code(code)
+        return 0
+
+    cdef int _publish_instances(self) except -1:
+        """
+        Publish a snapshot of :py:attr:`~.active_instances` for the
+        trace callbacks.
+
+        Note:
+            Only the thread owning the instance calls this, so the
+            writes need no further serialization.
+        """
+        cdef vector[void*] items
+        for prof in self.active_instances:
+            items.push_back(<void*>prof)
+        self._c_instances.publish(items)
+        return 0
 
     cpdef _handle_enable_event(self, prof):
         cdef TraceCallback* legacy_callback
         instances = self.active_instances
         already_active = bool(instances)
         instances.add(prof)
+        self._publish_instances()
         if already_active:
+            if not USE_LEGACY_TRACE:
+                for code in (<LineProfiler>prof)._code_blocks.values():
+                    self.mon_state.add_code(code)
             return
         if USE_LEGACY_TRACE:
             legacy_callback = alloc_callback()
@@ -790,17 +1632,29 @@ sys.monitoring.html#monitoring-event-RERAISE
             self.legacy_callback = legacy_callback
             PyEval_SetTrace(legacy_trace_callback, self)
         else:
-            self.mon_state.register(self.handle_line_event,
-                                    self.handle_return_event,
-                                    self.handle_yield_event,
-                                    self.handle_raise_event,
-                                    self.handle_reraise_event)
+            codes = list((<LineProfiler>prof)._code_blocks.values())
+            self.mon_state.register(*self._get_mon_callbacks(), codes)
 
     cpdef _handle_disable_event(self, prof):
         cdef TraceCallback* legacy_callback
         instances = self.active_instances
-        instances.discard(prof)
+        if prof in instances:
+            instances.remove(prof)
+            # Callbacks on other threads may still be looking at the
+            # previous snapshot
+            self._retired_instances.add(prof)
+        self._publish_instances()
         if instances:
+            if not USE_LEGACY_TRACE:
+                # Drop the events of the code no active profiler wants,
+                # instead of DISABLE-ing its locations one by one
+                wanted = set()
+                for other in instances:
+                    wanted.update(
+                        map(id, (<LineProfiler>other)._code_blocks.values()))
+                for code in (<LineProfiler>prof)._code_blocks.values():
+                    if id(code) not in wanted:
+                        self.mon_state.remove_code(code)
             return
         # Only use the legacy trace-callback system if Python < 3.12 or
         # if explicitly requested with `LINE_PROFILER_CORE=legacy`;
@@ -812,7 +1666,11 @@ sys.monitoring.html#monitoring-event-RERAISE
             free_callback(legacy_callback)
             self.legacy_callback = NULL
         else:
+            # Note: on free-threaded builds, this stops the world, so
+            # the callbacks are no longer running when it returns
             self.mon_state.deregister()
+        self._c_instances.release()
+        self._retired_instances.clear()
 
     property wrap_trace:
         def __get__(self):
@@ -831,6 +1689,127 @@ sys.monitoring.html#monitoring-event-RERAISE
                 1 if set_frame_local_trace and USE_LEGACY_TRACE else 0)
 
 
+cdef tuple args_to_tuple(PyObject **args, Py_ssize_t nargs):
+    """
+    Returns:
+        A tuple of the ``nargs`` objects in ``args``.
+    """
+    cdef tuple result = PyTuple_New(nargs)
+    cdef Py_ssize_t i
+    for i in range(nargs):
+        obj = <object>args[i]
+        Py_INCREF(obj)  # `PyTuple_SET_ITEM()` steals a reference
+        PyTuple_SET_ITEM(result, i, obj)
+    return result
+
+
+# The `sys.monitoring` callbacks proper (see
+# `_LineProfilerManager._get_mon_callbacks()`): `METH_FASTCALL`
+# functions of the `_LineProfilerManager` (as `self`) and the arguments
+# passed to the callback
+
+@cython.profile(False)
+cdef object _mon_line_callback(
+        object manager, PyObject **args, Py_ssize_t nargs):
+    if nargs != 2:
+        raise TypeError(f'expected 2 arguments, got {nargs}')
+    if (<_LineProfilerManager>manager)._base_callback(
+            _MON_LINE, <object>args[0], <object>args[1], args, 2, 2):
+        return _MON_DISABLE
+    return None
+
+
+@cython.profile(False)
+cdef inline object _mon_exit_callback(
+        int event_id, object manager, PyObject **args, Py_ssize_t nargs):
+    if nargs != 3:
+        raise TypeError(f'expected 3 arguments, got {nargs}')
+    if (<_LineProfilerManager>manager)._handle_offset_event(
+            event_id, args, 3):
+        return _MON_DISABLE
+    return None
+
+
+@cython.profile(False)
+cdef object _mon_return_callback(
+        object manager, PyObject **args, Py_ssize_t nargs):
+    return _mon_exit_callback(_MON_PY_RETURN, manager, args, nargs)
+
+
+@cython.profile(False)
+cdef object _mon_yield_callback(
+        object manager, PyObject **args, Py_ssize_t nargs):
+    return _mon_exit_callback(_MON_PY_YIELD, manager, args, nargs)
+
+
+@cython.profile(False)
+cdef object _mon_resume_callback(
+        object manager, PyObject **args, Py_ssize_t nargs):
+    if nargs != 2:
+        raise TypeError(f'expected 2 arguments, got {nargs}')
+    if (<_LineProfilerManager>manager)._handle_offset_event(
+            _MON_PY_RESUME, args, 2):
+        return _MON_DISABLE
+    return None
+
+
+@cython.profile(False)
+cdef object _mon_raise_callback(
+        object manager, PyObject **args, Py_ssize_t nargs):
+    # Note: these events can't be disabled
+    _mon_exit_callback(_MON_RAISE, manager, args, nargs)
+    return None
+
+
+@cython.profile(False)
+cdef object _mon_reraise_callback(
+        object manager, PyObject **args, Py_ssize_t nargs):
+    # Note: these events can't be disabled
+    _mon_exit_callback(_MON_RERAISE, manager, args, nargs)
+    return None
+
+
+ctypedef object (*_mon_fastcall)(object, PyObject **, Py_ssize_t)
+
+
+cdef inline object _call_mon_exit_callback(
+        _mon_fastcall callback, object manager,
+        object code, object offset, object obj):
+    cdef PyObject *args[3]
+    args[0] = <PyObject *>code
+    args[1] = <PyObject *>offset
+    args[2] = <PyObject *>obj
+    return callback(manager, args, 3)
+
+
+cdef enum:
+    _NUM_MON_CALLBACKS = 6
+
+cdef PyMethodDef _MON_CALLBACK_DEFS[_NUM_MON_CALLBACKS]
+
+
+cdef void _set_method_def(
+        PyMethodDef *ml, const char *name, _mon_fastcall meth) noexcept:
+    ml.ml_name = name
+    ml.ml_meth = <PyCFunction>meth
+    ml.ml_flags = METH_FASTCALL
+    ml.ml_doc = NULL
+
+
+_set_method_def(&_MON_CALLBACK_DEFS[0], b'handle_line_event',
+                _mon_line_callback)
+_set_method_def(&_MON_CALLBACK_DEFS[1], b'handle_return_event',
+                _mon_return_callback)
+_set_method_def(&_MON_CALLBACK_DEFS[2], b'handle_yield_event',
+                _mon_yield_callback)
+_set_method_def(&_MON_CALLBACK_DEFS[3], b'handle_resume_event',
+                _mon_resume_callback)
+_set_method_def(&_MON_CALLBACK_DEFS[4], b'handle_raise_event',
+                _mon_raise_callback)
+_set_method_def(&_MON_CALLBACK_DEFS[5], b'handle_reraise_event',
+                _mon_reraise_callback)
+
+
 cdef class LineProfiler:
     """
     Time the execution of lines of Python code.
@@ -900,6 +1879,42 @@ cdef class LineProfiler:
 
             See the :ref:`caveats <warning-trace-caveats>` and also the
             :ref:`extra explanation <note-set_frame_local_trace>`.
+        sample_every (int | None)
+            If greater than 1, only time one in every ``sample_every``
+            line events (counted per thread) in the profiled code,
+            recording it with ``sample_every`` times the weight (in both
+            hits and time); the other events take a cheap path which
+            doesn't read the timer.  Mutually exclusive with
+            ``sample_interval``.
+        sample_interval (float | None)
+            If set, only time (at most) one line event per thread every
+            ``sample_interval`` seconds, weighted by the number of line
+            events since the previous sample.  The intervals are
+            measured by a coarse clock ticking in a background thread
+            (at most every 100 microseconds, and only while a profiler
+            samples by time), so that the other events also take the
+            cheap path.
+
+        In either sampling mode the statistics are estimates, but the
+        overhead is low enough to leave profiling on, e.g. in
+        production.
+        histograms (bool)
+            If true, also keep the distribution of the durations of the
+            hits of each line (see :py:attr:`.histograms`).
+        per_thread (bool)
+            If true, also report the timings of each thread separately
+            (see :py:attr:`.per_thread`).
+        self_time (bool)
+            If true, also report the self time of each line, i.e. the
+            time not spent in other profiled lines it called into (see
+            :py:attr:`.self_time`).
+        counters (Sequence[str] | None)
+            Names of (up to 4) hardware events to also count per line,
+            e.g. ``['cycles', 'instructions', 'cache-misses']`` (see
+            :py:attr:`.counters`); Linux only.
+        memory (bool)
+            If true, also account the memory allocated by each line
+            (see :py:attr:`.memory`).
 
     Example:
         >>> import copy
@@ -1005,10 +2020,17 @@ cdef class LineProfiler:
             and the wrapped/cached callbacks will once again receive
             events from the
             previously-:py:data:`~sys.monitoring.DISABLE`-d locations.
-          * Callbacks which only listen to and alter code-object-local
-            events (via :py:func:`sys.monitoring.set_local_events`) do
-            not interfere with line profiling, and such changes are
-            therefore not intercepted.
+          * Line profiling only turns on the line events locally on
+            the profiled code objects (via
+            :py:func:`sys.monitoring.set_local_events`) or, for Cython
+            code, globally; changes (by the cached callbacks) to the
+            code-object-local events of the profiled code are likewise
+            intercepted.  The profiler callbacks return
+            :py:data:`sys.monitoring.DISABLE` for locations no active
+            profiler or cached callback is interested in; when some
+            profiler instances are :py:meth:`.disable`-ed while others
+            stay active, the local events of the code objects only the
+            former profile are dropped instead.
 
     .. _note-set_frame_local_trace:
 
@@ -1046,13 +2068,64 @@ cdef class LineProfiler:
     .. _"legacy" trace system: https://github.com/python/cpython/blob/\
 3.13/Python/legacy_tracing.c
     """
-    cdef unordered_map[int64, LineTimeMap] _c_code_map
-    # Mapping between thread-id and map of LastTime
-    cdef unordered_map[int64, LastTimeMap] _c_last_time
+    # Mapping between block hash and the layout of the block
+    cdef BlockRegistry _c_code_map
+    # Mapping between thread index (see `lp_thread_index()`) and the
+    # line timings and last-time records on the thread; the timings of
+    # the threads which have exited are folded into the shards with the
+    # (negative) keys in `._retired_keys` (see `._retire_thread()`)
+    cdef ThreadShardMap _c_shard_store
+    # Pointers into `._c_shard_store`, indexed by thread index
+    cdef PointerTable _c_shards
+    # Serializes the writes to the above three (and the reads of
+    # `._c_shard_store`); the trace callbacks read `._c_code_map` and
+    # `._c_shards` without it
+    cdef lp_mutex _c_lock
+    # type: dict[int, CodeType], int = block hash
+    # (Keyed by the hashes since distinct code objects may compare
+    # equal)
+    cdef dict _code_blocks
+    # Merged line timings as of the last `.get_stats_delta()`
+    cdef LineTimeBlockMap _c_reported
+    # type: dict[str, dict[tuple[str, int, str], dict[int, tuple[int, int]]]];
+    # per-thread timings (`(nhits, total_time)` by line number) as of the
+    # last `.get_stats_delta()`
+    cdef dict _thread_reported
+    # See `.sample_every` and `.sample_interval`
+    cdef long _sample_every
+    cdef long long _sample_interval_us
+    cdef bint _sampling
+    # See `.histograms`
+    cdef bint _histograms
+    # See `.per_thread`; the names are keyed by thread index
+    cdef bint _per_thread
+    cdef dict _thread_names
+    # type: dict[str | None, int]; the key in `._c_shard_store` of the
+    # retired shard for each thread name (with `.per_thread`), or for
+    # all the threads (`None`)
+    cdef dict _retired_keys
+    # See `.self_time`
+    cdef bint _self_time
+    # See `.counters`; indices into `lp_perf_event_names`
+    cdef int _counter_events[LP_PERF_MAX_COUNTERS]
+    cdef int _ncounters
+    # See `.memory`; the allocation counters of the lines are looked up
+    # in `._c_mem_table` (by line hash) as the lines are first executed,
+    # and `._mem_hooked` is whether the profiler is a user of the hook
+    # (see alloc_hook.h)
+    cdef bint _memory
+    cdef bint _mem_hooked
+    cdef LineMemMap *_c_mem_table
+    # Allocation counters as of the last `.get_stats_delta()`
+    cdef LineMemMap _c_mem_reported
     cdef public list functions
     cdef public dict code_hash_map, dupes_map
     cdef public double timer_unit
+    # See `.overhead`
+    cdef object _overhead
     cdef public object threaddata
+    # Instances are tracked in `_LIVE_PROFILERS`
+    cdef object __weakref__
 
     # These are shared between instances and threads
     if _CAN_USE_SYS_MONITORING:
@@ -1065,18 +2138,45 @@ cdef class LineProfiler:
         tool_id = 2
     # type: ClassVar[dict[int, _LineProfilerManager]], int = thread id
     _managers = {}
-    # type: ClassVar[dict[bytes, int]], bytes = bytecode
-    _all_paddings = {}
-    # type: ClassVar[dict[int, weakref.WeakSet[LineProfiler]]],
-    # int = func id
-    _all_instances_by_funcs = {}
+
+    def __cinit__(self, *args, **kwargs):
+        _NUM_PROFILERS.add(1)
+
+    def __dealloc__(self):
+        cdef vector[int64] block_hashes = self._get_block_hashes()
+        cdef ThreadShardMap.iterator it = self._c_shard_store.begin()
+        cdef size_t i
+        lp_mutex_lock(&_DISPATCH_LOCK)
+        try:
+            for i in range(block_hashes.size()):
+                _BLOCK_DISPATCH.remove(block_hashes[i], <void*>self)
+        finally:
+            lp_mutex_unlock(&_DISPATCH_LOCK)
+        while it != self._c_shard_store.end():
+            lp_perf_close(deref(it).second.perf)
+            deref(it).second.perf = NULL
+            inc(it)
+        if self._mem_hooked:
+            lp_mem_hook_release()
+            self._mem_hooked = False
+        lp_mem_table_retire(self._c_mem_table)
+        self._c_mem_table = NULL
+        if self._sample_interval_us:
+            lp_clock_release(self._sample_interval_us)
+            self._sample_interval_us = 0
+        _NUM_PROFILERS.add(-1)
 
     def __init__(self, *functions,
-                 wrap_trace=None, set_frame_local_trace=None):
+                 wrap_trace=None, set_frame_local_trace=None,
+                 sample_every=None, sample_interval=None, histograms=False,
+                 per_thread=False, self_time=False, counters=None,
+                 memory=False):
         self.functions = []
         self.code_hash_map = {}
         self.dupes_map = {}
+        self._code_blocks = {}
         self.timer_unit = hpTimerUnit()
+        _LIVE_PROFILERS.add(self)
         # Create a data store for thread-local objects
         # https://docs.python.org/3/library/threading.html#thread-local-data
         self.threaddata = threading.local()
@@ -1084,6 +2184,24 @@ cdef class LineProfiler:
             self.wrap_trace = wrap_trace
         if set_frame_local_trace is not None:
             self.set_frame_local_trace = set_frame_local_trace
+        if sample_every is not None and sample_interval is not None:
+            raise ValueError('`sample_every` and `sample_interval` are '
+                             'mutually exclusive')
+        self.sample_every = sample_every
+        self.sample_interval = sample_interval
+        self.histograms = histograms
+        self._thread_names = {}
+        self._retired_keys = {}
+        self._thread_reported = {}
+        self.per_thread = per_thread
+        self.self_time = self_time
+        if counters:
+            self._set_counters(counters)
+        if memory:
+            self._c_mem_table = lp_mem_table_new()
+            if self._c_mem_table == NULL:
+                raise MemoryError
+            self._memory = True
 
         for func in functions:
             self.add_function(func)
@@ -1103,6 +2221,13 @@ cdef class LineProfiler:
         .. _function: https://docs.python.org/3/reference/\
 datamodel.html#user-defined-functions
         """
+        with _REGISTRATION_LOCK:
+            self._add_function(func)
+
+    cdef _add_function(self, func):
+        cdef vector[int] linenos
+        cdef size_t i
+
         if hasattr(func, "__wrapped__"):
             warn(
                 "Adding a function with a `.__wrapped__` attribute. "
@@ -1121,64 +2246,31 @@ datamodel.html#user-defined-functions
                     f"Could not extract a code object for the object {func!r}")
                 return
 
-        # Note: if we are to alter the code object, other profilers
-        # which previously added this function would still expect the
-        # old bytecode, and thus will not see anything when the function
-        # is executed;
-        # hence:
-        # - When doing bytecode padding, take into account all instances
-        #   which refers to the same base bytecode to ensure
-        #   disambiguation
-        # - Update all existing instances referring to the old code
-        #   object
-        # Since no code padding is/can be done with Cython mock
-        # "code objects", it is *probably* okay to only do the special
-        # handling on the non-Cython branch.
-        # XXX: tests for the above assertion if necessary
+        # Note: the code objects are identified by themselves (see
+        # `compute_block_hash()`) and never altered, so that functions
+        # with the same bytecode are told apart without touching them
+        # (or what other profilers see of them)
         co_code: bytes = code.co_code
         code_hashes = []
         if any(co_code):  # Normal Python functions
-            # Figure out how much padding we need and strip the bytecode
-            base_co_code: bytes
-            npad_code: int
-            base_co_code, npad_code = multibyte_rstrip(co_code)
-            try:
-                npad = self._all_paddings[base_co_code]
-            except KeyError:
-                npad = 0
-            self._all_paddings[base_co_code] = max(npad, npad_code) + 1
-            try:
-                profilers_to_update = self._all_instances_by_funcs[func_id]
-                profilers_to_update.add(self)
-            except KeyError:
-                profilers_to_update = WeakSet({self})
-                self._all_instances_by_funcs[func_id] = profilers_to_update
             # Maintain `.dupes_map` (legacy)
             try:
-                self.dupes_map[base_co_code].append(code)
+                self.dupes_map[co_code].append(code)
             except KeyError:
-                self.dupes_map[base_co_code] = [code]
-            if npad > npad_code:
-                # Code hash already exists, so there must be a duplicate
-                # function (on some instance);
-                # (re-)pad with no-op
-                co_code = base_co_code + NOP_BYTES * npad
-                code = _code_replace(func, co_code)
-                try:
-                    func.__code__ = code
-                except AttributeError as e:
-                    func.__func__.__code__ = code
-            else:  # No re-padding -> no need to update the other profs
-                profilers_to_update = {self}
-            # TODO: Since each line can be many bytecodes, this is kinda
-            # inefficient
-            # See if this can be sped up by not needing to iterate over
-            # every byte
-            for offset, _ in enumerate(co_code):
-                code_hashes.append(
-                    compute_line_hash(
-                        hash(co_code),
-                        PyCode_Addr2Line(<PyCodeObject*>code, offset)))
+                self.dupes_map[co_code] = [code]
+            # Also prime the block-hash cache for the trace callbacks
+            block_hash = get_block_hash(code)
+            first_lineno = code.co_firstlineno
+            last_lineno = -1
+            get_code_lines(code, &linenos)
+            for i in range(linenos.size()):
+                lineno = linenos[i]
+                code_hashes.append(compute_line_hash(block_hash, lineno))
+                if lineno < 0:  # No line number for the instruction
+                    continue
+                if last_lineno < 0:  # Line numbers come in order
+                    first_lineno = lineno
+                last_lineno = lineno
         else:  # Cython functions have empty/zero bytecodes
             if CANNOT_LINE_TRACE_CYTHON:
                 return
@@ -1194,34 +2286,533 @@ datamodel.html#user-defined-functions
             if not cython_source:  # Can't find the source
                 return
             nlines = len(get_code_block(cython_source, lineno))
-            block_hash = hash(code)
+            block_hash = get_block_hash(code)
+            first_lineno = lineno
+            last_lineno = lineno + nlines - 1
             for lineno in range(lineno, lineno + nlines):
                 code_hash = compute_line_hash(block_hash, lineno)
                 code_hashes.append(code_hash)
             # We can't replace the code object on Cython functions, but
             # we can *store* a copy with the correct metadata
-            # Note: we don't use `_copy_local_sysmon_events()` here
-            # because Cython shim code objects don't support local
-            # events
+            # Note: Cython shim code objects don't support local events,
+            # so the copy needn't inherit them
             code = code.replace(co_filename=cython_source)
-            profilers_to_update = {self}
         # Update `._c_code_map` and `.code_hash_map` with the new line
-        # hashes on `self` (and other instances profiling the same
-        # function if we padded the bytecode)
-        for instance in profilers_to_update:
-            prof = <LineProfiler>instance
-            try:
-                line_hashes = prof.code_hash_map[code]
-            except KeyError:
-                line_hashes = prof.code_hash_map[code] = []
-            for code_hash in code_hashes:
-                line_hash = <int64>code_hash
-                if not prof._c_code_map.count(line_hash):
-                    line_hashes.append(line_hash)
-                    prof._c_code_map[line_hash]
+        # hashes
+        self._register_block(block_hash, first_lineno, last_lineno)
+        self._code_blocks[block_hash] = code
+        try:
+            line_hashes = self.code_hash_map[code]
+        except KeyError:
+            line_hashes = self.code_hash_map[code] = []
+        known_hashes = set(line_hashes)
+        for code_hash in code_hashes:
+            if code_hash not in known_hashes:
+                known_hashes.add(code_hash)
+                line_hashes.append(code_hash)
+        # If already profiling, (`sys.monitoring`) line events have to
+        # be turned on for the new code object
+        for manager in list(self._managers.values()):
+            (<_LineProfilerManager>manager)._watch_code(code, self)
 
         self.functions.append(func)
 
+    cdef int _register_block(
+            self, int64 block_hash, int first_lineno,
+            int last_lineno) except -1:
+        """
+        Register the code block ``block_hash`` spanning the lines
+        ``first_lineno`` to ``last_lineno`` (inclusive); if it is
+        already registered, extend it to cover said lines.
+        """
+        lp_mutex_lock(&self._c_lock)
+        try:
+            self._c_code_map.add(block_hash, first_lineno, last_lineno)
+        finally:
+            lp_mutex_unlock(&self._c_lock)
+        lp_mutex_lock(&_DISPATCH_LOCK)
+        try:
+            _BLOCK_DISPATCH.add(block_hash, <void*>self)
+        finally:
+            lp_mutex_unlock(&_DISPATCH_LOCK)
+        return 0
+
+    cdef vector[int64] _get_block_hashes(self) except *:
+        """
+        Returns:
+            The hashes of the registered code blocks, in the order of
+            registration.
+        """
+        cdef vector[int64] block_hashes
+        cdef size_t i
+        lp_mutex_lock(&self._c_lock)
+        try:
+            for i in range(self._c_code_map.size()):
+                block_hashes.push_back(self._c_code_map.key_at(i))
+        finally:
+            lp_mutex_unlock(&self._c_lock)
+        return block_hashes
+
+    cdef void _merge_block(self, int64 block_hash, LineTimeBlock *out,
+                           Py_ssize_t tidx=-1):
+        """
+        Sum the line timings of the code block ``block_hash`` over all
+        threads (or only the thread with the index ``tidx``, if
+        non-negative) into ``out``.
+
+        Note:
+            Other threads may be profiling meanwhile, so the sums are
+            but a snapshot; the blocks themselves are however locked so
+            that their owners can't reallocate them under our feet.
+        """
+        cdef const BlockInfo *info = self._c_code_map.find(block_hash)
+        cdef ThreadShardMap.iterator sit
+
+        if info == NULL:
+            return
+        ensure_block_lines(out, block_hash, info.first_lineno,
+                           info.first_lineno + info.nlines - 1,
+                           self._histograms, self._ncounters)
+        lp_mutex_lock(&self._c_lock)
+        if tidx >= 0:
+            sit = self._c_shard_store.find(tidx)
+            if sit != self._c_shard_store.end():
+                merge_shard_block(&(deref(sit).second), info, out)
+        else:
+            sit = self._c_shard_store.begin()
+            while sit != self._c_shard_store.end():
+                merge_shard_block(&(deref(sit).second), info, out)
+                inc(sit)
+        lp_mutex_unlock(&self._c_lock)
+
+    cdef vector[Py_ssize_t] _get_thread_indices(self):
+        """
+        Returns:
+            The indices of the threads which have profiling data.
+        """
+        cdef vector[Py_ssize_t] tidxs
+        cdef ThreadShardMap.iterator sit
+        lp_mutex_lock(&self._c_lock)
+        sit = self._c_shard_store.begin()
+        while sit != self._c_shard_store.end():
+            tidxs.push_back(deref(sit).first)
+            inc(sit)
+        lp_mutex_unlock(&self._c_lock)
+        return tidxs
+
+    cdef dict _get_thread_timings(self, dict blocks_by_key):
+        """
+        Get the per-thread timings (see
+        :py:attr:`LineStats.thread_timings`) of the code blocks in
+        ``blocks_by_key`` (mapping labels to lists of block hashes).
+        """
+        cdef vector[Py_ssize_t] tidxs = self._get_thread_indices()
+        cdef LineTimeBlock merged
+        cdef LineTime *entry
+        cdef size_t i
+        # Note: the live threads are only looked up for the names not
+        # recorded upon their first event (e.g. because `.per_thread`
+        # was off then)
+        cdef dict alive = None
+        tidxs_by_name = {}
+        for i in range(tidxs.size()):
+            name = self._thread_names.get(tidxs[i])
+            if name is None:
+                if alive is None:
+                    alive = {thread.ident: thread.name
+                             for thread in threading.enumerate()}
+                ident = self._get_thread_ident(tidxs[i])
+                name = alive.get(ident, f'<thread {ident:#x}>')
+            tidxs_by_name.setdefault(name, []).append(tidxs[i])
+        thread_timings = {}
+        for name, thread_tidxs in tidxs_by_name.items():
+            timings = {}
+            for key, block_hashes in blocks_by_key.items():
+                merged.lines.clear()
+                merged.hist.clear()
+                merged.counts.clear()
+                for tidx in thread_tidxs:
+                    for block_hash in block_hashes:
+                        self._merge_block(block_hash, &merged, tidx)
+                entries = []
+                for i in range(merged.lines.size()):
+                    entry = &(merged.lines[i])
+                    if entry.nhits:
+                        entries.append(
+                            (entry.lineno, entry.nhits, entry.total_time))
+                if entries:
+                    timings[key] = entries
+            if timings:
+                thread_timings[name] = timings
+        return thread_timings
+
+    cdef dict _get_thread_timings_delta(self, dict blocks_by_key):
+        """
+        Get the changes in the per-thread timings of the code blocks in
+        ``blocks_by_key`` since the last such call (see
+        :py:meth:`.get_stats_delta`).
+        """
+        thread_timings = {}
+        for name, timings in self._get_thread_timings(blocks_by_key).items():
+            reported = self._thread_reported.setdefault(name, {})
+            changes = {}
+            for key, entries in timings.items():
+                prev_entries = reported.setdefault(key, {})
+                changed = []
+                for lineno, nhits, total_time in entries:
+                    prev_nhits, prev_time = prev_entries.get(lineno, (0, 0))
+                    if nhits != prev_nhits or total_time != prev_time:
+                        changed.append((lineno, nhits - prev_nhits,
+                                        total_time - prev_time))
+                        prev_entries[lineno] = nhits, total_time
+                if changed:
+                    changes[key] = changed
+            if changes:
+                thread_timings[name] = changes
+        return thread_timings
+
+    cdef dict _get_memory(self, dict blocks_by_key, bint delta=False):
+        """
+        Get the allocation counters (see :py:attr:`LineStats.memory`)
+        of the code blocks in ``blocks_by_key`` (mapping labels to lists
+        of block hashes); with ``delta``, get the changes since the last
+        such call instead (see :py:meth:`.get_stats_delta`).
+        """
+        cdef LineMemMap snapshot
+        cdef LineMemMap.iterator it, prev
+        cdef const BlockInfo *info
+        cdef long long nallocs, allocated, retained
+        cdef int64 block_hash
+        cdef int lineno
+        memory = {}
+        if self._c_mem_table == NULL:
+            return memory
+        if lp_mem_table_copy(self._c_mem_table, &snapshot) < 0:
+            raise MemoryError
+        for key, block_hashes in blocks_by_key.items():
+            for block_hash in block_hashes:
+                info = self._c_code_map.find(block_hash)
+                if info == NULL:
+                    continue
+                for lineno in range(info.first_lineno,
+                                    info.first_lineno + info.nlines):
+                    it = snapshot.find(compute_line_hash(block_hash, lineno))
+                    if it == snapshot.end():
+                        continue
+                    nallocs = deref(it).second.nallocs
+                    allocated = deref(it).second.allocated
+                    retained = allocated - deref(it).second.freed
+                    if delta:
+                        prev = self._c_mem_reported.find(deref(it).first)
+                        if prev != self._c_mem_reported.end():
+                            nallocs -= deref(prev).second.nallocs
+                            allocated -= deref(prev).second.allocated
+                            retained -= (deref(prev).second.allocated
+                                         - deref(prev).second.freed)
+                    if not (nallocs or allocated or retained):
+                        continue
+                    line_memory = memory.setdefault(key, {})
+                    if lineno in line_memory:
+                        old_nallocs, old_allocated, old_retained = (
+                            line_memory[lineno])
+                        nallocs += old_nallocs
+                        allocated += old_allocated
+                        retained += old_retained
+                    line_memory[lineno] = (nallocs, allocated, retained)
+        if delta:
+            self._c_mem_reported.swap(snapshot)
+        return memory
+
+    cdef int _retire_thread(self, Py_ssize_t tidx) except -1:
+        """
+        Fold the line timings of the thread with the index ``tidx``,
+        which has exited, into the retired shard for its name (see
+        :py:attr:`.per_thread`) or for all the threads, and drop its
+        shard, so that the index can be reused.
+        """
+        cdef ThreadShardMap.iterator sit
+        cdef ThreadShard *dead
+        cdef ThreadShard *retired
+        cdef const BlockInfo *info
+        cdef int64 block_hash
+        cdef Py_ssize_t key
+        cdef size_t i
+        name = self._thread_names.pop(tidx, None)
+        if self._per_thread:
+            if name is None:
+                name = f'<thread {self._get_thread_ident(tidx):#x}>'
+        else:
+            name = None
+        key = self._retired_keys.get(name, 0)
+        if not key:
+            # Note: -1 is the "all threads" sentinel of `._merge_block()`
+            key = -2 - len(self._retired_keys)
+            self._retired_keys[name] = key
+            self._thread_names[key] = (
+                '<exited threads>' if name is None else name)
+        lp_mutex_lock(&self._c_lock)
+        try:
+            sit = self._c_shard_store.find(tidx)
+            if sit == self._c_shard_store.end():
+                return 0
+            dead = &(deref(sit).second)
+            retired = &(self._c_shard_store[key])
+            for i in range(self._c_code_map.size()):
+                block_hash = self._c_code_map.key_at(i)
+                info = self._c_code_map.find(block_hash)
+                if (info == NULL
+                        or <size_t>info.index >= dead.blocks.size()
+                        or dead.blocks[info.index].lines.empty()):
+                    continue
+                merge_shard_block(
+                    dead, info,
+                    get_shard_block(retired, info, block_hash,
+                                    self._histograms, self._ncounters))
+            lp_perf_close(dead.perf)
+            dead.perf = NULL
+            self._c_shards.set(tidx, NULL)
+            self._c_shard_store.erase(sit)
+        finally:
+            lp_mutex_unlock(&self._c_lock)
+        return 0
+
+    cdef unsigned long _get_thread_ident(self, Py_ssize_t tidx):
+        cdef ThreadShardMap.iterator sit
+        cdef unsigned long ident = 0
+        lp_mutex_lock(&self._c_lock)
+        sit = self._c_shard_store.find(tidx)
+        if sit != self._c_shard_store.end():
+            ident = deref(sit).second.thread_ident
+        lp_mutex_unlock(&self._c_lock)
+        return ident
+
+    property sample_every:
+        """
+        Number of line events (per thread) of which only one is timed,
+        or :py:data:`None` if not sampling by count.
+        """
+        def __get__(self):
+            return self._sample_every if self._sample_every > 1 else None
+        def __set__(self, sample_every):
+            if sample_every is None:
+                sample_every = 0
+            elif sample_every < 1:
+                raise ValueError(
+                    f'sample_every = {sample_every!r}: expected an integer '
+                    '>= 1 or `None`')
+            elif sample_every > 1:  # Sampling by count replaces time
+                self._set_sample_interval_us(0)
+            self._sample_every = sample_every
+            self._sampling = (self._sample_every > 1
+                              or self._sample_interval_us > 0)
+
+    property sample_interval:
+        """
+        Interval (in seconds) between line events timed (per thread),
+        or :py:data:`None` if not sampling by time.
+        """
+        def __get__(self):
+            if self._sample_interval_us > 0:
+                return self._sample_interval_us / 1e6
+            return None
+        def __set__(self, sample_interval):
+            cdef long long interval_us
+            if sample_interval is None:
+                interval_us = 0
+            elif not sample_interval > 0:
+                raise ValueError(
+                    f'sample_interval = {sample_interval!r}: expected a '
+                    'positive number or `None`')
+            else:
+                interval_us = max(<long long>(sample_interval * 1e6), 1)
+            self._set_sample_interval_us(interval_us)
+            if interval_us:
+                self._sample_every = 0  # Sampling by time replaces count
+            self._sampling = (self._sample_every > 1
+                              or self._sample_interval_us > 0)
+
+    cdef int _set_sample_interval_us(self, long long interval_us) except -1:
+        """
+        Set ``._sample_interval_us``, and trade the reference to the
+        sampling clock (see sampling_clock.h) held for the old interval
+        for one for the new interval.
+        """
+        if interval_us == self._sample_interval_us:
+            return 0
+        if interval_us and lp_clock_acquire(interval_us) < 0:
+            raise RuntimeError(
+                'cannot start the thread for the sampling clock')
+        if self._sample_interval_us:
+            lp_clock_release(self._sample_interval_us)
+        self._sample_interval_us = interval_us
+        return 0
+
+    property histograms:
+        """
+        Whether to also keep a logarithmic histogram of the durations of
+        the hits of each line (see :py:mod:`line_profiler.histograms`),
+        so that the stats also have their percentiles and maxima
+        (:py:attr:`LineStats.histograms`).
+
+        Note:
+            The histograms are allocated along with the line slots
+            (i.e. upon the first event in a code block on each thread),
+            so that keeping them doesn't allocate on the hot path;
+            only the hits after turning this on are counted.
+        """
+        def __get__(self):
+            return bool(self._histograms)
+        def __set__(self, histograms):
+            self._histograms = bool(histograms)
+
+    property per_thread:
+        """
+        Whether to also report the timings of each thread separately
+        (:py:attr:`LineStats.thread_timings`), e.g. to tell apart the
+        workers of a thread pool.
+
+        Note:
+            The timings are kept per thread anyway (see
+            :c:type:`ThreadShard`), so this costs nothing on the hot
+            path: the threads are named (see
+            :py:attr:`threading.Thread.name`) upon their first profiled
+            event, and their timings are only merged separately in
+            :py:meth:`.get_stats` (but not :py:meth:`.get_stats_delta`).
+        """
+        def __get__(self):
+            return bool(self._per_thread)
+        def __set__(self, per_thread):
+            self._per_thread = bool(per_thread)
+
+    property self_time:
+        """
+        Whether to also report the self (exclusive) time of each line
+        (:py:attr:`LineStats.self_times`), i.e. the part of its
+        (inclusive) time not spent in the lines of the profiled code it
+        calls (directly or via unprofiled code) on the same thread, so
+        as to tell the lines which are slow apart from the lines which
+        call something slow.
+
+        Note:
+            * Each thread keeps a running sum of the self times of the
+              lines it timed, and each last-time record a snapshot of
+              it, so that the self time of a line is just its time
+              minus the growth of the sum meanwhile; this costs an
+              addition per line event, and nothing on call events.
+            * Time spent in unprofiled code (or in code profiled by
+              other profilers only) counts as self time of its caller.
+            * With :py:attr:`.sample_every` or
+              :py:attr:`.sample_interval`, the lines which happen not to
+              be sampled aren't subtracted from their callers, so the
+              self times are overestimated.
+            * Only the hits after turning this on are counted.
+        """
+        def __get__(self):
+            return bool(self._self_time)
+        def __set__(self, self_time):
+            self._self_time = bool(self_time)
+
+    property counters:
+        """
+        Names of the hardware events (see :py:data:`COUNTER_EVENTS`)
+        counted per line (:py:attr:`LineStats.counters`), as set upon
+        instantiation; the counts are inclusive like the times, i.e.
+        they include the events in the code each line calls into.
+
+        Note:
+            * Each thread opens a group of :manpage:`perf_event_open(2)`
+              counters (counting its user-space execution) upon its first
+              profiled event, which the trace callbacks read wherever
+              they read the timer: via ``rdpmc`` where the kernel allows
+              it (x86 only), and with a :manpage:`read(2)` system call
+              otherwise, which adds a few microseconds to each line
+              event (and to its time).
+            * Unprivileged counters require
+              ``/proc/sys/kernel/perf_event_paranoid`` to be at most 2;
+              :py:class:`OSError` is raised upon instantiation if the
+              counters can't be opened.
+            * The counts include the overhead of the trace callbacks.
+        """
+        def __get__(self):
+            return tuple([
+                lp_perf_event_name(self._counter_events[i]).decode('ascii')
+                for i in range(self._ncounters)])
+
+    property memory:
+        """
+        Whether to also account the memory allocations of each line
+        (:py:attr:`LineStats.memory`), as set upon instantiation: the
+        number of blocks allocated while the line was executing (on the
+        same thread), their total size in bytes, and the part of it
+        still retained (i.e. not freed since, by any code).
+
+        Note:
+            * While the profiler is enabled, a hook wraps the
+              :c:func:`PyMem_SetAllocator` allocators of the
+              ``PYMEM_DOMAIN_MEM`` and ``PYMEM_DOMAIN_OBJ`` domains
+              (i.e. the allocations of Python objects and buffers, but
+              not of :c:func:`PyMem_RawMalloc` or of extensions calling
+              :c:func:`malloc` directly), remembering the size and line
+              of each block allocated by profiled code so that its
+              release can be charged back.  This makes allocations (and
+              releases) a few times slower, but doesn't cost the trace
+              callbacks more than a pointer store per line event.
+            * Like the times, the allocations are inclusive, i.e. they
+              include those of the (unprofiled) code a line calls into;
+              those of the profiled code it calls into are charged to
+              the lines thereof instead.
+            * A line is followed until the next line event on its
+              thread, so with :py:attr:`.sample_every` or
+              :py:attr:`.sample_interval`, the lines which aren't
+              sampled are charged to the last sampled one.
+            * With several profilers accounting memory at once, the
+              allocations are only charged to one of the profilers
+              profiling the line.
+            * The blocks are forgotten when the last such profiler is
+              :py:meth:`.disable`-d, so that their later releases
+              aren't accounted for.
+            * Installing the hook while e.g. :py:mod:`tracemalloc` is
+              tracing is fine, but stopping the latter while profiling
+              can only leave our hook in place (passing through).
+        """
+        def __get__(self):
+            return bool(self._memory)
+
+    cdef int _set_counters(self, counters) except -1:
+        cdef lp_perf_group *group
+        cdef int events[LP_PERF_MAX_COUNTERS]
+        cdef int i, index
+        names = [counters] if isinstance(counters, str) else list(counters)
+        if len(names) > LP_PERF_MAX_COUNTERS:
+            raise ValueError(
+                f'counters = {counters!r}: at most {LP_PERF_MAX_COUNTERS} '
+                'events can be counted')
+        if len(set(names)) < len(names):
+            raise ValueError(f'counters = {counters!r}: duplicate events')
+        for i, name in enumerate(names):
+            index = -1
+            if isinstance(name, str) and name.isascii():
+                index = lp_perf_event_index(name.encode('ascii'))
+            if index < 0:
+                raise ValueError(
+                    f'counters = {counters!r}: unknown event {name!r} '
+                    f'(expected any of {COUNTER_EVENTS!r})')
+            events[i] = index
+        # Check that the counters can be opened at all (e.g. that
+        # they're permitted), instead of failing silently per thread
+        group = lp_perf_open(events, len(names))
+        if group == NULL:
+            errno = cerrno.errno
+            raise OSError(
+                errno, f'cannot open the hardware counters {names!r}: '
+                f'{os.strerror(errno)} (see '
+                '`/proc/sys/kernel/perf_event_paranoid`)')
+        lp_perf_close(group)
+        for i in range(len(names)):
+            self._counter_events[i] = events[i]
+        self._ncounters = len(names)
+        return 0
+
     property enable_count:
         def __get__(self):
             if not hasattr(self.threaddata, 'enable_count'):
@@ -1240,7 +2831,7 @@ datamodel.html#user-defined-functions
             # Make sure we have a manager
             manager = self._manager
             # Sync values between all thread states
-            for manager in self._managers.values():
+            for manager in list(self._managers.values()):
                 manager.wrap_trace = wrap_trace
 
     property set_frame_local_trace:
@@ -1250,21 +2841,27 @@ datamodel.html#user-defined-functions
             # Make sure we have a manager
             manager = self._manager
             # Sync values between all thread states
-            for manager in self._managers.values():
+            for manager in list(self._managers.values()):
                 manager.set_frame_local_trace = set_frame_local_trace
 
     property _manager:
         def __get__(self):
+            cdef PyObject *cached = lp_get_thread_manager()
+            if cached != NULL:
+                return <object>cached
             thread_id = PyThread_get_thread_ident()
             try:
-                return self._managers[thread_id]
+                manager = self._managers[thread_id]
             except KeyError:
                 pass
+            else:
+                lp_set_thread_manager(<PyObject *>manager)
+                return manager
             # First profiler instance on the thread, get the correct
             # `wrap_trace` and `set_frame_local_trace` values and set up
             # a `_LineProfilerManager`
             try:
-                manager, *_ = self._managers.values()
+                manager, *_ = list(self._managers.values())
             except ValueError:
                 # First thread in the interpretor: load default values
                 # from the environment (at package startup time)
@@ -1276,6 +2873,7 @@ datamodel.html#user-defined-functions
                 set_frame_local_trace = manager.set_frame_local_trace
             self._managers[thread_id] = manager = _LineProfilerManager(
                 self.tool_id, wrap_trace, set_frame_local_trace)
+            lp_set_thread_manager(<PyObject *>manager)
             return manager
 
     def enable_by_count(self):
@@ -1301,15 +2899,53 @@ datamodel.html#user-defined-functions
     def __exit__(self, exc_type, exc_val, exc_tb):
         self.disable_by_count()
 
+    property overhead:
+        """
+        Estimated overhead of the profiler (in seconds) included in the
+        time of each hit, as recorded in the stats; unless set, this is
+        only measured (see :py:func:`calibrate_overhead`) when first
+        needed, so that enabling the profiler doesn't run the
+        measurement.
+        """
+        def __get__(self):
+            if self._overhead is None:
+                return calibrate_overhead()
+            return self._overhead
+        def __set__(self, overhead):
+            self._overhead = None if overhead is None else float(overhead)
+
     def enable(self):
+        if self._memory and not self._mem_hooked:
+            if lp_mem_hook_acquire() < 0:
+                raise MemoryError
+            self._mem_hooked = True
         self._manager._handle_enable_event(self)
 
     @property
     def c_code_map(self):
         """
-        A Python view of the internal C lookup table.
+        A Python view of the internal C lookup table, mapping each line
+        hash to a dictionary of the line timings recorded thereunder.
         """
-        return <dict>self._c_code_map
+        cdef LineTimeBlock merged
+        cdef LineTime *entry
+        cdef size_t i
+        cdef dict py_code_map = {}
+        cdef vector[int64] block_hashes = self._get_block_hashes()
+
+        with _REGISTRATION_LOCK:
+            for line_hashes in self.code_hash_map.values():
+                for line_hash in line_hashes:
+                    py_code_map.setdefault(line_hash, {})
+        for block_hash in block_hashes:
+            merged.lines.clear()
+            self._merge_block(block_hash, &merged)
+            for i in range(merged.lines.size()):
+                entry = &(merged.lines[i])
+                if entry.nhits:
+                    py_code_map.setdefault(entry.code, {})[entry.lineno] = (
+                        deref(entry))
+        return py_code_map
 
     @property
     def c_last_time(self):
@@ -1318,14 +2954,28 @@ datamodel.html#user-defined-functions
             KeyError
                 If no profiling data is available on the current thread.
         """
-        try:
-            return (<dict>self._c_last_time)[PyThread_get_thread_ident()]
-        except KeyError as e:
+        cdef ThreadShard *shard = <ThreadShard *>self._c_shards.get(
+            lp_thread_index())
+        cdef const BlockInfo *info
+        cdef LineTimeBlock *block
+        cdef dict py_last_time = {}
+        cdef vector[int64] block_hashes
+
+        if shard == NULL:
             # We haven't actually profiled anything yet
-            raise (KeyError('No profiling data on the current thread '
-                            '(`threading.get_ident()` = '
-                            f'{threading.get_ident()})')
-                   .with_traceback(e.__traceback__)) from None
+            raise KeyError('No profiling data on the current thread '
+                           '(`threading.get_ident()` = '
+                           f'{threading.get_ident()})')
+        # Note: only the current thread writes to its shard, so no need
+        # to lock it
+        block_hashes = self._get_block_hashes()
+        for block_hash in block_hashes:
+            info = self._c_code_map.find(block_hash)
+            if <size_t>info.index < shard.blocks.size():
+                block = &(shard.blocks[info.index])
+                if block.has_last:
+                    py_last_time[block_hash] = block.last
+        return py_last_time
 
     @property
     def code_map(self):
@@ -1334,19 +2984,33 @@ datamodel.html#user-defined-functions
         :py:attr:`~.code_map`, but this will construct something similar
         for backwards compatibility.
         """
-        c_code_map = self.c_code_map
-        code_hash_map = self.code_hash_map
+        cdef LineTimeBlock merged
+        cdef LineTime *entry
+        cdef size_t i
+        cdef dict py_entries
+
+        with _REGISTRATION_LOCK:
+            code_blocks = list(self._code_blocks.items())
         py_code_map = {}
-        for code, code_hashes in code_hash_map.items():
-            py_code_map.setdefault(code, {})
-            for code_hash in code_hashes:
-                c_entries = c_code_map[code_hash]
-                py_entries = {}
-                for key, c_entry in c_entries.items():
-                    py_entry = c_entry.copy()
-                    py_entry['code'] = code
-                    py_entries[key] = py_entry
-                py_code_map[code].update(py_entries)
+        for block_hash, code in code_blocks:
+            # Note: code objects comparing equal share the entry
+            py_entries = py_code_map.setdefault(code, {})
+            merged.lines.clear()
+            self._merge_block(block_hash, &merged)
+            for i in range(merged.lines.size()):
+                entry = &(merged.lines[i])
+                if not entry.nhits:
+                    continue
+                if entry.lineno in py_entries:
+                    py_entries[entry.lineno]['total_time'] += (
+                        entry.total_time)
+                    py_entries[entry.lineno]['nhits'] += entry.nhits
+                    continue
+                py_entries[entry.lineno] = {
+                    'code': code,
+                    'lineno': entry.lineno,
+                    'total_time': entry.total_time,
+                    'nhits': entry.nhits}
         return py_code_map
 
     @property
@@ -1358,124 +3022,847 @@ datamodel.html#user-defined-functions
         """
         c_last_time = self.c_last_time
         py_last_time = {}
-        for code in self.code_hash_map:
-            block_hash = hash(code.co_code)
+        with _REGISTRATION_LOCK:
+            code_blocks = list(self._code_blocks.items())
+        for block_hash, code in code_blocks:
             if block_hash in c_last_time:
                 py_last_time[code] = c_last_time[block_hash]
         return py_last_time
 
     cpdef disable(self):
-        self._c_last_time[PyThread_get_thread_ident()].clear()
+        # Note: a thread which never profiled has no shard (and doesn't
+        # need one) to clear
+        cdef ThreadShard *shard = <ThreadShard *>self._c_shards.get(
+            lp_thread_index())
+        if shard != NULL:
+            shard_clear_last(shard)
+        if self._mem_hooked:
+            lp_mem_set_current(lp_mem_ref_to(NULL))
+            lp_mem_hook_release()
+            self._mem_hooked = False
         self._manager._handle_disable_event(self)
 
     def get_stats(self):
         """
         Returns:
             :py:class:`LineStats` object containing the timings.
+
+        Note:
+            The per-thread timings of the code blocks (and of code
+            objects sharing the same label, which are reported
+            together) are summed into a dense array indexed by line
+            number, so that the entries come out merged and sorted
+            without intermediate Python objects; with
+            :py:attr:`.per_thread`, they are also summed separately
+            for each thread (see :py:attr:`LineStats.thread_timings`).
+        """
+        cdef LineTimeBlock merged
+        cdef LineTime *entry
+        cdef PY_LONG_LONG count
+        cdef size_t i, k, ncounters
+        cdef list entries
+
+        with _REGISTRATION_LOCK:
+            code_blocks = list(self._code_blocks.items())
+        # Group the code blocks by label
+        blocks_by_key = {}
+        for block_hash, code in code_blocks:
+            blocks_by_key.setdefault(label(code), []).append(block_hash)
+
+        stats = {}
+        histograms = {}
+        self_times = {}
+        event_names = self.counters
+        counters = {name: {} for name in event_names}
+        for key, block_hashes in blocks_by_key.items():
+            merged.lines.clear()
+            merged.hist.clear()
+            merged.counts.clear()
+            for block_hash in block_hashes:
+                self._merge_block(block_hash, &merged)
+            stats[key] = entries = []
+            ncounters = 0
+            if not merged.counts.empty():
+                ncounters = merged.counts.size() // merged.lines.size()
+            if not merged.hist.empty():
+                histograms[key] = line_hists = {}
+            if self._self_time:
+                self_times[key] = line_self_times = {}
+            for i in range(merged.lines.size()):
+                entry = &(merged.lines[i])
+                if entry.nhits:
+                    entries.append(
+                        (entry.lineno, entry.nhits, entry.total_time))
+                    if not merged.hist.empty():
+                        line_hists[entry.lineno] = (
+                            entry.max_time, get_hist_counts(&merged, entry))
+                    if self._self_time:
+                        line_self_times[entry.lineno] = entry.self_time
+                    for k in range(ncounters):
+                        # Note: like in the files, the lines (and the
+                        # functions) without counts are left out
+                        count = merged.counts[i * ncounters + k]
+                        if count:
+                            counters[event_names[k]].setdefault(
+                                key, {})[entry.lineno] = count
+        thread_timings = None
+        if self._per_thread:
+            thread_timings = self._get_thread_timings(blocks_by_key)
+        return LineStats(stats, self.timer_unit, self._overhead, histograms,
+                         thread_timings, self_times, counters,
+                         self._get_memory(blocks_by_key))
+
+    def get_stats_delta(self):
+        """
+        Returns:
+            :py:class:`LineStats` object containing the changes in the
+            timings since the last call (or since profiling started):
+            the lines whose hits changed and the differences in their
+            hits and times, and (with no lines) the functions not seen
+            by a previous call.
+
+        Note:
+            Summing the results of all the calls gives the timings of
+            :py:meth:`.get_stats`. The unchanged lines are skipped
+            without creating Python objects for them, which makes this
+            much cheaper than :py:meth:`.get_stats` for taking periodic
+            snapshots when few lines run in between.  With
+            :py:attr:`.memory`, the lines whose allocation counters
+            changed are reported too (in :py:attr:`LineStats.memory`),
+            and their retained bytes may shrink, i.e. be negative.  With
+            :py:attr:`.per_thread`, the changes in the per-thread
+            timings are reported too (in
+            :py:attr:`LineStats.thread_timings`); unlike the overall
+            ones, they are computed from Python objects.
         """
-        cdef dict cmap = self._c_code_map
+        cdef LineTimeBlock merged
+        cdef LineTimeBlock *reported
+        cdef LineTime *entry
+        cdef LineTime *prev
+        cdef long nhits
+        cdef PY_LONG_LONG total_time, self_time, count
+        cdef bint is_new, has_prev_counts
+        cdef size_t i, k, ncounters
 
         all_entries = {}
-        for code in self.code_hash_map:
-            entries = []
-            for entry in self.code_hash_map[code]:
-                entries.extend(cmap[entry].values())
-            key = label(code)
-
-            # Merge duplicate line numbers, which occur for branch
-            # entrypoints like `if`
-            entries_by_lineno = all_entries.setdefault(key, {})
-
-            for line_dict in entries:
-                 _, lineno, total_time, nhits = line_dict.values()
-                 orig_nhits, orig_total_time = entries_by_lineno.get(
-                     lineno, (0, 0))
-                 entries_by_lineno[lineno] = (orig_nhits + nhits,
-                                              orig_total_time + total_time)
-
-        # Aggregate the timing data
+        all_hists = {}
+        all_self_times = {}
+        event_names = self.counters
+        all_counters = {name: {} for name in event_names}
+        # Also serializes the updates to `._c_reported`
+        with _REGISTRATION_LOCK:
+            code_blocks = list(self._code_blocks.items())
+            for block_hash, code in code_blocks:
+                merged.lines.clear()
+                merged.hist.clear()
+                merged.counts.clear()
+                self._merge_block(block_hash, &merged)
+                ncounters = 0
+                if not merged.counts.empty():
+                    ncounters = merged.counts.size() // merged.lines.size()
+                is_new = not self._c_reported.count(block_hash)
+                reported = &(self._c_reported[block_hash])
+                has_prev_counts = (
+                    ncounters and reported.counts.size()
+                    == ncounters * reported.lines.size())
+                entries_by_lineno = None
+                if is_new:
+                    entries_by_lineno = all_entries.setdefault(label(code), {})
+                for i in range(merged.lines.size()):
+                    entry = &(merged.lines[i])
+                    nhits = entry.nhits
+                    total_time = entry.total_time
+                    self_time = entry.self_time
+                    prev = block_get_entry(reported, entry.lineno)
+                    if prev != NULL:
+                        nhits -= prev.nhits
+                        total_time -= prev.total_time
+                        self_time -= prev.self_time
+                    if not nhits and not total_time:
+                        continue
+                    if entries_by_lineno is None:
+                        entries_by_lineno = all_entries.setdefault(
+                            label(code), {})
+                    lineno = entry.lineno
+                    orig_nhits, orig_total_time = entries_by_lineno.get(
+                        lineno, (0, 0))
+                    entries_by_lineno[lineno] = (orig_nhits + nhits,
+                                                 orig_total_time + total_time)
+                    if self._self_time or self_time:
+                        line_self_times = all_self_times.setdefault(
+                            label(code), {})
+                        line_self_times[lineno] = (
+                            line_self_times.get(lineno, 0) + self_time)
+                    for k in range(ncounters):
+                        count = merged.counts[i * ncounters + k]
+                        if prev != NULL and has_prev_counts:
+                            count -= reported.counts[
+                                (prev - &(reported.lines[0])) * ncounters + k]
+                        if not count:
+                            continue
+                        line_counts = all_counters[
+                            event_names[k]].setdefault(label(code), {})
+                        line_counts[lineno] = (
+                            line_counts.get(lineno, 0) + count)
+                    if merged.hist.empty():
+                        continue
+                    # Note: the maxima can't be "subtracted", but they
+                    # combine by taking the larger one
+                    counts = get_hist_counts(&merged, entry, reported, prev)
+                    line_hists = all_hists.setdefault(label(code), {})
+                    if lineno in line_hists:
+                        orig_max_time, orig_counts = line_hists[lineno]
+                        for bucket, count in counts.items():
+                            orig_counts[bucket] = (
+                                orig_counts.get(bucket, 0) + count)
+                        line_hists[lineno] = (
+                            max(orig_max_time, entry.max_time), orig_counts)
+                    else:
+                        line_hists[lineno] = (entry.max_time, counts)
+                reported.first_lineno = merged.first_lineno
+                reported.lines.swap(merged.lines)
+                reported.hist.swap(merged.hist)
+                reported.counts.swap(merged.counts)
+            blocks_by_key = {}
+            for block_hash, code in code_blocks:
+                blocks_by_key.setdefault(label(code), []).append(block_hash)
+            memory = self._get_memory(blocks_by_key, delta=True)
+            thread_timings = None
+            if self._per_thread:
+                thread_timings = self._get_thread_timings_delta(
+                    blocks_by_key)
+
         stats = {
             key: sorted((line, nhits, time)
                         for line, (nhits, time) in entries_by_lineno.items())
             for key, entries_by_lineno in all_entries.items()}
-        return LineStats(stats, self.timer_unit)
+        return LineStats(stats, self.timer_unit, self._overhead, all_hists,
+                         thread_timings, all_self_times, all_counters,
+                         memory)
+
+    def _get_live_layout(self):
+        """
+        Returns:
+            List of ``(key, block_hashes, first_lineno, nlines)`` tuples,
+            one for each profiled function (with the code objects
+            sharing its label merged), where the lines ``first_lineno``
+            to ``first_lineno + nlines - 1`` span those of its code
+            blocks; see :py:class:`line_profiler.live.LivePublisher`.
+        """
+        cdef const BlockInfo *info
+        cdef int first, last
+
+        with _REGISTRATION_LOCK:
+            code_blocks = list(self._code_blocks.items())
+        blocks_by_key = {}
+        for block_hash, code in code_blocks:
+            blocks_by_key.setdefault(label(code), []).append(block_hash)
+        layout = []
+        for key, block_hashes in blocks_by_key.items():
+            first, last = 0, -1
+            for block_hash in block_hashes:
+                info = self._c_code_map.find(block_hash)
+                if info == NULL or not info.nlines:
+                    continue
+                if last < first:
+                    first = info.first_lineno
+                    last = first + info.nlines - 1
+                else:
+                    first = min(first, info.first_lineno)
+                    last = max(last, info.first_lineno + info.nlines - 1)
+            layout.append((key, tuple(block_hashes), first, last - first + 1))
+        return layout
+
+    def _fill_live_counters(self, list layout, long long[::1] counters):
+        """
+        Write the current line timings of the functions described by
+        ``layout`` (see :py:meth:`._get_live_layout`) into
+        ``counters``, as consecutive ``(nhits, total_time)`` pairs for
+        each of their lines in order.
+
+        Returns:
+            Whether ``layout`` was up to date; if not (e.g. because a
+            code block has since grown), the contents of ``counters``
+            are incomplete.
+
+        Note:
+            Like :py:meth:`.get_stats`, this sums the per-thread
+            timings, but without building any Python object, so that it
+            can be called frequently.
+        """
+        cdef LineTimeBlock merged
+        cdef LineTime *entry
+        cdef Py_ssize_t slot = 0
+        cdef Py_ssize_t nlines, index, j
+        cdef int first_lineno
+        cdef size_t i
+
+        for _, block_hashes, first_lineno, nlines in layout:
+            if 2 * (slot + nlines) > counters.shape[0]:
+                return False
+            for j in range(2 * slot, 2 * (slot + nlines)):
+                counters[j] = 0
+            merged.lines.clear()
+            for block_hash in block_hashes:
+                self._merge_block(block_hash, &merged)
+            for i in range(merged.lines.size()):
+                entry = &(merged.lines[i])
+                if not entry.nhits:
+                    continue
+                index = entry.lineno - first_lineno
+                if index < 0 or index >= nlines:
+                    return False
+                counters[2 * (slot + index)] = entry.nhits
+                counters[2 * (slot + index) + 1] = entry.total_time
+            slot += nlines
+        return True
+
+    cdef void _reinit_after_fork(self) noexcept:
+        """
+        Reset the locks of the instance in a forked child, and reopen
+        the hardware counters of the forking thread (the child inherits
+        the file descriptors, but they count the parent).
+        """
+        cdef ThreadShardMap.iterator it = self._c_shard_store.begin()
+        cdef ThreadShard *shard
+        cdef unsigned long ident = PyThread_get_thread_ident()
+        lp_mutex_reinit(&self._c_lock)
+        while it != self._c_shard_store.end():
+            shard = &(deref(it).second)
+            lp_mutex_reinit(&(shard.lock))
+            if shard.perf != NULL:
+                lp_perf_close(shard.perf)
+                shard.perf = NULL
+                if shard.thread_ident == ident:
+                    shard.perf = lp_perf_open(self._counter_events,
+                                              self._ncounters)
+            inc(it)
+
+
+def _after_fork_in_child():
+    """
+    Restore the module state in a forked child, where only the thread
+    which forked is left: reset the locks the other threads may have
+    held, and restart the sampling clock.
+
+    Note:
+        The profilers keep their timings and stay enabled (on the
+        forking thread) in the child; see
+        :py:mod:`line_profiler.workers` for collecting the timings of
+        the child separately.
+    """
+    global _REGISTRATION_LOCK, _CALIBRATION_LOCK
+    _REGISTRATION_LOCK = threading.RLock()
+    _CALIBRATION_LOCK = threading.RLock()
+    lp_mutex_reinit(&_CODE_INFO_LOCK)
+    lp_mutex_reinit(&_DISPATCH_LOCK)
+    lp_mem_after_fork()
+    for prof in list(_LIVE_PROFILERS):
+        (<LineProfiler>prof)._reinit_after_fork()
+    if lp_clock_after_fork() < 0:
+        warn('cannot restart the thread for the sampling clock in the '
+             'forked child; time-based sampling will stop')
+
+
+if hasattr(os, 'register_at_fork'):  # POSIX
+    os.register_at_fork(after_in_child=_after_fork_in_child)
+
+
+cdef int reap_exited_threads() except -1:
+    """
+    Retire the data of the threads which have exited from all the
+    profilers (see :py:meth:`LineProfiler._retire_thread`), and hand
+    their indices (see :c:func:`lp_thread_index`) back for reuse, so
+    that neither grows with the number of threads ever started.
+    """
+    cdef vector[Py_ssize_t] tidxs
+    cdef size_t i
+    lp_thread_reap(&tidxs)
+    if tidxs.empty():
+        return 0
+    profs = list(_LIVE_PROFILERS)
+    for i in range(tidxs.size()):
+        for prof in profs:
+            (<LineProfiler>prof)._retire_thread(tidxs[i])
+        lp_thread_recycle(tidxs[i])
+    return 0
+
+
+cdef inline ThreadShard *get_thread_shard(
+        LineProfiler prof, Py_ssize_t tidx) except NULL:
+    """
+    Get the :c:type:`ThreadShard` of ``prof`` for the thread with the
+    index ``tidx`` (see :c:func:`lp_thread_index`), creating it upon
+    first access.
+
+    Note:
+        Only the thread ``tidx`` itself calls this, so there is no race
+        in creating the shard; the lock is for the other threads
+        creating or reading theirs.
+    """
+    cdef ThreadShard *shard = <ThreadShard *>prof._c_shards.get(tidx)
+    if shard != NULL:
+        return shard
+    # Note: this is the first event of the thread for the profiler, and
+    # a good time to clean up after the threads which have exited
+    reap_exited_threads()
+    lp_mutex_lock(&prof._c_lock)
+    try:
+        shard = &(prof._c_shard_store[tidx])
+        shard.thread_ident = PyThread_get_thread_ident()
+        if prof._ncounters:
+            # Note: best-effort; if the counters can't be opened on
+            # this thread, its lines just aren't counted
+            shard.perf = lp_perf_open(prof._counter_events,
+                                      prof._ncounters)
+        prof._c_shards.set(tidx, shard)
+    finally:
+        lp_mutex_unlock(&prof._c_lock)
+    if prof._per_thread:
+        # Note: only once per thread, and best-effort (the names are
+        # only for display)
+        try:
+            prof._thread_names[tidx] = threading.current_thread().name
+        except Exception:
+            pass
+    return shard
+
+
+cdef inline long take_sample(LineProfiler prof, ThreadShard *shard) noexcept:
+    """
+    Count a line event in the sampling mode of ``prof``.
+
+    Returns:
+        The weight of the sample (i.e. the number of events since the
+        previous one) if the event is to be timed, 0 otherwise.
+    """
+    cdef long weight
+    cdef long long now
+    shard.sample_events += 1
+    if prof._sample_every > 1:
+        if shard.sample_events < prof._sample_every:
+            return 0
+    else:
+        now = lp_clock_now()
+        if now - shard.sample_time < prof._sample_interval_us:
+            return 0
+        shard.sample_time = now
+    weight = shard.sample_events
+    shard.sample_events = 0
+    return weight
+
+
+cdef inline void merge_shard_block(
+        ThreadShard *shard, const BlockInfo *info,
+        LineTimeBlock *out) noexcept:
+    """
+    Sum the line timings (and histograms and counts) of the code block
+    described by ``info`` in ``shard`` into ``out`` (with the line slots
+    for the block), locking the shard.
+    """
+    cdef LineTimeBlock *block
+    cdef LineTime *entry
+    cdef LineTime *total
+    cdef size_t nbuckets = LP_HIST_BUCKETS
+    cdef size_t ncounters
+    cdef size_t i, j, src, dst
+    lp_mutex_lock(&shard.lock)
+    if <size_t>info.index < shard.blocks.size():
+        block = &(shard.blocks[info.index])
+        for i in range(block.lines.size()):
+            entry = &(block.lines[i])
+            if not entry.nhits:
+                continue
+            total = block_get_entry(out, entry.lineno)
+            if total == NULL:
+                continue
+            total.nhits += entry.nhits
+            total.total_time += entry.total_time
+            total.self_time += entry.self_time
+            if entry.max_time > total.max_time:
+                total.max_time = entry.max_time
+            if not (block.counts.empty() or out.counts.empty()):
+                ncounters = block.counts.size() // block.lines.size()
+                if out.counts.size() == ncounters * out.lines.size():
+                    src = i * ncounters
+                    dst = (total - &(out.lines[0])) * ncounters
+                    for j in range(ncounters):
+                        out.counts[dst + j] += block.counts[src + j]
+            if block.hist.empty() or out.hist.empty():
+                continue
+            src = i * nbuckets
+            dst = (total - &(out.lines[0])) * nbuckets
+            for j in range(nbuckets):
+                out.hist[dst + j] += block.hist[src + j]
+    lp_mutex_unlock(&shard.lock)
+
+
+cdef inline LineTimeBlock *get_shard_block(
+        ThreadShard *shard, const BlockInfo *info,
+        int64 block_hash, bint histograms, int ncounters=0,
+        bint memory=False) except NULL:
+    """
+    Get the :c:type:`LineTimeBlock` in ``shard`` for the code block
+    described by ``info``, (re-)allocating its line slots (and, with
+    ``histograms``, their histograms, with ``ncounters``, their
+    hardware-counter counts, and with ``memory``, their allocation
+    counters) as needed.
+    """
+    cdef LineTimeBlock *block
+    if <size_t>info.index < shard.blocks.size():
+        block = &(shard.blocks[info.index])
+        if (block.lines.size() == <size_t>info.nlines
+                and not (histograms and block.hist.empty())
+                and not (ncounters and block.counts.empty())
+                and not (memory and block.mem.empty())):
+            return block
+    # Slow path: lock out `LineProfiler._merge_block()` while
+    # reallocating
+    lp_mutex_lock(&shard.lock)
+    try:
+        if <size_t>info.index >= shard.blocks.size():
+            shard.blocks.resize(info.index + 1)
+        block = &(shard.blocks[info.index])
+        ensure_block_lines(block, block_hash, info.first_lineno,
+                           info.first_lineno + info.nlines - 1, histograms,
+                           ncounters, memory)
+    finally:
+        lp_mutex_unlock(&shard.lock)
+    return block
+
+
+cdef inline void record_hist(
+        LineTimeBlock *block, LineTime *entry, PY_LONG_LONG delta) noexcept:
+    """
+    Count a hit of ``delta`` timer units (standing for ``block.weight``
+    hits) in the histogram of the line ``entry`` of ``block``, if it
+    has been allocated.
+    """
+    cdef size_t index = entry - &(block.lines[0])
+    if block.hist.empty():
+        return
+    block.hist[index * LP_HIST_BUCKETS + lp_hist_bucket(delta)] += (
+        block.weight)
+    if delta > entry.max_time:
+        entry.max_time = delta
+
+
+cdef inline void record_self_time(
+        ThreadShard *shard, LineTimeBlock *block, LineTime *entry,
+        PY_LONG_LONG time) noexcept:
+    """
+    Add the self time of the hit of the line ``entry`` of ``block``
+    ending at ``time``, i.e. its time minus the self times of the lines
+    timed on the thread since it started (those of the profiled code it
+    called, directly or not), to the line and to ``shard.self_total``.
+
+    Note:
+        Since the self times of the lines timed in the meantime add up
+        to the time spent in them, this needs neither a call stack nor
+        the call events: a running sum per thread, and a snapshot
+        thereof in each last-time record, suffice.
+    """
+    cdef PY_LONG_LONG delta = (time - block.last.time
+                               - (shard.self_total - block.last.nested))
+    if delta < 0:
+        delta = 0
+    entry.self_time += block.weight * delta
+    shard.self_total += delta
+
+
+cdef inline void record_counts(
+        ThreadShard *shard, LineTimeBlock *block, LineTime *entry) noexcept:
+    """
+    Add the growth of the hardware counters of ``shard`` since the
+    last-time record of ``block`` opened to the counts of the line
+    ``entry``, if they have been allocated.
+    """
+    cdef PY_LONG_LONG now[LP_PERF_MAX_COUNTERS]
+    cdef PY_LONG_LONG delta
+    cdef size_t n, index, k
+    if block.counts.empty():
+        return
+    n = shard.perf.n
+    index = (entry - &(block.lines[0])) * n
+    for k in range(n):
+        now[k] = block.last.counts[k]
+    lp_perf_read(shard.perf, now)
+    for k in range(n):
+        delta = now[k] - block.last.counts[k]
+        if delta > 0:
+            block.counts[index + k] += block.weight * delta
+
+
+cdef inline void stamp_pending(
+        LineTimeBlock **pending, lp_perf_group **pending_perf,
+        size_t npending) noexcept:
+    """
+    Stamp the new last-time records of the ``pending`` blocks with the
+    time, and those with a counter group in ``pending_perf`` with the
+    counts.
+    """
+    cdef PY_LONG_LONG time
+    cdef size_t j
+    # Note: read the counters first and the timer last, so that the
+    # counter reads aren't timed
+    for j in range(npending):
+        if pending_perf[j] != NULL:
+            lp_perf_read(pending_perf[j], pending[j].last.counts)
+    time = hpTimer()
+    for j in range(npending):
+        pending[j].last.time = time
+
+
+cdef inline lp_mem_line *get_mem_line(
+        LineMemMap *table, LineTimeBlock *block, int lineno) noexcept:
+    """
+    Get the allocation counters in ``table`` of the line ``lineno`` of
+    ``block``, looking them up upon first use (and caching them in
+    ``block.mem``); ``NULL`` for lines outside of the block (or if out
+    of memory).
+    """
+    cdef LineTime *entry = block_get_entry(block, lineno)
+    cdef size_t index
+    if entry == NULL or block.mem.empty():
+        return NULL
+    index = entry - &(block.lines[0])
+    if block.mem[index] == NULL:
+        block.mem[index] = lp_mem_table_line(table, entry.code)
+    return block.mem[index]
+
+
+cdef int block_switch_frame(LineTimeBlock *block, void *frame) except -1:
+    """
+    Make ``block.last`` the record of ``frame`` (if any), setting aside
+    that of the frame which last executed the block.
+
+    Note:
+        This is only invoked when different frames take turns executing
+        the block (e.g. in recursion, or with interleaved generators or
+        coroutines), so that the common case is just a pointer
+        comparison.
+    """
+    cdef pair[void*, ParkedRecord] parking
+    cdef unordered_map[void*, ParkedRecord].iterator it
+    cdef ParkedRecord *record
+    if block.has_last:
+        parking.first = block.last_frame
+        parking.second.last = block.last
+        parking.second.weight = block.weight
+        parking.second.resumed = block.last_resumed
+        parking.second.mem_caller = block.mem_caller
+        # Note: a frame is never parked twice, since it is unparked
+        # whenever it becomes `.last_frame`
+        block.parked.insert(parking)
+        block.has_last = False
+    block.last_frame = frame
+    if block.parked.empty():
+        return 0
+    it = block.parked.find(frame)
+    if it == block.parked.end():
+        return 0
+    record = &(deref(it).second)
+    block.last = record.last
+    block.weight = record.weight
+    block.last_resumed = record.resumed
+    block.mem_caller = record.mem_caller
+    block.has_last = True
+    block.parked.erase(it)
+    return 0
+
+
+cdef enum:
+    # How many new last-time records `inner_trace_callback()` may hold
+    # before stamping them with the time
+    _MAX_PENDING_RECORDS = 16
+
+cdef enum:
+    # What the trace events passed to `inner_trace_callback()` mean for
+    # the frame
+    _START_LINE = 0  # Starts executing a new line
+    _EXIT_FRAME  # Returns, yields, or raises
+    _RESUME_FRAME  # (Generators and coroutines) Resumes after yielding
 
 
 @cython.boundscheck(False)
 @cython.wraparound(False)
-cdef inline void inner_trace_callback(
-        int is_line_event, set instances, object code, int lineno):
+cdef inline bint inner_trace_callback(
+        int event, vector[void*] *instances,
+        object code, int lineno, void *frame):
     """
     The basic building block for the trace callbacks.
+
+    Arguments:
+        event (int)
+            What happens to ``frame``: ``_START_LINE``, ``_EXIT_FRAME``,
+            or ``_RESUME_FRAME``
+        instances (vector[void*] *)
+            Snapshot of the active profilers
+        code (CodeType)
+            Code executed by ``frame``
+        lineno (int)
+            Line of ``code`` which ``frame`` is at
+        frame (void *)
+            Opaque key identifying the frame
+
+    Returns:
+        Whether any of the active profilers profiles ``code``.
+
+    Note:
+        * ``instances`` is a snapshot of the active profilers (see
+          :c:type:`InstanceSnapshots`); the pointers are borrowed, and
+          deliberately cast on access instead of being assigned to
+          object variables, so as to not touch the refcounts of the
+          profilers (which on free-threaded builds all threads would
+          contend for).
+        * The event is dispatched (via :c:type:`BlockDispatch`) only to
+          the profilers which registered the code, and the timer is
+          read at most twice however many of them there are: once to
+          close the previous records, and once to open the new ones.
+        * The last-time records are kept per frame, so that frames
+          executing the same code do not clobber one another's (see
+          :c:func:`block_switch_frame`).  A generator or coroutine
+          which yields closes its record, so that the time it spends
+          suspended isn't counted; when it resumes, a record is opened
+          anew at the line it resumes on, which charges the time until
+          its next line event to said line (without counting another
+          hit).
+        * For the profilers with :py:attr:`LineProfiler.memory`, the
+          line being executed is also made current on the thread for
+          the allocation hook (see alloc_hook.h), and a frame leaving
+          the code makes the line which was current upon its entry
+          current again; this is done once for all the profilers, after
+          the loop, so that they all see the same caller.
     """
-    cdef LineProfiler prof_
-    cdef LineProfiler prof
-    cdef LastTime old
-    cdef int key
+    cdef void *prof
     cdef PY_LONG_LONG time = 0
     cdef bint has_time = False
-    cdef bint has_last
-    cdef int64 code_hash
-    cdef object py_bytes_obj = code.co_code
-    cdef char* data = PyBytes_AS_STRING(py_bytes_obj)
-    cdef Py_ssize_t size = PyBytes_GET_SIZE(py_bytes_obj)
-    cdef unsigned long ident
-    cdef Py_hash_t block_hash
+    cdef Py_ssize_t tidx = -1
+    cdef long weight
+    cdef int64 block_hash
+    cdef const vector[void*] *targets
     cdef LineTime* entry
-    cdef LineTimeMap* line_entries
-    cdef LastTimeMap* last_map
-
-    # Loop over every byte to check if any are not NULL
-    # if there are any non-NULL, that indicates we're profiling Python code
-    for i in range(size):
-        if data[i]:
-            # because we use Python functions like hash, we CANNOT mark this function as nogil
-            block_hash = hash(py_bytes_obj)
-            break
-    else:
-        # fallback for Cython functions
-        block_hash = hash(code)
-
-    code_hash = compute_line_hash(block_hash, lineno)
-
-    for prof_ in instances:
-        # for some reason, doing this is much faster than just combining it into the above
-        # like doing "for prof in instances:" is far slower
-        prof = <LineProfiler>prof_
-        if not prof._c_code_map.count(code_hash):
+    cdef LineTimeBlock* block
+    cdef LineTimeBlock* pending[_MAX_PENDING_RECORDS]
+    cdef lp_perf_group* pending_perf[_MAX_PENDING_RECORDS]
+    cdef size_t npending = 0
+    cdef lp_mem_ref mem_next
+    cdef bint mem_switch = False
+    cdef bint wanted = False
+    cdef ThreadShard* shard
+    cdef const BlockInfo *info
+    cdef size_t i, j
+
+    if deref(instances).empty():
+        return False
+    # Note: on free-threaded builds, leave the caching to
+    # `LineProfiler.add_function()` (which primes the cache for the
+    # profiled code) to minimize the writes to the code objects
+    block_hash = get_block_hash(code, not LP_FREE_THREADING)
+    targets = _BLOCK_DISPATCH.find(block_hash)
+    if targets == NULL:
+        return False
+
+    for i in range(deref(targets).size()):
+        prof = deref(targets)[i]
+        # Only the profilers in the snapshot are known to be alive (and
+        # active)
+        if not lp_contains(instances, prof):
+            continue
+        info = (<LineProfiler>prof)._c_code_map.find(block_hash)
+        if info == NULL:
             continue
-        if not has_time:
-            time = hpTimer()
-            has_time = True
-        ident = PyThread_get_thread_ident()
-        last_map = &(prof._c_last_time[ident])
-        # deref() is Cython's version of the -> accessor in C++. if we don't use deref then
-        # Cython thinks that when we index last_map,
-        # we want pointer indexing (which is not the case)
-        if deref(last_map).count(block_hash):
-            old = deref(last_map)[block_hash]
-            line_entries = &(prof._c_code_map[code_hash])
-            # Ensure that an entry exists in line_entries before accessing it
-            entry = line_ensure_entry(line_entries, old.f_lineno, code_hash)
-            # Note: explicitly `deref()`-ing here causes the new values
-            # to be assigned to a temp var;
-            # meanwhile, directly dot-accessing a pointer causes Cython
-            # to correctly write `ptr->attr = (ptr->attr + incr)`
-            entry.nhits += 1
-            entry.total_time += time - old.time
-            has_last = True
+        wanted = True
+        if tidx < 0:
+            tidx = lp_thread_index()
+        # The per-thread data is reached by indexing (instead of
+        # hashing the thread ID), and only merged in `get_stats()`
+        shard = get_thread_shard(<LineProfiler>prof, tidx)
+        block = get_shard_block(
+            shard, info, block_hash, (<LineProfiler>prof)._histograms,
+            (<LineProfiler>prof)._ncounters, (<LineProfiler>prof)._memory)
+        if block.last_frame != frame:
+            block_switch_frame(block, frame)
+        if block.has_last:
+            if not has_time:
+                time = hpTimer()
+                has_time = True
+            # The slots are pre-allocated, so this is just an index into
+            # the block (or `NULL` for lines outside of it)
+            entry = block_get_entry(block, block.last.f_lineno)
+            if entry != NULL:
+                # Note: explicitly `deref()`-ing here causes the new
+                # values to be assigned to a temp var;
+                # meanwhile, directly dot-accessing a pointer causes
+                # Cython to correctly write `ptr->attr = (ptr->attr +
+                # incr)`
+                if not block.last_resumed:
+                    entry.nhits += block.weight
+                # Records opened upon resumption only add time, and only
+                # to lines which have been hit (e.g. not to the `def`
+                # line upon first entering a generator with the legacy
+                # trace system), lest we report timed lines without hits
+                if entry.nhits:
+                    entry.total_time += block.weight * (time - block.last.time)
+                    if ((<LineProfiler>prof)._histograms
+                            and not block.last_resumed):
+                        record_hist(block, entry, time - block.last.time)
+                    if (<LineProfiler>prof)._self_time:
+                        record_self_time(shard, block, entry, time)
+                    if shard.perf != NULL:
+                        record_counts(shard, block, entry)
+        if event == _START_LINE:
+            if (<LineProfiler>prof)._sampling:
+                # Cheap path: no timing for the events not sampled
+                weight = take_sample(<LineProfiler>prof, shard)
+                if not weight:
+                    block.has_last = False
+                    continue
+            else:
+                weight = 1
+            block.last_resumed = False
+        elif event == _RESUME_FRAME and not (<LineProfiler>prof)._sampling:
+            # Note: the sampled estimates don't need the partial line
+            weight = 1
+            block.last_resumed = True
         else:
-            has_last = False
-        if is_line_event:
-            # Get the time again. This way, we don't record much time
-            # wasted in this function.
-            deref(last_map)[block_hash] = LastTime(lineno, hpTimer())
-        elif deref(last_map).count(block_hash):
-            # We are returning from a function, not executing a line.
-            # Delete the last_time record. It may have already been
-            # deleted if we are profiling a generator that is being
-            # pumped past its end.
-            last_erase_if_present(last_map, block_hash)
+            # We are leaving the frame (or not timing the resumption),
+            # not executing a line.  Delete the last_time record. It may
+            # have already been deleted if we are profiling a generator
+            # that is being pumped past its end.
+            if (<LineProfiler>prof)._memory and block.has_last:
+                mem_next = block.mem_caller
+                mem_switch = True
+            block.has_last = False
+            continue
+        if not block.is_live:
+            shard.live_blocks.push_back(info.index)
+            block.is_live = True
+        if (<LineProfiler>prof)._memory:
+            if not block.has_last:
+                # Entering (or resuming) the frame
+                block.mem_caller = lp_mem_get_current()
+            mem_next = lp_mem_ref_to(get_mem_line(
+                (<LineProfiler>prof)._c_mem_table, block, lineno))
+            mem_switch = True
+        block.has_last = True
+        block.weight = weight
+        block.last.f_lineno = lineno
+        block.last.nested = shard.self_total
+        if npending == _MAX_PENDING_RECORDS:
+            stamp_pending(pending, pending_perf, npending)
+            npending = 0
+        pending[npending] = block
+        pending_perf[npending] = shard.perf
+        npending += 1
+
+    if npending:
+        # Get the time again (once for all the profilers). This way, we
+        # don't record much time wasted in this function.
+        stamp_pending(pending, pending_perf, npending)
+    if mem_switch:
+        lp_mem_set_current(mem_next)
+    return wanted
 
 
 cdef extern int legacy_trace_callback(
@@ -1491,6 +3878,21 @@ pystate.h#L16
     cdef int result
     cdef int recursion_guard = manager_.recursion_guard
     cdef PyObject *code
+    cdef int event = -1
+
+    if what == PyTrace_LINE:
+        event = _START_LINE
+    elif what == PyTrace_RETURN:
+        event = _EXIT_FRAME
+    elif what == PyTrace_CALL and lp_frame_is_resumable(py_frame):
+        # Generators and coroutines also emit call events upon resuming
+        event = _RESUME_FRAME
+    if event >= 0:
+        code = <PyObject *>PyFrame_GetCode(py_frame)
+        inner_trace_callback(event, manager_._c_instances.current(),
+                             <object>code, PyFrame_GetLineNumber(py_frame),
+                             <void *>py_frame)
+        Py_XDECREF(code)
 
     if what == PyTrace_CALL:
         # Any code using the `sys.gettrace()`-`sys.settrace()` paradigm
@@ -1512,13 +3914,6 @@ pystate.h#L16
         # the restoration with `sys.settrace()`
         if manager_._set_frame_local_trace:
             set_local_trace(<PyObject *>manager_, py_frame)
-    elif what == PyTrace_LINE or what == PyTrace_RETURN:
-        code = <PyObject *>PyFrame_GetCode(py_frame)
-        inner_trace_callback((what == PyTrace_LINE),
-                             manager_.active_instances,
-                             <object>code,
-                             PyFrame_GetLineNumber(py_frame))
-        Py_XDECREF(code)
 
     # Call the trace callback that we're wrapping around where
     # appropriate
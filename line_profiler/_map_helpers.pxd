@@ -2,6 +2,7 @@
 # cython: legacy_implicit_noexcept=True
 # used in _line_profiler.pyx
 from libcpp.unordered_map cimport unordered_map
+from libcpp.vector cimport vector
 from cython.operator cimport dereference as deref
 
 # long long int is at least 64 bytes assuming c99
@@ -10,26 +11,194 @@ ctypedef long long int int64
 cdef extern from "Python_wrapper.h":
     ctypedef long long PY_LONG_LONG
 
+# Hardware performance counters (see `LineProfiler.counters`)
+cdef extern from "perf_counters.h":
+    cdef enum:
+        LP_PERF_MAX_COUNTERS
+
+    ctypedef struct lp_perf_group:
+        int n
+
+# Memory-allocation accounting (see `LineProfiler.memory`)
+cdef extern from "alloc_hook.h":
+    ctypedef struct lp_mem_line:
+        long long nallocs
+        long long allocated
+        long long freed
+
+    ctypedef struct lp_mem_ref:
+        lp_mem_line *line
+        unsigned long epoch
+
 cdef struct LastTime:
     int f_lineno
     PY_LONG_LONG time
+    # `ThreadShard.self_total` as of `.time` (only with
+    # `LineProfiler.self_time`)
+    PY_LONG_LONG nested
+    # Values of the hardware counters as of `.time` (only with
+    # `LineProfiler.counters`)
+    PY_LONG_LONG counts[LP_PERF_MAX_COUNTERS]
 
 cdef struct LineTime:
     long long code
     int lineno
     PY_LONG_LONG total_time
     long nhits
+    # Longest single hit (only with `LineProfiler.histograms`)
+    PY_LONG_LONG max_time
+    # Part of `.total_time` not spent in the lines of other profiled
+    # code (only with `LineProfiler.self_time`)
+    PY_LONG_LONG self_time
+
+# Per-code-object data cached in the code object's scratch space (see
+# `get_code_info()` in _line_profiler.pyx)
+cdef struct CodeInfo:
+    int64 block_hash
+
+# Last-time record set aside while another frame executes the same
+# code block (see `LineTimeBlock.parked`)
+cdef struct ParkedRecord:
+    LastTime last
+    long weight
+    bint resumed
+    lp_mem_ref mem_caller
+
+# Dense storage for the line timings of a code block on a thread, with
+# one (pre-allocated) slot for each line indexed by
+# `lineno - first_lineno`
+cdef struct LineTimeBlock:
+    int first_lineno
+    vector[LineTime] lines
+    # With `LineProfiler.histograms`, `LP_HIST_BUCKETS` counts of the
+    # durations of the hits (see histogram.h) for each of the `.lines`
+    # (in the same order); empty otherwise
+    vector[unsigned long long] hist
+    # With `LineProfiler.counters`, the counts of the events (as many
+    # as there are counters) for each of the `.lines` (in the same
+    # order); empty otherwise
+    vector[PY_LONG_LONG] counts
+    # With `LineProfiler.memory`, the allocation counters for each of
+    # the `.lines` (in the same order), looked up as the lines are first
+    # executed; empty otherwise
+    vector[lp_mem_line*] mem
+    # The line the thread is executing in the block (if `has_last`) and
+    # when it started
+    LastTime last
+    bint has_last
+    # Number of line events the `.last` record stands for (see
+    # `LineProfiler.sample_every`)
+    long weight
+    # The frame (an opaque key) which `.last` belongs to, and whether
+    # the record was opened upon resuming a generator or coroutine (in
+    # which case its line has already been counted as hit)
+    void *last_frame
+    bint last_resumed
+    # The line which was current on the thread (see alloc_hook.h) when
+    # the frame of `.last` started executing the block, to be made
+    # current again when it leaves (only with `LineProfiler.memory`)
+    lp_mem_ref mem_caller
+    # Records of the other frames executing the block on the thread
+    # (e.g. the callers in a recursion, or coroutines of the same
+    # function awaiting one another), keyed by frame
+    unordered_map[void*, ParkedRecord] parked
+    # Whether the block is listed in `ThreadShard.live_blocks`
+    bint is_live
+
+# Tables which the trace callbacks can read without locking, even on
+# free-threaded builds (see the header)
+cdef extern from "concurrent_tables.h":
+    cdef int LP_FREE_THREADING
+
+    ctypedef struct lp_mutex:
+        pass
+    void lp_mutex_lock(lp_mutex *m) noexcept nogil
+    void lp_mutex_unlock(lp_mutex *m) noexcept nogil
+    void lp_mutex_reinit(lp_mutex *m) noexcept nogil
+
+    # Layout of a registered code block: where it lives in
+    # `ThreadShard.blocks` and which lines it spans
+    ctypedef struct BlockInfo:
+        Py_ssize_t index
+        int first_lineno
+        int nlines
+
+    # Mapping between block hash and block layout
+    cdef cppclass BlockRegistry:
+        const BlockInfo *find(int64 key) noexcept
+        const BlockInfo *add(
+            int64 key, int first_lineno, int last_lineno) except +
+        size_t size() noexcept
+        int64 key_at(size_t index)
+
+    # Mapping between block hash and the profilers which registered
+    # the block
+    cdef cppclass BlockDispatch:
+        const vector[void*] *find(int64 key) noexcept
+        void add(int64 key, void *item) except +
+        void remove(int64 key, void *item) except +
+
+    int lp_contains(const vector[void*] *items, void *item) noexcept
+
+    cdef cppclass AtomicCounter:
+        Py_ssize_t add(Py_ssize_t n) noexcept
+        Py_ssize_t get() noexcept
+
+    cdef cppclass PointerTable:
+        void *get(size_t index) noexcept
+        void set(size_t index, void *item) except +
+
+    cdef cppclass InstanceSnapshots:
+        vector[void*] *current() noexcept
+        void publish(const vector[void*] &items) except +
+        void release() noexcept
+
+# Profiling data of a profiler on a single thread
+cdef struct ThreadShard:
+    unsigned long thread_ident
+    # Indexed by `BlockInfo.index`; only ever written to by its own
+    # thread, which however has to hold `.lock` when (re-)allocating
+    # (so that `LineProfiler._merge_block()` on another thread doesn't
+    # read freed memory)
+    vector[LineTimeBlock] blocks
+    # Indices of the blocks which may hold a `.last` (or parked) record
+    vector[Py_ssize_t] live_blocks
+    lp_mutex lock
+    # Line events since the last sample, and when (per `lp_clock_now()`)
+    # that was taken (see `LineProfiler.sample_every` and
+    # `.sample_interval`)
+    long sample_events
+    long long sample_time
+    # Sum of the self times of all the lines timed on the thread, so
+    # that a line can tell how much of its time was spent in the lines
+    # timed in the meantime (see `LineProfiler.self_time`)
+    PY_LONG_LONG self_total
+    # Hardware counters of the thread (see `LineProfiler.counters`);
+    # `NULL` if not counting, or if they can't be opened on the thread
+    lp_perf_group *perf
+
+# Type used for mappings from thread index to per-thread data
+ctypedef unordered_map[Py_ssize_t, ThreadShard] ThreadShardMap
+
+# Type used for mappings from block hash to (merged) line timings
+ctypedef unordered_map[int64, LineTimeBlock] LineTimeBlockMap
 
-# Types used for mappings from code hash to last/line times.
-ctypedef unordered_map[int64, LastTime] LastTimeMap
-ctypedef unordered_map[int64, LineTime] LineTimeMap
+# Type used for mappings from line hash to allocation counters (same as
+# `lp_mem_table` in alloc_hook.h)
+ctypedef unordered_map[int64, lp_mem_line] LineMemMap
 
-cdef inline void last_erase_if_present(LastTimeMap* m, int64 key) noexcept:
-    cdef LastTimeMap.iterator it = deref(m).find(key)
-    if it != deref(m).end():
-        deref(m).erase(it)
+cdef inline LineTime* block_get_entry(LineTimeBlock* block, int lineno) noexcept:
+    cdef long index = lineno - block.first_lineno
+    if index < 0 or <size_t>index >= block.lines.size():
+        return NULL
+    return &(block.lines[index])
 
-cdef inline LineTime* line_ensure_entry(LineTimeMap* m, int lineno, long long code_hash) noexcept:
-    if not deref(m).count(lineno):
-        deref(m)[lineno] = LineTime(code_hash, lineno, 0, 0)
-    return &(deref(m)[lineno])
+cdef inline void shard_clear_last(ThreadShard* shard) noexcept:
+    cdef LineTimeBlock* block
+    cdef size_t i
+    for i in range(shard.live_blocks.size()):
+        block = &(shard.blocks[shard.live_blocks[i]])
+        block.has_last = False
+        block.parked.clear()
+        block.is_live = False
+    shard.live_blocks.clear()
@@ -0,0 +1,448 @@
+// Per-line memory-allocation accounting for `_line_profiler.pyx` (see
+// `LineProfiler.memory`).
+//
+// While installed, the hook wraps the `PYMEM_DOMAIN_MEM` and
+// `PYMEM_DOMAIN_OBJ` allocators (see `PyMem_SetAllocator()`), charging
+// each allocation to the line which is current on the allocating
+// thread (set by the trace callbacks, see `lp_mem_set_current()`), and
+// remembering the line and size of the block so that freeing it (on
+// whichever thread) can be charged back to the line, which yields the
+// bytes the line retains.
+//
+// The blocks are kept in stripes chosen by address, each with its own
+// lock, so that on free-threaded builds allocations on different threads
+// don't serialize on a single lock; the counters of the lines are then
+// updated atomically.  The locks are spinlocks rather than `lp_mutex`es,
+// since `PyMutex_Lock()` may detach the thread state when contended,
+// which mustn't happen in the middle of an allocation (cf. tracemalloc,
+// which for the same reason never detaches while taking its lock).
+//
+// Note: like `thread_locals.h`, this header is C++-only.
+
+#ifndef LINE_PROFILER_ALLOC_HOOK_H
+#define LINE_PROFILER_ALLOC_HOOK_H
+
+#include "Python.h"
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#include <atomic>
+#include <stdint.h>
+#include <new>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "concurrent_tables.h"
+
+// Allocation counters of a line
+typedef struct lp_mem_line {
+    // Number of blocks allocated while the line was current
+    long long nallocs;
+    // Sum of their sizes in bytes
+    long long allocated;
+    // Sum of the sizes of those of them which have since been freed
+    long long freed;
+} lp_mem_line;
+
+// The lines of a profiler, keyed by line hash; the entries are never
+// erased, so that pointers to them stay valid as long as the table
+static_assert(sizeof(long long) == sizeof(PY_LONG_LONG), "");
+typedef std::unordered_map<long long, lp_mem_line> lp_mem_table;
+
+// A line to charge the allocations to, tagged with the installation of
+// the hook it is valid for (see `lp_mem_epoch`)
+typedef struct lp_mem_ref {
+    lp_mem_line *line;
+    unsigned long epoch;
+} lp_mem_ref;
+
+typedef struct lp_mem_block {
+    size_t size;
+    lp_mem_line *line;
+} lp_mem_block;
+
+// Context of a wrapper, i.e. of an installation of the hook in a
+// domain; a wrapper which couldn't be removed from the allocator chain
+// (see `lp_mem_hook_release()`) just passes through from then on
+typedef struct lp_mem_domain {
+    PyMemAllocatorEx orig;
+    // Value of `lp_mem_epoch` while installed
+    unsigned long epoch;
+} lp_mem_domain;
+
+// Lock which never detaches the thread state (only needed on
+// free-threaded builds: on other builds the allocators, and the
+// readers, hold the GIL)
+typedef struct lp_mem_spinlock {
+    std::atomic<bool> locked;
+} lp_mem_spinlock;
+
+static inline void lp_mem_lock(lp_mem_spinlock *lock)
+{
+#if LP_FREE_THREADING
+    int spins = 0;
+    while (lock->locked.exchange(true, std::memory_order_acquire)) {
+        while (lock->locked.load(std::memory_order_relaxed)) {
+            if (++spins > 64) std::this_thread::yield();
+        }
+    }
+#else
+    (void)lock;
+#endif
+}
+
+static inline void lp_mem_unlock(lp_mem_spinlock *lock)
+{
+#if LP_FREE_THREADING
+    lock->locked.store(false, std::memory_order_release);
+#else
+    (void)lock;
+#endif
+}
+
+// Add to (or read) a counter of a line, concurrently with the other
+// stripes
+static inline void lp_mem_count(long long *counter, long long n)
+{
+#if LP_FREE_THREADING && defined(_MSC_VER)
+    _InterlockedExchangeAdd64((volatile __int64 *)counter, n);
+#elif LP_FREE_THREADING
+    __atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+#else
+    *counter += n;
+#endif
+}
+
+static inline long long lp_mem_counted(const long long *counter)
+{
+#if LP_FREE_THREADING && defined(_MSC_VER)
+    // Aligned 64-bit loads are atomic on the 64-bit targets
+    return *(const volatile long long *)counter;
+#elif LP_FREE_THREADING
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+#else
+    return *counter;
+#endif
+}
+
+// Number of stripes of blocks (a power of 2)
+#define LP_MEM_NSTRIPES 64
+
+typedef struct lp_mem_stripe {
+    lp_mem_spinlock lock;
+    std::unordered_map<void *, lp_mem_block> blocks;
+} lp_mem_stripe;
+
+// Guards the tables of lines (and `lp_mem_retired`)
+static lp_mem_spinlock lp_mem_table_lock;
+// Bumped whenever the hook is uninstalled, so that the lines stored in
+// the thread-local `lp_mem_current` (and elsewhere) by earlier
+// installations are ignored
+static std::atomic<unsigned long> lp_mem_epoch(1);
+static std::atomic<size_t> lp_mem_ntracked(0);
+static long lp_mem_users = 0;
+static lp_mem_stripe *lp_mem_stripes = NULL;
+// Tables of dead profilers, which may still be pointed to until the
+// hook is uninstalled
+static std::vector<lp_mem_table *> *lp_mem_retired = NULL;
+static const PyMemAllocatorDomain lp_mem_domain_ids[2] = {
+    PYMEM_DOMAIN_MEM, PYMEM_DOMAIN_OBJ,
+};
+static lp_mem_domain *lp_mem_domains[2] = {NULL, NULL};
+// Contexts of the wrappers which were removed, for reuse (they're never
+// freed, lest a thread still be running through them)
+static lp_mem_domain *lp_mem_spares[2] = {NULL, NULL};
+static thread_local lp_mem_ref lp_mem_current = {NULL, 0};
+
+static inline lp_mem_ref lp_mem_get_current(void)
+{
+    return lp_mem_current;
+}
+
+static inline void lp_mem_set_current(lp_mem_ref ref)
+{
+    lp_mem_current = ref;
+}
+
+static inline lp_mem_ref lp_mem_ref_to(lp_mem_line *line)
+{
+    lp_mem_ref ref = {line, lp_mem_epoch.load(std::memory_order_relaxed)};
+    return ref;
+}
+
+static inline bool lp_mem_is_live(lp_mem_domain *domain)
+{
+    return domain->epoch == lp_mem_epoch.load(std::memory_order_relaxed);
+}
+
+static inline lp_mem_stripe *lp_mem_stripe_of(void *ptr)
+{
+    // Fibonacci hashing of the address, sans the alignment bits
+    unsigned long long h = (unsigned long long)(uintptr_t)ptr >> 4;
+    h *= 0x9E3779B97F4A7C15ULL;
+    return &lp_mem_stripes[h >> 58];  // 64 - log2(LP_MEM_NSTRIPES)
+}
+
+static inline void lp_mem_track(void *ptr, size_t size)
+{
+    lp_mem_ref ref = lp_mem_current;
+    lp_mem_block block = {size, ref.line};
+    lp_mem_stripe *stripe;
+    if (ref.line == NULL
+            || ref.epoch != lp_mem_epoch.load(std::memory_order_relaxed)
+            || lp_mem_stripes == NULL)
+        return;
+    stripe = lp_mem_stripe_of(ptr);
+    lp_mem_lock(&stripe->lock);
+    try {
+        if (stripe->blocks.insert({ptr, block}).second)
+            lp_mem_ntracked.fetch_add(1, std::memory_order_relaxed);
+        lp_mem_count(&ref.line->nallocs, 1);
+        lp_mem_count(&ref.line->allocated, (long long)size);
+    } catch (...) {
+        // Out of memory: leave the block uncharged
+    }
+    lp_mem_unlock(&stripe->lock);
+}
+
+// Forget the block at `ptr` (if tracked), charging its release to its
+// line; returns it in `block` (if not `NULL`) so that it can be
+// re-tracked
+static inline bool lp_mem_untrack(void *ptr, lp_mem_block *block)
+{
+    std::unordered_map<void *, lp_mem_block>::iterator it;
+    lp_mem_stripe *stripe;
+    bool found = false;
+    if (!lp_mem_ntracked.load(std::memory_order_relaxed)
+            || lp_mem_stripes == NULL)
+        return false;
+    stripe = lp_mem_stripe_of(ptr);
+    lp_mem_lock(&stripe->lock);
+    if ((it = stripe->blocks.find(ptr)) != stripe->blocks.end()) {
+        lp_mem_count(&it->second.line->freed, (long long)it->second.size);
+        if (block != NULL) *block = it->second;
+        stripe->blocks.erase(it);
+        lp_mem_ntracked.fetch_sub(1, std::memory_order_relaxed);
+        found = true;
+    }
+    lp_mem_unlock(&stripe->lock);
+    return found;
+}
+
+static void *lp_mem_malloc(void *ctx, size_t size)
+{
+    PyMemAllocatorEx *orig = &((lp_mem_domain *)ctx)->orig;
+    void *ptr = orig->malloc(orig->ctx, size);
+    if (ptr != NULL && lp_mem_is_live((lp_mem_domain *)ctx))
+        lp_mem_track(ptr, size);
+    return ptr;
+}
+
+static void *lp_mem_calloc(void *ctx, size_t nelem, size_t elsize)
+{
+    PyMemAllocatorEx *orig = &((lp_mem_domain *)ctx)->orig;
+    void *ptr = orig->calloc(orig->ctx, nelem, elsize);
+    if (ptr != NULL && lp_mem_is_live((lp_mem_domain *)ctx))
+        lp_mem_track(ptr, nelem * elsize);
+    return ptr;
+}
+
+static void *lp_mem_realloc(void *ctx, void *ptr, size_t size)
+{
+    PyMemAllocatorEx *orig = &((lp_mem_domain *)ctx)->orig;
+    lp_mem_block old;
+    bool live = lp_mem_is_live((lp_mem_domain *)ctx);
+    // Note: untrack the block before it may be freed, lest another
+    // thread allocate (and track) the address in the meantime
+    bool tracked = live && ptr != NULL && lp_mem_untrack(ptr, &old);
+    void *new_ptr = orig->realloc(orig->ctx, ptr, size);
+    if (new_ptr != NULL && live) {
+        // Charged as a new block to the current line
+        lp_mem_track(new_ptr, size);
+    } else if (tracked) {
+        // The block is left alone: undo the release
+        lp_mem_stripe *stripe = lp_mem_stripe_of(ptr);
+        lp_mem_count(&old.line->freed, -(long long)old.size);
+        lp_mem_lock(&stripe->lock);
+        try {
+            if (stripe->blocks.insert({ptr, old}).second)
+                lp_mem_ntracked.fetch_add(1, std::memory_order_relaxed);
+        } catch (...) {
+        }
+        lp_mem_unlock(&stripe->lock);
+    }
+    return new_ptr;
+}
+
+static void lp_mem_free(void *ctx, void *ptr)
+{
+    PyMemAllocatorEx *orig = &((lp_mem_domain *)ctx)->orig;
+    if (ptr != NULL && lp_mem_is_live((lp_mem_domain *)ctx))
+        lp_mem_untrack(ptr, NULL);
+    orig->free(orig->ctx, ptr);
+}
+
+/*
+ * Install the hook (if it isn't already), for one more user.
+ *
+ * Returns:
+ *     0, or -1 if out of memory.
+ */
+static inline int lp_mem_hook_acquire(void)
+{
+    PyMemAllocatorEx hook;
+    int i;
+    if (lp_mem_users) {
+        lp_mem_users++;
+        return 0;
+    }
+    if (lp_mem_stripes == NULL) {
+        lp_mem_stripes = new (std::nothrow) lp_mem_stripe[LP_MEM_NSTRIPES]();
+        if (lp_mem_stripes == NULL) return -1;
+    }
+    for (i = 0; i < 2; i++) {
+        if (lp_mem_spares[i] == NULL)
+            lp_mem_spares[i] = new (std::nothrow) lp_mem_domain();
+        if (lp_mem_spares[i] == NULL) return -1;
+    }
+    for (i = 0; i < 2; i++) {
+        lp_mem_domains[i] = lp_mem_spares[i];
+        lp_mem_spares[i] = NULL;
+        lp_mem_domains[i]->epoch = lp_mem_epoch.load();
+        PyMem_GetAllocator(lp_mem_domain_ids[i], &lp_mem_domains[i]->orig);
+        hook.ctx = lp_mem_domains[i];
+        hook.malloc = lp_mem_malloc;
+        hook.calloc = lp_mem_calloc;
+        hook.realloc = lp_mem_realloc;
+        hook.free = lp_mem_free;
+        PyMem_SetAllocator(lp_mem_domain_ids[i], &hook);
+    }
+    lp_mem_users = 1;
+    return 0;
+}
+
+/*
+ * Release the hook for one user, uninstalling it (and forgetting the
+ * blocks allocated meanwhile) with the last one.
+ */
+static inline void lp_mem_hook_release(void)
+{
+    PyMemAllocatorEx current;
+    size_t i;
+    if (lp_mem_users <= 0 || --lp_mem_users) return;
+    for (i = 0; i < 2; i++) {
+        PyMem_GetAllocator(lp_mem_domain_ids[i], &current);
+        // Only unwrap if nobody wrapped us in turn (e.g. tracemalloc);
+        // otherwise, the wrapper (and its context) has to stay in the
+        // chain, passing through since its epoch is over
+        if (current.malloc == lp_mem_malloc
+                && current.ctx == lp_mem_domains[i]) {
+            PyMem_SetAllocator(lp_mem_domain_ids[i],
+                               &lp_mem_domains[i]->orig);
+            lp_mem_spares[i] = lp_mem_domains[i];
+        }
+        lp_mem_domains[i] = NULL;
+    }
+    lp_mem_epoch.fetch_add(1);
+    if (lp_mem_stripes != NULL) {
+        for (i = 0; i < LP_MEM_NSTRIPES; i++) {
+            lp_mem_lock(&lp_mem_stripes[i].lock);
+            lp_mem_stripes[i].blocks.clear();
+            lp_mem_unlock(&lp_mem_stripes[i].lock);
+        }
+    }
+    lp_mem_ntracked.store(0);
+    lp_mem_lock(&lp_mem_table_lock);
+    if (lp_mem_retired != NULL) {
+        for (i = 0; i < lp_mem_retired->size(); i++)
+            delete (*lp_mem_retired)[i];
+        lp_mem_retired->clear();
+    }
+    lp_mem_unlock(&lp_mem_table_lock);
+}
+
+static inline lp_mem_table *lp_mem_table_new(void)
+{
+    return new (std::nothrow) lp_mem_table();
+}
+
+/*
+ * Free `table` once nothing can point to its lines anymore.
+ */
+static inline void lp_mem_table_retire(lp_mem_table *table)
+{
+    if (table == NULL) return;
+    lp_mem_lock(&lp_mem_table_lock);
+    if (!lp_mem_users) {
+        delete table;
+    } else {
+        try {
+            if (lp_mem_retired == NULL)
+                lp_mem_retired = new std::vector<lp_mem_table *>();
+            lp_mem_retired->push_back(table);
+        } catch (...) {
+            // Leak it rather than leave dangling pointers
+        }
+    }
+    lp_mem_unlock(&lp_mem_table_lock);
+}
+
+/*
+ * Returns:
+ *     The (stable) counters of the line `line_hash` in `table`,
+ *     created as needed, or `NULL` if out of memory.
+ */
+static inline lp_mem_line *lp_mem_table_line(
+    lp_mem_table *table, long long line_hash)
+{
+    lp_mem_line *line = NULL;
+    lp_mem_lock(&lp_mem_table_lock);
+    try {
+        line = &(*table)[line_hash];
+    } catch (...) {
+    }
+    lp_mem_unlock(&lp_mem_table_lock);
+    return line;
+}
+
+/*
+ * Copy the lines of `table` into `out`.
+ *
+ * Note:
+ *     On free-threaded builds, the counters of each line are read one
+ *     at a time while other threads may be allocating, so `freed` may
+ *     be slightly ahead of `allocated`.
+ */
+static inline int lp_mem_table_copy(lp_mem_table *table, lp_mem_table *out)
+{
+    lp_mem_table::const_iterator it;
+    lp_mem_line line;
+    int status = 0;
+    lp_mem_lock(&lp_mem_table_lock);
+    try {
+        out->clear();
+        out->reserve(table->size());
+        for (it = table->begin(); it != table->end(); ++it) {
+            line.nallocs = lp_mem_counted(&it->second.nallocs);
+            line.allocated = lp_mem_counted(&it->second.allocated);
+            line.freed = lp_mem_counted(&it->second.freed);
+            (*out)[it->first] = line;
+        }
+    } catch (...) {
+        status = -1;
+    }
+    lp_mem_unlock(&lp_mem_table_lock);
+    return status;
+}
+
+static inline void lp_mem_after_fork(void)
+{
+    size_t i;
+    lp_mem_table_lock.locked.store(false);
+    if (lp_mem_stripes == NULL) return;
+    for (i = 0; i < LP_MEM_NSTRIPES; i++)
+        lp_mem_stripes[i].lock.locked.store(false);
+}
+
+#endif // LINE_PROFILER_ALLOC_HOOK_H
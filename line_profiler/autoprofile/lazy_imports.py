@@ -0,0 +1,255 @@
+r"""
+Tools for lazily profiling everything as specified in
+``line_profiler.autoprof.run(prof_mod=...)``: instead of eagerly
+importing all the targets (and walking the packages among them) up
+front like :py:mod:`~.eager_preimports` does, a meta-path finder adds
+the target modules (or the specified attributes thereof) to the
+profiler as they are imported by the profiled code, so that the modules
+which are never imported cost nothing.
+
+Example:
+    >>> import sys
+    >>> import tempfile
+    >>> from pathlib import Path
+    >>>
+    >>>
+    >>> def write_package(path):
+    ...     path.mkdir()
+    ...     (path / '__init__.py').touch()
+    ...     for name in 'used', 'unused':
+    ...         source = f'def {name}_func():\n    pass\n'
+    ...         (path / f'{name}.py').write_text(source)
+    ...
+    >>>
+    >>> added = []
+    >>> with tempfile.TemporaryDirectory() as tmpdir:
+    ...     write_package(Path(tmpdir) / 'my_lazy_pkg')
+    ...     sys.path.insert(0, tmpdir)
+    ...     try:
+    ...         with LazyImportHook(added.append, recurse=['my_lazy_pkg']):
+    ...             import my_lazy_pkg.used
+    ...     finally:
+    ...         sys.path.remove(tmpdir)
+    ...         for name in 'my_lazy_pkg', 'my_lazy_pkg.used':
+    ...             del sys.modules[name]
+    >>> [module.__name__ for module in added]
+    ['my_lazy_pkg', 'my_lazy_pkg.used']
+"""
+
+from __future__ import annotations
+
+import sys
+import threading
+from collections.abc import Callable, Collection
+from importlib.abc import Loader, MetaPathFinder
+from importlib.machinery import ModuleSpec
+from types import ModuleType
+from typing import Any, Sequence
+from warnings import warn
+from .eager_preimports import split_dotted_path
+
+
+__all__ = ('LazyImportHook',)
+
+
+class _ProfilingLoader(Loader):
+    """
+    Thin wrapper around a loader, which hands the module over to a
+    :py:class:`LazyImportHook` once it has been executed.
+    """
+
+    def __init__(self, loader: Loader, hook: LazyImportHook) -> None:
+        self.loader = loader
+        self.hook = hook
+
+    def __getattr__(self, attr: str) -> Any:
+        return getattr(self.loader, attr)
+
+    def create_module(self, spec: ModuleSpec) -> ModuleType | None:
+        create = getattr(self.loader, 'create_module', None)
+        if create is None:
+            return None
+        return create(spec)
+
+    def exec_module(self, module: ModuleType) -> None:
+        # Don't leave the wrapper on the module, so that e.g.
+        # `importlib.reload()` and `inspect` deal with the real loader
+        spec = getattr(module, '__spec__', None)
+        if spec is not None and spec.loader is self:
+            spec.loader = self.loader
+        if getattr(module, '__loader__', None) is self:
+            module.__loader__ = self.loader
+        self.loader.exec_module(module)
+        # Note: the module may have replaced itself in `sys.modules`
+        self.hook.add_module(sys.modules.get(module.__name__, module))
+
+
+class LazyImportHook(MetaPathFinder):
+    """
+    Meta-path finder which passes the targeted modules (or the targeted
+    attributes thereof) to ``adder`` right after they are imported.
+
+    Arguments:
+        adder (Callable[[Any], Any]):
+            Callable adding an object to the profiler, e.g.
+            ``profile.add_imported_function_or_module``
+        dotted_paths (Collection[str]):
+            Dotted paths (strings of period-joined identifiers)
+            indicating what should be profiled: modules, or objects
+            accessible via (chained) attribute access thereon
+        recurse (Collection[str]):
+            Dotted paths indicating the packages whose submodules
+            (recursively) are also to be profiled upon import
+        static (bool):
+            Whether to use static analysis (true) or the import system
+            (false) to split ``dotted_paths`` into the module and
+            attribute parts (see
+            :py:func:`~.eager_preimports.split_dotted_path`)
+
+    Note:
+        * Modules which are already imported when the hook is
+          :py:meth:`.install`-ed are added right away.
+        * Unlike with :py:mod:`~.eager_preimports`, the packages in
+          ``recurse`` are not walked; their submodules are just matched
+          by name as they are imported.
+    """
+
+    def __init__(
+        self,
+        adder: Callable[[Any], Any],
+        dotted_paths: Collection[str] = (),
+        recurse: Collection[str] = (),
+        *,
+        static: bool = True,
+    ) -> None:
+        self.adder = adder
+        # Module names -> attribute names (`None` = the whole module)
+        self.targets: dict[str, set[str | None]] = {}
+        # Packages the submodules of which are also added
+        self.recurse: set[str] = set()
+        self._added: set[str] = set()
+        self._lock = threading.RLock()
+        recurse = set(recurse)
+        unresolved = []
+        for path in sorted(set(dotted_paths) | recurse):
+            try:
+                module, target = split_dotted_path(path, static=static)
+            except ModuleNotFoundError:
+                unresolved.append(path)
+                continue
+            self.targets.setdefault(module, set()).add(target)
+            if path in recurse and target is None:
+                self.recurse.add(module)
+        if unresolved:
+            msg = '{} import target{} cannot be resolved: {!r}'.format(
+                len(unresolved),
+                '' if len(unresolved) == 1 else 's',
+                unresolved,
+            )
+            warn(msg, stacklevel=2)
+
+    def __enter__(self) -> LazyImportHook:
+        self.install()
+        return self
+
+    def __exit__(self, *_, **__) -> None:
+        self.uninstall()
+
+    def wants(self, fullname: str) -> bool:
+        """
+        Returns:
+            Whether (something in) the module ``fullname`` is to be
+            profiled
+        """
+        return fullname in self.targets or self._is_recursed(fullname)
+
+    def _is_recursed(self, fullname: str) -> bool:
+        return any(
+            fullname == pkg or fullname.startswith(pkg + '.')
+            for pkg in self.recurse
+        )
+
+    def find_spec(
+        self,
+        fullname: str,
+        path: Sequence[str] | None = None,
+        target: ModuleType | None = None,
+    ) -> ModuleSpec | None:
+        """
+        Find the spec of ``fullname`` with the finders after ``self``
+        on :py:data:`sys.meta_path`, wrapping its loader so that the
+        module is profiled once executed if it is targeted.
+        """
+        if not self.wants(fullname):
+            return None
+        try:
+            finders = sys.meta_path[sys.meta_path.index(self) + 1 :]
+        except ValueError:  # Not installed
+            return None
+        for finder in finders:
+            find_spec = getattr(finder, 'find_spec', None)
+            if find_spec is None:
+                continue
+            spec = find_spec(fullname, path, target)
+            if spec is not None:
+                break
+        else:
+            return None
+        # Leave anything we can't wrap to the usual machinery
+        if spec.loader is None or not hasattr(spec.loader, 'exec_module'):
+            return None
+        spec.loader = _ProfilingLoader(spec.loader, self)
+        return spec
+
+    def add_module(self, module: ModuleType) -> None:
+        """
+        Pass ``module`` (or the targeted attributes thereof) to
+        :py:attr:`.adder` if it is targeted and hasn't been added yet.
+        """
+        name = getattr(module, '__name__', None)
+        if not (isinstance(name, str) and self.wants(name)):
+            return
+        with self._lock:
+            if name in self._added:
+                return
+            self._added.add(name)
+        targets = self.targets.get(name, set())
+        failures = []
+        if None in targets or self._is_recursed(name):
+            self.adder(module)
+        for target in sorted(t for t in targets if t is not None):
+            obj: Any = module
+            try:
+                for attr in target.split('.'):
+                    obj = getattr(obj, attr)
+            except AttributeError:
+                failures.append(f'{name}.{target}')
+                continue
+            self.adder(obj)
+        if failures:
+            msg = '{} target{} cannot be imported: {!r}'.format(
+                len(failures), '' if len(failures) == 1 else 's', failures
+            )
+            warn(msg, stacklevel=2)
+
+    def install(self) -> None:
+        """
+        Put ``self`` at the front of :py:data:`sys.meta_path`, and add
+        the targeted modules which have already been imported.
+        """
+        with self._lock:
+            if self not in sys.meta_path:
+                sys.meta_path.insert(0, self)
+        for name, module in list(sys.modules.items()):
+            if isinstance(module, ModuleType) and self.wants(name):
+                self.add_module(module)
+
+    def uninstall(self) -> None:
+        """
+        Remove ``self`` from :py:data:`sys.meta_path`.
+        """
+        with self._lock:
+            try:
+                sys.meta_path.remove(self)
+            except ValueError:
+                pass
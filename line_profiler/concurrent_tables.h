@@ -0,0 +1,557 @@
+// Thread-safe lookup tables for `_line_profiler.pyx`.
+//
+// With the GIL, the trace callbacks of different threads never run
+// concurrently; on free-threaded builds (PEP 703) they do, so the
+// tables they read on every event are built such that:
+// - Lookups never take a lock: the tables are only ever replaced
+//   wholesale (by a grown copy) and their entries never mutated in
+//   place once published; and
+// - Writes (which only happen upon registration, i.e. way off the hot
+//   path) are serialized by an `lp_mutex` held by the caller.
+// Replaced tables and entries are only freed along with the containing
+// object, because a reader may still be looking at them; since tables
+// grow geometrically and entries are only replaced when a code block is
+// extended, that memory stays bounded.
+//
+// Note: like `thread_locals.h`, this header is C++-only.
+
+#ifndef LINE_PROFILER_CONCURRENT_TABLES_H
+#define LINE_PROFILER_CONCURRENT_TABLES_H
+
+#include "Python.h"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+#ifdef Py_GIL_DISABLED
+#   define LP_FREE_THREADING 1
+#else
+#   define LP_FREE_THREADING 0
+#endif
+
+/*
+ * Mutex guarding the (rare) writes to the tables.  Must be
+ * zero-initialized, and must not be held while calling into Python.
+ * Before 3.13 there is no free-threading and no `PyMutex`, and since
+ * the critical sections don't call into Python (and thus can't release
+ * the GIL midway), the GIL alone suffices.
+ */
+#if PY_VERSION_HEX >= 0x030d00a1  // 3.13.0a1
+    typedef PyMutex lp_mutex;
+    static inline void lp_mutex_lock(lp_mutex *m) { PyMutex_Lock(m); }
+    static inline void lp_mutex_unlock(lp_mutex *m) { PyMutex_Unlock(m); }
+#else
+    typedef struct { char _unused; } lp_mutex;
+    static inline void lp_mutex_lock(lp_mutex *m) { (void)m; }
+    static inline void lp_mutex_unlock(lp_mutex *m) { (void)m; }
+#endif
+
+/*
+ * Reset a mutex to the unlocked state in a forked child (where the
+ * thread which may have held it no longer exists).
+ */
+static inline void lp_mutex_reinit(lp_mutex *m) { *m = lp_mutex(); }
+
+/*
+ * Counter safe to update from any thread (e.g. of live objects).
+ */
+class AtomicCounter {
+  public:
+    AtomicCounter() : value_(0) {}
+
+    Py_ssize_t add(Py_ssize_t n) noexcept
+    {
+        return value_.fetch_add(n, std::memory_order_relaxed) + n;
+    }
+
+    Py_ssize_t get() const noexcept
+    {
+        return value_.load(std::memory_order_relaxed);
+    }
+
+  private:
+    std::atomic<Py_ssize_t> value_;
+};
+
+/*
+ * Layout of a registered code block: where it lives in
+ * `ThreadShard.blocks` and which lines it spans.
+ */
+typedef struct BlockInfo {
+    Py_ssize_t index;
+    int first_lineno;
+    int nlines;
+} BlockInfo;
+
+/*
+ * Open-addressing hash table from block hashes to (immutable) `T`s,
+ * with lock-free lookups; entries can be replaced but not removed.
+ * Ownership of the `T`s stays with the caller.
+ */
+template <typename T>
+class KeyedTable {
+  public:
+    KeyedTable() : table_(new_table(16)), count_(0) {}
+
+    ~KeyedTable()
+    {
+        delete_table(table_.load(std::memory_order_relaxed));
+        for (Table *table : retired_tables_) delete_table(table);
+    }
+
+    KeyedTable(const KeyedTable &) = delete;
+    KeyedTable &operator=(const KeyedTable &) = delete;
+
+    // Returns: the entry for `key`, or `NULL` if there is none
+    const T *find(long long key) const noexcept
+    {
+        const Table *table = table_.load(std::memory_order_acquire);
+        size_t i = mix(key) & table->mask;
+        for (;; i = (i + 1) & table->mask) {
+            const Slot &slot = table->slots[i];
+            const T *value = slot.value.load(std::memory_order_acquire);
+            if (value == NULL) return NULL;
+            if (slot.key.load(std::memory_order_relaxed) == key) return value;
+        }
+    }
+
+    /*
+     * Set the entry for `key` to `value` (which must not be `NULL`).
+     *
+     * Note:
+     *     The caller must hold the lock serializing the writes.
+     */
+    void store(long long key, const T *value)
+    {
+        Table *table = table_.load(std::memory_order_relaxed);
+        Slot *slot = probe(table, key);
+        if (slot->value.load(std::memory_order_relaxed) == NULL) {
+            if (2 * (count_ + 1) > table->mask + 1) {
+                table = grow(table);
+                slot = probe(table, key);
+            }
+            count_++;
+            slot->key.store(key, std::memory_order_relaxed);
+        }
+        slot->value.store(value, std::memory_order_release);
+    }
+
+  private:
+    struct Slot {
+        std::atomic<long long> key;
+        std::atomic<const T *> value;
+    };
+
+    struct Table {
+        size_t mask;
+        Slot *slots;
+    };
+
+    static size_t mix(long long key) noexcept
+    {
+        // SplitMix64 finalizer; the line hashes of a block differ from
+        // its hash only in the low bits, so spread them out
+        unsigned long long x = (unsigned long long)key;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return (size_t)(x ^ (x >> 31));
+    }
+
+    static Table *new_table(size_t capacity)
+    {
+        Table *table = new Table;
+        table->mask = capacity - 1;
+        try {
+            table->slots = new Slot[capacity];
+        } catch (...) {
+            delete table;
+            throw;
+        }
+        for (size_t i = 0; i < capacity; i++) {
+            table->slots[i].key.store(0, std::memory_order_relaxed);
+            table->slots[i].value.store(NULL, std::memory_order_relaxed);
+        }
+        return table;
+    }
+
+    static void delete_table(Table *table)
+    {
+        if (table == NULL) return;
+        delete[] table->slots;
+        delete table;
+    }
+
+    static Slot *probe(Table *table, long long key) noexcept
+    {
+        size_t i = mix(key) & table->mask;
+        for (;; i = (i + 1) & table->mask) {
+            Slot *slot = &table->slots[i];
+            if (slot->value.load(std::memory_order_relaxed) == NULL
+                    || slot->key.load(std::memory_order_relaxed) == key)
+                return slot;
+        }
+    }
+
+    Table *grow(Table *table)
+    {
+        retired_tables_.reserve(retired_tables_.size() + 1);
+        Table *grown = new_table(2 * (table->mask + 1));
+        for (size_t i = 0; i <= table->mask; i++) {
+            const Slot &old = table->slots[i];
+            const T *value = old.value.load(std::memory_order_relaxed);
+            if (value == NULL) continue;
+            long long key = old.key.load(std::memory_order_relaxed);
+            Slot *slot = probe(grown, key);
+            slot->key.store(key, std::memory_order_relaxed);
+            slot->value.store(value, std::memory_order_relaxed);
+        }
+        table_.store(grown, std::memory_order_release);
+        retired_tables_.push_back(table);
+        return grown;
+    }
+
+    std::atomic<Table *> table_;
+    std::vector<Table *> retired_tables_;
+    size_t count_;
+};
+
+/*
+ * Mapping from block hashes to (immutable) `BlockInfo`s, with
+ * lock-free lookups.
+ */
+class BlockRegistry {
+  public:
+    BlockRegistry() {}
+
+    ~BlockRegistry()
+    {
+        for (BlockInfo *info : infos_) delete info;
+    }
+
+    BlockRegistry(const BlockRegistry &) = delete;
+    BlockRegistry &operator=(const BlockRegistry &) = delete;
+
+    /*
+     * Returns:
+     *     The layout of the block `key`, or `NULL` if it isn't
+     *     registered.
+     */
+    const BlockInfo *find(long long key) const noexcept
+    {
+        return table_.find(key);
+    }
+
+    /*
+     * Register the block `key` spanning `first_lineno` to `last_lineno`
+     * (inclusive), or extend it to cover said lines if it is already
+     * registered.  New blocks are indexed in the order of registration.
+     *
+     * Note:
+     *     The caller must hold the lock serializing the writes.
+     */
+    const BlockInfo *add(long long key, int first_lineno, int last_lineno)
+    {
+        const BlockInfo *old = table_.find(key);
+        BlockInfo info;
+        if (old == NULL) {
+            info.index = (Py_ssize_t)keys_.size();
+            info.first_lineno = first_lineno;
+            info.nlines = 0;
+        } else {
+            info = *old;
+        }
+        if (first_lineno <= last_lineno) {
+            if (info.nlines) {
+                last_lineno = std::max(
+                    last_lineno, info.first_lineno + info.nlines - 1);
+                first_lineno = std::min(first_lineno, info.first_lineno);
+            }
+            info.first_lineno = first_lineno;
+            info.nlines = last_lineno - first_lineno + 1;
+        }
+        if (old != NULL
+                && old->first_lineno == info.first_lineno
+                && old->nlines == info.nlines)
+            return old;
+        // Make room before allocating so that nothing can leak
+        infos_.reserve(infos_.size() + 1);
+        if (old == NULL) keys_.reserve(keys_.size() + 1);
+        BlockInfo *new_info = new BlockInfo(info);
+        infos_.push_back(new_info);
+        try {
+            table_.store(key, new_info);
+        } catch (...) {
+            infos_.pop_back();
+            delete new_info;
+            throw;
+        }
+        if (old == NULL) keys_.push_back(key);
+        return new_info;
+    }
+
+    // Note: the caller must hold the lock serializing the writes
+    size_t size() const noexcept { return keys_.size(); }
+    long long key_at(size_t index) const { return keys_[index]; }
+
+  private:
+    KeyedTable<BlockInfo> table_;
+    // All the `BlockInfo`s ever published, including the superseded
+    // ones
+    std::vector<BlockInfo *> infos_;
+    // Block hashes in the order of registration
+    std::vector<long long> keys_;
+};
+
+/*
+ * Mapping from block hashes to the (sorted) lists of profilers (as
+ * borrowed `PyObject *`s) which registered said blocks, shared by all
+ * the profilers, so that the trace callbacks can tell who is interested
+ * in an event with a single lookup, however many profilers are active.
+ * The lists are interned by content and never freed (a reader may be
+ * looking at a superseded one); there are only ever so many distinct
+ * combinations of profilers anyway.
+ *
+ * Note:
+ *     Since a list may still mention a profiler which has since been
+ *     deallocated (and whose address has since been reused), readers
+ *     must only dereference those that they know to be alive, e.g. by
+ *     checking them against an `InstanceSnapshots` snapshot.
+ */
+class BlockDispatch {
+  public:
+    typedef std::vector<void *> Targets;
+
+    BlockDispatch() {}
+
+    ~BlockDispatch()
+    {
+        for (Targets *targets : lists_) delete targets;
+    }
+
+    BlockDispatch(const BlockDispatch &) = delete;
+    BlockDispatch &operator=(const BlockDispatch &) = delete;
+
+    /*
+     * Returns:
+     *     The profilers which registered the block `key` (if any), or
+     *     `NULL` if none did.
+     */
+    const Targets *find(long long key) const noexcept
+    {
+        return table_.find(key);
+    }
+
+    // Note: the caller must hold the lock serializing the writes
+    void add(long long key, void *item)
+    {
+        const Targets *old = table_.find(key);
+        Targets targets;
+        if (old != NULL) {
+            if (std::binary_search(old->begin(), old->end(), item)) return;
+            targets = *old;
+        }
+        targets.insert(
+            std::upper_bound(targets.begin(), targets.end(), item), item);
+        table_.store(key, intern(targets));
+    }
+
+    // Note: the caller must hold the lock serializing the writes
+    void remove(long long key, void *item)
+    {
+        const Targets *old = table_.find(key);
+        if (old == NULL) return;
+        auto it = std::lower_bound(old->begin(), old->end(), item);
+        if (it == old->end() || *it != item) return;
+        Targets targets(*old);
+        targets.erase(targets.begin() + (it - old->begin()));
+        table_.store(key, intern(targets));
+    }
+
+  private:
+    const Targets *intern(const Targets &targets)
+    {
+        auto it = std::lower_bound(
+            lists_.begin(), lists_.end(), &targets,
+            [](const Targets *a, const Targets *b) { return *a < *b; });
+        if (it != lists_.end() && **it == targets) return *it;
+        size_t pos = it - lists_.begin();
+        lists_.reserve(lists_.size() + 1);
+        Targets *interned = new Targets(targets);
+        lists_.insert(lists_.begin() + pos, interned);
+        return interned;
+    }
+
+    KeyedTable<Targets> table_;
+    // Sorted by content
+    std::vector<Targets *> lists_;
+};
+
+/*
+ * Returns:
+ *     Whether the sorted `items` (e.g. an `InstanceSnapshots` snapshot)
+ *     contain `item`.
+ */
+static inline int lp_contains(
+    const std::vector<void *> *items, void *item) noexcept
+{
+    return std::binary_search(items->begin(), items->end(), item);
+}
+
+/*
+ * Growable array of pointers (e.g. indexed by `lp_thread_index()`),
+ * with lock-free reads.
+ */
+class PointerTable {
+  public:
+    PointerTable() : array_(new_array(64)) {}
+
+    ~PointerTable()
+    {
+        delete_array(array_.load(std::memory_order_relaxed));
+        for (Array *array : retired_arrays_) delete_array(array);
+    }
+
+    PointerTable(const PointerTable &) = delete;
+    PointerTable &operator=(const PointerTable &) = delete;
+
+    void *get(size_t index) const noexcept
+    {
+        const Array *array = array_.load(std::memory_order_acquire);
+        if (index >= array->size) return NULL;
+        return array->items[index].load(std::memory_order_acquire);
+    }
+
+    // Note: the caller must hold the lock serializing the writes
+    void set(size_t index, void *item)
+    {
+        Array *array = array_.load(std::memory_order_relaxed);
+        if (index >= array->size) {
+            size_t size = array->size;
+            while (index >= size) size *= 2;
+            retired_arrays_.reserve(retired_arrays_.size() + 1);
+            Array *grown = new_array(size);
+            for (size_t i = 0; i < array->size; i++)
+                grown->items[i].store(
+                    array->items[i].load(std::memory_order_relaxed),
+                    std::memory_order_relaxed);
+            array_.store(grown, std::memory_order_release);
+            retired_arrays_.push_back(array);
+            array = grown;
+        }
+        array->items[index].store(item, std::memory_order_release);
+    }
+
+  private:
+    struct Array {
+        size_t size;
+        std::atomic<void *> *items;
+    };
+
+    static Array *new_array(size_t size)
+    {
+        Array *array = new Array;
+        array->size = size;
+        try {
+            array->items = new std::atomic<void *>[size];
+        } catch (...) {
+            delete array;
+            throw;
+        }
+        for (size_t i = 0; i < size; i++)
+            array->items[i].store(NULL, std::memory_order_relaxed);
+        return array;
+    }
+
+    static void delete_array(Array *array)
+    {
+        if (array == NULL) return;
+        delete[] array->items;
+        delete array;
+    }
+
+    std::atomic<Array *> array_;
+    std::vector<Array *> retired_arrays_;
+};
+
+/*
+ * Immutable snapshots of the set of active profilers of a
+ * `_LineProfilerManager` (as borrowed `PyObject *`s), so that the trace
+ * callbacks can iterate over it while the owning thread enables and
+ * disables profilers; with `sys.monitoring` the callbacks of one
+ * manager are called on all threads.
+ * Snapshots are interned by content, so that toggling profilers back
+ * and forth doesn't accumulate them.
+ */
+class InstanceSnapshots {
+  public:
+    typedef std::vector<void *> Snapshot;
+
+    InstanceSnapshots() : current_(&empty_) {}
+
+    ~InstanceSnapshots()
+    {
+        for (Snapshot *snapshot : snapshots_) delete snapshot;
+    }
+
+    InstanceSnapshots(const InstanceSnapshots &) = delete;
+    InstanceSnapshots &operator=(const InstanceSnapshots &) = delete;
+
+    // Note: the snapshot is not to be mutated
+    Snapshot *current() const noexcept
+    {
+        return current_.load(std::memory_order_acquire);
+    }
+
+    /*
+     * Publish a snapshot of `items`.
+     *
+     * Note:
+     *     The caller must hold the lock serializing the writes, and is
+     *     responsible for keeping the objects in all snapshots alive
+     *     until `release()`.
+     */
+    void publish(const Snapshot &items)
+    {
+        Snapshot sorted(items);
+        std::sort(sorted.begin(), sorted.end());
+        if (sorted.empty()) {
+            current_.store(&empty_, std::memory_order_release);
+            return;
+        }
+        for (Snapshot *snapshot : snapshots_) {
+            if (*snapshot == sorted) {
+                current_.store(snapshot, std::memory_order_release);
+                return;
+            }
+        }
+        snapshots_.reserve(snapshots_.size() + 1);
+        Snapshot *snapshot = new Snapshot(sorted);
+        snapshots_.push_back(snapshot);
+        current_.store(snapshot, std::memory_order_release);
+    }
+
+    /*
+     * Free all the snapshots but the current one (if any).
+     *
+     * Note:
+     *     The caller must ensure that no callback is reading them, e.g.
+     *     by having unset the callbacks.
+     */
+    void release()
+    {
+        Snapshot *current = current_.load(std::memory_order_relaxed);
+        for (Snapshot *snapshot : snapshots_) {
+            if (snapshot != current) delete snapshot;
+        }
+        snapshots_.clear();
+        if (current != &empty_) snapshots_.push_back(current);
+    }
+
+  private:
+    Snapshot empty_;
+    std::atomic<Snapshot *> current_;
+    std::vector<Snapshot *> snapshots_;
+};
+
+#endif // LINE_PROFILER_CONCURRENT_TABLES_H
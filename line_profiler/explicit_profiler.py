@@ -161,25 +161,53 @@ for ``func2`` and ``func4``.
     # Running with --line-profile will also profile ``func1``
     python demo.py --line-profile
 
+By default, the functions decorated while the profiler is disabled are handed
+back as-is, so that they cost nothing but also can't be profiled later.  With
+``switchable = true`` in the ``[tool.line_profiler.setup]`` table of the config
+file (see :py:attr:`GlobalProfiler.setup_config`), they are instead wrapped in
+a C-level pass-through
+(:py:class:`~line_profiler._line_profiler.PassThrough`), into which
+:func:`line_profiler.profile.enable` swaps the profiling wrappers and from
+which :func:`line_profiler.profile.disable` removes them again; in the example
+above, all four functions would then be profiled (since they are called while
+the profiler is enabled).
+
+To profile a running process on demand (e.g. a service which can't be started
+under :mod:`kernprof`), :func:`line_profiler.profile.capture` enables the
+profiler for a given number of seconds and then writes the results of that
+window to a timestamped ``.lprof`` file, and
+:func:`line_profiler.profile.install_trigger` (or the ``trigger_*`` items of
+the ``[tool.line_profiler.setup]`` table) has a signal or a control socket do
+so (see :py:mod:`line_profiler.trigger`).  Since it makes the decorated
+functions switchable, they cost next to nothing outside of the captures.
+
 The core functionality in this module was ported from :mod:`xdev`.
 """
 
 from __future__ import annotations
 import atexit
+import functools
 import multiprocessing
 import os
 import pathlib
 import sys
+import tempfile
+import threading
 import typing
-from typing import Any, Callable, TypeVar
+import weakref
+from inspect import isasyncgenfunction, iscoroutinefunction, isfunction
+from typing import Any, Callable, Iterable, TypeVar
 
 if typing.TYPE_CHECKING:
+    from .trigger import CaptureTrigger
+
     ConfigArg = str | pathlib.PurePath | bool | None
 
 
 # This is for compatibility
+from ._line_profiler import PassThrough
 from .cli_utils import boolean, get_python_executable as _python_command
-from .line_profiler import LineProfiler
+from .line_profiler import LineProfiler, LineStats
 from .toml_config import ConfigSource
 
 F = TypeVar('F', bound=Callable[..., Any])
@@ -191,6 +219,109 @@ F = TypeVar('F', bound=Callable[..., Any])
 _OWNER_PID_ENVVAR: str = 'LINE_PROFILER_OWNER_PID'
 
 
+def _stats_since(stats: LineStats, base: LineStats) -> LineStats:
+    """
+    Returns:
+        LineStats: The changes in ``stats`` since ``base`` (earlier
+        :py:meth:`LineProfiler.get_stats` of the same profiler), like
+        :py:meth:`LineProfiler.get_stats_delta` would give (plus the
+        per-thread timings), but without moving its cursor.
+
+    Example:
+        >>> base = LineStats({('f', 1, 'spam.py'): [(2, 1, 10)]}, 1e-6)
+        >>> stats = LineStats(
+        ...     {('f', 1, 'spam.py'): [(2, 3, 50), (3, 1, 5)],
+        ...      ('g', 5, 'spam.py'): []},
+        ...     1e-6)
+        >>> _stats_since(stats, base).timings
+        {('f', 1, 'spam.py'): [(2, 2, 40), (3, 1, 5)], ('g', 5, 'spam.py'): []}
+        >>> _stats_since(stats, stats).timings
+        {}
+    """
+
+    def timings_since(timings, base_timings):
+        result = {}
+        for key, entries in timings.items():
+            prev = {lineno: rest for lineno, *rest in base_timings.get(key, ())}
+            diff = []
+            for lineno, nhits, time in entries:
+                prev_nhits, prev_time = prev.get(lineno, (0, 0))
+                if nhits != prev_nhits or time != prev_time:
+                    diff.append((lineno, nhits - prev_nhits, time - prev_time))
+            if diff or key not in base_timings:
+                result[key] = diff
+        return result
+
+    def lines_since(lines_by_key, base_by_key, subtract):
+        result = {}
+        for key, lines in lines_by_key.items():
+            base_lines = base_by_key.get(key, {})
+            diff = {}
+            for lineno, value in lines.items():
+                value = subtract(value, base_lines.get(lineno))
+                if value is not None:
+                    diff[lineno] = value
+            if diff:
+                result[key] = diff
+        return result
+
+    def count_since(count, prev):
+        return (count - (prev or 0)) or None
+
+    def memory_since(counts, prev):
+        if prev is not None:
+            counts = tuple(a - b for a, b in zip(counts, prev))
+        return counts if any(counts) else None
+
+    def hist_since(hist, prev):
+        # Note: the maxima can't be "subtracted", but they combine by
+        # taking the larger one
+        max_time, counts = hist
+        if prev is not None:
+            prev_counts = prev[1]
+            counts = {
+                bucket: count - prev_counts.get(bucket, 0)
+                for bucket, count in counts.items()
+            }
+            counts = {bucket: n for bucket, n in counts.items() if n}
+        return (max_time, counts) if counts else None
+
+    thread_timings = {}
+    for name, timings in stats.thread_timings.items():
+        timings = timings_since(timings, base.thread_timings.get(name, {}))
+        timings = {key: entries for key, entries in timings.items() if entries}
+        if timings:
+            thread_timings[name] = timings
+    return LineStats(
+        timings_since(stats.timings, base.timings),
+        stats.unit,
+        stats.overhead,
+        lines_since(stats.histograms, base.histograms, hist_since),
+        thread_timings,
+        lines_since(stats.self_times, base.self_times, count_since),
+        {
+            event: lines_since(
+                counts, base.counters.get(event, {}), count_since
+            )
+            for event, counts in stats.counters.items()
+        },
+        lines_since(stats.memory, base.memory, memory_since),
+    )
+
+
+# Instances of `GlobalProfiler`, to be reset in forked children
+_GLOBAL_PROFILERS: weakref.WeakSet[GlobalProfiler] = weakref.WeakSet()
+
+
+def _after_fork_in_child() -> None:
+    for global_profiler in list(_GLOBAL_PROFILERS):
+        global_profiler._after_fork_in_child()
+
+
+if hasattr(os, 'register_at_fork'):  # POSIX
+    os.register_at_fork(after_in_child=_after_fork_in_child)
+
+
 class GlobalProfiler:
     """
     Manages a profiler that will output on interpreter exit.
@@ -211,9 +342,14 @@ class GlobalProfiler:
             to the default configuration
 
     Attributes:
-        setup_config (Dict[str, List[str]]):
+        setup_config (Dict[str, Any]):
             Determines how the implicit setup behaves by defining which
-            environment variables / command line flags to look for.
+            environment variables / command line flags to look for, and
+            whether the decorated functions can be switched between
+            profiled and not at runtime (``switchable``; see
+            :py:meth:`.__call__`), and whether to install a trigger for
+            on-demand captures (``trigger_signal``, ``trigger_socket``,
+            and ``trigger_duration``; see :py:meth:`.install_trigger`).
             Defaults to the ``[tool.line_profiler.setup]`` table of the
             loaded config file.
 
@@ -279,9 +415,14 @@ class GlobalProfiler:
     _config: pathlib.PurePath | None
     _profile: LineProfiler | None
     _owner_pid: int | None
+    _switches: weakref.WeakKeyDictionary[PassThrough, Callable | None]
+    _capture: str | None
+    _capture_start: LineStats | None
+    _capture_enabled: bool
+    _trigger: CaptureTrigger | None
     enabled: bool | None
 
-    setup_config: dict[str, list[str]]
+    setup_config: dict[str, Any]
     write_config: dict[str, Any]
     show_config: dict[str, Any]
     output_prefix: str
@@ -294,6 +435,18 @@ class GlobalProfiler:
         self._profile = None
         self._owner_pid = None
         self.enabled = None
+        # Switchable wrappers handed out, and their profiling wrappers
+        # (if created)
+        self._switches = weakref.WeakKeyDictionary()
+        # File being written by the running capture (if any), the stats
+        # when it started, whether it enabled the profiler, and the
+        # trigger starting them (if installed)
+        self._capture = None
+        self._capture_start = None
+        self._capture_enabled = False
+        self._capture_lock = threading.Lock()
+        self._trigger = None
+        _GLOBAL_PROFILERS.add(self)
 
         # Configs:
         # - How to toggle the profiler
@@ -318,6 +471,10 @@ class GlobalProfiler:
         """
         self._profile = profile
         self.enabled = True
+        # The profiling wrappers (if any) may be for another profiler
+        for switch in self._switches:
+            self._switches[switch] = None
+        self._switch_on()
 
     def _implicit_setup(self) -> None:
         """
@@ -331,6 +488,14 @@ class GlobalProfiler:
             boolean(os.environ.get(f, ''), fallback=True) for f in environ_flags
         )
         is_profiling |= any(f in sys.argv for f in cli_flags)
+        trigger_signal = self.setup_config.get('trigger_signal') or None
+        trigger_socket = self.setup_config.get('trigger_socket') or None
+        if (trigger_signal or trigger_socket) and not is_mp_bootstrap():
+            self.install_trigger(
+                signal=trigger_signal,
+                socket_path=trigger_socket,
+                duration=self.setup_config.get('trigger_duration', 30.0),
+            )
         if is_profiling:
             self.enable()
         else:
@@ -370,6 +535,28 @@ class GlobalProfiler:
         self.enabled = True
         if output_prefix is not None:
             self.output_prefix = output_prefix
+        self._switch_on()
+
+    def _switch_on(
+        self, switches: Iterable[PassThrough] | None = None
+    ) -> None:
+        """
+        Swap the profiling wrappers into the switchable wrappers (by
+        default all of them).
+        """
+        assert self._profile is not None
+        for switch in list(self._switches if switches is None else switches):
+            profiled = self._switches[switch]
+            if profiled is None:
+                profiled = self._switches[switch] = self._profile(switch.func)
+            switch.target = profiled
+
+    def _switch_off(self) -> None:
+        """
+        Swap the original functions back into the switchable wrappers.
+        """
+        for switch in list(self._switches):
+            switch.target = switch.func
 
     def _should_skip_due_to_owner(self) -> bool:
         """
@@ -423,9 +610,179 @@ class GlobalProfiler:
 
     def disable(self) -> None:
         """
-        Explicitly initialize and disable this global profiler.
+        Explicitly initialize and disable this global profiler; the
+        switchable wrappers (see :py:meth:`.__call__`) go back to
+        calling the original functions.
         """
         self.enabled = False
+        self._switch_off()
+
+    def capture(
+        self, duration: float, output_prefix: str | None = None
+    ) -> str | None:
+        """
+        Start profiling for ``duration`` seconds, after which the
+        profiler goes back to its previous state and the results of
+        that window are written (atomically, via a temporary file) to
+        the timestamped file
+        ``{output_prefix}_{YYYY-mm-ddTHHMMSS}_{pid}.lprof``.
+
+        Args:
+            duration (float):
+                Length of the capture in seconds
+            output_prefix (str | None):
+                Prefix of the output file; default is
+                :py:attr:`.output_prefix`
+
+        Returns:
+            str | None:
+                The file to be written, or :py:data:`None` if a capture
+                is already running (or profiling can't be enabled in
+                this process)
+
+        Note:
+            * This returns right away (the capture is ended by a
+              timer), so that it can be called from a signal handler
+              (see :py:meth:`.install_trigger`).
+            * Only the functions decorated while the profiler is
+              enabled, or ``switchable`` ones (see
+              :py:meth:`.__call__`), can be profiled; with the latter,
+              they cost next to nothing outside of captures.
+            * Unlike :py:meth:`.enable`, this doesn't set up the
+              writing of the results on exit.
+        """
+        duration = float(duration)
+        if not duration > 0:
+            raise ValueError(f'duration = {duration!r}: must be positive')
+        # Note: don't block, since this may be called from a signal
+        # handler interrupting the thread holding the lock
+        if not self._capture_lock.acquire(blocking=False):
+            return None
+        try:
+            if self._capture is not None:
+                return None
+            if self._profile is None:
+                self._profile = LineProfiler()
+            was_enabled = bool(self.enabled)
+            if not was_enabled:
+                self.enable()
+                if not self.enabled:
+                    return None
+            from datetime import datetime as datetime_cls
+
+            timestamp = datetime_cls.now().strftime('%Y-%m-%dT%H%M%S')
+            if output_prefix is None:
+                output_prefix = self.output_prefix
+            filename = f'{output_prefix}_{timestamp}_{os.getpid()}.lprof'
+            # Start the window
+            # Note: this snapshots the stats instead of using
+            # `LineProfiler.get_stats_delta()`, whose cursor may belong
+            # to an incremental log (e.g. `kernprof --incremental`, or
+            # that of a worker process)
+            self._capture_start = self._profile.get_stats()
+            self._capture_enabled = not was_enabled
+            timer = threading.Timer(
+                duration, self._end_capture, (filename, was_enabled)
+            )
+            timer.daemon = True
+            timer.start()
+            self._capture = filename
+            self._debug('capture:start', filename=filename, duration=duration)
+            return filename
+        finally:
+            self._capture_lock.release()
+
+    def _end_capture(self, filename: str, was_enabled: bool) -> None:
+        with self._capture_lock:
+            try:
+                if not was_enabled:
+                    self.disable()
+                assert self._profile is not None
+                assert self._capture_start is not None
+                stats = _stats_since(
+                    self._profile.get_stats(), self._capture_start
+                )
+                dirname = os.path.dirname(os.path.abspath(filename))
+                os.makedirs(dirname, exist_ok=True)
+                handle, tmp_path = tempfile.mkstemp(
+                    suffix='.lprof.tmp', dir=dirname
+                )
+                os.close(handle)
+                try:
+                    stats.to_file(tmp_path)
+                    os.replace(tmp_path, filename)
+                except BaseException:
+                    os.remove(tmp_path)
+                    raise
+                self._debug('capture:end', filename=filename)
+                print('Wrote profile results to %s' % filename)
+            finally:
+                self._capture = None
+                self._capture_start = None
+                self._capture_enabled = False
+
+    def _after_fork_in_child(self) -> None:
+        """
+        End the capture running (if any) in a forked child, where the
+        timer which was to end it is gone: go back to the state before
+        the capture, without writing (the parent does).
+        """
+        self._capture_lock = threading.Lock()
+        if self._capture is None:
+            return
+        if self._capture_enabled:
+            self.disable()
+        self._capture = None
+        self._capture_start = None
+        self._capture_enabled = False
+
+    def install_trigger(
+        self,
+        signal: int | str | None = None,
+        socket_path: str | os.PathLike[str] | None = None,
+        duration: float = 30.0,
+    ) -> CaptureTrigger:
+        """
+        Have a signal and/or a control socket start :py:meth:`.capture`-s,
+        so that a running process can be profiled on demand.
+
+        Args:
+            signal (int | str | None):
+                Signal to capture upon (e.g. ``'SIGUSR1'``)
+            socket_path (str | os.PathLike[str] | None):
+                Path of the Unix-domain control socket to listen on
+            duration (float):
+                Default duration of the captures in seconds
+
+        Returns:
+            CaptureTrigger:
+                The trigger (replacing the one previously installed, if
+                any); see :py:mod:`line_profiler.trigger`
+
+        Note:
+            This makes the functions decorated from now on
+            ``switchable`` (see :py:meth:`.__call__`), so that they
+            can be profiled in the captures. The trigger can also be
+            installed via the ``trigger_signal``, ``trigger_socket``,
+            and ``trigger_duration`` items of
+            :py:attr:`.setup_config`.
+        """
+        from .trigger import CaptureTrigger
+
+        trigger = CaptureTrigger(
+            self.capture,
+            signal=signal,
+            socket_path=socket_path,
+            duration=duration,
+            status=lambda: self._capture,
+        )
+        if self._trigger is not None:
+            self._trigger.uninstall()
+        trigger.install()
+        self._trigger = trigger
+        self.setup_config['switchable'] = True
+        self._debug('trigger:installed', signal=signal, socket=socket_path)
+        return trigger
 
     def __call__(self, func: Callable) -> Callable:
         """
@@ -433,11 +790,31 @@ class GlobalProfiler:
         profiler on function entry and stop it on function exit. Otherwise
         return the input.
 
+        If ``setup_config['switchable']`` is true, (non-async) functions
+        are instead wrapped in a
+        :py:class:`~line_profiler._line_profiler.PassThrough`, which
+        calls the profiling wrapper while the profiler is enabled and the
+        function itself otherwise, even if the profiler is
+        :py:meth:`.enable`-d or :py:meth:`.disable`-d after decorating
+        the function.
+
         Args:
             func (Callable): the function to profile
 
         Returns:
             Callable: a potentially wrapped function
+
+        Example:
+            >>> from line_profiler.explicit_profiler import GlobalProfiler
+            >>> self = GlobalProfiler()
+            >>> self.setup_config['switchable'] = True
+            >>> self.disable()
+            >>> def func(x):
+            ...     return x + 1
+            >>> switch = self(func)
+            >>> assert switch is not func and switch.__wrapped__ is func
+            >>> assert switch.target is func
+            >>> assert switch(1) == 2
         """
         # from multiprocessing import current_process
         # if current_process().name != 'MainProcess':
@@ -446,6 +823,12 @@ class GlobalProfiler:
         if self.enabled is None:
             # Force a setup if we haven't done it before.
             self._implicit_setup()
+        if self.setup_config.get('switchable') and _is_switchable(func):
+            switch = functools.update_wrapper(PassThrough(func), func)
+            self._switches[switch] = None
+            if self.enabled:
+                self._switch_on([switch])
+            return switch
         if not self.enabled:
             return func
         assert self._profile is not None
@@ -517,6 +900,15 @@ class GlobalProfiler:
             print(py_exe + ' -m line_profiler -rtmz ' + str(lprof_output_fpath))
 
 
+def _is_switchable(func: Any) -> bool:
+    # Note: async functions are left alone, since wrapping them in a
+    # non-function object would hide them from e.g.
+    # `inspect.iscoroutinefunction()`
+    return isfunction(func) and not (
+        iscoroutinefunction(func) or isasyncgenfunction(func)
+    )
+
+
 def is_mp_bootstrap() -> bool:
     """
     True when this interpreter invocation looks like multiprocessing
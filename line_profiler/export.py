@@ -0,0 +1,504 @@
+"""
+Export of line-profiling results to the formats of other profiling
+tools:
+
+* :py:func:`to_pprof`: the `pprof <https://github.com/google/pprof>`_
+  protobuf (as read by ``go tool pprof``, Grafana Pyroscope, etc.), with
+  a location for each profiled line and the sample types ``hits``,
+  ``time``, and (if available) ``self_time``, one for each counted
+  hardware event (e.g. ``cycles``), and the allocation counters
+  ``alloc_objects``, ``alloc_space``, and ``inuse_space``;
+* :py:func:`to_speedscope`: the `speedscope
+  <https://www.speedscope.app>`_ JSON file format, with a ``function ->
+  line`` stack for each profiled line (and a profile for each thread if
+  the timings are broken down by thread);
+* :py:func:`to_chrome_trace`: the Chrome trace-event JSON format (as
+  read by ``chrome://tracing`` and Perfetto), with a counter track per
+  function showing the time spent on each of its lines over time, from
+  the frames of an incremental log (as periodically written by
+  ``kernprof -l -i INTERVAL --incremental``).
+
+Since line profiles hold no call stacks, the line timings are
+inclusive; where :py:attr:`LineStats.self_times
+<line_profiler.line_profiler.LineStats.self_times>` are available,
+they are exported alongside.
+
+The same is available from the command line as
+``python -m line_profiler export -f FORMAT -o OUTPUT FILE [FILE ...]``.
+
+Example:
+    >>> import json
+    >>> import os
+    >>> import tempfile
+    >>> from line_profiler import LineStats
+    >>>
+    >>>
+    >>> stats = LineStats(
+    ...     {('spam.py', 1, 'foo'): [(2, 10, 300), (3, 1, 100)]}, 1E-6)
+    >>> with tempfile.TemporaryDirectory() as tmpdir:
+    ...     to_pprof(stats, os.path.join(tmpdir, 'out.pb.gz'))
+    ...     fname = os.path.join(tmpdir, 'out.speedscope.json')
+    ...     to_speedscope(stats, fname)
+    ...     with open(fname) as f:
+    ...         profile, = json.load(f)['profiles']
+    >>> profile['samples'], profile['weights']
+    ([[0, 1], [0, 2]], [300000, 100000])
+"""
+
+from __future__ import annotations
+
+import functools
+import gzip
+import json
+import os
+import time
+from argparse import ArgumentParser
+from collections.abc import Callable, Iterable, Mapping, Sequence
+from os import PathLike
+from typing import Any, Dict, List, Tuple
+
+from .cli_utils import add_argument
+from .line_profiler import LineStats, _match_patterns
+from .stats_file import StatsLog, is_stats_file
+
+__all__ = (
+    'FORMATS',
+    'encode_pprof',
+    'to_pprof',
+    'to_speedscope',
+    'to_chrome_trace',
+    'main',
+)
+
+#: Formats known to :py:func:`main`
+FORMATS = ('pprof', 'speedscope', 'chrome')
+
+_Key = Tuple[str, int, str]
+_Entries = Sequence[Tuple[int, int, float]]
+_Selector = Callable[[_Key], bool]
+
+
+def _to_nanoseconds(time_: float, unit: float) -> int:
+    return int(round(time_ * unit * 1E9))
+
+
+def _label(key: _Key) -> str:
+    filename, first_lineno, name = key
+    return f'{name} ({filename}:{first_lineno})'
+
+
+# pprof (see `profile.proto` in https://github.com/google/pprof)
+
+
+def _varint(value: int) -> bytes:
+    # Note: negative `int64` values are encoded as 10-byte two's
+    # complements
+    value &= (1 << 64) - 1
+    out = bytearray()
+    while value > 0x7F:
+        out.append((value & 0x7F) | 0x80)
+        value >>= 7
+    out.append(value)
+    return bytes(out)
+
+
+def _field_varint(field: int, value: int) -> bytes:
+    if not value:  # Proto3 default, omitted
+        return b''
+    return _varint(field << 3) + _varint(value)
+
+
+def _field_bytes(field: int, value: bytes) -> bytes:
+    return _varint(field << 3 | 2) + _varint(len(value)) + value
+
+
+def _field_packed(field: int, values: Iterable[int]) -> bytes:
+    return _field_bytes(field, b''.join(_varint(v) for v in values))
+
+
+class _StringTable:
+    def __init__(self) -> None:
+        self.strings: List[str] = ['']
+        self._index: Dict[str, int] = {'': 0}
+
+    def __getitem__(self, string: str) -> int:
+        try:
+            return self._index[string]
+        except KeyError:
+            self._index[string] = index = len(self.strings)
+            self.strings.append(string)
+            return index
+
+
+def _value_type(strings: _StringTable, type_: str, unit: str) -> bytes:
+    return _field_varint(1, strings[type_]) + _field_varint(2, strings[unit])
+
+
+def encode_pprof(stats: LineStats, time_nanos: int | None = None) -> bytes:
+    """
+    Arguments:
+        stats (LineStats):
+            Profiling results
+        time_nanos (int | None):
+            Time of the profile (nanoseconds since the epoch); default
+            is now
+
+    Returns:
+        data (bytes):
+            Serialized (uncompressed) ``perftools.profiles.Profile``
+            message, with a sample (of a single location) for each
+            profiled line
+    """
+    strings = _StringTable()
+    self_times = stats.self_times or {}
+    sample_types = [('hits', 'count'), ('time', 'nanoseconds')]
+    if self_times:
+        sample_types.append(('self_time', 'nanoseconds'))
+    counters = getattr(stats, 'counters', None) or {}
+    sample_types.extend((event, 'count') for event in counters)
+    memory = getattr(stats, 'memory', None) or {}
+    if memory:
+        sample_types += [
+            ('alloc_objects', 'count'),
+            ('alloc_space', 'bytes'),
+            ('inuse_space', 'bytes'),
+        ]
+    messages = [
+        _field_bytes(1, _value_type(strings, type_, unit))
+        for type_, unit in sample_types
+    ]
+    samples, locations, functions = [], [], []
+    for function_id, (key, entries) in enumerate(
+        sorted(stats.timings.items()), 1
+    ):
+        filename, first_lineno, name = key
+        functions.append(
+            _field_varint(1, function_id)
+            + _field_varint(2, strings[name])
+            + _field_varint(3, strings[name])
+            + _field_varint(4, strings[filename])
+            + _field_varint(5, first_lineno)
+        )
+        line_self_times = self_times.get(key, {})
+        for lineno, nhits, time_ in entries:
+            location_id = len(locations) + 1
+            locations.append(
+                _field_varint(1, location_id)
+                + _field_bytes(
+                    4, _field_varint(1, function_id) + _field_varint(2, lineno)
+                )
+            )
+            values = [nhits, _to_nanoseconds(time_, stats.unit)]
+            if self_times:
+                values.append(
+                    _to_nanoseconds(line_self_times.get(lineno, 0), stats.unit)
+                )
+            values.extend(
+                max(counts.get(key, {}).get(lineno, 0), 0)
+                for counts in counters.values()
+            )
+            if memory:
+                values.extend(
+                    max(value, 0)
+                    for value in memory.get(key, {}).get(lineno, (0, 0, 0))
+                )
+            samples.append(
+                _field_packed(1, [location_id]) + _field_packed(2, values)
+            )
+    messages.extend(_field_bytes(2, sample) for sample in samples)
+    messages.extend(_field_bytes(4, location) for location in locations)
+    messages.extend(_field_bytes(5, function) for function in functions)
+    if time_nanos is None:
+        time_nanos = time.time_ns()
+    # Note: the string table has to be complete before it's written
+    period_type = _value_type(strings, 'time', 'nanoseconds')
+    default_sample_type = strings['time']
+    messages.extend(
+        _field_bytes(6, string.encode('utf-8', 'surrogateescape'))
+        for string in strings.strings
+    )
+    messages.append(_field_varint(9, time_nanos))
+    messages.append(_field_bytes(11, period_type))
+    messages.append(_field_varint(14, default_sample_type))
+    return b''.join(messages)
+
+
+def to_pprof(
+    stats: LineStats,
+    file: PathLike[str] | str,
+    *,
+    compress: bool = True,
+    time_nanos: int | None = None,
+) -> None:
+    """
+    Write ``stats`` as a pprof profile (see :py:func:`encode_pprof`).
+
+    Arguments:
+        stats (LineStats):
+            Profiling results
+        file (str | os.PathLike[str]):
+            Filename
+        compress (bool):
+            Whether to gzip the profile (as pprof tools usually expect)
+        time_nanos (int | None):
+            See :py:func:`encode_pprof`
+    """
+    data = encode_pprof(stats, time_nanos)
+    if compress:
+        data = gzip.compress(data, mtime=0)
+    with open(file, 'wb') as f:
+        f.write(data)
+
+
+# speedscope (see https://www.speedscope.app/file-format-schema.json)
+
+
+def to_speedscope(
+    stats: LineStats, file: PathLike[str] | str, *, name: str | None = None
+) -> None:
+    """
+    Write ``stats`` as a speedscope profile.
+
+    Arguments:
+        stats (LineStats):
+            Profiling results
+        file (str | os.PathLike[str]):
+            Filename
+        name (str | None):
+            Name of the profile; default is the name of ``file``
+
+    Note:
+        The file has a ``sampled`` profile holding a ``function ->
+        line`` stack with the time of each line (in nanoseconds), then
+        a profile of the self times (if any), and a profile for each
+        thread (if the timings are broken down by thread).
+    """
+    frames: List[Dict[str, Any]] = []
+    frame_ids: Dict[Tuple[_Key, int | None], int] = {}
+
+    def get_frame(key: _Key, lineno: int | None) -> int:
+        try:
+            return frame_ids[key, lineno]
+        except KeyError:
+            pass
+        filename, first_lineno, func_name = key
+        if lineno is None:
+            frame = {'name': func_name, 'file': filename, 'line': first_lineno}
+        else:
+            frame = {
+                'name': f'{func_name}:{lineno}',
+                'file': filename,
+                'line': lineno,
+            }
+        frame_ids[key, lineno] = len(frames)
+        frames.append(frame)
+        return frame_ids[key, lineno]
+
+    def make_profile(
+        profile_name: str, timings: Mapping[_Key, _Entries]
+    ) -> Dict[str, Any]:
+        samples, weights = [], []
+        for key, entries in sorted(timings.items()):
+            for lineno, _, time_ in entries:
+                samples.append([get_frame(key, None), get_frame(key, lineno)])
+                weights.append(_to_nanoseconds(time_, stats.unit))
+        return {
+            'type': 'sampled',
+            'name': profile_name,
+            'unit': 'nanoseconds',
+            'startValue': 0,
+            'endValue': sum(weights),
+            'samples': samples,
+            'weights': weights,
+        }
+
+    profiles = [make_profile('Time', stats.timings)]
+    if stats.self_times:
+        profiles.append(
+            make_profile(
+                'Self time',
+                {
+                    key: [
+                        (lineno, 0, self_time)
+                        for lineno, self_time in sorted(line_times.items())
+                    ]
+                    for key, line_times in stats.self_times.items()
+                },
+            )
+        )
+    for thread, timings in sorted((stats.thread_timings or {}).items()):
+        profiles.append(make_profile(f'Time ({thread})', timings))
+    if name is None:
+        name = os.path.basename(os.fspath(file))
+    document = {
+        '$schema': 'https://www.speedscope.app/file-format-schema.json',
+        'shared': {'frames': frames},
+        'profiles': profiles,
+        'name': name,
+        'activeProfileIndex': 0,
+        'exporter': 'line_profiler',
+    }
+    with open(file, 'w', encoding='utf-8', errors='surrogateescape') as f:
+        json.dump(document, f)
+
+
+# Chrome trace events (see the "Trace Event Format" document)
+
+
+def to_chrome_trace(
+    log: PathLike[str] | str,
+    file: PathLike[str] | str,
+    *,
+    select: _Selector | None = None,
+) -> None:
+    """
+    Write the timeline of the incremental log ``log`` as Chrome trace
+    events.
+
+    Arguments:
+        log (str | os.PathLike[str]):
+            Filename of a binary ``.lprof`` file, whose frames are the
+            snapshots to plot (see
+            :py:func:`line_profiler.stats_file.append_stats`)
+        file (str | os.PathLike[str]):
+            Filename to write to
+        select (Callable[[tuple[str, int, str]], bool] | None):
+            Optional callable choosing the functions to include (see
+            :py:meth:`LineStats.from_files()
+            <line_profiler.line_profiler.LineStats.from_files>`)
+
+    Note:
+        Each function gets a counter track, with a series per line
+        giving the time (in milliseconds) spent on the line in each
+        interval between snapshots; the first interval is taken to be
+        as long as the second, since the log doesn't record when
+        profiling started.
+    """
+    if not is_stats_file(log):
+        raise ValueError(
+            f'{os.fspath(log)!r}: not a binary `.lprof` file (pickled '
+            'results have no timeline)'
+        )
+    with StatsLog(log) as stats_log:
+        unit = stats_log.unit
+        timestamps = stats_log.timestamps
+        deltas = [frame.select(select) for frame in stats_log.frames]
+    if len(timestamps) > 1:
+        start = max(2 * timestamps[0] - timestamps[1], 0)
+    else:
+        start = timestamps[0]
+    lines: Dict[_Key, List[int]] = {}
+    for delta in deltas:
+        for key, entries in delta.items():
+            known = lines.setdefault(key, [])
+            known.extend(
+                lineno for lineno, _, _ in entries if lineno not in known
+            )
+    pid = 1
+    events: List[Dict[str, Any]] = [
+        {
+            'name': 'process_name',
+            'ph': 'M',
+            'pid': pid,
+            'args': {'name': f'line_profiler: {os.fspath(log)}'},
+        }
+    ]
+    # Note: each counter event holds the values from its time until the
+    # next one, so the snapshot closing an interval is plotted from its
+    # start, and all the series are brought back to zero in the end
+    interval_starts = [start] + timestamps[:-1]
+    for interval_start, delta in zip(interval_starts, deltas):
+        ts = (interval_start - start) * 1E6
+        for key, linenos in sorted(lines.items()):
+            times = {lineno: 0.0 for lineno in linenos}
+            for lineno, _, time_ in delta.get(key, ()):
+                times[lineno] += time_ * unit * 1E3
+            events.append(
+                {
+                    'name': _label(key),
+                    'ph': 'C',
+                    'ts': ts,
+                    'pid': pid,
+                    'args': {f'line {n}': t for n, t in sorted(times.items())},
+                }
+            )
+    end_ts = (timestamps[-1] - start) * 1E6
+    for key, linenos in sorted(lines.items()):
+        events.append(
+            {
+                'name': _label(key),
+                'ph': 'C',
+                'ts': end_ts,
+                'pid': pid,
+                'args': {f'line {n}': 0.0 for n in sorted(linenos)},
+            }
+        )
+    document = {'traceEvents': events, 'displayTimeUnit': 'ms'}
+    with open(file, 'w', encoding='utf-8', errors='surrogateescape') as f:
+        json.dump(document, f)
+
+
+def main(argv: Sequence[str] | None = None) -> None:
+    """
+    The CLI to export ``.lprof`` files to other formats
+    (``python -m line_profiler export``).
+    """
+    parser = ArgumentParser(
+        prog='python -m line_profiler export',
+        description='Export line profiling results (`.lprof` files) to '
+        'the formats of other profiling tools.',
+    )
+    add_argument(
+        parser,
+        '-f',
+        '--format',
+        required=True,
+        choices=FORMATS,
+        help="Format to export to: 'pprof' (gzipped protobuf), "
+        "'speedscope' (JSON), or 'chrome' (trace-event JSON of the "
+        'timeline of an incremental log, as written by '
+        '`kernprof -l -i INTERVAL --incremental`).',
+    )
+    add_argument(
+        parser,
+        '-o',
+        '--output',
+        required=True,
+        help='File to write the exported results to.',
+    )
+    add_argument(
+        parser,
+        '-k',
+        '--filter',
+        action='append',
+        dest='filters',
+        metavar='PATTERN',
+        help='Only export the functions whose (qualified) names or '
+        'filenames match the glob pattern; can be given multiple times. '
+        '(Default: export all functions)',
+    )
+    add_argument(
+        parser,
+        'inputs',
+        nargs='+',
+        metavar='FILE',
+        help="'*.lprof' file(s) to export (the sum of which is exported, "
+        "except with '--format=chrome', which takes a single file).",
+    )
+    args = parser.parse_args(argv)
+    select = None
+    if args.filters:
+        select = functools.partial(_match_patterns, args.filters)
+    if args.format == 'chrome':
+        if len(args.inputs) > 1:
+            parser.error('--format=chrome: only takes a single file')
+        try:
+            to_chrome_trace(args.inputs[0], args.output, select=select)
+        except ValueError as e:
+            parser.error(str(e))
+        return
+    stats = LineStats.from_files(*args.inputs, select=select)
+    if args.format == 'pprof':
+        to_pprof(stats, args.output)
+    else:
+        to_speedscope(stats, args.output)
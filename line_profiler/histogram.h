@@ -0,0 +1,54 @@
+// Logarithmic histograms of line durations for `_line_profiler.pyx`
+// (see `LineProfiler.histograms`).
+//
+// Durations (in timer units) are binned HDR-style: exactly for values
+// below `LP_HIST_SUBBUCKETS`, and then into `LP_HIST_SUBBUCKETS`
+// equal-width sub-buckets per power of two, so that the bucket bounds
+// are within 1 / `LP_HIST_SUBBUCKETS` of any value therein.  The
+// layout is mirrored by `line_profiler.histograms`, and must not be
+// changed without bumping the version of the `.lprof` format.
+
+#ifndef LINE_PROFILER_HISTOGRAM_H
+#define LINE_PROFILER_HISTOGRAM_H
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#define LP_HIST_SUBBUCKET_BITS 2
+#define LP_HIST_SUBBUCKETS (1 << LP_HIST_SUBBUCKET_BITS)
+// Enough for durations up to 2 ** 33 timer units (e.g. ~8.6 s with a
+// nanosecond timer); longer ones go into the last bucket (the maximum
+// is tracked separately)
+#define LP_HIST_BUCKETS 128
+
+static inline int lp_hist_msb(unsigned long long value)
+{
+#if defined(_MSC_VER) && defined(_WIN64)
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return (int)index;
+#elif defined(__GNUC__) || defined(__clang__)
+    return 63 - __builtin_clzll(value);
+#else
+    int index = 0;
+    while (value >>= 1) index++;
+    return index;
+#endif
+}
+
+/*
+ * Index of the bucket for a duration of `delta` timer units.
+ */
+static inline int lp_hist_bucket(long long delta)
+{
+    int msb, bucket;
+    if (delta < LP_HIST_SUBBUCKETS) return delta < 0 ? 0 : (int)delta;
+    msb = lp_hist_msb((unsigned long long)delta);
+    bucket = ((msb - LP_HIST_SUBBUCKET_BITS + 1) << LP_HIST_SUBBUCKET_BITS)
+             + (int)((delta >> (msb - LP_HIST_SUBBUCKET_BITS))
+                     & (LP_HIST_SUBBUCKETS - 1));
+    return bucket < LP_HIST_BUCKETS ? bucket : LP_HIST_BUCKETS - 1;
+}
+
+#endif // LINE_PROFILER_HISTOGRAM_H
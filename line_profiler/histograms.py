@@ -0,0 +1,165 @@
+"""
+Logarithmic histograms of the durations of the hits of profiled lines
+(see :py:attr:`LineProfiler.histograms
+<line_profiler._line_profiler.LineProfiler.histograms>` and
+:py:attr:`LineStats.histograms
+<line_profiler.line_profiler.LineStats.histograms>`).
+
+Durations (in timer units) are binned HDR-style: exactly below
+:py:data:`SUBBUCKETS`, and then into :py:data:`SUBBUCKETS` equal-width
+buckets per power of two, so that the bounds of a bucket are within
+``1 / SUBBUCKETS`` (25%) of the durations in it; durations too long for
+the last of the :py:data:`NBUCKETS` buckets are counted therein.  A
+histogram is stored sparsely as a mapping from bucket indices to their
+(non-zero) counts, along with the longest duration.
+
+Note:
+    The layout mirrors the one in ``histogram.h`` (used by the trace
+    callbacks), and is also that of the histograms in ``.lprof`` files.
+
+Example:
+    >>> counts = {}
+    >>> for duration in [1000] * 98 + [50_000, 1_000_000]:
+    ...     bucket = bucket_of(duration)
+    ...     counts[bucket] = counts.get(bucket, 0) + 1
+    >>> lo, hi = bucket_bounds(bucket_of(1000))
+    >>> assert lo <= 1000 < hi
+    >>> assert percentile(counts, 50) == hi - 1
+    >>> assert 50_000 <= percentile(counts, 99) < 1.25 * 50_000
+    >>> assert percentile(counts, 100, max_time=1_000_000) == 1_000_000
+"""
+
+from __future__ import annotations
+
+from collections.abc import Iterable, Mapping
+from typing import Dict, Tuple
+
+__all__ = (
+    'SUBBUCKET_BITS',
+    'SUBBUCKETS',
+    'NBUCKETS',
+    'bucket_of',
+    'bucket_bounds',
+    'percentile',
+    'merge',
+    'rescale',
+)
+
+#: Base-2 logarithm of the number of buckets per power of two
+SUBBUCKET_BITS = 2
+#: Number of buckets per power of two
+SUBBUCKETS = 1 << SUBBUCKET_BITS
+#: Number of buckets
+NBUCKETS = 128
+
+Histogram = Tuple[int, Dict[int, int]]
+
+
+def bucket_of(duration: int) -> int:
+    """
+    Returns:
+        Index of the bucket for ``duration`` (in timer units)
+    """
+    duration = int(duration)
+    if duration < SUBBUCKETS:
+        return max(duration, 0)
+    msb = duration.bit_length() - 1
+    bucket = ((msb - SUBBUCKET_BITS + 1) << SUBBUCKET_BITS) + (
+        (duration >> (msb - SUBBUCKET_BITS)) & (SUBBUCKETS - 1)
+    )
+    return min(bucket, NBUCKETS - 1)
+
+
+def bucket_bounds(bucket: int) -> tuple[int, int]:
+    """
+    Returns:
+        The smallest duration in ``bucket`` and the smallest one past
+        it (in timer units); the last bucket also holds all the longer
+        durations
+
+    Example:
+        >>> [bucket_bounds(i) for i in (0, 3, 4, 7, 8, 12)]
+        [(0, 1), (3, 4), (4, 5), (7, 8), (8, 10), (16, 20)]
+        >>> assert all(
+        ...     bucket_of(d) == i
+        ...     for i in range(NBUCKETS - 1)
+        ...     for d in set(bucket_bounds(i)) - {bucket_bounds(i)[1]})
+    """
+    if bucket < SUBBUCKETS:
+        return bucket, bucket + 1
+    octave, sub = divmod(bucket, SUBBUCKETS)
+    shift = octave - 1
+    return (SUBBUCKETS + sub) << shift, (SUBBUCKETS + sub + 1) << shift
+
+
+def percentile(
+    counts: Mapping[int, int], q: float, max_time: int | None = None
+) -> int:
+    """
+    Arguments:
+        counts (Mapping[int, int]):
+            Counts of the hits by bucket
+        q (float):
+            Percentile (0 to 100)
+        max_time (int | None):
+            Longest duration, if known
+
+    Returns:
+        Upper bound (in timer units) of the durations of the
+        (``q``)% quickest hits, i.e. the largest duration in the bucket
+        holding the hit at that rank (capped at ``max_time``); 0 if
+        there are no hits
+    """
+    total = sum(counts.values())
+    if not total:
+        return 0
+    rank = max(q / 100 * total, 1)
+    seen = 0
+    for bucket in sorted(counts):
+        seen += counts[bucket]
+        if seen >= rank:
+            break
+    value = bucket_bounds(bucket)[1] - 1
+    if max_time is not None and (max_time < value or bucket == NBUCKETS - 1):
+        value = max_time
+    return value
+
+
+def merge(histograms: Iterable[Histogram]) -> Histogram:
+    """
+    Returns:
+        Sum of the ``(max_time, counts)`` histograms
+
+    Example:
+        >>> merge([(10, {9: 1}), (5, {5: 2, 9: 1})])
+        (10, {9: 2, 5: 2})
+    """
+    max_time = 0
+    total: Dict[int, int] = {}
+    for hist_max, counts in histograms:
+        max_time = max(max_time, hist_max)
+        for bucket, count in counts.items():
+            total[bucket] = total.get(bucket, 0) + count
+    return max_time, total
+
+
+def rescale(histogram: Histogram, factor: float) -> Histogram:
+    """
+    Returns:
+        ``histogram`` with the durations multiplied by ``factor`` (e.g.
+        to convert between timer units); the counts of each bucket are
+        moved to the bucket of the (scaled) middle of its bounds
+
+    Example:
+        >>> rescale((20, {12: 3}), 0.5)
+        (10, {8: 3})
+    """
+    if factor == 1:
+        return histogram[0], dict(histogram[1])
+    max_time, counts = histogram
+    scaled: Dict[int, int] = {}
+    for bucket, count in counts.items():
+        lo, hi = bucket_bounds(bucket)
+        new = bucket_of(round((lo + hi - 1) / 2 * factor))
+        scaled[new] = scaled.get(new, 0) + count
+    return int(round(max_time * factor)), scaled
@@ -90,7 +90,7 @@ class _ParseParamResult:
             :py:class:`str` of unparsed argument(s).
         ``.dump_raw_dest``
             (Descriptor) :py:class:`pathlib.Path` to write the raw
-            (pickled) profiling results to, or :py:data:`None` if not to
+            (binary ``.lprof``) profiling results to, or :py:data:`None` if not to
             be written.
         ``.dump_text_dest``
             (Descriptor) :py:class:`pathlib.Path` to write the
@@ -373,7 +373,7 @@ class LineProfilerMagics(Magics):
         dump_file = run_result.parse_result.dump_raw_dest
         if dump_file is not None:
             prof.dump_stats(dump_file)
-            print(f'\n*** Profile stats pickled to file {str(dump_file)!r}.')
+            print(f'\n*** Profile stats written to file {str(dump_file)!r}.')
 
         text_file = run_result.parse_result.dump_text_dest
         if text_file is not None:
@@ -417,7 +417,7 @@ class LineProfilerMagics(Magics):
         One or more ``-f`` or ``-m`` options are required to get any
         useful results.
 
-        ``-D <filename>``: dump the raw statistics out to a pickle file
+        ``-D <filename>``: dump the raw statistics out to a binary file
         on disk. The usual extension for this is ``.lprof``. These
         statistics may be viewed later by running
         ``python -m line_profiler``.
@@ -496,7 +496,7 @@ class LineProfilerMagics(Magics):
 
         Options:
 
-        ``-D <filename>``: dump the raw statistics out to a pickle file
+        ``-D <filename>``: dump the raw statistics out to a binary file
         on disk. The usual extension for this is ``.lprof``. These
         statistics may be viewed later by running
         ``python -m line_profiler``.
@@ -7,6 +7,7 @@ Cython backend.
 
 from __future__ import annotations
 
+import fnmatch
 import functools
 import io
 import inspect
@@ -16,6 +17,7 @@ import os
 import pickle
 import sys
 import tempfile
+import time
 import types
 import tokenize
 from argparse import ArgumentParser
@@ -45,6 +47,7 @@ except ImportError as ex:
         f'Has it been compiled? Underlying error is ex={ex!r}'
     )
 from . import _diagnostics as diagnostics
+from . import histograms as _hist
 from .cli_utils import (
     add_argument,
     get_cli_config,
@@ -53,20 +56,48 @@ from .cli_utils import (
 )
 from .profiler_mixin import ByCountProfilerMixin, is_c_level_callable
 from .scoping_policy import ScopingPolicy, ScopingPolicyDict
+from .stats_file import StatsLog, append_stats, is_stats_file, write_stats
 from .toml_config import ConfigSource
 
 if TYPE_CHECKING:  # pragma: no cover
     from typing_extensions import ParamSpec, Self
 
+    from .live import LivePublisher
+    from .workers import WorkerCollector
+
     class _IPythonLike(Protocol):
         def register_magics(self, magics: type) -> None: ...
 
     PS = ParamSpec('PS')
     _TimingsMap = Mapping[Tuple[str, int, str], list[Tuple[int, int, int]]]
+    _HistogramsMap = Mapping[
+        Tuple[str, int, str], Mapping[int, Tuple[int, Mapping[int, int]]]
+    ]
+    _ThreadTimingsMap = Mapping[str, _TimingsMap]
+    _SelfTimesMap = Mapping[Tuple[str, int, str], Mapping[int, int]]
+    _CountersMap = Mapping[str, _SelfTimesMap]
+    _MemoryMap = Mapping[
+        Tuple[str, int, str], Mapping[int, Tuple[int, int, int]]
+    ]
     T = TypeVar('T')
     T_co = TypeVar('T_co', covariant=True)
 
-ColumnLiterals = Literal['line', 'hits', 'time', 'perhit', 'percent']
+ColumnLiterals = Literal[
+    'line',
+    'hits',
+    'time',
+    'perhit',
+    'percent',
+    'self',
+    'counter',
+    'allocs',
+    'allocated',
+    'retained',
+    'p50',
+    'p99',
+    'max',
+    'thread',
+]
 
 
 # NOTE: This needs to be in sync with ../kernprof.py and __init__.py
@@ -196,6 +227,34 @@ def get_code_block(filename: os.PathLike[str] | str, lineno: int) -> list[str]:
         namespace['BlockFinder'] = BlockFinder
 
 
+# Code blocks found by `_get_cached_code_block()`, keyed by filename and
+# first line number, along with the (`linecache`-d) lines of the file
+# they were found in
+_CODE_BLOCKS: dict[tuple[str, int], tuple[list[str], list[str]]] = {}
+
+
+def _get_cached_code_block(filename: str, lineno: int) -> list[str]:
+    """
+    Cached version of :py:func:`get_code_block`.
+
+    Note:
+        Each file is only read (and each block only tokenized) once,
+        unless the file changes on disk in the meantime.
+    """
+    linecache.checkcache(filename)
+    lines = linecache.getlines(filename)
+    try:
+        cached_lines, block = _CODE_BLOCKS[filename, lineno]
+    except KeyError:
+        pass
+    else:
+        if cached_lines is lines:
+            return block
+    block = get_code_block(filename, lineno)
+    _CODE_BLOCKS[filename, lineno] = lines, block
+    return block
+
+
 class _CythonBlockFinder(inspect.BlockFinder):
     """
     Compatibility layer turning Cython-specific code blocks (``cdef``,
@@ -250,9 +309,34 @@ class _StatsLike(Protocol):
 class LineStats(CLineStats):
     timings: _TimingsMap
     unit: float
-
-    def __init__(self, timings: _TimingsMap, unit: float) -> None:
-        super().__init__(timings, unit)
+    overhead: float
+    histograms: _HistogramsMap
+    thread_timings: _ThreadTimingsMap
+    self_times: _SelfTimesMap
+    counters: _CountersMap
+    memory: _MemoryMap
+
+    def __init__(
+        self,
+        timings: _TimingsMap,
+        unit: float,
+        overhead: float = 0.0,
+        histograms: _HistogramsMap | None = None,
+        thread_timings: _ThreadTimingsMap | None = None,
+        self_times: _SelfTimesMap | None = None,
+        counters: _CountersMap | None = None,
+        memory: _MemoryMap | None = None,
+    ) -> None:
+        super().__init__(
+            timings,
+            unit,
+            overhead,
+            histograms,
+            thread_timings,
+            self_times,
+            counters,
+            memory,
+        )
 
     def __repr__(self) -> str:
         return '{}({}, {:.2G})'.format(
@@ -307,8 +391,7 @@ class LineStats(CLineStats):
             ...     1E-6)
             >>> assert stats1 + stats2 == stats2 + stats1 == stats_sum
         """
-        timings, unit = self._get_aggregated_timings([self, other])
-        return type(self)(timings, unit)
+        return type(self).from_stats_objects(self, other)
 
     def __iadd__(self, other: _StatsLike) -> Self:
         """
@@ -334,7 +417,17 @@ class LineStats(CLineStats):
             >>> assert id(stats2) == address
             >>> assert stats2 == stats_sum
         """
-        self.timings, self.unit = self._get_aggregated_timings([self, other])
+        stats_objs = [self, other]
+        overhead = self._get_aggregated_overhead(stats_objs)
+        timings, unit = self._get_aggregated_timings(stats_objs)
+        self.histograms = self._get_aggregated_histograms(stats_objs, unit)
+        self.thread_timings = self._get_aggregated_thread_timings(
+            stats_objs, unit
+        )
+        self.self_times = self._get_aggregated_self_times(stats_objs, unit)
+        self.counters = self._get_aggregated_counters(stats_objs)
+        self.memory = self._get_aggregated_memory(stats_objs)
+        self.timings, self.unit, self.overhead = timings, unit, overhead
         return self
 
     def print(
@@ -348,7 +441,23 @@ class LineStats(CLineStats):
         rich: bool = False,
         *,
         config: str | PathLike[str] | bool | None = None,
+        subtract_overhead: bool = False,
+        top: int | None = None,
+        min_percent: float = 0.0,
     ) -> None:
+        """
+        Show the statistics (see :py:func:`show_text`, which also
+        describes the pruning with ``top`` and ``min_percent``), with the
+        percentiles of the times of the lines which have
+        :py:attr:`.histograms`, the self times of those which have
+        :py:attr:`.self_times`, the hardware-event counts of those which
+        have :py:attr:`.counters`, the allocations of those which have
+        :py:attr:`.memory`, and the breakdown by thread of the
+        functions which have :py:attr:`.thread_timings`; if
+        ``subtract_overhead`` is true, the
+        estimated overhead of the profiler (see :py:attr:`.overhead`)
+        is subtracted from the times of the lines.
+        """
         show_text(
             self.timings,
             self.unit,
@@ -360,25 +469,78 @@ class LineStats(CLineStats):
             sort=sort,
             rich=rich,
             config=config,
+            overhead=self.overhead if subtract_overhead else 0.0,
+            histograms=self.histograms,
+            thread_timings=self.thread_timings,
+            self_times=self.self_times,
+            counters=self.counters,
+            memory=self.memory,
+            top=top,
+            min_percent=min_percent,
         )
 
     def to_file(self, filename: PathLike[str] | str) -> None:
-        """Pickle the instance to the given filename."""
-        with open(filename, 'wb') as f:
-            pickle.dump(self, f, pickle.HIGHEST_PROTOCOL)
+        """
+        Write the instance to the given filename in the binary
+        ``.lprof`` format (see :py:mod:`line_profiler.stats_file`).
+        """
+        write_stats(
+            filename,
+            self.timings,
+            self.unit,
+            overhead=self.overhead,
+            histograms=self.histograms,
+            thread_timings=self.thread_timings,
+            self_times=self.self_times,
+            counters=self.counters,
+            memory=self.memory,
+        )
 
     @classmethod
     def from_files(
-        cls, file: PathLike[str] | str, /, *files: PathLike[str] | str
+        cls,
+        file: PathLike[str] | str,
+        /,
+        *files: PathLike[str] | str,
+        select: Callable[[tuple[str, int, str]], bool] | None = None,
     ) -> Self:
         """
-        Utility function to load an instance from the given filenames.
+        Utility function to load an instance from the given filenames,
+        which can be either binary ``.lprof`` files (see
+        :py:mod:`line_profiler.stats_file`) or pickled
+        :py:class:`LineStats` objects (as written by older versions).
+
+        Arguments:
+            file, *files (str | os.PathLike[str]):
+                Filenames
+            select (Callable[[tuple[str, int, str]], bool] | None):
+                Optional callable taking a key ``(filename,
+                first_lineno, name)`` and returning whether to load the
+                timings of the function; for binary files, those of the
+                other functions aren't read at all
+
+        Example:
+            >>> import os
+            >>> import tempfile
+            >>> stats = LineStats(
+            ...     {('spam.py', 1, 'foo'): [(2, 10, 300)],
+            ...      ('spam.py', 10, 'bar'):
+            ...      [(11, 2, 1000), (12, 1, 500)]},
+            ...     1E-6)
+            >>> with tempfile.TemporaryDirectory() as tmpdir:
+            ...     fname = os.path.join(tmpdir, 'out.lprof')
+            ...     stats.to_file(fname)
+            ...     assert LineStats.from_files(fname) == stats
+            ...     bar_stats = LineStats.from_files(
+            ...         fname, select=lambda key: key[2] == 'bar')
+            >>> assert list(bar_stats.timings) == [('spam.py', 10, 'bar')]
         """
-        stats_objs = []
+        # Note: sum the files as they are read, so that only the total
+        # and the current file are kept in memory
+        reducer = _StatsReducer()
         for file in [file, *files]:
-            with open(file, 'rb') as f:
-                stats_objs.append(pickle.load(f))
-        return cls.from_stats_objects(*stats_objs)
+            reducer.add(_load_stats(file, select))
+        return reducer.get_stats(cls)
 
     @classmethod
     def from_stats_objects(
@@ -405,8 +567,132 @@ class LineStats(CLineStats):
             ...     [(11, 12, 3000), (12, 6, 600)],
             ...     ('baz', 5, 'eggs.py'): [(5, 2, 500)]}
         """
-        timings, unit = cls._get_aggregated_timings([stats, *more_stats])
-        return cls(timings, unit)
+        stats_objs = [stats, *more_stats]
+        timings, unit = cls._get_aggregated_timings(stats_objs)
+        return cls(
+            timings,
+            unit,
+            cls._get_aggregated_overhead(stats_objs),
+            cls._get_aggregated_histograms(stats_objs, unit),
+            cls._get_aggregated_thread_timings(stats_objs, unit),
+            cls._get_aggregated_self_times(stats_objs, unit),
+            cls._get_aggregated_counters(stats_objs),
+            cls._get_aggregated_memory(stats_objs),
+        )
+
+    @staticmethod
+    def _get_aggregated_overhead(stats_objs):
+        # Average of the overheads weighted by the numbers of hits, so
+        # that subtracting it from the summed times subtracts the same
+        # total
+        # Note: if none of the overheads have been measured yet (see
+        # `CLineStats.overhead`), don't measure them just yet either
+        if all(
+            getattr(stats, '_overhead', 0.0) is None for stats in stats_objs
+        ):
+            return None
+        total_hits = 0
+        total_overhead = 0.0
+        for stats in stats_objs:
+            overhead = getattr(stats, 'overhead', 0.0)
+            nhits = sum(
+                entry[1]
+                for entries in stats.timings.values()
+                for entry in entries
+            )
+            total_hits += nhits
+            total_overhead += nhits * overhead
+        if total_hits:
+            return total_overhead / total_hits
+        return max(getattr(stats, 'overhead', 0.0) for stats in stats_objs)
+
+    @staticmethod
+    def _get_aggregated_histograms(stats_objs, unit):
+        per_line = {}
+        for stats in stats_objs:
+            factor = stats.unit / unit
+            for key, line_hists in getattr(stats, 'histograms', {}).items():
+                lines = per_line.setdefault(key, {})
+                for lineno, histogram in line_hists.items():
+                    lines.setdefault(lineno, []).append(
+                        _hist.rescale(histogram, factor)
+                    )
+        return {
+            key: {
+                lineno: _hist.merge(hists)
+                for lineno, hists in sorted(lines.items())
+            }
+            for key, lines in per_line.items()
+        }
+
+    @staticmethod
+    def _get_aggregated_self_times(stats_objs, unit):
+        per_line = {}
+        for stats in stats_objs:
+            factor = stats.unit / unit
+            for key, self_times in getattr(stats, 'self_times', {}).items():
+                lines = per_line.setdefault(key, {})
+                for lineno, self_time in self_times.items():
+                    lines[lineno] = lines.get(lineno, 0) + factor * self_time
+        return {
+            key: {
+                lineno: int(round(self_time, 0))
+                for lineno, self_time in sorted(lines.items())
+            }
+            for key, lines in per_line.items()
+        }
+
+    @staticmethod
+    def _get_aggregated_counters(stats_objs):
+        # Note: the counts are in events, so they need no rescaling
+        per_event = {}
+        for stats in stats_objs:
+            for event, counts in getattr(stats, 'counters', {}).items():
+                per_key = per_event.setdefault(event, {})
+                for key, line_counts in counts.items():
+                    lines = per_key.setdefault(key, {})
+                    for lineno, count in line_counts.items():
+                        lines[lineno] = lines.get(lineno, 0) + count
+        return {
+            event: {
+                key: dict(sorted(lines.items()))
+                for key, lines in per_key.items()
+            }
+            for event, per_key in per_event.items()
+        }
+
+    @staticmethod
+    def _get_aggregated_memory(stats_objs):
+        # Note: the allocation counters are summed component-wise
+        per_line = {}
+        for stats in stats_objs:
+            for key, line_memory in getattr(stats, 'memory', {}).items():
+                lines = per_line.setdefault(key, {})
+                for lineno, counts in line_memory.items():
+                    prev = lines.get(lineno, (0, 0, 0))
+                    lines[lineno] = tuple(a + b for a, b in zip(prev, counts))
+        return {
+            key: dict(sorted(lines.items()))
+            for key, lines in per_line.items()
+        }
+
+    @classmethod
+    def _get_aggregated_thread_timings(cls, stats_objs, unit):
+        per_thread = {}
+        for stats in stats_objs:
+            thread_timings = getattr(stats, 'thread_timings', {})
+            for thread, timings in thread_timings.items():
+                per_thread.setdefault(thread, []).append(
+                    CLineStats(timings, stats.unit)
+                )
+        result = {}
+        for thread, thread_stats in per_thread.items():
+            # Note: `unit` is the largest of all the units, so adding an
+            # empty object in it makes the thread timings come out in
+            # the same unit as the overall ones
+            thread_stats.append(CLineStats({}, unit))
+            result[thread], _ = cls._get_aggregated_timings(thread_stats)
+        return result
 
     @staticmethod
     def _get_aggregated_timings(stats_objs):
@@ -445,6 +731,303 @@ class LineStats(CLineStats):
         return timings, unit
 
 
+def _load_stats(
+    file: PathLike[str] | str,
+    select: Callable[[tuple[str, int, str]], bool] | None = None,
+) -> _StatsLike:
+    """
+    Load the (selected) results in the ``.lprof`` file ``file``, be it
+    binary or pickled (see :py:meth:`LineStats.from_files`).
+    """
+    if is_stats_file(file):
+        with StatsLog(file) as log:
+            return CLineStats(
+                log.get_timings(select=select),
+                log.unit,
+                log.overhead,
+                log.get_histograms(select=select),
+                log.get_thread_timings(select=select),
+                log.get_self_times(select=select),
+                log.get_counters(select=select),
+                log.get_memory(select=select),
+            )
+    with open(file, 'rb') as f:
+        stats = pickle.load(f)
+    if select is None:
+        return stats
+    return CLineStats(
+        {
+            key: entries
+            for key, entries in stats.timings.items()
+            if select(key)
+        },
+        stats.unit,
+        stats.overhead,
+        {
+            key: line_hists
+            for key, line_hists in stats.histograms.items()
+            if select(key)
+        },
+        {
+            thread: {
+                key: entries
+                for key, entries in timings.items()
+                if select(key)
+            }
+            for thread, timings in stats.thread_timings.items()
+        },
+        {
+            key: self_times
+            for key, self_times in stats.self_times.items()
+            if select(key)
+        },
+        {
+            event: {
+                key: line_counts
+                for key, line_counts in counts.items()
+                if select(key)
+            }
+            for event, counts in getattr(stats, 'counters', {}).items()
+        },
+        {
+            key: line_memory
+            for key, line_memory in getattr(stats, 'memory', {}).items()
+            if select(key)
+        },
+    )
+
+
+class _StatsReducer:
+    """
+    Running sum of line-profiling results, to which results are added
+    one at a time, so that (unlike with
+    :py:meth:`LineStats.from_stats_objects`) they needn't all be kept
+    around until the end.
+
+    The sums are kept in the largest timer unit seen so far, and are
+    only rounded to integers by :py:meth:`.get_stats`; results sharing
+    the unit are summed exactly.
+
+    Example:
+        >>> stats1 = LineStats(
+        ...     {('foo', 1, 'spam.py'): [(2, 10, 300)],
+        ...      ('bar', 10, 'spam.py'):
+        ...      [(11, 2, 1000), (12, 1, 500)]},
+        ...     1E-7)
+        >>> stats2 = LineStats(
+        ...     {('bar', 10, 'spam.py'):
+        ...      [(11, 10, 2000), (12, 5, 100)],
+        ...      ('baz', 5, 'eggs.py'): [(5, 2, 500)]},
+        ...     1E-6)
+        >>> reducer = _StatsReducer()
+        >>> for stats in stats1, stats2:
+        ...     reducer.add(stats)
+        >>> assert reducer.nadded == 2
+        >>> assert reducer.get_stats() == stats1 + stats2
+    """
+
+    def __init__(self) -> None:
+        self.unit: float | None = None
+        #: Number of results added
+        self.nadded = 0
+        # Key -> line number -> `[nhits, time]`
+        self._timings: dict[tuple[str, int, str], dict] = {}
+        # Key -> line number -> `(max_time, counts)`
+        self._histograms: dict[tuple[str, int, str], dict] = {}
+        # Thread name -> key -> line number -> `[nhits, time]`
+        self._thread_timings: dict[str, dict] = {}
+        # Key -> line number -> self time
+        self._self_times: dict[tuple[str, int, str], dict] = {}
+        # Event name -> key -> line number -> count
+        self._counters: dict[str, dict] = {}
+        # Key -> line number -> `(nallocs, allocated, retained)`
+        self._memory: dict[tuple[str, int, str], dict] = {}
+        # Sum of the overheads weighted by the numbers of hits (see
+        # `LineStats._get_aggregated_overhead()`)
+        self._nhits = 0
+        self._weighted_overhead = 0.0
+        self._max_overhead = 0.0
+
+    def add(self, stats: _StatsLike | _StatsReducer) -> None:
+        """
+        Add the results ``stats`` (a :py:class:`LineStats` or alike, or
+        another :py:class:`_StatsReducer`, e.g. one which summed a share
+        of the results in another process) to the sum.
+        """
+        if isinstance(stats, _StatsReducer):
+            if stats.unit is None:
+                return
+            timings = self._iter_totals(stats._timings)
+            histograms = stats._histograms
+            self_times = stats._self_times
+            counters = stats._counters
+            memory = stats._memory
+            thread_timings = {
+                thread: self._iter_totals(totals)
+                for thread, totals in stats._thread_timings.items()
+            }
+        else:
+            timings = stats.timings.items()
+            histograms = getattr(stats, 'histograms', {})
+            self_times = getattr(stats, 'self_times', {})
+            counters = getattr(stats, 'counters', {})
+            memory = getattr(stats, 'memory', {})
+            thread_timings = {
+                thread: timings.items()
+                for thread, timings in getattr(
+                    stats, 'thread_timings', {}
+                ).items()
+            }
+        if self.unit is None:
+            self.unit = stats.unit
+        elif stats.unit > self.unit:
+            self._rescale(self.unit / stats.unit)
+            self.unit = stats.unit
+        factor = stats.unit / self.unit
+        nhits = self._add_timings(self._timings, timings, factor)
+        for key, line_hists in histograms.items():
+            lines = self._histograms.setdefault(key, {})
+            for lineno, histogram in line_hists.items():
+                histogram = _hist.rescale(histogram, factor)
+                try:
+                    prev = lines[lineno]
+                except KeyError:
+                    lines[lineno] = histogram
+                else:
+                    lines[lineno] = _hist.merge([prev, histogram])
+        for key, line_self_times in self_times.items():
+            lines = self._self_times.setdefault(key, {})
+            for lineno, self_time in line_self_times.items():
+                if factor != 1:
+                    self_time *= factor
+                lines[lineno] = lines.get(lineno, 0) + self_time
+        for event, counts in counters.items():
+            per_key = self._counters.setdefault(event, {})
+            for key, line_counts in counts.items():
+                lines = per_key.setdefault(key, {})
+                for lineno, count in line_counts.items():
+                    lines[lineno] = lines.get(lineno, 0) + count
+        for key, line_memory in memory.items():
+            lines = self._memory.setdefault(key, {})
+            for lineno, counts in line_memory.items():
+                prev = lines.get(lineno, (0, 0, 0))
+                lines[lineno] = tuple(a + b for a, b in zip(prev, counts))
+        for thread, thread_items in thread_timings.items():
+            self._add_timings(
+                self._thread_timings.setdefault(thread, {}),
+                thread_items,
+                factor,
+            )
+        if isinstance(stats, _StatsReducer):
+            self._nhits += stats._nhits
+            self._weighted_overhead += stats._weighted_overhead
+            self._max_overhead = max(self._max_overhead, stats._max_overhead)
+            self.nadded += stats.nadded
+            return
+        overhead = getattr(stats, 'overhead', 0.0)
+        self._nhits += nhits
+        self._weighted_overhead += nhits * overhead
+        self._max_overhead = max(self._max_overhead, overhead)
+        self.nadded += 1
+
+    @staticmethod
+    def _iter_totals(totals):
+        for key, lines in totals.items():
+            yield key, [(lineno, *total) for lineno, total in lines.items()]
+
+    @staticmethod
+    def _add_timings(totals, items, factor):
+        # Note: only scale the times if needed, so that the sums of
+        # integer times stay exact
+        nhits_total = 0
+        for key, entries in items:
+            lines = totals.setdefault(key, {})
+            for lineno, nhits, time in entries:
+                if factor != 1:
+                    time *= factor
+                nhits_total += nhits
+                try:
+                    total = lines[lineno]
+                except KeyError:
+                    lines[lineno] = [nhits, time]
+                else:
+                    total[0] += nhits
+                    total[1] += time
+        return nhits_total
+
+    def _rescale(self, factor):
+        for totals in [self._timings, *self._thread_timings.values()]:
+            for lines in totals.values():
+                for total in lines.values():
+                    total[1] *= factor
+        for lines in self._self_times.values():
+            for lineno in lines:
+                lines[lineno] *= factor
+        for lines in self._histograms.values():
+            for lineno, histogram in lines.items():
+                lines[lineno] = _hist.rescale(histogram, factor)
+
+    @staticmethod
+    def _get_timings(totals):
+        return {
+            key: [
+                (lineno, nhits, int(round(time, 0)))
+                for lineno, (nhits, time) in sorted(lines.items())
+            ]
+            for key, lines in totals.items()
+        }
+
+    def get_stats(self, cls: type[LineStats] | None = None) -> LineStats:
+        """
+        Returns:
+            stats (LineStats):
+                Instance of ``cls`` (default :py:class:`LineStats`)
+                holding the sum of the added results
+
+        Raises:
+            ValueError: if no results have been added
+        """
+        if self.unit is None:
+            raise ValueError('no results to sum')
+        if cls is None:
+            cls = LineStats
+        if self._nhits:
+            overhead = self._weighted_overhead / self._nhits
+        else:
+            overhead = self._max_overhead
+        return cls(
+            self._get_timings(self._timings),
+            self.unit,
+            overhead,
+            {
+                key: dict(sorted(lines.items()))
+                for key, lines in self._histograms.items()
+            },
+            {
+                thread: self._get_timings(totals)
+                for thread, totals in self._thread_timings.items()
+            },
+            {
+                key: {
+                    lineno: int(round(self_time, 0))
+                    for lineno, self_time in sorted(lines.items())
+                }
+                for key, lines in self._self_times.items()
+            },
+            {
+                event: {
+                    key: dict(sorted(lines.items()))
+                    for key, lines in per_key.items()
+                }
+                for event, per_key in self._counters.items()
+            },
+            {
+                key: dict(sorted(lines.items()))
+                for key, lines in self._memory.items()
+            },
+        )
+
+
 class LineProfiler(CLineProfiler, ByCountProfilerMixin):
     """
     A profiler that records the execution times of individual lines.
@@ -563,14 +1146,84 @@ class LineProfiler(CLineProfiler, ByCountProfilerMixin):
         logger.debug(msg)
 
     def get_stats(self) -> LineStats:
-        return LineStats.from_stats_objects(super().get_stats())
+        # Note: the timings are freshly built, no need to copy them
+        stats = super().get_stats()
+        return LineStats(
+            stats.timings,
+            stats.unit,
+            stats.overhead,
+            stats.histograms,
+            stats.thread_timings,
+            stats.self_times,
+            stats.counters,
+            stats.memory,
+        )
 
     def dump_stats(self, filename: os.PathLike[str] | str) -> None:
-        """Dump a representation of the data to a file as a pickled
-        :py:class:`~.LineStats` object from :py:meth:`~.get_stats()`.
+        """Dump the :py:class:`~.LineStats` object from
+        :py:meth:`~.get_stats()` to a binary ``.lprof`` file (see
+        :py:meth:`LineStats.to_file`).
         """
         self.get_stats().to_file(filename)
 
+    def get_stats_delta(self) -> LineStats:
+        stats = super().get_stats_delta()
+        return LineStats(
+            stats.timings,
+            stats.unit,
+            stats.overhead,
+            stats.histograms,
+            stats.thread_timings,
+            stats.self_times,
+            stats.counters,
+            stats.memory,
+        )
+
+    def dump_stats_delta(self, filename: os.PathLike[str] | str) -> None:
+        """Append the changes in the timings since the last call (see
+        :py:meth:`~.get_stats_delta()`) to the incremental binary
+        ``.lprof`` log ``filename``, which
+        :py:meth:`LineStats.from_files` reads as the sum of all the
+        snapshots (see also :py:class:`line_profiler.stats_file.StatsLog`).
+        """
+        stats = self.get_stats_delta()
+        append_stats(
+            filename,
+            stats.timings,
+            stats.unit,
+            overhead=stats.overhead,
+            histograms=stats.histograms,
+            thread_timings=stats.thread_timings,
+            self_times=stats.self_times,
+            counters=stats.counters,
+            memory=stats.memory,
+        )
+
+    def collect_workers(
+        self,
+        directory: os.PathLike[str] | str | None = None,
+        interval: float | None = None,
+    ) -> WorkerCollector:
+        """Start collecting the results from the child processes (e.g.
+        :py:mod:`multiprocessing` workers) started from now on; see
+        :py:class:`line_profiler.workers.WorkerCollector`.
+        """
+        from .workers import WorkerCollector
+
+        return WorkerCollector(self, directory, interval).start()
+
+    def publish_live(
+        self, filename: os.PathLike[str] | str, interval: float = 1.0
+    ) -> LivePublisher:
+        """Start publishing the timings to the live-counter file
+        ``filename`` every ``interval`` seconds, for other processes to
+        watch (e.g. with :command:`python -m line_profiler --attach`);
+        see :py:class:`line_profiler.live.LivePublisher`.
+        """
+        from .live import LivePublisher
+
+        return LivePublisher(self, filename, interval).start()
+
     def print_stats(
         self,
         stream: io.TextIOBase | None = None,
@@ -582,8 +1235,11 @@ class LineProfiler(CLineProfiler, ByCountProfilerMixin):
         rich: bool = False,
         *,
         config: str | PathLike[str] | bool | None = None,
+        subtract_overhead: bool = False,
+        top: int | None = None,
+        min_percent: float = 0.0,
     ) -> None:
-        """Show the gathered statistics."""
+        """Show the gathered statistics (see :py:meth:`LineStats.print`)."""
         self.get_stats().print(
             stream=stream,
             output_unit=output_unit,
@@ -593,6 +1249,9 @@ class LineProfiler(CLineProfiler, ByCountProfilerMixin):
             sort=sort,
             rich=rich,
             config=config,
+            subtract_overhead=subtract_overhead,
+            top=top,
+            min_percent=min_percent,
         )
 
     def _add_namespace(
@@ -821,6 +1480,65 @@ def is_generated_code(filename: str) -> bool:
     )
 
 
+def subtract_overhead(
+    timings: Sequence[tuple[int, int, int | float]], overhead: float
+) -> list[tuple[int, int, int | float]]:
+    """
+    Returns:
+        Copy of ``timings`` (``(lineno, nhits, time)`` tuples) with
+        ``overhead`` (in the same units as the times) subtracted from
+        the time of each hit, clipped at zero
+
+    Example:
+        >>> subtract_overhead([(1, 10, 100), (2, 1, 5)], 6)
+        [(1, 10, 40), (2, 1, 0)]
+    """
+    return [
+        (lineno, nhits, max(time - nhits * overhead, 0))
+        for lineno, nhits, time in timings
+    ]
+
+
+def _format_percentiles(
+    histogram: tuple[int, Mapping[int, int]] | None,
+    scalar: float,
+    overhead: float,
+    column_sizes: Mapping[ColumnLiterals, int],
+) -> tuple[str, str, str]:
+    # The median, 99th percentile, and maximum of the hits of a line
+    if not histogram:
+        return '', '', ''
+    max_time, counts = histogram
+    cells = []
+    for column, value in [
+        ('p50', _hist.percentile(counts, 50, max_time)),
+        ('p99', _hist.percentile(counts, 99, max_time)),
+        ('max', max_time),
+    ]:
+        value = max(value - overhead, 0) * scalar
+        disp = '%5.1f' % value
+        if len(disp) > column_sizes[column]:
+            disp = '%5.3g' % value
+        cells.append(disp)
+    return cells[0], cells[1], cells[2]
+
+
+def _format_bytes(nbytes: int) -> str:
+    """
+    Example:
+        >>> [_format_bytes(n) for n in [512, 2048, -3 * 2**20, 2**50]]
+        ['512 B', '2.0 KiB', '-3.0 MiB', '1024.0 TiB']
+    """
+    if abs(nbytes) < 1024:
+        return '%d B' % nbytes
+    value = float(nbytes)
+    for prefix in 'KMGT':
+        value /= 1024
+        if abs(value) < 1024:
+            break
+    return f'{value:.1f} {prefix}iB'
+
+
 def show_func(
     filename: str,
     start_lineno: int,
@@ -833,6 +1551,13 @@ def show_func(
     rich: bool = False,
     *,
     config: str | PathLike[str] | bool | None = None,
+    overhead: float = 0.0,
+    histograms: Mapping[int, tuple[int, Mapping[int, int]]] | None = None,
+    thread_timings: Mapping[str, Sequence[tuple[int, int, int | float]]]
+    | None = None,
+    self_times: Mapping[int, int | float] | None = None,
+    counters: Mapping[str, Mapping[int, int]] | None = None,
+    memory: Mapping[int, tuple[int, int, int]] | None = None,
 ) -> None:
     """
     Show results for a single function.
@@ -873,6 +1598,41 @@ def show_func(
             passing `False` disables all lookup and falls back to the
             default configuration
 
+        overhead (float):
+            Overhead of the profiler (in seconds per hit) to subtract
+            from the time of each line (see `LineStats.overhead`),
+            leaving at least zero; default is to show the times as
+            measured
+
+        histograms (Mapping[int, tuple[int, Mapping[int, int]]] | None):
+            Optional histograms of the durations of the hits of the
+            lines (see `LineStats.histograms`); if any, the median, the
+            99th percentile, and the maximum are shown for each line
+
+        thread_timings (Mapping[str, Sequence[Tuple[int, int, float]]] \
+| None):
+            Optional measurements for each line on each thread (keyed
+            by thread name, see `LineStats.thread_timings`); if any, a
+            breakdown of the lines by thread follows the table
+
+        self_times (Mapping[int, int | float] | None):
+            Optional self (exclusive) times of the lines (see
+            `LineStats.self_times`); if any, they are shown next to the
+            (inclusive) times, so that the lines which are slow
+            themselves can be told apart from those calling into slow
+            profiled code
+
+        counters (Mapping[str, Mapping[int, int]] | None):
+            Optional counts of hardware events in the lines, keyed by
+            event name (see `LineStats.counters`); if any, a column for
+            each event is shown after the times
+
+        memory (Mapping[int, tuple[int, int, int]] | None):
+            Optional allocation counters of the lines (see
+            `LineStats.memory`); if any, the numbers of blocks
+            allocated, their sizes, and the bytes retained are shown
+            after the counts
+
     Example:
         >>> from line_profiler.line_profiler import show_func
         >>> import line_profiler
@@ -900,7 +1660,29 @@ def show_func(
     if stream is None:
         stream = cast(io.TextIOBase, sys.stdout)
 
+    if overhead:
+        timings = subtract_overhead(timings, overhead / unit)
     total_hits = sum(t[1] for t in timings)
+    if not histograms:
+        histograms = None
+    if not self_times:
+        self_times = None
+    elif overhead:
+        nhits_by_lineno = {lineno: nhits for lineno, nhits, _ in timings}
+        self_times = {
+            lineno: max(
+                self_time - nhits_by_lineno.get(lineno, 0) * overhead / unit,
+                0,
+            )
+            for lineno, self_time in self_times.items()
+        }
+    # Note: keep the events in order, and skip those without counts for
+    # the function
+    counters = {
+        event: counts for event, counts in (counters or {}).items() if counts
+    }
+    if not memory:
+        memory = None
     total_time = sum(t[2] for t in timings)
 
     if stripzeros and total_hits == 0:
@@ -932,10 +1714,9 @@ def show_func(
     if os.path.exists(filename) or is_generated_code(filename):
         stream.write(f'File: {filename}\n')
         stream.write(f'Function: {func_name} at line {start_lineno}\n')
-        if os.path.exists(filename):
-            # Clear the cache to ensure that we get up-to-date results.
-            linecache.clearcache()
-        sublines = get_code_block(filename, start_lineno)
+        # Note: this re-reads the file if it has changed on disk, to
+        # ensure that we get up-to-date results
+        sublines = _get_cached_code_block(filename, start_lineno)
     else:
         stream.write('\n')
         stream.write(f'Could not find file {filename}\n')
@@ -984,16 +1765,45 @@ def show_func(
             nhits_disp = '%g' % nhits
 
         display[lineno] = (nhits_disp, time_disp, perhit_disp, percent)
-
-    # Expand column sizes if the numbers are large.
-    column_sizes = default_column_sizes.copy()
-    if len(display):
-        max_hitlen = max(len(t[0]) for t in display.values())
-        max_timelen = max(len(t[1]) for t in display.values())
-        max_perhitlen = max(len(t[2]) for t in display.values())
-        column_sizes['hits'] = max(column_sizes['hits'], max_hitlen)
-        column_sizes['time'] = max(column_sizes['time'], max_timelen)
-        column_sizes['perhit'] = max(column_sizes['perhit'], max_perhitlen)
+        if self_times is not None:
+            self_time = self_times.get(lineno)
+            if self_time is None:
+                self_disp = ''
+            else:
+                self_disp = '%5.1f' % (self_time * scalar)
+                if len(self_disp) > default_column_sizes['self']:
+                    self_disp = '%5.3g' % (self_time * scalar)
+            display[lineno] += (self_disp,)
+        for counts in counters.values():
+            count = counts.get(lineno)
+            if count is None:
+                count_disp = ''
+            else:
+                count_disp = '%d' % count
+                if len(count_disp) > default_column_sizes['counter']:
+                    count_disp = '%5.3g' % count
+            display[lineno] += (count_disp,)
+        if memory is not None:
+            counts = memory.get(lineno)
+            if counts is None:
+                display[lineno] += ('', '', '')
+            else:
+                nallocs, allocated, retained = counts
+                nallocs_disp = '%d' % nallocs
+                if len(nallocs_disp) > default_column_sizes['allocs']:
+                    nallocs_disp = '%5.3g' % nallocs
+                display[lineno] += (
+                    nallocs_disp,
+                    _format_bytes(allocated),
+                    _format_bytes(retained),
+                )
+        if histograms is not None:
+            display[lineno] += _format_percentiles(
+                histograms.get(lineno),
+                scalar,
+                overhead / unit,
+                default_column_sizes,
+            )
 
     col_order: list[ColumnLiterals] = [
         'line',
@@ -1002,14 +1812,39 @@ def show_func(
         'perhit',
         'percent',
     ]
+    header = ('Line #', 'Hits', 'Time', 'Per Hit', '% Time')
+    if self_times is not None:
+        col_order.append('self')
+        header += ('Self Time',)
+    col_order += ['counter'] * len(counters)
+    header += tuple(counters)
+    if memory is not None:
+        col_order += ['allocs', 'allocated', 'retained']
+        header += ('Allocs', 'Allocated', 'Retained')
+    if histograms is not None:
+        col_order += ['p50', 'p99', 'max']
+        header += ('p50', 'p99', 'Max')
+    header += ('Line Contents',)
+
+    # Expand column sizes if the numbers (or the titles, e.g. the names
+    # of the counters) are large.
+    column_sizes = default_column_sizes.copy()
+    for i, column in enumerate(col_order[1:]):
+        if column == 'percent':
+            continue
+        column_sizes[column] = max(
+            column_sizes[column],
+            len(header[i + 1]),
+            *(len(t[i]) for t in display.values()),
+        )
+
     lhs_template = ' '.join(
         ['%' + str(column_sizes[k]) + 's' for k in col_order]
     )
     template = lhs_template + '  %-s'
 
     linenos = list(range(start_lineno, start_lineno + len(sublines)))
-    empty = ('', '', '', '')
-    header = ('Line #', 'Hits', 'Time', 'Per Hit', '% Time', 'Line Contents')
+    empty = ('',) * (len(col_order) - 1)
     header_line = template % header
     stream.write('\n')
     stream.write(header_line)
@@ -1022,8 +1857,7 @@ def show_func(
         lhs_lines = []
         rhs_lines = []
         for lineno, line in zip(linenos, sublines):
-            nhits_s, time_s, per_hit_s, percent_s = display.get(lineno, empty)
-            txt = lhs_template % (lineno, nhits_s, time_s, per_hit_s, percent_s)
+            txt = lhs_template % (lineno, *display.get(lineno, empty))
             rhs_lines.append(line.rstrip('\n').rstrip('\r'))
             lhs_lines.append(txt)
 
@@ -1062,34 +1896,84 @@ def show_func(
         stream.write('\n')
     else:
         for lineno, line in zip(linenos, sublines):
-            nhits_s, time_s, per_hit_s, percent_s = display.get(lineno, empty)
+            cells = display.get(lineno, empty)
             line_ = line.rstrip('\n').rstrip('\r')
-            txt = template % (
-                lineno,
-                nhits_s,
-                time_s,
-                per_hit_s,
-                percent_s,
-                line_,
-            )
+            txt = template % (lineno, *cells, line_)
             try:
                 stream.write(txt)
             except UnicodeEncodeError:
                 # todo: better handling of windows encoding issue
                 # for now just work around it
                 line_ = 'UnicodeEncodeError - help wanted for a fix'
-                txt = template % (
-                    lineno,
-                    nhits_s,
-                    time_s,
-                    per_hit_s,
-                    percent_s,
-                    line_,
-                )
+                txt = template % (lineno, *cells, line_)
                 stream.write(txt)
 
             stream.write('\n')
     stream.write('\n')
+    if thread_timings:
+        _show_thread_breakdown(
+            thread_timings, unit, scalar, overhead, column_sizes, stream
+        )
+
+
+def _show_thread_breakdown(
+    thread_timings: Mapping[str, Sequence[tuple[int, int, int | float]]],
+    unit: float,
+    scalar: float,
+    overhead: float,
+    column_sizes: Mapping[ColumnLiterals, int],
+    stream: io.TextIOBase,
+) -> None:
+    # One row for each thread which hit each line, with its share of
+    # the time of the line
+    rows_by_line: dict[int, list[tuple[str, int, int | float]]] = {}
+    for thread, timings in thread_timings.items():
+        if overhead:
+            timings = subtract_overhead(timings, overhead / unit)
+        for lineno, nhits, time in timings:
+            if nhits:
+                rows_by_line.setdefault(lineno, []).append(
+                    (thread, nhits, time)
+                )
+    if not rows_by_line:
+        return
+    thread_width = max(
+        column_sizes['thread'],
+        max(len(row[0]) for rows in rows_by_line.values() for row in rows),
+    )
+    template = (
+        f'%{column_sizes["line"]}s  %-{thread_width}s'
+        f' %{column_sizes["hits"]}s %{column_sizes["time"]}s'
+        f' %{column_sizes["perhit"]}s %{column_sizes["percent"]}s'
+    )
+    header_line = template % (
+        'Line #',
+        'Thread',
+        'Hits',
+        'Time',
+        'Per Hit',
+        '% Line',
+    )
+    stream.write('Per-thread breakdown:\n\n')
+    stream.write(header_line + '\n')
+    stream.write('=' * len(header_line) + '\n')
+    for lineno, rows in sorted(rows_by_line.items()):
+        line_time = sum(time for _, _, time in rows)
+        for thread, nhits, time in sorted(rows, key=lambda row: -row[2]):
+            percent = '%5.1f' % (100 * time / line_time) if line_time else ''
+            stream.write(
+                template
+                % (
+                    lineno,
+                    thread,
+                    '%d' % nhits,
+                    '%5.1f' % (time * scalar),
+                    '%5.1f' % (float(time) * scalar / nhits),
+                    percent,
+                )
+            )
+            stream.write('\n')
+    stream.write('\n')
 
 
 def show_text(
@@ -1104,9 +1988,29 @@ def show_text(
     rich: bool = False,
     *,
     config: str | PathLike[str] | bool | None = None,
+    overhead: float = 0.0,
+    histograms: _HistogramsMap | None = None,
+    thread_timings: _ThreadTimingsMap | None = None,
+    self_times: _SelfTimesMap | None = None,
+    counters: _CountersMap | None = None,
+    memory: _MemoryMap | None = None,
+    top: int | None = None,
+    min_percent: float = 0.0,
 ) -> None:
     """
-    Show text for the given timings.
+    Show text for the given timings; see :py:func:`show_func` for the
+    arguments (``histograms``, ``self_times``, and ``memory`` are keyed
+    like ``stats``, see `LineStats.histograms`, `LineStats.self_times`,
+    and `LineStats.memory`;
+    ``thread_timings`` and ``counters`` map thread and event names to
+    mappings keyed like ``stats``, see `LineStats.thread_timings` and
+    `LineStats.counters`).
+
+    The functions are pruned before any source is read: only the
+    ``top`` ones with the most time (if given) are shown, and only
+    those taking at least ``min_percent`` % of the total time of all
+    functions (if non-zero); the results for each function are written
+    to ``stream`` as soon as they are formatted.
 
     Ignore:
         # For developer testing, generate some profile output
@@ -1126,14 +2030,38 @@ def show_text(
     else:
         stream.write('Timer unit: %g s\n\n' % unit)
 
+    # Note: `show_func()` subtracts the overhead itself (also from the
+    # percentiles and the per-thread timings)
+    measured = stats
+    if overhead:
+        stream.write(
+            'Profiler overhead subtracted: %g s per hit\n\n' % overhead
+        )
+        per_hit = overhead / unit
+        stats = {
+            key: subtract_overhead(timings, per_hit)
+            for key, timings in stats.items()
+        }
+
+    totals = {
+        key: sum(t[2] for t in timings) for key, timings in stats.items()
+    }
+    kept = _prune_functions(totals, top, min_percent)
+    if len(kept) < len(totals):
+        stream.write(
+            'Showing %d of %d functions (pruned by total time)\n\n'
+            % (len(kept), len(totals))
+        )
     if sort:
         # Order by ascending duration
         stats_order = sorted(
-            stats.items(), key=lambda kv: sum(t[2] for t in kv[1])
+            ((key, stats[key]) for key in kept), key=lambda kv: totals[kv[0]]
         )
     else:
         # Default ordering
-        stats_order = list(stats.items())
+        stats_order = [
+            (key, timings) for key, timings in stats.items() if key in kept
+        ]
 
     # Pre-lookup the appropriate config file
     config = ConfigSource.from_config(config).path
@@ -1145,13 +2073,27 @@ def show_text(
                 fn,
                 lineno,
                 name,
-                stats[fn, lineno, name],
+                measured[fn, lineno, name],
                 unit,
                 output_unit=output_unit,
                 stream=stream,
                 stripzeros=stripzeros,
                 rich=rich,
                 config=config,
+                overhead=overhead,
+                histograms=(histograms or {}).get((fn, lineno, name)),
+                self_times=(self_times or {}).get((fn, lineno, name)),
+                memory=(memory or {}).get((fn, lineno, name)),
+                counters={
+                    event: per_key[fn, lineno, name]
+                    for event, per_key in (counters or {}).items()
+                    if (fn, lineno, name) in per_key
+                },
+                thread_timings={
+                    thread: per_key[fn, lineno, name]
+                    for thread, per_key in (thread_timings or {}).items()
+                    if (fn, lineno, name) in per_key
+                },
             )
 
     if summarize:
@@ -1171,8 +2113,9 @@ def show_text(
                 soft_wrap=True,
                 color_system='standard',
             )
-            for (fn, lineno, name), timings in stats_order:
-                total_time = sum(t[2] for t in timings) * unit
+            for key, timings in stats_order:
+                fn, lineno, name = key
+                total_time = totals[key] * unit
                 if not stripzeros or total_time:
                     # Wrap the filename with link markup to allow the user to
                     # open the file
@@ -1185,24 +2128,74 @@ def show_text(
                     )
                     write_console.print(line)
         else:
-            for (fn, lineno, name), timings in stats_order:
-                total_time = sum(t[2] for t in timings) * unit
+            for key, timings in stats_order:
+                fn, lineno, name = key
+                total_time = totals[key] * unit
                 if not stripzeros or total_time:
                     line = line_template % (total_time, fn, lineno, name)
                     stream.write(line + '\n')
 
 
+def _prune_functions(
+    totals: Mapping[T, float], top: int | None = None, min_percent: float = 0.0
+) -> set[T]:
+    """
+    Returns:
+        The keys of ``totals`` (mapping keys to total times) which are
+        among the ``top`` ones with the largest totals (if ``top``),
+        and whose totals are at least ``min_percent`` % of their sum
+        (if ``min_percent``)
+
+    Example:
+        >>> totals = {'a': 1, 'b': 50, 'c': 9, 'd': 40}
+        >>> sorted(_prune_functions(totals))
+        ['a', 'b', 'c', 'd']
+        >>> sorted(_prune_functions(totals, top=2))
+        ['b', 'd']
+        >>> sorted(_prune_functions(totals, min_percent=5))
+        ['b', 'c', 'd']
+    """
+    kept = set(totals)
+    if min_percent > 0:
+        threshold = sum(totals.values()) * min_percent / 100
+        kept = {key for key in kept if totals[key] >= threshold}
+    if top is not None and 0 < top < len(kept):
+        # Note: break ties in favor of the functions listed earlier
+        order = {key: i for i, key in enumerate(totals)}
+        kept = set(
+            sorted(kept, key=lambda key: (-totals[key], order[key]))[:top]
+        )
+    return kept
+
+
 load_stats = LineStats.from_files
 
 
 def main() -> None:
     """
-    The line profiler CLI to view output from :command:`kernprof -l`.
+    The line profiler CLI to view output from :command:`kernprof -l`
+    (or, as ``python -m line_profiler merge``, to merge many such files
+    into one, see :py:mod:`line_profiler.merge`; and as
+    ``python -m line_profiler export``, to export them to other
+    formats, see :py:mod:`line_profiler.export`).
     """
+    if sys.argv[1:2] == ['merge']:
+        from .merge import main as merge_main
+
+        merge_main(sys.argv[2:])
+        return
+    if sys.argv[1:2] == ['export']:
+        from .export import main as export_main
+
+        export_main(sys.argv[2:])
+        return
     parser = ArgumentParser(
         description='Read and show line profiling results (`.lprof` files) '
         'as generated by the CLI application `kernprof` or by '
-        '`LineProfiler.dump_stats()`.'
+        '`LineProfiler.dump_stats()`. '
+        '(See `%(prog)s merge --help` for merging many such files into '
+        'one, and `%(prog)s export --help` for exporting them to other '
+        'formats.)'
     )
     get_main_config = functools.partial(get_cli_config, 'cli')
     default = config = get_main_config()
@@ -1266,11 +2259,72 @@ def main() -> None:
         help='Print a summary of total function time. '
         f'(Default: {default.conf_dict["summarize"]})',
     )
+    add_argument(
+        parser,
+        '-s',
+        '--subtract-overhead',
+        action='store_true',
+        help='Subtract the estimated overhead of the profiler (as recorded '
+        'in the files) from the time of each hit. '
+        f'(Default: {default.conf_dict["subtract_overhead"]})',
+    )
+    add_argument(
+        parser,
+        '-n',
+        '--top',
+        type=int,
+        metavar='N',
+        help='Only show the N functions with the most total time '
+        '(0 to show all); the others are pruned before reading any '
+        f'source. (Default: {default.conf_dict["top"]})',
+    )
+    add_argument(
+        parser,
+        '--min-percent',
+        type=float,
+        metavar='PERCENT',
+        help='Only show the functions taking at least PERCENT %% of '
+        'the total time of all functions; the others are pruned before '
+        'reading any source. '
+        f'(Default: {default.conf_dict["min_percent"]})',
+    )
+    add_argument(
+        parser,
+        '-k',
+        '--filter',
+        action='append',
+        dest='filters',
+        metavar='PATTERN',
+        help='Only load and show the functions whose (qualified) names '
+        'or filenames match the glob pattern; can be given multiple times. '
+        '(Default: show all functions)',
+    )
+    add_argument(
+        parser,
+        '-a',
+        '--attach',
+        # Note: not `store_true`, which would take the next argument
+        # as its (optional) value
+        action='store_const',
+        const=True,
+        help='Read the files as live-counter files (as written by '
+        '`kernprof --live` or `LineProfiler.publish_live()`), and keep '
+        'showing the current results every REFRESH seconds until the '
+        'profiling is over (or until interrupted).',
+    )
+    add_argument(
+        parser,
+        '--refresh',
+        type=positive_float,
+        default=1.0,
+        help='Seconds between updates with `--attach`. (Default: 1 s)',
+    )
     add_argument(
         parser,
         'profile_output',
         nargs='+',
-        help="'*.lprof' file(s) created by `kernprof`",
+        help="'*.lprof' file(s) created by `kernprof` "
+        '(or live-counter files with `--attach`)',
     )
 
     args = parser.parse_args()
@@ -1281,17 +2335,83 @@ def main() -> None:
         if getattr(args, key, None) is None:
             setattr(args, key, default)
 
-    lstats = LineStats.from_files(*args.profile_output)
-    show_text(
-        lstats.timings,
-        lstats.unit,
+    select = None
+    if args.filters:
+        select = functools.partial(_match_patterns, args.filters)
+    show_kwargs = dict(
         output_unit=args.unit,
         stripzeros=args.skip_zero,
         rich=args.rich,
         sort=args.sort,
         summarize=args.summarize,
         config=args.config,
+        top=args.top,
+        min_percent=args.min_percent,
     )
+    if args.attach:
+        _watch_live(args.profile_output, args.refresh, select, **show_kwargs)
+        return
+    lstats = LineStats.from_files(*args.profile_output, select=select)
+    if args.subtract_overhead:
+        show_kwargs['overhead'] = lstats.overhead
+    show_text(
+        lstats.timings,
+        lstats.unit,
+        histograms=lstats.histograms,
+        thread_timings=lstats.thread_timings,
+        self_times=lstats.self_times,
+        counters=lstats.counters,
+        memory=lstats.memory,
+        **show_kwargs,
+    )
+
+
+def _match_patterns(
+    patterns: Sequence[str], key: tuple[str, int, str]
+) -> bool:
+    """
+    Returns:
+        Whether the (qualified) name or the filename of the function
+        ``key`` matches any of the glob ``patterns`` (see
+        ``python -m line_profiler --filter``)
+    """
+    filename, _, name = key
+    return any(
+        fnmatch.fnmatchcase(name, pattern)
+        or fnmatch.fnmatch(filename, pattern)
+        for pattern in patterns
+    )
+
+
+def _watch_live(
+    filenames: Sequence[os.PathLike[str] | str],
+    refresh: float,
+    select: Callable[[tuple[str, int, str]], bool] | None = None,
+    **kwargs,
+) -> None:
+    """
+    Keep showing the summed results in the live-counter files
+    ``filenames`` (see :py:mod:`line_profiler.live`) every ``refresh``
+    seconds, until all their publishers are done.
+    """
+    from .live import read_live
+
+    stream = sys.stdout
+    try:
+        while True:
+            snapshots = [read_live(fname, select) for fname in filenames]
+            lstats = LineStats.from_stats_objects(
+                *(LineStats(snap.timings, snap.unit) for snap in snapshots)
+            )
+            if stream.isatty():  # Redraw in place
+                stream.write('\x1b[H\x1b[2J')
+            show_text(lstats.timings, lstats.unit, stream=stream, **kwargs)
+            stream.flush()
+            if all(snap.closed for snap in snapshots):
+                return
+            time.sleep(refresh)
+    except KeyboardInterrupt:
+        pass
 
 
 if __name__ == '__main__':
@@ -0,0 +1,451 @@
+"""
+Live line-profiling counters in a memory-mapped file, for watching a
+running profile from another process (see
+:command:`python -m line_profiler --attach`).
+
+A :py:class:`LivePublisher` keeps the line timings of a
+:py:class:`~.LineProfiler` in a file mapped into the memory of the
+profiled process, refreshing them every so often by summing the
+per-thread counters natively into the mapping (which, unlike
+:py:meth:`LineProfiler.get_stats() <.LineProfiler.get_stats>`, creates
+no Python object per line).  Readers (:py:func:`read_live`) only ever
+read the file, so that watching the profile doesn't disturb the
+profiled process, which may be on another machine sharing the
+filesystem.
+
+Layout:
+    All integers are little-endian; all offsets are in bytes from the
+    start of the file, and are multiples of 8.
+
+    Header (see :py:data:`HEADER`):
+
+    * Magic number :py:data:`MAGIC` (8 bytes)
+    * Format version (``uint16``), currently :py:data:`VERSION`
+    * Flags (``uint16``), see :py:data:`FLAG_CLOSED`
+    * Number of functions (``uint32``)
+    * Sequence number (``uint64``), odd while the publisher is updating
+      the file
+    * PID of the profiled process (``int64``)
+    * Timer unit in seconds (``float64``)
+    * Time of the last update (``float64``, seconds since the epoch)
+    * Offset of the counter array (``uint64``)
+    * Number of line slots in the counter array (``uint64``)
+
+    Function table (right after the header):
+        For each function, an entry (see :py:data:`FUNCTION`) holding
+        its first line number (as in its key), the line number and
+        index of its first line slot, its number of line slots, and the
+        lengths of its UTF-8 encoded filename and name, which follow
+        the entry (padded to 8 bytes).
+
+    Counter array:
+        One ``(nhits, total_time)`` pair of ``int64`` (see
+        :py:data:`COUNTER`) for each line slot of each function, which
+        has one slot for each line spanned by its code.
+
+    Readers should retry if the sequence number is odd, or has changed
+    by the time they are done reading; the file only ever grows, so
+    that readers never read past its end.
+"""
+
+from __future__ import annotations
+
+import mmap
+import os
+import struct
+import threading
+import time
+from collections.abc import Callable
+from os import PathLike
+from typing import TYPE_CHECKING, Dict, List, NamedTuple, Tuple
+
+if TYPE_CHECKING:  # pragma: no cover
+    from typing_extensions import Self
+
+    from .line_profiler import LineProfiler
+
+__all__ = (
+    'MAGIC',
+    'VERSION',
+    'FLAG_CLOSED',
+    'is_live_file',
+    'read_live',
+    'LivePublisher',
+    'LiveSnapshot',
+)
+
+_Key = Tuple[str, int, str]
+_Entries = List[Tuple[int, int, int]]
+
+#: Magic number at the start of live-counter files
+MAGIC = b'\x89LPLIVE\n'
+#: Current version of the format
+VERSION = 1
+#: Header flag marking that the publisher has stopped, i.e. that the
+#: counters are final
+FLAG_CLOSED = 0x1
+
+#: File header
+HEADER = struct.Struct('<8sHHIQqddQQ')
+#: A function-table entry (followed by the filename and the name)
+FUNCTION = struct.Struct('<qqQQII')
+#: The counters of a line slot
+COUNTER = struct.Struct('<qq')
+_SEQUENCE_OFFSET = struct.calcsize('<8sHHI')
+_SEQUENCE = struct.Struct('<Q')
+
+_ENCODING = 'utf-8'
+_ERRORS = 'surrogatepass'
+
+
+class LiveSnapshot(NamedTuple):
+    """
+    Consistent snapshot of a live-counter file (see
+    :py:func:`read_live`).
+    """
+
+    timings: Dict[_Key, _Entries]
+    unit: float
+    pid: int
+    timestamp: float
+    closed: bool
+
+
+def _align(n: int) -> int:
+    return -(-n // 8) * 8
+
+
+def is_live_file(filename: PathLike[str] | str) -> bool:
+    """
+    Returns:
+        is_live_file (bool):
+            Whether ``filename`` starts with :py:data:`MAGIC`
+    """
+    with open(filename, 'rb') as f:
+        return f.read(len(MAGIC)) == MAGIC
+
+
+def read_live(
+    filename: PathLike[str] | str,
+    select: Callable[[_Key], bool] | None = None,
+    *,
+    timeout: float = 1.0,
+) -> LiveSnapshot:
+    """
+    Read a consistent snapshot of the live-counter file ``filename``
+    (see :py:class:`LivePublisher`).
+
+    Args:
+        filename (str | os.PathLike[str]):
+            Filename
+        select (Callable[[tuple[str, int, str]], bool] | None):
+            Optional callable taking a key ``(filename, first_lineno,
+            name)`` and returning whether to include the function
+        timeout (float):
+            Seconds to keep retrying for while the file is being
+            updated
+
+    Returns:
+        :py:class:`LiveSnapshot`; as with
+        :py:meth:`LineProfiler.get_stats() <.LineProfiler.get_stats>`,
+        the lines which haven't been hit are omitted
+
+    Raises:
+        ValueError
+            If ``filename`` isn't a live-counter file
+        TimeoutError
+            If no consistent snapshot could be taken in time
+    """
+    deadline = time.monotonic() + timeout
+    with open(filename, 'rb') as f:
+        while True:
+            data = f.read()
+            try:
+                snapshot = _parse(data, filename, select)
+            except (struct.error, UnicodeDecodeError):  # Torn read
+                snapshot = None
+            if snapshot is not None:
+                f.seek(_SEQUENCE_OFFSET)
+                (seq,) = _SEQUENCE.unpack(f.read(_SEQUENCE.size))
+                if seq == _SEQUENCE.unpack_from(data, _SEQUENCE_OFFSET)[0]:
+                    return snapshot
+            if time.monotonic() > deadline:
+                raise TimeoutError(
+                    f'{os.fspath(filename)!r}: cannot read a consistent '
+                    f'snapshot in {timeout} s'
+                )
+            time.sleep(0.001)
+            f.seek(0)
+
+
+def _parse(
+    data: bytes,
+    filename: PathLike[str] | str,
+    select: Callable[[_Key], bool] | None,
+) -> LiveSnapshot | None:
+    # -> None if the file is being updated
+    if len(data) < HEADER.size or data[: len(MAGIC)] != MAGIC:
+        raise ValueError(
+            f'{os.fspath(filename)!r}: not a live line-profiler file'
+        )
+    (
+        _,
+        version,
+        flags,
+        nfuncs,
+        seq,
+        pid,
+        unit,
+        timestamp,
+        counters_offset,
+        nslots,
+    ) = HEADER.unpack_from(data)
+    if version > VERSION:
+        raise ValueError(
+            f'{os.fspath(filename)!r}: version {version} of the live '
+            f'format is not supported (latest known version: {VERSION})'
+        )
+    if seq % 2 or len(data) < counters_offset + nslots * COUNTER.size:
+        return None
+    timings = {}
+    offset = HEADER.size
+    for _ in range(nfuncs):
+        (
+            first_lineno,
+            slot_lineno,
+            first_slot,
+            nlines,
+            len_filename,
+            len_name,
+        ) = FUNCTION.unpack_from(data, offset)
+        offset += FUNCTION.size
+        fname = data[offset : offset + len_filename]
+        offset += len_filename
+        name = data[offset : offset + len_name]
+        offset = _align(offset + len_name)
+        key = (
+            fname.decode(_ENCODING, _ERRORS),
+            first_lineno,
+            name.decode(_ENCODING, _ERRORS),
+        )
+        if select is not None and not select(key):
+            continue
+        start = counters_offset + first_slot * COUNTER.size
+        timings[key] = [
+            (slot_lineno + i, nhits, total_time)
+            for i, (nhits, total_time) in enumerate(
+                COUNTER.iter_unpack(
+                    data[start : start + nlines * COUNTER.size]
+                )
+            )
+            if nhits
+        ]
+    closed = bool(flags & FLAG_CLOSED)
+    return LiveSnapshot(timings, unit, pid, timestamp, closed)
+
+
+class LivePublisher:
+    """
+    Publish the line timings of ``prof`` to the live-counter file
+    ``filename`` (see :py:mod:`line_profiler.live`), every ``interval``
+    seconds once started, and one last time when stopped.
+
+    Args:
+        prof (LineProfiler):
+            Profiler
+        filename (str | os.PathLike[str]):
+            File to publish to (truncated)
+        interval (float):
+            Seconds between updates
+
+    Example:
+        >>> import os
+        >>> import tempfile
+        >>> from line_profiler import LineProfiler
+        >>>
+        >>>
+        >>> def func(n):
+        ...     return sum(range(n))
+        >>>
+        >>>
+        >>> prof = LineProfiler()
+        >>> wrapper = prof(func)
+        >>> with tempfile.TemporaryDirectory() as tmpdir:
+        ...     fname = os.path.join(tmpdir, 'out.live')
+        ...     with LivePublisher(prof, fname) as publisher:
+        ...         wrapper(10)
+        ...         publisher.publish()
+        ...         snapshot = read_live(fname)
+        ...         assert not snapshot.closed
+        ...     assert read_live(fname).closed
+        >>> assert snapshot.timings == prof.get_stats().timings
+
+    Note:
+        While the counters are summed natively, this is done with the
+        GIL held (as the other threads may be registering new code);
+        the cost is that of a pass over the counters of the profiled
+        lines of all threads.
+    """
+
+    def __init__(
+        self,
+        prof: LineProfiler,
+        filename: PathLike[str] | str,
+        interval: float = 1.0,
+    ) -> None:
+        self.prof = prof
+        self.filename = os.fspath(filename)
+        self.interval = interval
+        self.pid = os.getpid()
+        self._lock = threading.Lock()
+        self._stopped = threading.Event()
+        self._thread: threading.Thread | None = None
+        self._layout: list | None = None
+        self._counters: memoryview | None = None
+        self._seq = 0
+        self._file = open(self.filename, 'w+b')
+        try:
+            self._file.write(bytes(HEADER.size))
+            self._file.flush()
+            self._mmap: mmap.mmap | None = mmap.mmap(self._file.fileno(), 0)
+            self._write_header(0, 0, 0, 0.0)
+        except BaseException:
+            self._file.close()
+            raise
+
+    def __enter__(self) -> Self:
+        return self.start()
+
+    def __exit__(self, *_, **__) -> None:
+        self.stop()
+
+    @property
+    def closed(self) -> bool:
+        return self._mmap is None
+
+    def start(self) -> Self:
+        """
+        Start publishing every :py:attr:`~.interval` seconds on a
+        daemon thread.
+
+        Returns:
+            The instance
+        """
+        if self._thread is None and not self.closed:
+            self._thread = threading.Thread(
+                target=self._run, name='line-profiler-live', daemon=True
+            )
+            self._thread.start()
+        return self
+
+    def stop(self) -> None:
+        """
+        Publish the final timings, mark the file as closed (see
+        :py:data:`FLAG_CLOSED`), and close it.
+        """
+        self._stopped.set()
+        if self._thread is not None:
+            self._thread.join()
+            self._thread = None
+        with self._lock:
+            if self.closed or os.getpid() != self.pid:
+                return
+            self._publish(flags=FLAG_CLOSED)
+            self._counters = None
+            self._mmap.close()
+            self._mmap = None
+            self._file.close()
+
+    def publish(self) -> None:
+        """
+        Update the counters in the file.
+        """
+        with self._lock:
+            # Note: forked children share neither the mapping nor the
+            # counters with the parent
+            if not self.closed and os.getpid() == self.pid:
+                self._publish()
+
+    def _run(self) -> None:
+        while not self._stopped.wait(self.interval):
+            self.publish()
+
+    def _publish(self, flags: int = 0) -> None:
+        self._set_sequence(self._seq + 1)
+        try:
+            for _ in range(3):
+                layout = self.prof._get_live_layout()
+                if layout != self._layout:
+                    self._write_layout(layout)
+                if self.prof._fill_live_counters(layout, self._counters):
+                    break
+                # A code block grew after the layout was taken
+                self._layout = None
+            self._write_header(self._seq, flags, len(layout), time.time())
+        finally:
+            self._set_sequence(self._seq + 1)
+
+    def _set_sequence(self, seq: int) -> None:
+        self._seq = seq
+        _SEQUENCE.pack_into(self._mmap, _SEQUENCE_OFFSET, seq)
+
+    def _write_header(
+        self, seq: int, flags: int, nfuncs: int, timestamp: float
+    ) -> None:
+        if self._layout is None:
+            counters_offset = nslots = 0
+        else:
+            counters_offset = self._counters_offset
+            nslots = self._nslots
+        HEADER.pack_into(
+            self._mmap,
+            0,
+            MAGIC,
+            VERSION,
+            flags,
+            nfuncs,
+            seq,
+            self.pid,
+            self.prof.timer_unit,
+            timestamp,
+            counters_offset,
+            nslots,
+        )
+
+    def _write_layout(self, layout: list) -> None:
+        entries = []
+        nslots = 0
+        offset = HEADER.size
+        for (filename, first_lineno, name), _, slot_lineno, nlines in layout:
+            fname = filename.encode(_ENCODING, _ERRORS)
+            bname = name.encode(_ENCODING, _ERRORS)
+            entry = FUNCTION.pack(
+                first_lineno,
+                slot_lineno,
+                nslots,
+                nlines,
+                len(fname),
+                len(bname),
+            )
+            blob = entry + fname + bname
+            entries.append(blob + bytes(_align(len(blob)) - len(blob)))
+            nslots += nlines
+            offset += len(entries[-1])
+        counters_offset = offset
+        size = counters_offset + nslots * COUNTER.size
+        # Release the view before (possibly) remapping
+        self._counters = None
+        if size > len(self._mmap):
+            # Note: the file only ever grows, so that readers (which
+            # don't map it) never read past its end
+            self._mmap.close()
+            self._file.truncate(size)
+            self._mmap = mmap.mmap(self._file.fileno(), 0)
+            _SEQUENCE.pack_into(self._mmap, _SEQUENCE_OFFSET, self._seq)
+        self._mmap[HEADER.size : counters_offset] = b''.join(entries)
+        self._counters = memoryview(self._mmap)[counters_offset:size].cast(
+            'q'
+        )
+        self._counters_offset = counters_offset
+        self._nslots = nslots
+        self._layout = layout
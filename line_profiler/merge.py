@@ -0,0 +1,233 @@
+"""
+Merging of many ``.lprof`` files (e.g. one per worker per host of a
+fleet) into one, in parallel and with bounded memory.
+
+The files are split between ``jobs`` worker processes, each of which
+reads its share of the files one at a time and adds them to a running
+sum, so that it only ever holds that sum and the file being added; the
+sums of the workers are then added up in the same way as they come in,
+and the total can be written (in the binary format, see
+:py:mod:`line_profiler.stats_file`) to a single file.
+
+The same is available from the command line as
+``python -m line_profiler merge -o OUTPUT FILE [FILE ...]``, where the
+directories among the ``FILE``\\ s stand for all the ``*.lprof`` files
+under them, and ``@LIST`` reads more arguments from the file ``LIST``
+(one per line).
+
+Example:
+    >>> import os
+    >>> import tempfile
+    >>> from line_profiler import LineStats
+    >>>
+    >>>
+    >>> key = 'spam.py', 1, 'foo'
+    >>> with tempfile.TemporaryDirectory() as tmpdir:
+    ...     files = []
+    ...     for i in range(1, 5):
+    ...         files.append(os.path.join(tmpdir, f'{i}.lprof'))
+    ...         LineStats({key: [(2, i, 10 * i)]}, 1E-6).to_file(files[-1])
+    ...     output = os.path.join(tmpdir, 'merged.lprof')
+    ...     merged = merge_files(files, output, jobs=1)
+    ...     assert LineStats.from_files(output) == merged
+    >>> merged.timings
+    {('spam.py', 1, 'foo'): [(2, 10, 100)]}
+"""
+
+from __future__ import annotations
+
+import concurrent.futures
+import functools
+import os
+from argparse import ArgumentParser
+from collections.abc import Callable, Sequence
+from os import PathLike
+from typing import List
+
+from .cli_utils import add_argument
+from .line_profiler import (
+    LineStats,
+    _load_stats,
+    _match_patterns,
+    _StatsReducer,
+)
+
+__all__ = ('merge_files', 'find_stats_files', 'main')
+
+_Selector = Callable[[tuple], bool]
+
+
+def merge_files(
+    files: Sequence[PathLike[str] | str],
+    output: PathLike[str] | str | None = None,
+    *,
+    jobs: int | None = None,
+    select: _Selector | None = None,
+) -> LineStats:
+    """
+    Sum the results in the ``.lprof`` ``files`` (binary or pickled; see
+    :py:meth:`LineStats.from_files()
+    <line_profiler.line_profiler.LineStats.from_files>`).
+
+    Arguments:
+        files (Sequence[str | os.PathLike[str]]):
+            Filenames
+        output (str | os.PathLike[str] | None):
+            Optional filename to write the sum to in the binary format
+        jobs (int | None):
+            Number of worker processes to read the files in; default is
+            the number of CPUs, and with 1 (or only one file) the files
+            are read in the current process
+        select (Callable[[tuple[str, int, str]], bool] | None):
+            Optional callable choosing the functions to load (see
+            :py:meth:`LineStats.from_files()
+            <line_profiler.line_profiler.LineStats.from_files>`); with
+            multiple ``jobs``, it has to be picklable
+
+    Returns:
+        stats (LineStats):
+            The sum
+
+    Note:
+        The results are summed as they are read, so that each process
+        only holds its running sum and the file being added, instead of
+        all the files.
+    """
+    files = [os.fspath(file) for file in files]
+    if not files:
+        raise ValueError(f'files = {files!r}: empty')
+    if jobs is None:
+        jobs = os.cpu_count() or 1
+    jobs = max(min(jobs, len(files)), 1)
+    if jobs == 1:
+        reducer = _merge_in_process(files, select)
+    else:
+        reducer = _StatsReducer()
+        # Note: deal the files out round-robin, so that each worker gets
+        # a similar mix of (e.g. per-host) files, and have each worker
+        # send back only its (unrounded) sum, which is dropped as soon
+        # as it's added
+        with concurrent.futures.ProcessPoolExecutor(jobs) as executor:
+            pending = {
+                executor.submit(_merge_in_process, files[i::jobs], select)
+                for i in range(jobs)
+            }
+            while pending:
+                done, pending = concurrent.futures.wait(
+                    pending, return_when=concurrent.futures.FIRST_COMPLETED
+                )
+                for future in done:
+                    reducer.add(future.result())
+                del done, future
+    stats = reducer.get_stats()
+    if output is not None:
+        stats.to_file(output)
+    return stats
+
+
+def _merge_in_process(
+    files: Sequence[str], select: _Selector | None
+) -> _StatsReducer:
+    reducer = _StatsReducer()
+    for file in files:
+        reducer.add(_load_stats(file, select))
+    return reducer
+
+
+def find_stats_files(paths: Sequence[PathLike[str] | str]) -> List[str]:
+    """
+    Returns:
+        files (list[str]):
+            ``paths``, with each directory replaced by the ``*.lprof``
+            files under it (recursively, in sorted order)
+    """
+    files = []
+    for path in paths:
+        path = os.fspath(path)
+        if not os.path.isdir(path):
+            files.append(path)
+            continue
+        found = []
+        for dirpath, _, filenames in os.walk(path):
+            found.extend(
+                os.path.join(dirpath, filename)
+                for filename in filenames
+                if filename.endswith('.lprof')
+            )
+        files.extend(sorted(found))
+    return files
+
+
+def main(argv: Sequence[str] | None = None) -> None:
+    """
+    The CLI to merge ``.lprof`` files
+    (``python -m line_profiler merge``).
+    """
+    parser = ArgumentParser(
+        prog='python -m line_profiler merge',
+        description='Merge line profiling results (`.lprof` files) in '
+        'parallel, and write the total to a single binary `.lprof` file.',
+        fromfile_prefix_chars='@',
+    )
+    add_argument(
+        parser,
+        '-o',
+        '--output',
+        required=True,
+        help='File to write the merged results to.',
+    )
+    add_argument(
+        parser,
+        '-j',
+        '--jobs',
+        type=int,
+        help='Number of worker processes. (Default: the number of CPUs)',
+    )
+    add_argument(
+        parser,
+        '-k',
+        '--filter',
+        action='append',
+        dest='filters',
+        metavar='PATTERN',
+        help='Only merge the functions whose (qualified) names or '
+        'filenames match the glob pattern; can be given multiple times. '
+        '(Default: merge all functions)',
+    )
+    add_argument(
+        parser,
+        '-q',
+        '--quiet',
+        action='store_true',
+        help="Don't print the summary of the merge.",
+    )
+    add_argument(
+        parser,
+        'inputs',
+        nargs='+',
+        metavar='FILE',
+        help="'*.lprof' file(s) to merge, or directories to merge all "
+        "the '*.lprof' files under; '@LIST' reads more arguments from "
+        'the file LIST, one per line.',
+    )
+    args = parser.parse_args(argv)
+    if args.jobs is not None and args.jobs < 1:
+        parser.error(f'--jobs={args.jobs}: must be positive')
+    files = find_stats_files(args.inputs)
+    if not files:
+        parser.error(f'no `.lprof` files found in {args.inputs!r}')
+    select = None
+    if args.filters:
+        # Note: a partial object (unlike a closure) can be pickled for
+        # the worker processes
+        select = functools.partial(_match_patterns, args.filters)
+    stats = merge_files(files, args.output, jobs=args.jobs, select=select)
+    if not args.quiet:
+        print(
+            f'Wrote the merged results of {len(files)} file(s) '
+            f'({len(stats.timings)} function(s)) to {args.output!r}'
+        )
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,234 @@
+// Per-thread hardware performance counters for `_line_profiler.pyx`
+// (see `LineProfiler.counters`).
+//
+// Each profiled thread opens a group of `perf_event_open(2)` counters
+// counting its own user-space execution, which the trace callbacks read
+// wherever they read the timer: with `rdpmc` straight from the PMU if
+// the kernel allows it (as advertised in the memory-mapped page of each
+// counter), and with a single `read(2)` of the whole group otherwise.
+//
+// Counters are only available on Linux; elsewhere, `lp_perf_open()`
+// always fails (with `ENOSYS`).
+
+#ifndef LINE_PROFILER_PERF_COUNTERS_H
+#define LINE_PROFILER_PERF_COUNTERS_H
+
+#include "Python.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Most counters per group, i.e. per profiler; kept small so that the
+// groups fit in the PMU (together with the kernel's watchdog counter)
+#define LP_PERF_MAX_COUNTERS 4
+
+// Names of the events, by index, as in `perf list`
+static const char *const lp_perf_event_names[] = {
+    "cycles",
+    "instructions",
+    "cache-references",
+    "cache-misses",
+    "branches",
+    "branch-misses",
+    NULL,
+};
+#define LP_PERF_NUM_EVENTS \
+    ((int)(sizeof(lp_perf_event_names) / sizeof(lp_perf_event_names[0]) - 1))
+
+static inline int lp_perf_event_index(const char *name)
+{
+    int i;
+    for (i = 0; lp_perf_event_names[i] != NULL; i++) {
+        if (!strcmp(lp_perf_event_names[i], name)) return i;
+    }
+    return -1;
+}
+
+static inline const char *lp_perf_event_name(int index)
+{
+    if (index < 0 || index >= LP_PERF_NUM_EVENTS) return NULL;
+    return lp_perf_event_names[index];
+}
+
+#if defined(__linux__)
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define LP_PERF_HAVE_RDPMC 1
+#else
+#define LP_PERF_HAVE_RDPMC 0
+#endif
+
+static const unsigned long long lp_perf_event_configs[] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_REFERENCES,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_INSTRUCTIONS,
+    PERF_COUNT_HW_BRANCH_MISSES,
+};
+
+typedef struct lp_perf_group {
+    int n;
+    int fds[LP_PERF_MAX_COUNTERS];
+    // Memory-mapped control page of each counter (or `NULL`)
+    struct perf_event_mmap_page *pages[LP_PERF_MAX_COUNTERS];
+    // Size of the page mappings
+    size_t page_size;
+} lp_perf_group;
+
+static inline void lp_perf_close(lp_perf_group *group)
+{
+    int i;
+    if (group == NULL) return;
+    for (i = 0; i < group->n; i++) {
+        if (group->pages[i] != NULL)
+            munmap((void *)group->pages[i], group->page_size);
+        if (group->fds[i] >= 0) close(group->fds[i]);
+    }
+    free(group);
+}
+
+/*
+ * Open a group of counters for the `n` events (indices into
+ * `lp_perf_event_names`) on the calling thread, counting right away.
+ *
+ * Returns:
+ *     The group, or `NULL` (with `errno` set) on failure, e.g. if
+ *     `/proc/sys/kernel/perf_event_paranoid` forbids unprivileged
+ *     counters or the PMU has too few of them.
+ */
+static inline lp_perf_group *lp_perf_open(const int *events, int n)
+{
+    struct perf_event_attr attr;
+    lp_perf_group *group;
+    void *page;
+    int i, fd, saved;
+
+    if (n < 1 || n > LP_PERF_MAX_COUNTERS) {
+        errno = EINVAL;
+        return NULL;
+    }
+    group = (lp_perf_group *)calloc(1, sizeof(lp_perf_group));
+    if (group == NULL) return NULL;
+    group->page_size = (size_t)sysconf(_SC_PAGESIZE);
+    for (i = 0; i < LP_PERF_MAX_COUNTERS; i++) group->fds[i] = -1;
+    for (i = 0; i < n; i++) {
+        if (lp_perf_event_name(events[i]) == NULL) {
+            errno = EINVAL;
+            goto error;
+        }
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = lp_perf_event_configs[events[i]];
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP;
+        // The group is scheduled as a whole, so that the counters of a
+        // line are always from the same stretches of execution
+        attr.disabled = (i == 0);
+        fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1,
+                          i ? group->fds[0] : -1, 0);
+        if (fd < 0) goto error;
+        group->fds[i] = fd;
+        group->n = i + 1;
+        page = mmap(NULL, group->page_size, PROT_READ, MAP_SHARED, fd, 0);
+        group->pages[i] = (page == MAP_FAILED
+                           ? NULL : (struct perf_event_mmap_page *)page);
+    }
+    if (ioctl(group->fds[0], PERF_EVENT_IOC_ENABLE,
+              PERF_IOC_FLAG_GROUP) < 0)
+        goto error;
+    return group;
+error:
+    saved = errno;
+    lp_perf_close(group);
+    errno = saved;
+    return NULL;
+}
+
+#if LP_PERF_HAVE_RDPMC
+// Read a counter from user space per the protocol documented in
+// `linux/perf_event.h`; returns -1 if the kernel doesn't allow it (or
+// the counter isn't currently on the PMU)
+static inline int lp_perf_rdpmc(
+    struct perf_event_mmap_page *page, PY_LONG_LONG *value)
+{
+    unsigned int seq, index;
+    unsigned short width;
+    long long count, pmc;
+    do {
+        seq = page->lock;
+        __asm__ __volatile__("" ::: "memory");
+        index = page->index;
+        if (!page->cap_user_rdpmc || !index) return -1;
+        count = page->offset;
+        width = page->pmc_width;
+        pmc = (long long)__rdpmc((int)index - 1);
+        pmc <<= 64 - width;
+        pmc >>= 64 - width;
+        count += pmc;
+        __asm__ __volatile__("" ::: "memory");
+    } while (page->lock != seq);
+    *value = count;
+    return 0;
+}
+#endif
+
+/*
+ * Read the counters of `group` (opened on the calling thread) into
+ * `values`; they are left alone if they can't be read.
+ */
+static inline void lp_perf_read(lp_perf_group *group, PY_LONG_LONG *values)
+{
+    unsigned long long buf[1 + LP_PERF_MAX_COUNTERS];
+    int i;
+#if LP_PERF_HAVE_RDPMC
+    for (i = 0; i < group->n; i++) {
+        if (group->pages[i] == NULL
+                || lp_perf_rdpmc(group->pages[i], &values[i]) < 0)
+            break;
+    }
+    if (i == group->n) return;
+#endif
+    // Slow path: a system call for the whole group
+    if (read(group->fds[0], buf, sizeof(buf)) < (ssize_t)sizeof(buf[0]))
+        return;
+    for (i = 0; i < group->n && (unsigned long long)i < buf[0]; i++)
+        values[i] = (PY_LONG_LONG)buf[1 + i];
+}
+
+#else  // !defined(__linux__)
+
+typedef struct lp_perf_group {
+    int n;
+} lp_perf_group;
+
+static inline lp_perf_group *lp_perf_open(const int *events, int n)
+{
+    (void)events;
+    (void)n;
+    errno = ENOSYS;
+    return NULL;
+}
+
+static inline void lp_perf_close(lp_perf_group *group)
+{
+    (void)group;
+}
+
+static inline void lp_perf_read(lp_perf_group *group, PY_LONG_LONG *values)
+{
+    (void)group;
+    (void)values;
+}
+
+#endif  // defined(__linux__)
+
+#endif  // LINE_PROFILER_PERF_COUNTERS_H
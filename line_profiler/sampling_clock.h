@@ -0,0 +1,213 @@
+// Coarse clock for the time-based sampling mode of `LineProfiler`.
+//
+// A background thread (which never touches the interpreter) advances a
+// counter of microseconds every so often, so that the trace callbacks
+// can tell whether a sampling interval has elapsed with a single memory
+// load instead of a timer call.  The clock is approximate (it doesn't
+// account for oversleeping), which is fine for picking samples.  It only
+// runs while a profiler samples by time, at the shortest interval any of
+// them asks for.
+//
+// Note: like `thread_locals.h`, this header is C++-only.
+
+#ifndef LINE_PROFILER_SAMPLING_CLOCK_H
+#define LINE_PROFILER_SAMPLING_CLOCK_H
+
+#include "Python.h"
+#include "pythread.h"
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <set>
+
+// Shortest tick period of the clock; finer intervals are still honored
+// by the profilers, but only to within a tick
+#define LP_CLOCK_MIN_PERIOD_US 100
+
+static std::atomic<long long> lp_clock_us(0);
+// Tick period of the clock (0 if not running)
+static std::atomic<long long> lp_clock_period_us(0);
+
+// Bookkeeping of the users of the clock; heap-allocated (and replaced
+// in forked children, where another thread may have held the lock)
+struct lp_clock_state {
+    std::mutex lock;
+    // Periods requested by the users (see `lp_clock_acquire()`)
+    std::multiset<long long> periods;
+    // Lock the running thread sleeps on (see `lp_clock_run()`), and
+    // whether it has been released to wake the thread up
+    PyThread_type_lock wakeup = NULL;
+    bool woken = false;
+    // Incremented whenever the thread is to stop
+    unsigned long generation = 0;
+};
+
+static lp_clock_state *lp_clock_state_ptr = new lp_clock_state();
+
+struct lp_clock_thread_args {
+    PyThread_type_lock wakeup;
+    unsigned long generation;
+};
+
+static void lp_clock_run(void *arg)
+{
+    lp_clock_thread_args args = *(lp_clock_thread_args *)arg;
+    delete (lp_clock_thread_args *)arg;
+    for (;;) {
+        long long period;
+        PyLockStatus status;
+        {
+            lp_clock_state *state = lp_clock_state_ptr;
+            std::lock_guard<std::mutex> guard(state->lock);
+            if (state->generation != args.generation) break;
+            period = lp_clock_period_us.load(std::memory_order_relaxed);
+        }
+        // The lock is held, so this sleeps for the period unless woken
+        // up (by a change of period or a stop), in which case the lock
+        // is held again
+        status = PyThread_acquire_lock_timed(
+            args.wakeup, (PY_TIMEOUT_T)period, 0);
+        if (status == PY_LOCK_ACQUIRED) {
+            lp_clock_state *state = lp_clock_state_ptr;
+            std::lock_guard<std::mutex> guard(state->lock);
+            // Note: if stopped, `state` may already have a new thread
+            if (state->generation != args.generation) break;
+            state->woken = false;
+            continue;
+        }
+        lp_clock_us.fetch_add(period, std::memory_order_relaxed);
+    }
+    PyThread_free_lock(args.wakeup);
+}
+
+static inline long long lp_clock_now(void)
+{
+    return lp_clock_us.load(std::memory_order_relaxed);
+}
+
+// Wake up the running thread, if any (with `state->lock` held)
+static inline void lp_clock_wake(lp_clock_state *state)
+{
+    if (state->wakeup == NULL || state->woken) return;
+    state->woken = true;
+    PyThread_release_lock(state->wakeup);
+}
+
+// Start (or stop, or re-time) the thread so that it ticks at the
+// shortest period requested (with `state->lock` held)
+static inline int lp_clock_update(lp_clock_state *state)
+{
+    lp_clock_thread_args *args;
+    long long period = 0;
+    if (!state->periods.empty()) {
+        period = *state->periods.begin();
+        if (period < LP_CLOCK_MIN_PERIOD_US) period = LP_CLOCK_MIN_PERIOD_US;
+    }
+    if (period == lp_clock_period_us.load(std::memory_order_relaxed))
+        return 0;
+    lp_clock_period_us.store(period, std::memory_order_relaxed);
+    if (state->wakeup != NULL) {
+        if (period) {
+            lp_clock_wake(state);
+            return 0;
+        }
+        // Stop: the thread frees the lock on its way out
+        state->generation++;
+        lp_clock_wake(state);
+        state->wakeup = NULL;
+        state->woken = false;
+        return 0;
+    }
+    if (!period) return 0;
+    args = new (std::nothrow) lp_clock_thread_args;
+    if (args == NULL) goto error;
+    args->wakeup = PyThread_allocate_lock();
+    if (args->wakeup == NULL) goto error;
+    PyThread_acquire_lock(args->wakeup, WAIT_LOCK);
+    args->generation = ++state->generation;
+    state->wakeup = args->wakeup;
+    state->woken = false;
+    if (PyThread_start_new_thread(lp_clock_run, (void *)args)
+            == PYTHREAD_INVALID_THREAD_ID) {
+        state->wakeup = NULL;
+        PyThread_release_lock(args->wakeup);
+        PyThread_free_lock(args->wakeup);
+        goto error;
+    }
+    return 0;
+error:
+    delete args;
+    lp_clock_period_us.store(0, std::memory_order_relaxed);
+    return -1;
+}
+
+/*
+ * Start using the clock with a tick period of (at most) `period_us`
+ * microseconds, starting it if needed; every successful call is to be
+ * matched by an `lp_clock_release()` with the same period, after the
+ * last of which the clock stops.  The ticks are never shorter than
+ * `LP_CLOCK_MIN_PERIOD_US` though.
+ *
+ * Returns:
+ *     0 on success, -1 if the thread can't be started (or on running
+ *     out of memory).
+ */
+static inline int lp_clock_acquire(long long period_us)
+{
+    lp_clock_state *state = lp_clock_state_ptr;
+    std::lock_guard<std::mutex> guard(state->lock);
+    std::multiset<long long>::iterator it;
+    if (period_us < 1) period_us = 1;
+    try {
+        it = state->periods.insert(period_us);
+    } catch (...) {
+        return -1;
+    }
+    if (lp_clock_update(state) < 0) {
+        state->periods.erase(it);
+        return -1;
+    }
+    return 0;
+}
+
+// Stop using the clock (see `lp_clock_acquire()`)
+static inline void lp_clock_release(long long period_us)
+{
+    lp_clock_state *state = lp_clock_state_ptr;
+    std::lock_guard<std::mutex> guard(state->lock);
+    std::multiset<long long>::iterator it;
+    if (period_us < 1) period_us = 1;
+    it = state->periods.find(period_us);
+    if (it == state->periods.end()) return;
+    state->periods.erase(it);
+    // Note: slowing down or stopping can't fail
+    lp_clock_update(state);
+}
+
+/*
+ * Restart the clock in a forked child, where the thread advancing it
+ * no longer exists.
+ *
+ * Returns:
+ *     0 on success, -1 if the thread can't be started.
+ */
+static inline int lp_clock_after_fork(void)
+{
+    // Note: the old state is leaked, since its lock may be held by a
+    // thread which is gone
+    lp_clock_state *old = lp_clock_state_ptr;
+    lp_clock_state *state = new (std::nothrow) lp_clock_state();
+    if (state == NULL) return -1;
+    try {
+        state->periods = old->periods;
+    } catch (...) {
+        delete state;
+        return -1;
+    }
+    lp_clock_state_ptr = state;
+    lp_clock_period_us.store(0, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> guard(state->lock);
+    return lp_clock_update(state);
+}
+
+#endif // LINE_PROFILER_SAMPLING_CLOCK_H
@@ -0,0 +1,1406 @@
+"""
+Binary on-disk format for line-profiling results (``.lprof`` files).
+
+Historically, ``.lprof`` files were pickled
+:py:class:`~.line_profiler.LineStats` objects, which have to be
+unpickled as a whole before anything can be done with them.  The format
+implemented here instead consists of fixed-width records which can be
+memory-mapped, so that the results for a subset of the profiled
+functions can be read without deserializing the rest of the file.
+
+Layout:
+    A file consists of one or more *frames* laid out back to back.  The
+    timings in a file are the sums of those in its frames: a file
+    written by :py:func:`write_stats` has a single frame, while an
+    incremental log written by :py:func:`append_stats` has one frame
+    (flagged with :py:data:`FLAG_DELTA`) for the changes since the
+    previous one, so that the timings at any point in time are the
+    sums of the frames up to it.
+
+    All integers are little-endian; all offsets are in bytes from the
+    start of the frame, and are multiples of 8.  A frame consists of:
+
+    Header (64 bytes, see :py:data:`HEADER`):
+
+    * Magic number :py:data:`MAGIC` (8 bytes)
+    * Format version (``uint16``), currently :py:data:`VERSION`
+    * Flags (``uint16``), see :py:data:`FLAG_DELTA`,
+      :py:data:`FLAG_HISTOGRAMS`, :py:data:`FLAG_THREADS`,
+      :py:data:`FLAG_SELF_TIMES`, :py:data:`FLAG_COUNTERS`, and
+      :py:data:`FLAG_MEMORY`
+    * Number of strings in the string table (``uint32``)
+    * Number of functions in the function table (``uint32``)
+    * Timer unit in seconds (``float64``)
+    * Offsets of the record array, the string table, and the function
+      table (3 ``uint64``)
+    * Time at which the frame was written (``float64``, seconds since
+      the epoch)
+    * Estimated overhead of the profiler in seconds per hit
+      (``float32``, see :py:attr:`LineStats.overhead
+      <.line_profiler.LineStats.overhead>`); 0 if unknown (the bytes
+      were padding in files written by older versions)
+
+    Record array (see :py:data:`RECORD`):
+        One ``(lineno, nhits, total_time)`` triplet of ``int64`` for
+        each profiled line; the records of each function are contiguous
+        and in their original order.
+
+    Histogram section (only if flagged with :py:data:`FLAG_HISTOGRAMS`;
+    right after the record array):
+        One ``(max_time, start, count)`` entry (``int64`` and 2
+        ``uint64``, see :py:data:`HIST_RECORD`) for each record, giving
+        the longest hit of the line and the range of its entries in the
+        array which follows, of ``(bucket, count)`` pairs of ``int64``
+        (see :py:data:`HIST_BUCKET`) for the non-zero buckets of the
+        histograms of the lines (see :py:mod:`line_profiler.histograms`);
+        lines without histograms have no entries.  Older readers skip
+        the section, since the string and function tables are found by
+        their offsets.
+
+    Memory section (only if flagged with :py:data:`FLAG_MEMORY`; right
+    before the counter section if any, or else where the latter would
+    be):
+        One ``(nallocs, allocated, retained)`` triplet of ``int64`` (see
+        :py:data:`MEMORY`) for each record, giving the allocation
+        counters of the line (see :py:attr:`LineStats.memory
+        <.line_profiler.LineStats.memory>`); like the self-time
+        section, it is found backwards from the next section.
+
+    Counter section (only if flagged with :py:data:`FLAG_COUNTERS`;
+    right before the self-time section if any, or else where the
+    latter would be):
+        The counts of hardware events in the lines (see
+        :py:attr:`LineStats.counters
+        <.line_profiler.LineStats.counters>`): the string indices of
+        the names of the ``nevents`` events (``uint64`` each, see
+        :py:data:`COUNTER_EVENT`), followed by ``nevents`` arrays of
+        one ``int64`` (see :py:data:`COUNT`) for each record, and by
+        ``nevents`` (``uint64``, see :py:data:`COUNTER_TRAILER`), so
+        that the section can be found backwards from the next one.
+
+    Self-time section (only if flagged with :py:data:`FLAG_SELF_TIMES`;
+    right before the thread section if any, and before the string table
+    otherwise):
+        One ``int64`` (see :py:data:`SELF_TIME`) for each record, giving
+        the self time of the line (see :py:attr:`LineStats.self_times
+        <.line_profiler.LineStats.self_times>`); since its size follows
+        from the number of records, it is found backwards from the next
+        section, and older readers skip it.
+
+    Thread section (only if flagged with :py:data:`FLAG_THREADS`;
+    right before the string table):
+        The per-thread timings (see :py:attr:`LineStats.thread_timings
+        <.line_profiler.LineStats.thread_timings>`): one ``(name,
+        reserved, start, count)`` entry (2 ``uint32`` and 2 ``uint64``,
+        see :py:data:`THREAD`) for each thread, giving the string index
+        of its name and the range of its records in the array which
+        follows, of ``(function, lineno, nhits, total_time)`` records
+        (``uint64`` index into the function table and 3 ``int64``, see
+        :py:data:`THREAD_RECORD`); the section ends with the numbers of
+        threads and of records (2 ``uint64``, see
+        :py:data:`THREAD_TRAILER`), so that it can be found from the
+        offset of the string table.
+
+    String table:
+        ``nstrings + 1`` ``uint64`` offsets (relative to the end of the
+        offset array), followed by the concatenated UTF-8 strings (lone
+        surrogates, e.g. from undecodable filenames, are passed
+        through), so that string ``i`` spans the bytes
+        ``offsets[i]:offsets[i + 1]``.
+
+    Function table (see :py:data:`FUNCTION`):
+        For each function: the string indices of its filename and name
+        (2 ``uint32``), its first line number (``int64``), and the
+        index of its first record and its number of records (2
+        ``uint64``).  The frame ends with the table.
+
+    Frames are written front-to-back in one pass, except for their
+    headers, which are filled in last; readers should ignore a trailing
+    frame with no valid header (e.g. from a process killed mid-write),
+    and reject frames whose major version they don't know.
+
+Example:
+    >>> import os
+    >>> import tempfile
+    >>> timings = {('spam.py', 1, 'foo'): [(2, 10, 300)],
+    ...            ('spam.py', 10, 'bar'): [(11, 2, 1000), (12, 1, 500)]}
+    >>> with tempfile.TemporaryDirectory() as tmpdir:
+    ...     fname = os.path.join(tmpdir, 'out.lprof')
+    ...     write_stats(fname, timings, 1E-6)
+    ...     assert is_stats_file(fname)
+    ...     with StatsFile(fname) as stats:
+    ...         assert stats.unit == 1E-6
+    ...         assert len(stats) == 2
+    ...         assert stats['spam.py', 10, 'bar'] == timings[
+    ...             'spam.py', 10, 'bar']
+    ...         assert stats.select(
+    ...             lambda key: key[2] == 'foo') == {
+    ...                 ('spam.py', 1, 'foo'): [(2, 10, 300)]}
+    ...         assert dict(stats) == timings
+"""
+
+from __future__ import annotations
+
+import mmap
+import os
+import struct
+import time
+from collections.abc import Callable, Iterable, Iterator, Mapping
+from os import PathLike
+from typing import IO, Dict, List, Tuple
+
+from .histograms import merge
+
+__all__ = (
+    'MAGIC',
+    'VERSION',
+    'FLAG_DELTA',
+    'FLAG_HISTOGRAMS',
+    'FLAG_THREADS',
+    'FLAG_SELF_TIMES',
+    'FLAG_COUNTERS',
+    'FLAG_MEMORY',
+    'is_stats_file',
+    'write_stats',
+    'append_stats',
+    'read_stats',
+    'StatsFile',
+    'StatsLog',
+    'StatsWriter',
+)
+
+_Key = Tuple[str, int, str]
+_Entries = List[Tuple[int, int, int]]
+_Histograms = Dict[int, Tuple[int, Dict[int, int]]]
+_ThreadTimings = Dict[str, Dict[_Key, _Entries]]
+_SelfTimes = Dict[int, int]
+_Counters = Dict[str, Dict[_Key, Dict[int, int]]]
+_Memory = Dict[int, Tuple[int, int, int]]
+
+#: Magic number at the start of binary ``.lprof`` files; the leading
+#: non-ASCII byte and the ``\r\n`` catch transfers in text mode (and
+#: pickles, which start with ``b'\x80'``, can't be confused with it)
+MAGIC = b'\x89LPROF\r\n'
+#: Current version of the format
+VERSION = 1
+#: Header flag marking the frame as holding the changes since the
+#: previous frame (for information; frames are always summed)
+FLAG_DELTA = 0x1
+#: Header flag marking the frame as having a histogram section
+FLAG_HISTOGRAMS = 0x2
+#: Header flag marking the frame as having a thread section
+FLAG_THREADS = 0x4
+#: Header flag marking the frame as having a self-time section
+FLAG_SELF_TIMES = 0x8
+#: Header flag marking the frame as having a counter section
+FLAG_COUNTERS = 0x10
+#: Header flag marking the frame as having a memory section
+FLAG_MEMORY = 0x20
+
+#: Frame header
+HEADER = struct.Struct('<8sHHIIdQQQdf')
+#: A ``(lineno, nhits, total_time)`` record
+RECORD = struct.Struct('<qqq')
+#: A function-table entry
+FUNCTION = struct.Struct('<IIqQQ')
+#: A ``(max_time, start, count)`` entry of the histogram section
+HIST_RECORD = struct.Struct('<qQQ')
+#: A ``(bucket, count)`` pair of the histogram section
+HIST_BUCKET = struct.Struct('<qq')
+#: A ``(name, reserved, start, count)`` entry of the thread section
+THREAD = struct.Struct('<IIQQ')
+#: A ``(function, lineno, nhits, total_time)`` record of the thread
+#: section
+THREAD_RECORD = struct.Struct('<Qqqq')
+#: The ``(nthreads, nrecords)`` at the end of the thread section
+THREAD_TRAILER = struct.Struct('<QQ')
+#: The self time of a record in the self-time section
+SELF_TIME = struct.Struct('<q')
+#: The string index of the name of an event in the counter section
+COUNTER_EVENT = struct.Struct('<Q')
+#: The count of an event in a record in the counter section
+COUNT = struct.Struct('<q')
+#: The ``nevents`` at the end of the counter section
+COUNTER_TRAILER = struct.Struct('<Q')
+#: The ``(nallocs, allocated, retained)`` of a record in the memory
+#: section
+MEMORY = struct.Struct('<qqq')
+_OFFSET = struct.Struct('<Q')
+
+_ENCODING = 'utf-8'
+_ERRORS = 'surrogatepass'
+
+
+def _sum_timings(
+    all_timings: Iterable[Mapping[_Key, Iterable[Tuple[int, int, int]]]],
+) -> Dict[_Key, _Entries]:
+    totals: Dict[_Key, Dict[int, List[int]]] = {}
+    for timings in all_timings:
+        for key, entries in timings.items():
+            lines = totals.setdefault(key, {})
+            for lineno, nhits, total_time in entries:
+                try:
+                    total = lines[lineno]
+                except KeyError:
+                    lines[lineno] = [nhits, total_time]
+                else:
+                    total[0] += nhits
+                    total[1] += total_time
+    return {
+        key: [
+            (lineno, nhits, total_time)
+            for lineno, (nhits, total_time) in sorted(lines.items())
+        ]
+        for key, lines in totals.items()
+    }
+
+
+def is_stats_file(file: PathLike[str] | str | IO[bytes]) -> bool:
+    """
+    Returns:
+        is_stats_file (bool):
+            Whether ``file`` (a path, or a binary file object which is
+            read from the current position and rewound) starts with
+            :py:data:`MAGIC`
+    """
+    if hasattr(file, 'read'):
+        pos = file.tell()
+        try:
+            return file.read(len(MAGIC)) == MAGIC
+        finally:
+            file.seek(pos)
+    with open(file, 'rb') as f:
+        return f.read(len(MAGIC)) == MAGIC
+
+
+def _pad(f: IO[bytes], base: int = 0) -> int:
+    pos = f.tell() - base
+    if pos % 8:
+        f.write(bytes(8 - pos % 8))
+        pos += 8 - pos % 8
+    return pos
+
+
+class StatsWriter:
+    """
+    Write a frame of a binary ``.lprof`` file function by function, so
+    that the records don't have to be held in memory all at once.
+
+    Arguments:
+        file (str | os.PathLike[str] | IO[bytes]):
+            Filename to (over)write, or seekable binary file object
+            positioned where the frame is to start (which isn't closed
+            by the writer)
+        unit (float):
+            Timer unit
+        flags (int):
+            Header flags (see :py:data:`FLAG_DELTA`)
+        timestamp (float | None):
+            Time of writing to record (default: now)
+        overhead (float):
+            Per-hit overhead of the profiler to record
+
+    Example:
+        >>> import os
+        >>> import tempfile
+        >>> with tempfile.TemporaryDirectory() as tmpdir:
+        ...     fname = os.path.join(tmpdir, 'out.lprof')
+        ...     with StatsWriter(fname, 1E-7) as writer:
+        ...         writer.add(('spam.py', 1, 'foo'), [(2, 1, 10)])
+        ...         writer.add(('spam.py', 5, 'bar'), [])
+        ...     with StatsFile(fname) as stats:
+        ...         assert list(stats) == [('spam.py', 1, 'foo'),
+        ...                                ('spam.py', 5, 'bar')]
+    """
+
+    def __init__(
+        self,
+        file: PathLike[str] | str | IO[bytes],
+        unit: float,
+        *,
+        flags: int = 0,
+        timestamp: float | None = None,
+        overhead: float = 0.0,
+    ) -> None:
+        self.unit = unit
+        self.flags = flags
+        self.overhead = overhead
+        self.timestamp = time.time() if timestamp is None else timestamp
+        if hasattr(file, 'write'):
+            self._file: IO[bytes] | None = file
+            self._owns_file = False
+        else:
+            self._file = open(file, 'wb')
+            self._owns_file = True
+        self._base = self._file.tell()
+        self._strings: Dict[str, int] = {}
+        self._functions: List[Tuple[int, int, int, int, int]] = []
+        self._function_index: Dict[_Key, int] = {}
+        self._nrecords = 0
+        # Histograms of the records, if any (see `.add()`)
+        self._histograms: List[Tuple[int, Dict[int, int]] | None] = []
+        self._has_histograms = False
+        # Self times of the records, if any (see `.add()`)
+        self._self_times: List[int] = []
+        self._has_self_times = False
+        # Counts of the records by event, if any (see `.add()`)
+        self._counters: Dict[str, List[int]] = {}
+        # Allocation counters of the records, if any (see `.add()`)
+        self._memory: List[Tuple[int, int, int]] = []
+        self._has_memory = False
+        # Packed records of the threads, if any (see `.add_thread()`)
+        self._threads: Dict[str, List[bytes]] = {}
+        self._file.write(bytes(HEADER.size))
+
+    def _intern(self, string: str) -> int:
+        try:
+            return self._strings[string]
+        except KeyError:
+            index = self._strings[string] = len(self._strings)
+            return index
+
+    def add(
+        self,
+        key: _Key,
+        entries: Iterable[Tuple[int, int, int]],
+        histograms: Mapping[int, Tuple[int, Mapping[int, int]]] | None = None,
+        self_times: Mapping[int, int] | None = None,
+        counters: Mapping[str, Mapping[int, int]] | None = None,
+        memory: Mapping[int, Tuple[int, int, int]] | None = None,
+    ) -> None:
+        """
+        Append the records for the function ``key`` (a ``(filename,
+        first_lineno, name)`` tuple), written immediately; the
+        histograms of its lines (``{lineno: (max_time, counts)}``, see
+        :py:attr:`LineStats.histograms
+        <.line_profiler.LineStats.histograms>`), their self times
+        (``{lineno: self_time}``, see :py:attr:`LineStats.self_times
+        <.line_profiler.LineStats.self_times>`), their counts of
+        hardware events (``{event: {lineno: count}}``, see
+        :py:attr:`LineStats.counters
+        <.line_profiler.LineStats.counters>`), and their allocation
+        counters (``{lineno: (nallocs, allocated, retained)}``, see
+        :py:attr:`LineStats.memory <.line_profiler.LineStats.memory>`;
+        only those of lines with records are kept), if any, are written
+        when closing the writer.
+        """
+        if self._file is None:
+            raise ValueError('writer is closed')
+        filename, first_lineno, name = key
+        pack = RECORD.pack
+        entries = list(entries)
+        data = b''.join(
+            pack(lineno, nhits, total_time)
+            for lineno, nhits, total_time in entries
+        )
+        self._file.write(data)
+        nrecords = len(entries)
+        if histograms:
+            self._has_histograms = True
+            self._histograms.extend(
+                histograms.get(lineno) for lineno, _, _ in entries
+            )
+        else:
+            self._histograms.extend([None] * nrecords)
+        if self_times:
+            self._has_self_times = True
+            self._self_times.extend(
+                self_times.get(lineno, 0) for lineno, _, _ in entries
+            )
+        else:
+            self._self_times.extend([0] * nrecords)
+        if memory:
+            self._has_memory = True
+            self._memory.extend(
+                tuple(memory.get(lineno, (0, 0, 0)))
+                for lineno, _, _ in entries
+            )
+        else:
+            self._memory.extend([(0, 0, 0)] * nrecords)
+        counters = counters or {}
+        for event in counters:
+            self._counters.setdefault(event, [0] * self._nrecords)
+        for event, counts in self._counters.items():
+            line_counts = counters.get(event)
+            if line_counts:
+                counts.extend(
+                    line_counts.get(lineno, 0) for lineno, _, _ in entries
+                )
+            else:
+                counts.extend([0] * nrecords)
+        self._function_index.setdefault(key, len(self._functions))
+        self._functions.append(
+            (
+                self._intern(filename),
+                self._intern(name),
+                first_lineno,
+                self._nrecords,
+                nrecords,
+            )
+        )
+        self._nrecords += nrecords
+
+    def add_thread(
+        self,
+        thread: str,
+        key: _Key,
+        entries: Iterable[Tuple[int, int, int]],
+    ) -> None:
+        """
+        Add the records of the thread named ``thread`` for the function
+        ``key`` (see :py:attr:`LineStats.thread_timings
+        <.line_profiler.LineStats.thread_timings>`), which are written
+        when closing the writer; if the function hasn't been
+        :py:meth:`.add`-ed, it is added without (overall) records.
+        """
+        if self._file is None:
+            raise ValueError('writer is closed')
+        try:
+            function = self._function_index[key]
+        except KeyError:
+            self.add(key, [])
+            function = self._function_index[key]
+        pack = THREAD_RECORD.pack
+        self._threads.setdefault(thread, []).extend(
+            pack(function, lineno, nhits, total_time)
+            for lineno, nhits, total_time in entries
+        )
+
+    def close(self) -> None:
+        """
+        Write the string and function tables and the header (and close
+        the file if the writer opened it).
+        """
+        f = self._file
+        if f is None:
+            return
+        self._file = None
+        base = self._base
+        flags = self.flags
+        try:
+            if self._has_histograms:
+                flags |= FLAG_HISTOGRAMS
+                self._write_histograms(f)
+            if self._has_memory:
+                flags |= FLAG_MEMORY
+                f.write(
+                    b''.join(MEMORY.pack(*counts) for counts in self._memory)
+                )
+            if self._counters:
+                flags |= FLAG_COUNTERS
+                self._write_counters(f)
+            if self._has_self_times:
+                flags |= FLAG_SELF_TIMES
+                f.write(
+                    b''.join(SELF_TIME.pack(t) for t in self._self_times)
+                )
+            if self._threads:
+                flags |= FLAG_THREADS
+                self._write_threads(f)
+            # The records are 8-byte aligned (as is the header)
+            strings_offset = f.tell() - base
+            blobs = [s.encode(_ENCODING, _ERRORS) for s in self._strings]
+            offset = 0
+            offsets = [offset]
+            for blob in blobs:
+                offset += len(blob)
+                offsets.append(offset)
+            f.write(b''.join(_OFFSET.pack(offset) for offset in offsets))
+            f.write(b''.join(blobs))
+            funcs_offset = _pad(f, base)
+            f.write(
+                b''.join(FUNCTION.pack(*func) for func in self._functions)
+            )
+            end = f.tell()
+            f.seek(base)
+            f.write(
+                HEADER.pack(
+                    MAGIC,
+                    VERSION,
+                    flags,
+                    len(blobs),
+                    len(self._functions),
+                    self.unit,
+                    HEADER.size,
+                    strings_offset,
+                    funcs_offset,
+                    self.timestamp,
+                    self.overhead,
+                )
+            )
+            f.seek(end)
+        finally:
+            if self._owns_file:
+                f.close()
+
+    def _write_histograms(self, f: IO[bytes]) -> None:
+        index: List[bytes] = []
+        buckets: List[bytes] = []
+        for histogram in self._histograms:
+            if histogram is None:
+                index.append(HIST_RECORD.pack(0, len(buckets), 0))
+                continue
+            max_time, counts = histogram
+            index.append(HIST_RECORD.pack(max_time, len(buckets), len(counts)))
+            buckets.extend(
+                HIST_BUCKET.pack(bucket, count)
+                for bucket, count in sorted(counts.items())
+            )
+        f.write(b''.join(index))
+        f.write(b''.join(buckets))
+
+    def _write_counters(self, f: IO[bytes]) -> None:
+        f.write(
+            b''.join(
+                COUNTER_EVENT.pack(self._intern(event))
+                for event in self._counters
+            )
+        )
+        for counts in self._counters.values():
+            f.write(b''.join(COUNT.pack(count) for count in counts))
+        f.write(COUNTER_TRAILER.pack(len(self._counters)))
+
+    def _write_threads(self, f: IO[bytes]) -> None:
+        nrecords = 0
+        for thread, records in self._threads.items():
+            f.write(
+                THREAD.pack(self._intern(thread), 0, nrecords, len(records))
+            )
+            nrecords += len(records)
+        for records in self._threads.values():
+            f.write(b''.join(records))
+        f.write(THREAD_TRAILER.pack(len(self._threads), nrecords))
+
+    def __enter__(self) -> StatsWriter:
+        return self
+
+    def __exit__(self, *_, **__) -> None:
+        self.close()
+
+
+def write_stats(
+    filename: PathLike[str] | str,
+    timings: Mapping[_Key, Iterable[Tuple[int, int, int]]],
+    unit: float,
+    *,
+    overhead: float = 0.0,
+    histograms: Mapping[_Key, Mapping] | None = None,
+    thread_timings: Mapping[str, Mapping[_Key, Iterable]] | None = None,
+    self_times: Mapping[_Key, Mapping[int, int]] | None = None,
+    counters: Mapping[str, Mapping[_Key, Mapping[int, int]]] | None = None,
+    memory: Mapping[_Key, Mapping[int, Tuple[int, int, int]]] | None = None,
+) -> None:
+    """
+    Write ``timings`` (in the format of
+    :py:attr:`LineStats.timings <.line_profiler.LineStats.timings>`),
+    ``unit``, ``overhead``, ``histograms``, ``thread_timings``,
+    ``self_times``, ``counters``, and ``memory`` (in the formats of
+    :py:attr:`LineStats.histograms
+    <.line_profiler.LineStats.histograms>`,
+    :py:attr:`LineStats.thread_timings
+    <.line_profiler.LineStats.thread_timings>`,
+    :py:attr:`LineStats.self_times
+    <.line_profiler.LineStats.self_times>`,
+    :py:attr:`LineStats.counters <.line_profiler.LineStats.counters>`,
+    and :py:attr:`LineStats.memory <.line_profiler.LineStats.memory>`)
+    to ``filename`` in the binary format.
+    """
+    with StatsWriter(filename, unit, overhead=overhead) as writer:
+        _add_all(
+            writer,
+            timings,
+            histograms,
+            thread_timings,
+            self_times,
+            counters,
+            memory,
+        )
+
+
+def _add_all(
+    writer: StatsWriter,
+    timings: Mapping[_Key, Iterable[Tuple[int, int, int]]],
+    histograms: Mapping[_Key, Mapping] | None,
+    thread_timings: Mapping[str, Mapping[_Key, Iterable]] | None,
+    self_times: Mapping[_Key, Mapping[int, int]] | None = None,
+    counters: Mapping[str, Mapping[_Key, Mapping[int, int]]] | None = None,
+    memory: Mapping[_Key, Mapping[int, Tuple[int, int, int]]] | None = None,
+) -> None:
+    histograms = histograms or {}
+    self_times = self_times or {}
+    counters = counters or {}
+    memory = memory or {}
+    for key, entries in timings.items():
+        writer.add(
+            key,
+            entries,
+            histograms.get(key),
+            self_times.get(key),
+            {
+                event: per_key[key]
+                for event, per_key in counters.items()
+                if key in per_key
+            },
+            memory.get(key),
+        )
+    for thread, per_key in (thread_timings or {}).items():
+        for key, entries in per_key.items():
+            writer.add_thread(thread, key, entries)
+
+
+def _frames_end(f: IO[bytes], filename: PathLike[str] | str) -> int:
+    """
+    Returns:
+        Offset just past the last complete frame of ``f`` (0 if there
+        is none, i.e. if the first frame hasn't been written in full)
+    """
+    size = f.seek(0, os.SEEK_END)
+    end = offset = 0
+    while offset + HEADER.size <= size:
+        f.seek(offset)
+        header = HEADER.unpack(f.read(HEADER.size))
+        if header[0] != MAGIC:
+            break
+        _, _, _, _, nfuncs, _, _, _, funcs_offset, _, _ = header
+        frame_end = offset + funcs_offset + nfuncs * FUNCTION.size
+        if frame_end > size:
+            break
+        end = frame_end
+        offset = frame_end + (-frame_end) % 8
+    if not end and size:
+        # The header of an incomplete frame is still zeroed; anything
+        # else isn't ours to truncate
+        f.seek(0)
+        if f.read(len(MAGIC)).strip(b'\0'):
+            raise _not_a_stats_file(filename)
+    return end
+
+
+def append_stats(
+    filename: PathLike[str] | str,
+    timings: Mapping[_Key, Iterable[Tuple[int, int, int]]],
+    unit: float,
+    *,
+    timestamp: float | None = None,
+    overhead: float = 0.0,
+    histograms: Mapping[_Key, Mapping] | None = None,
+    thread_timings: Mapping[str, Mapping[_Key, Iterable]] | None = None,
+    self_times: Mapping[_Key, Mapping[int, int]] | None = None,
+    counters: Mapping[str, Mapping[_Key, Mapping[int, int]]] | None = None,
+    memory: Mapping[_Key, Mapping[int, Tuple[int, int, int]]] | None = None,
+) -> None:
+    """
+    Append ``timings`` (the changes since the last call, e.g. from
+    :py:meth:`LineProfiler.get_stats_delta()
+    <.line_profiler.LineProfiler.get_stats_delta>`, along with
+    ``histograms``, ``thread_timings``, ``self_times``, ``counters``,
+    and ``memory``) and ``unit``
+    to ``filename`` (created if needed) as a new frame; see
+    :py:class:`StatsLog` for reading the file back.
+
+    An incomplete frame at the end of the file (e.g. left by a process
+    killed mid-write) is discarded first, so that the new frame follows
+    the previous complete one.
+
+    Example:
+        >>> import os
+        >>> import tempfile
+        >>> key = 'spam.py', 1, 'foo'
+        >>> with tempfile.TemporaryDirectory() as tmpdir:
+        ...     fname = os.path.join(tmpdir, 'out.lprof')
+        ...     append_stats(fname, {key: [(2, 1, 10)]}, 1E-6)
+        ...     append_stats(fname, {}, 1E-6)
+        ...     append_stats(fname, {key: [(2, 2, 5), (3, 1, 1)]}, 1E-6)
+        ...     assert read_stats(fname) == (
+        ...         {key: [(2, 3, 15), (3, 1, 1)]}, 1E-6)
+        ...     with StatsLog(fname) as log:
+        ...         assert len(log) == 3
+        ...         assert log.get_timings(1) == {key: [(2, 1, 10)]}
+    """
+    try:
+        f = open(filename, 'r+b')
+    except FileNotFoundError:
+        f = open(filename, 'w+b')
+    with f:
+        end = _frames_end(f, filename)
+        f.seek(end)
+        f.truncate()
+        _pad(f)
+        with StatsWriter(
+            f,
+            unit,
+            flags=FLAG_DELTA,
+            timestamp=timestamp,
+            overhead=overhead,
+        ) as writer:
+            _add_all(
+                writer,
+                timings,
+                histograms,
+                thread_timings,
+                self_times,
+                counters,
+                memory,
+            )
+
+
+def read_stats(
+    filename: PathLike[str] | str,
+    select: Callable[[_Key], bool] | None = None,
+) -> Tuple[Dict[_Key, _Entries], float]:
+    """
+    Returns:
+        timings_and_unit (tuple[dict[tuple[str, int, str], \
+list[tuple[int, int, int]]], float]):
+            Timings (summed over the frames; see
+            :py:meth:`StatsFile.select` for ``select``) and timer unit
+            of the binary ``.lprof`` file ``filename``
+    """
+    with StatsLog(filename) as log:
+        return log.get_timings(select=select), log.unit
+
+
+def _not_a_stats_file(filename: PathLike[str] | str) -> ValueError:
+    return ValueError(f'{os.fspath(filename)!r}: not a binary `.lprof` file')
+
+
+class StatsFile(Mapping):
+    """
+    Read-only, memory-mapped view of a frame of a binary ``.lprof``
+    file, mapping the keys ``(filename, first_lineno, name)`` to the
+    lists of ``(lineno, nhits, total_time)`` tuples.
+
+    Only the function table is read upon construction (and the strings
+    upon the first lookup); the records of a function are only read
+    when it is looked up.
+
+    Arguments:
+        filename (str | os.PathLike[str]):
+            Filename
+        offset (int):
+            Offset of the frame (see :py:attr:`.end`)
+
+    Attributes:
+        unit (float):
+            Timer unit
+        flags (int):
+            Header flags (see :py:data:`FLAG_DELTA`)
+        timestamp (float):
+            Time at which the frame was written
+        overhead (float):
+            Per-hit overhead of the profiler (0 if unknown)
+        end (int):
+            Offset just past the frame
+
+    Note:
+        Objects should be :py:meth:`.close`-d (or used as context
+        managers) so that the file is unmapped promptly.
+    """
+
+    def __init__(self, filename: PathLike[str] | str, offset: int = 0) -> None:
+        with open(filename, 'rb') as f:
+            if os.fstat(f.fileno()).st_size < offset + HEADER.size:
+                raise _not_a_stats_file(filename)
+            buffer = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        try:
+            self._map(buffer, offset, filename)
+        except BaseException:
+            buffer.close()
+            raise
+        self._owns_mmap = True
+
+    @classmethod
+    def _from_mmap(
+        cls, buffer: mmap.mmap, offset: int, filename: PathLike[str] | str
+    ) -> StatsFile:
+        self = cls.__new__(cls)
+        self._map(buffer, offset, filename)
+        self._owns_mmap = False
+        return self
+
+    def _map(
+        self, buffer: mmap.mmap, offset: int, filename: PathLike[str] | str
+    ) -> None:
+        if len(buffer) < offset + HEADER.size:
+            raise _not_a_stats_file(filename)
+        (
+            magic,
+            version,
+            self.flags,
+            nstrings,
+            nfuncs,
+            self.unit,
+            records_offset,
+            strings_offset,
+            funcs_offset,
+            self.timestamp,
+            self.overhead,
+        ) = HEADER.unpack_from(buffer, offset)
+        if magic != MAGIC:
+            raise _not_a_stats_file(filename)
+        if version > VERSION:
+            raise ValueError(
+                f'{os.fspath(filename)!r}: version {version} of the '
+                '`.lprof` format is not supported '
+                f'(latest known version: {VERSION})'
+            )
+        funcs_start = offset + funcs_offset
+        self.end = funcs_start + nfuncs * FUNCTION.size
+        if self.end > len(buffer):
+            raise ValueError(f'{os.fspath(filename)!r}: truncated file')
+        self._mmap = buffer
+        self._records_offset = offset + records_offset
+        self._strings_offset = offset + strings_offset
+        self._nstrings = nstrings
+        self._functions = list(
+            FUNCTION.iter_unpack(buffer[funcs_start : self.end])
+        )
+        self._hist_offset: int | None = None
+        if self.flags & FLAG_HISTOGRAMS:
+            self._hist_offset = self._records_offset + RECORD.size * max(
+                (start + n for *_, start, n in self._functions), default=0
+            )
+        self._threads_offset: int | None = None
+        if self.flags & FLAG_THREADS:
+            trailer = self._strings_offset - THREAD_TRAILER.size
+            nthreads, nrecords = THREAD_TRAILER.unpack_from(buffer, trailer)
+            self._nthreads = nthreads
+            self._threads_offset = (
+                trailer
+                - nrecords * THREAD_RECORD.size
+                - nthreads * THREAD.size
+            )
+        nrecords_total = max(
+            (start + n for *_, start, n in self._functions), default=0
+        )
+        self._nrecords_total = nrecords_total
+        next_offset = self._threads_offset
+        if next_offset is None:
+            next_offset = self._strings_offset
+        self._self_offset: int | None = None
+        if self.flags & FLAG_SELF_TIMES:
+            self._self_offset = next_offset - SELF_TIME.size * nrecords_total
+            next_offset = self._self_offset
+        self._counts_offset: int | None = None
+        self._counter_events: List[int] = []
+        if self.flags & FLAG_COUNTERS:
+            trailer = next_offset - COUNTER_TRAILER.size
+            (nevents,) = COUNTER_TRAILER.unpack_from(buffer, trailer)
+            self._counts_offset = (
+                trailer - COUNT.size * nevents * nrecords_total
+            )
+            events_offset = self._counts_offset - COUNTER_EVENT.size * nevents
+            self._counter_events = [
+                index
+                for (index,) in COUNTER_EVENT.iter_unpack(
+                    buffer[events_offset : self._counts_offset]
+                )
+            ]
+            next_offset = events_offset
+        self._memory_offset: int | None = None
+        if self.flags & FLAG_MEMORY:
+            self._memory_offset = next_offset - MEMORY.size * nrecords_total
+        self._strings: List[str] | None = None
+        self._index: Dict[_Key, int] | None = None
+
+    def _get_strings(self) -> List[str]:
+        if self._strings is None:
+            start = self._strings_offset
+            n = self._nstrings + 1
+            table_end = start + n * _OFFSET.size
+            offsets = [
+                table_end + offset
+                for (offset,) in _OFFSET.iter_unpack(
+                    self._mmap[start:table_end]
+                )
+            ]
+            self._strings = [
+                self._mmap[a:b].decode(_ENCODING, _ERRORS)
+                for a, b in zip(offsets[:-1], offsets[1:])
+            ]
+        return self._strings
+
+    def _get_index(self) -> Dict[_Key, int]:
+        if self._index is None:
+            strings = self._get_strings()
+            self._index = {
+                (strings[fname], lineno, strings[name]): i
+                for i, (fname, name, lineno, _, _) in enumerate(
+                    self._functions
+                )
+            }
+        return self._index
+
+    def _read_entries(self, i: int) -> _Entries:
+        *_, start, nrecords = self._functions[i]
+        start = self._records_offset + start * RECORD.size
+        end = start + nrecords * RECORD.size
+        return list(RECORD.iter_unpack(self._mmap[start:end]))
+
+    def _read_histograms(self, i: int) -> _Histograms:
+        if self._hist_offset is None:
+            return {}
+        *_, start, nrecords = self._functions[i]
+        if not nrecords:
+            return {}
+        nrecords_total = (
+            self._hist_offset - self._records_offset
+        ) // RECORD.size
+        index_start = self._hist_offset + start * HIST_RECORD.size
+        index_end = index_start + nrecords * HIST_RECORD.size
+        buckets_start = self._hist_offset + nrecords_total * HIST_RECORD.size
+        histograms: _Histograms = {}
+        for (lineno, _, _), (max_time, first, count) in zip(
+            self._read_entries(i),
+            HIST_RECORD.iter_unpack(self._mmap[index_start:index_end]),
+        ):
+            if not count:
+                continue
+            a = buckets_start + first * HIST_BUCKET.size
+            b = a + count * HIST_BUCKET.size
+            histograms[lineno] = (
+                max_time,
+                dict(HIST_BUCKET.iter_unpack(self._mmap[a:b])),
+            )
+        return histograms
+
+    def _read_self_times(self, i: int) -> _SelfTimes:
+        if self._self_offset is None:
+            return {}
+        *_, start, nrecords = self._functions[i]
+        a = self._self_offset + start * SELF_TIME.size
+        b = a + nrecords * SELF_TIME.size
+        return {
+            lineno: self_time
+            for (lineno, _, _), (self_time,) in zip(
+                self._read_entries(i), SELF_TIME.iter_unpack(self._mmap[a:b])
+            )
+        }
+
+    def _read_counts(self, i: int, event: int) -> Dict[int, int]:
+        *_, start, nrecords = self._functions[i]
+        a = self._counts_offset + COUNT.size * (
+            event * self._nrecords_total + start
+        )
+        b = a + nrecords * COUNT.size
+        return {
+            lineno: count
+            for (lineno, _, _), (count,) in zip(
+                self._read_entries(i), COUNT.iter_unpack(self._mmap[a:b])
+            )
+            if count
+        }
+
+    def _read_memory(self, i: int) -> _Memory:
+        *_, start, nrecords = self._functions[i]
+        a = self._memory_offset + start * MEMORY.size
+        b = a + nrecords * MEMORY.size
+        return {
+            lineno: counts
+            for (lineno, _, _), counts in zip(
+                self._read_entries(i), MEMORY.iter_unpack(self._mmap[a:b])
+            )
+            if any(counts)
+        }
+
+    def __getitem__(self, key: _Key) -> _Entries:
+        return self._read_entries(self._get_index()[key])
+
+    def __iter__(self) -> Iterator[_Key]:
+        return iter(self._get_index())
+
+    def __len__(self) -> int:
+        return len(self._functions)
+
+    def __contains__(self, key: object) -> bool:
+        return key in self._get_index()
+
+    def select(
+        self, predicate: Callable[[_Key], bool] | None = None
+    ) -> Dict[_Key, _Entries]:
+        """
+        Returns:
+            timings (dict[tuple[str, int, str], list[tuple[int, int, int]]]):
+                Timings of the functions whose keys satisfy
+                ``predicate`` (all of them if it is :py:data:`None`);
+                the records of the others aren't read
+        """
+        return {
+            key: self._read_entries(i)
+            for key, i in self._get_index().items()
+            if predicate is None or predicate(key)
+        }
+
+    def select_histograms(
+        self, predicate: Callable[[_Key], bool] | None = None
+    ) -> Dict[_Key, _Histograms]:
+        """
+        Returns:
+            histograms (dict[tuple[str, int, str], \
+dict[int, tuple[int, dict[int, int]]]]):
+                Histograms of the lines (see :py:attr:`LineStats.histograms
+                <.line_profiler.LineStats.histograms>`) of the functions
+                which have any and whose keys satisfy ``predicate``
+        """
+        if self._hist_offset is None:
+            return {}
+        histograms = {}
+        for key, i in self._get_index().items():
+            if predicate is None or predicate(key):
+                line_hists = self._read_histograms(i)
+                if line_hists:
+                    histograms[key] = line_hists
+        return histograms
+
+    def select_self_times(
+        self, predicate: Callable[[_Key], bool] | None = None
+    ) -> Dict[_Key, _SelfTimes]:
+        """
+        Returns:
+            self_times (dict[tuple[str, int, str], dict[int, int]]):
+                Self times of the lines (see :py:attr:`LineStats.self_times
+                <.line_profiler.LineStats.self_times>`) of the functions
+                whose keys satisfy ``predicate``, if recorded
+        """
+        if self._self_offset is None:
+            return {}
+        return {
+            key: self._read_self_times(i)
+            for key, i in self._get_index().items()
+            if predicate is None or predicate(key)
+        }
+
+    def select_counters(
+        self, predicate: Callable[[_Key], bool] | None = None
+    ) -> _Counters:
+        """
+        Returns:
+            counters (dict[str, dict[tuple[str, int, str], \
+dict[int, int]]]):
+                Counts of hardware events in the lines (see
+                :py:attr:`LineStats.counters
+                <.line_profiler.LineStats.counters>`) of the functions
+                which have any and whose keys satisfy ``predicate``, if
+                recorded
+        """
+        if self._counts_offset is None:
+            return {}
+        strings = self._get_strings()
+        counters = {}
+        for event, name in enumerate(self._counter_events):
+            counters[strings[name]] = per_key = {}
+            for key, i in self._get_index().items():
+                if predicate is None or predicate(key):
+                    line_counts = self._read_counts(i, event)
+                    if line_counts:
+                        per_key[key] = line_counts
+        return counters
+
+    def select_memory(
+        self, predicate: Callable[[_Key], bool] | None = None
+    ) -> Dict[_Key, _Memory]:
+        """
+        Returns:
+            memory (dict[tuple[str, int, str], \
+dict[int, tuple[int, int, int]]]):
+                Allocation counters of the lines (see
+                :py:attr:`LineStats.memory
+                <.line_profiler.LineStats.memory>`) of the functions
+                which have any and whose keys satisfy ``predicate``
+        """
+        if self._memory_offset is None:
+            return {}
+        memory = {}
+        for key, i in self._get_index().items():
+            if predicate is None or predicate(key):
+                line_memory = self._read_memory(i)
+                if line_memory:
+                    memory[key] = line_memory
+        return memory
+
+    def select_thread_timings(
+        self, predicate: Callable[[_Key], bool] | None = None
+    ) -> _ThreadTimings:
+        """
+        Returns:
+            thread_timings (dict[str, dict[tuple[str, int, str], \
+list[tuple[int, int, int]]]]):
+                Per-thread timings (see :py:attr:`LineStats.thread_timings
+                <.line_profiler.LineStats.thread_timings>`) of the
+                functions whose keys satisfy ``predicate``
+        """
+        if self._threads_offset is None:
+            return {}
+        strings = self._get_strings()
+        keys = [
+            (strings[fname], lineno, strings[name])
+            for fname, name, lineno, _, _ in self._functions
+        ]
+        records_start = self._threads_offset + self._nthreads * THREAD.size
+        thread_timings: _ThreadTimings = {}
+        for name, _, start, count in THREAD.iter_unpack(
+            self._mmap[self._threads_offset : records_start]
+        ):
+            a = records_start + start * THREAD_RECORD.size
+            b = a + count * THREAD_RECORD.size
+            timings: Dict[_Key, _Entries] = {}
+            for function, *entry in THREAD_RECORD.iter_unpack(
+                self._mmap[a:b]
+            ):
+                key = keys[function]
+                if predicate is None or predicate(key):
+                    timings.setdefault(key, []).append(tuple(entry))
+            if timings:
+                thread_timings[strings[name]] = timings
+        return thread_timings
+
+    def close(self) -> None:
+        if self._owns_mmap:
+            self._mmap.close()
+
+    def __enter__(self) -> StatsFile:
+        return self
+
+    def __exit__(self, *_, **__) -> None:
+        self.close()
+
+
+class StatsLog:
+    """
+    Read-only, memory-mapped view of all the frames of a binary
+    ``.lprof`` file, e.g. an incremental log written by
+    :py:func:`append_stats`.
+
+    The frame headers are scanned upon construction, but the frames
+    themselves are only read when looked up; a trailing frame without
+    a valid header (i.e. one which is incomplete) is skipped.
+
+    Attributes:
+        frames (list[StatsFile]):
+            Frames in the file; each holds the changes in the timings
+            since the previous one
+        unit (float):
+            Timer unit
+        overhead (float):
+            Per-hit overhead of the profiler, as recorded by the last
+            frame which has it (0 if unknown)
+
+    Note:
+        Objects should be :py:meth:`.close`-d (or used as context
+        managers) so that the file is unmapped promptly.
+    """
+
+    def __init__(self, filename: PathLike[str] | str) -> None:
+        with open(filename, 'rb') as f:
+            if os.fstat(f.fileno()).st_size < HEADER.size:
+                raise _not_a_stats_file(filename)
+            self._mmap = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        try:
+            self.frames = [StatsFile._from_mmap(self._mmap, 0, filename)]
+            while True:
+                offset = self.frames[-1].end
+                if offset % 8:
+                    offset += 8 - offset % 8
+                # The header is written last, so frames beginning with
+                # the magic number are complete
+                if self._mmap[offset : offset + len(MAGIC)] != MAGIC:
+                    break
+                self.frames.append(
+                    StatsFile._from_mmap(self._mmap, offset, filename)
+                )
+            self.unit = self.frames[0].unit
+            self.overhead = next(
+                (f.overhead for f in reversed(self.frames) if f.overhead),
+                0.0,
+            )
+            for frame in self.frames:
+                if frame.unit != self.unit:
+                    raise ValueError(
+                        f'{os.fspath(filename)!r}: frames have different '
+                        f'timer units ({self.unit!r} vs {frame.unit!r})'
+                    )
+        except BaseException:
+            self._mmap.close()
+            raise
+
+    @property
+    def timestamps(self) -> List[float]:
+        """
+        Times at which the frames were written.
+        """
+        return [frame.timestamp for frame in self.frames]
+
+    def __len__(self) -> int:
+        return len(self.frames)
+
+    def get_timings(
+        self,
+        index: int = -1,
+        select: Callable[[_Key], bool] | None = None,
+    ) -> Dict[_Key, _Entries]:
+        """
+        Arguments:
+            index (int):
+                Index of the last frame to include (default: all
+                frames)
+            select (Callable[[tuple[str, int, str]], bool] | None):
+                See :py:meth:`StatsFile.select`
+
+        Returns:
+            timings (dict[tuple[str, int, str], list[tuple[int, int, int]]]):
+                Timings as of the frame ``index``
+        """
+        frames = self.frames[: range(len(self.frames))[index] + 1]
+        if len(frames) == 1:
+            return frames[0].select(select)
+        return _sum_timings(frame.select(select) for frame in frames)
+
+    def get_histograms(
+        self,
+        index: int = -1,
+        select: Callable[[_Key], bool] | None = None,
+    ) -> Dict[_Key, _Histograms]:
+        """
+        Returns:
+            histograms (dict[tuple[str, int, str], \
+dict[int, tuple[int, dict[int, int]]]]):
+                Histograms (see :py:meth:`StatsFile.select_histograms`)
+                summed over the frames up to ``index`` (see
+                :py:meth:`.get_timings`)
+        """
+        frames = self.frames[: range(len(self.frames))[index] + 1]
+        if len(frames) == 1:
+            return frames[0].select_histograms(select)
+        totals: Dict[_Key, Dict[int, List[Tuple[int, Dict[int, int]]]]] = {}
+        for frame in frames:
+            for key, line_hists in frame.select_histograms(select).items():
+                lines = totals.setdefault(key, {})
+                for lineno, histogram in line_hists.items():
+                    lines.setdefault(lineno, []).append(histogram)
+        return {
+            key: {
+                lineno: merge(histograms)
+                for lineno, histograms in sorted(lines.items())
+            }
+            for key, lines in totals.items()
+        }
+
+    def get_self_times(
+        self,
+        index: int = -1,
+        select: Callable[[_Key], bool] | None = None,
+    ) -> Dict[_Key, _SelfTimes]:
+        """
+        Returns:
+            self_times (dict[tuple[str, int, str], dict[int, int]]):
+                Self times of the lines (see
+                :py:meth:`StatsFile.select_self_times`) summed over the
+                frames up to ``index`` (see :py:meth:`.get_timings`)
+        """
+        frames = self.frames[: range(len(self.frames))[index] + 1]
+        if len(frames) == 1:
+            return frames[0].select_self_times(select)
+        totals: Dict[_Key, _SelfTimes] = {}
+        for frame in frames:
+            for key, self_times in frame.select_self_times(select).items():
+                lines = totals.setdefault(key, {})
+                for lineno, self_time in self_times.items():
+                    lines[lineno] = lines.get(lineno, 0) + self_time
+        return {
+            key: dict(sorted(lines.items())) for key, lines in totals.items()
+        }
+
+    def get_counters(
+        self,
+        index: int = -1,
+        select: Callable[[_Key], bool] | None = None,
+    ) -> _Counters:
+        """
+        Returns:
+            counters (dict[str, dict[tuple[str, int, str], \
+dict[int, int]]]):
+                Counts of hardware events in the lines (see
+                :py:meth:`StatsFile.select_counters`) summed over the
+                frames up to ``index`` (see :py:meth:`.get_timings`)
+        """
+        frames = self.frames[: range(len(self.frames))[index] + 1]
+        if len(frames) == 1:
+            return frames[0].select_counters(select)
+        totals: _Counters = {}
+        for frame in frames:
+            for event, counts in frame.select_counters(select).items():
+                per_key = totals.setdefault(event, {})
+                for key, line_counts in counts.items():
+                    lines = per_key.setdefault(key, {})
+                    for lineno, count in line_counts.items():
+                        lines[lineno] = lines.get(lineno, 0) + count
+        return {
+            event: {
+                key: dict(sorted(lines.items()))
+                for key, lines in per_key.items()
+            }
+            for event, per_key in totals.items()
+        }
+
+    def get_memory(
+        self,
+        index: int = -1,
+        select: Callable[[_Key], bool] | None = None,
+    ) -> Dict[_Key, _Memory]:
+        """
+        Returns:
+            memory (dict[tuple[str, int, str], \
+dict[int, tuple[int, int, int]]]):
+                Allocation counters of the lines (see
+                :py:meth:`StatsFile.select_memory`) summed over the
+                frames up to ``index`` (see :py:meth:`.get_timings`)
+        """
+        frames = self.frames[: range(len(self.frames))[index] + 1]
+        if len(frames) == 1:
+            return frames[0].select_memory(select)
+        totals: Dict[_Key, _Memory] = {}
+        for frame in frames:
+            for key, line_memory in frame.select_memory(select).items():
+                lines = totals.setdefault(key, {})
+                for lineno, counts in line_memory.items():
+                    prev = lines.get(lineno, (0, 0, 0))
+                    lines[lineno] = tuple(a + b for a, b in zip(prev, counts))
+        return {
+            key: dict(sorted(lines.items())) for key, lines in totals.items()
+        }
+
+    def get_thread_timings(
+        self,
+        index: int = -1,
+        select: Callable[[_Key], bool] | None = None,
+    ) -> _ThreadTimings:
+        """
+        Returns:
+            thread_timings (dict[str, dict[tuple[str, int, str], \
+list[tuple[int, int, int]]]]):
+                Per-thread timings (see
+                :py:meth:`StatsFile.select_thread_timings`) summed over
+                the frames up to ``index`` (see :py:meth:`.get_timings`)
+        """
+        frames = self.frames[: range(len(self.frames))[index] + 1]
+        if len(frames) == 1:
+            return frames[0].select_thread_timings(select)
+        per_thread: Dict[str, List[Dict[_Key, _Entries]]] = {}
+        for frame in frames:
+            for thread, timings in frame.select_thread_timings(
+                select
+            ).items():
+                per_thread.setdefault(thread, []).append(timings)
+        return {
+            thread: _sum_timings(all_timings)
+            for thread, all_timings in per_thread.items()
+        }
+
+    def close(self) -> None:
+        self._mmap.close()
+
+    def __enter__(self) -> StatsLog:
+        return self
+
+    def __exit__(self, *_, **__) -> None:
+        self.close()
@@ -0,0 +1,112 @@
+// Thread-local helpers for `_line_profiler.pyx`.
+//
+// Note: unlike the other headers here, this one is C++-only (it is only
+// included by the Cython module, which is compiled as C++).
+
+#ifndef LINE_PROFILER_THREAD_LOCALS_H
+#define LINE_PROFILER_THREAD_LOCALS_H
+
+#include "Python.h"
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+// Indices of the threads which have exited, and of those whose data
+// the profilers have since let go of (see `lp_thread_reap()`); heap-
+// allocated so that they outlive the static destructors, which may run
+// before those of the last threads.  (A `std::mutex` rather than an
+// `lp_mutex`, since the threads exit without a thread state.)
+struct lp_thread_pool {
+    std::mutex lock;
+    std::vector<Py_ssize_t> exited;
+    std::vector<Py_ssize_t> free;
+};
+
+static inline lp_thread_pool &lp_get_thread_pool(void)
+{
+    static lp_thread_pool *pool = new lp_thread_pool();
+    return *pool;
+}
+
+// Holder of the index of a thread, which hands it back upon exit
+struct lp_thread_slot {
+    Py_ssize_t index = -1;
+    ~lp_thread_slot()
+    {
+        if (index < 0) return;
+        lp_thread_pool &pool = lp_get_thread_pool();
+        std::lock_guard<std::mutex> guard(pool.lock);
+        try {
+            pool.exited.push_back(index);
+        } catch (...) {
+            // Out of memory: the index is just not reused
+        }
+    }
+};
+
+/*
+ * Small dense index identifying the calling thread, so that the
+ * profilers can keep their per-thread data in arrays indexed thereby,
+ * instead of hashing the thread ID on every event.  Indices are handed
+ * out upon the first call on each thread, and only reused once the
+ * thread has exited and `lp_thread_recycle()` has been called for it.
+ */
+static inline Py_ssize_t lp_thread_index(void)
+{
+    static std::atomic<Py_ssize_t> next_index(0);
+    static thread_local lp_thread_slot slot;
+    if (slot.index >= 0) return slot.index;
+    {
+        lp_thread_pool &pool = lp_get_thread_pool();
+        std::lock_guard<std::mutex> guard(pool.lock);
+        if (!pool.free.empty()) {
+            slot.index = pool.free.back();
+            pool.free.pop_back();
+        }
+    }
+    if (slot.index < 0) slot.index = next_index.fetch_add(1);
+    return slot.index;
+}
+
+/*
+ * Move the indices of the threads which have exited since the last
+ * call into `out`; they are to be passed to `lp_thread_recycle()` once
+ * the data of the threads is retired.
+ */
+static inline void lp_thread_reap(std::vector<Py_ssize_t> *out)
+{
+    lp_thread_pool &pool = lp_get_thread_pool();
+    std::lock_guard<std::mutex> guard(pool.lock);
+    out->swap(pool.exited);
+    pool.exited.clear();
+}
+
+// Make the index of an exited thread available to new threads
+static inline void lp_thread_recycle(Py_ssize_t index)
+{
+    lp_thread_pool &pool = lp_get_thread_pool();
+    std::lock_guard<std::mutex> guard(pool.lock);
+    try {
+        pool.free.push_back(index);
+    } catch (...) {
+    }
+}
+
+/*
+ * Borrowed reference to the `_LineProfilerManager` of the calling
+ * thread (or `NULL` if not looked up yet); the manager itself is kept
+ * alive by `LineProfiler._managers`.
+ */
+static thread_local PyObject *lp_thread_manager = NULL;
+
+static inline PyObject *lp_get_thread_manager(void)
+{
+    return lp_thread_manager;
+}
+
+static inline void lp_set_thread_manager(PyObject *manager)
+{
+    lp_thread_manager = manager;
+}
+
+#endif // LINE_PROFILER_THREAD_LOCALS_H
@@ -12,16 +12,16 @@
 
 #include <windows.h>
 
-PY_LONG_LONG
-hpTimer(void)
+static PY_LONG_LONG
+sysTimer(void)
 {
         LARGE_INTEGER li;
         QueryPerformanceCounter(&li);
         return li.QuadPart;
 }
 
-double
-hpTimerUnit(void)
+static double
+sysTimerUnit(void)
 {
         LARGE_INTEGER li;
         if (QueryPerformanceFrequency(&li))
@@ -34,8 +34,8 @@ hpTimerUnit(void)
 
 #include <sys/time.h>
 
-PY_LONG_LONG
-hpTimer(void)
+static PY_LONG_LONG
+sysTimer(void)
 {
         struct timeval tv;
         PY_LONG_LONG ret;
@@ -45,8 +45,8 @@ hpTimer(void)
         return ret;
 }
 
-double
-hpTimerUnit(void)
+static double
+sysTimerUnit(void)
 {
         return 0.000001;
 }
@@ -56,8 +56,8 @@ hpTimerUnit(void)
 #include <sys/resource.h>
 #include <sys/times.h>
 
-PY_LONG_LONG
-hpTimer(void)
+static PY_LONG_LONG
+sysTimer(void)
 {
         struct timespec ts;
         PY_LONG_LONG ret;
@@ -66,10 +66,195 @@ hpTimer(void)
         return ret;
 }
 
+static double
+sysTimerUnit(void)
+{
+        return 0.000000001;
+}
+
+#endif
+
+/*** Optional time-stamp-counter (TSC) timer ***/
+
+/*
+ * Reading the TSC is an order of magnitude cheaper than querying the
+ * system clock, but it is only usable as a timer if it ticks at a
+ * constant rate and is synchronized between cores ("invariant"); its
+ * rate is measured against the system clock upon selection.
+ */
+
+#if (defined(__x86_64__) || defined(__i386__) \
+     || defined(_M_X64) || defined(_M_IX86))
+
+#define LP_HAVE_TSC 1
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+#ifdef __linux__
+#include <stdio.h>
+#include <string.h>
+#endif
+
+static PY_LONG_LONG
+readTSC(void)
+{
+        return (PY_LONG_LONG)__rdtsc();
+}
+
+static int
+tscIsInvariant(void)
+{
+        unsigned int regs[4] = {0, 0, 0, 0};  /* EAX, EBX, ECX, EDX */
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 0x80000000);
+        if ((unsigned int)info[0] < 0x80000007)
+                return 0;
+        __cpuid(info, 0x80000007);
+        regs[3] = (unsigned int)info[3];
+#else
+        if (__get_cpuid_max(0x80000000, NULL) < 0x80000007)
+                return 0;
+        __get_cpuid(0x80000007, &regs[0], &regs[1], &regs[2], &regs[3]);
+#endif
+        if (!(regs[3] & (1u << 8)))  /* CPUID.80000007H:EDX[8] */
+                return 0;
+#ifdef __linux__
+        /* The kernel drops the TSC from the clock sources if it finds
+         * it unreliable (e.g. unsynchronized between sockets) */
+        {
+                char buf[256];
+                FILE *f = fopen("/sys/devices/system/clocksource/"
+                                "clocksource0/available_clocksource", "r");
+                if (f != NULL) {
+                        size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+                        fclose(f);
+                        buf[n] = '\0';
+                        if (strstr(buf, "tsc") == NULL)
+                                return 0;
+                }
+        }
+#endif
+        return 1;
+}
+
+static double
+tscFrequency(void)
+{
+        /* Count the TSC ticks over a few milliseconds of the system
+         * timer, twice; only trust the result if the two agree */
+        double unit = sysTimerUnit();
+        double freq[2];
+        PY_LONG_LONG t0, t1, c0, c1;
+        int i;
+
+        for (i = 0; i < 2; i++) {
+                t0 = sysTimer();
+                c0 = readTSC();
+                do {
+                        t1 = sysTimer();
+                } while ((t1 - t0) * unit < 0.005);
+                c1 = readTSC();
+                freq[i] = (double)(c1 - c0) / ((t1 - t0) * unit);
+        }
+        if (freq[0] <= 0 || freq[1] <= 0)
+                return 0.0;
+        if (freq[0] > freq[1] * 1.005 || freq[1] > freq[0] * 1.005)
+                return 0.0;
+        return (freq[0] + freq[1]) / 2;
+}
+
+#elif defined(__aarch64__) && (defined(__GNUC__) || defined(__clang__))
+
+#define LP_HAVE_TSC 1
+
+static PY_LONG_LONG
+readTSC(void)
+{
+        unsigned long long ticks;
+        __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(ticks));
+        return (PY_LONG_LONG)ticks;
+}
+
+static int
+tscIsInvariant(void)
+{
+        return 1;  /* The generic timer ticks at a fixed frequency */
+}
+
+static double
+tscFrequency(void)
+{
+        unsigned long long freq;
+        __asm__ __volatile__("mrs %0, cntfrq_el0" : "=r"(freq));
+        return (double)freq;
+}
+
+#else
+
+#define LP_HAVE_TSC 0
+
+#endif
+
+#if LP_HAVE_TSC
+static int use_tsc = 0;
+static double tsc_unit = 0.0;
+#endif
+
+PY_LONG_LONG
+hpTimer(void)
+{
+#if LP_HAVE_TSC
+        if (use_tsc)
+                return readTSC();
+#endif
+        return sysTimer();
+}
+
 double
 hpTimerUnit(void)
 {
-        return 0.000000001;
+#if LP_HAVE_TSC
+        if (use_tsc)
+                return tsc_unit;
+#endif
+        return sysTimerUnit();
 }
 
+int
+hpTimerUseTSC(int enable)
+{
+#if LP_HAVE_TSC
+        double freq;
+        if (!enable) {
+                use_tsc = 0;
+                return 0;
+        }
+        if (use_tsc)
+                return 0;
+        if (!tscIsInvariant())
+                return -1;
+        freq = tscFrequency();
+        if (freq <= 0)
+                return -1;
+        tsc_unit = 1.0 / freq;
+        use_tsc = 1;
+        return 0;
+#else
+        return enable ? -1 : 0;
+#endif
+}
+
+int
+hpTimerIsTSC(void)
+{
+#if LP_HAVE_TSC
+        return use_tsc;
+#else
+        return 0;
 #endif
+}
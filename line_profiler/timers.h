@@ -2,3 +2,7 @@
 
 PY_LONG_LONG hpTimer(void);
 double hpTimerUnit(void);
+/* Switch to (if `enable`) or away from the TSC timer; returns -1 (and
+ * keeps the current timer) if the TSC is unavailable or unreliable */
+int hpTimerUseTSC(int enable);
+int hpTimerIsTSC(void);
@@ -0,0 +1,269 @@
+"""
+Triggers for on-demand, time-bounded profiling of a running process
+(see :py:meth:`GlobalProfiler.capture()
+<line_profiler.explicit_profiler.GlobalProfiler.capture>`): a
+:py:class:`CaptureTrigger` starts a capture whenever the process
+receives a signal (e.g. :py:data:`signal.SIGUSR1`) and/or whenever a
+client connects to a control socket (a Unix-domain socket) and sends a
+command.
+
+Control-socket protocol:
+    Each connection carries a single command, a line of ASCII text,
+    which gets a single line in reply:
+
+    * ``capture [SECONDS]``: start a capture (of ``SECONDS`` seconds,
+      or the trigger's default duration); the reply is
+      ``ok FILENAME``, with the file the results will be written to
+      once the capture is over, or ``busy`` if a capture is already
+      running
+    * ``status``: the reply is ``capturing FILENAME`` or ``idle``
+
+    Malformed commands get ``error: MESSAGE`` in reply; see
+    :py:func:`send_command` for a Python client (or use e.g.
+    ``echo capture 30 | nc -U SOCKET``).
+
+Example:
+    >>> import os
+    >>> import tempfile
+    >>>
+    >>>
+    >>> started = []
+    >>>
+    >>>
+    >>> def start(duration):
+    ...     started.append(duration)
+    ...     return 'out.lprof'
+    ...
+    >>>
+    >>> with tempfile.TemporaryDirectory() as tmpdir:
+    ...     path = os.path.join(tmpdir, 'ctl.sock')
+    ...     with CaptureTrigger(start, socket_path=path, duration=5):
+    ...         replies = [send_command(path, 'capture'),
+    ...                    send_command(path, 'capture 0.5'),
+    ...                    send_command(path, 'capture soon')]
+    >>> replies[:2], started
+    (['ok out.lprof', 'ok out.lprof'], [5.0, 0.5])
+    >>> replies[2]
+    "error: invalid duration: 'soon'"
+"""
+
+from __future__ import annotations
+
+import os
+import signal
+import socket
+import stat
+import threading
+from collections.abc import Callable
+from os import PathLike
+from typing import Any
+
+__all__ = ('CaptureTrigger', 'send_command')
+
+_MAX_COMMAND = 256
+
+
+def _get_signal(sig: int | str) -> signal.Signals:
+    if isinstance(sig, str):
+        name = sig.upper()
+        if not name.startswith('SIG'):
+            name = 'SIG' + name
+        try:
+            return signal.Signals[name]
+        except KeyError:
+            raise ValueError(f'signal = {sig!r}: unknown signal') from None
+    return signal.Signals(sig)
+
+
+class CaptureTrigger:
+    """
+    Call ``start(duration)`` upon a signal or a control-socket command.
+
+    Arguments:
+        start (Callable[[float], str | None]):
+            Callable starting a capture of ``duration`` seconds in the
+            background and returning the file it will write to (or
+            :py:data:`None` if a capture is already running), e.g.
+            :py:meth:`GlobalProfiler.capture()
+            <line_profiler.explicit_profiler.GlobalProfiler.capture>`
+        signal (int | str | None):
+            Optional signal (number or name, e.g. ``'SIGUSR1'`` or
+            ``'usr1'``) to capture upon; its handler is installed by
+            :py:meth:`.install`, which then has to be called from the
+            main thread
+        socket_path (str | os.PathLike[str] | None):
+            Optional path to bind a Unix-domain control socket to (see
+            the module docs); a (stale) socket there is replaced, but
+            any other file makes :py:meth:`.install` raise a
+            :py:exc:`FileExistsError`
+        duration (float):
+            Default duration of the captures in seconds
+        status (Callable[[], str | None] | None):
+            Optional callable returning the file the current capture
+            is writing to (:py:data:`None` if there isn't one), for the
+            ``status`` command
+
+    Note:
+        The signal handler only ever calls ``start()``, which should
+        return promptly (e.g. by leaving the rest of the capture to a
+        timer), and the socket is served by a daemon thread; when idle,
+        the trigger costs nothing but that thread blocking on
+        :py:meth:`socket.socket.accept`.
+    """
+
+    def __init__(
+        self,
+        start: Callable[[float], str | None],
+        *,
+        signal: int | str | None = None,
+        socket_path: PathLike[str] | str | None = None,
+        duration: float = 30.0,
+        status: Callable[[], str | None] | None = None,
+    ) -> None:
+        duration = float(duration)
+        if not duration > 0:
+            raise ValueError(f'duration = {duration!r}: must be positive')
+        self.start = start
+        self.status = status
+        self.duration = duration
+        self.signal = None if signal is None else _get_signal(signal)
+        self.socket_path = (
+            None if socket_path is None else os.fspath(socket_path)
+        )
+        self._old_handler: Any = None
+        self._socket: socket.socket | None = None
+        self._thread: threading.Thread | None = None
+
+    def install(self) -> None:
+        """
+        Install the signal handler and start serving the control socket.
+        """
+        serve = self.socket_path is not None and self._socket is None
+        if serve:
+            # Only replace sockets, lest a wrong path delete a file
+            try:
+                mode = os.lstat(self.socket_path).st_mode
+            except FileNotFoundError:
+                pass
+            else:
+                if not stat.S_ISSOCK(mode):
+                    raise FileExistsError(
+                        f'{self.socket_path!r}: exists and is not a socket'
+                    )
+                os.remove(self.socket_path)
+        if self.signal is not None and self._old_handler is None:
+            self._old_handler = signal.signal(self.signal, self._on_signal)
+        if serve:
+            sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+            try:
+                sock.bind(self.socket_path)
+                sock.listen()
+            except BaseException:
+                sock.close()
+                raise
+            self._socket = sock
+            self._thread = threading.Thread(
+                target=self._serve,
+                args=(sock,),
+                name='line_profiler-capture-trigger',
+                daemon=True,
+            )
+            self._thread.start()
+
+    def uninstall(self) -> None:
+        """
+        Restore the previous signal handler, and close and remove the
+        control socket.
+        """
+        if self._old_handler is not None:
+            signal.signal(self.signal, self._old_handler)
+            self._old_handler = None
+        sock, self._socket = self._socket, None
+        if sock is None:
+            return
+        # Note: closing a listening socket doesn't reliably wake up a
+        # thread blocking on it, so shut it down first
+        try:
+            sock.shutdown(socket.SHUT_RDWR)
+        except OSError:
+            pass
+        sock.close()
+        if self._thread is not None:
+            self._thread.join()
+            self._thread = None
+        try:
+            os.remove(self.socket_path)
+        except OSError:
+            pass
+
+    def __enter__(self) -> CaptureTrigger:
+        self.install()
+        return self
+
+    def __exit__(self, *_, **__) -> None:
+        self.uninstall()
+
+    def _on_signal(self, signum: int, frame: Any) -> None:
+        self.start(self.duration)
+
+    def _serve(self, sock: socket.socket) -> None:
+        while True:
+            try:
+                conn, _ = sock.accept()
+            except OSError:  # Closed by `.uninstall()`
+                return
+            with conn:
+                try:
+                    conn.settimeout(5)
+                    command = conn.recv(_MAX_COMMAND).decode('ascii')
+                    reply = self.handle_command(command)
+                    conn.sendall(reply.encode('ascii', 'replace') + b'\n')
+                except (OSError, UnicodeDecodeError):
+                    # Hung up, too slow, or not speaking the protocol
+                    continue
+
+    def handle_command(self, command: str) -> str:
+        """
+        Returns:
+            The reply to the control-socket ``command`` (see the module
+            docs), which is carried out
+        """
+        words = command.split()
+        if words[:1] == ['status'] and len(words) == 1:
+            current = None if self.status is None else self.status()
+            return 'idle' if current is None else f'capturing {current}'
+        if words[:1] != ['capture'] or len(words) > 2:
+            return f'error: unknown command: {command.strip()!r}'
+        duration = self.duration
+        if len(words) == 2:
+            try:
+                duration = float(words[1])
+            except ValueError:
+                return f'error: invalid duration: {words[1]!r}'
+            if not 0 < duration < float('inf'):
+                return f'error: invalid duration: {words[1]!r}'
+        filename = self.start(duration)
+        return 'busy' if filename is None else f'ok {filename}'
+
+
+def send_command(
+    socket_path: PathLike[str] | str, command: str, timeout: float = 5.0
+) -> str:
+    """
+    Send ``command`` to the control socket of a :py:class:`CaptureTrigger`.
+
+    Returns:
+        reply (str):
+            The reply (without the trailing newline)
+    """
+    with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as sock:
+        sock.settimeout(timeout)
+        sock.connect(os.fspath(socket_path))
+        sock.sendall(command.encode('ascii') + b'\n')
+        reply = b''
+        while not reply.endswith(b'\n'):
+            chunk = sock.recv(4096)
+            if not chunk:
+                break
+            reply += chunk
+    return reply.decode('ascii').rstrip('\n')
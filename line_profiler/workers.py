@@ -0,0 +1,390 @@
+"""
+Collection of line-profiling results from child processes, e.g. the
+workers of :py:mod:`multiprocessing` and :py:mod:`concurrent.futures`
+process pools, or those of pre-forking servers.
+
+While a :py:class:`WorkerCollector` is active, the child processes
+started by the current one are profiled too:
+
+* Forked children inherit the profiler, along with the functions added
+  to it and its enabled state; the timings inherited from the parent
+  are discarded upon forking, so that each child only reports its own.
+
+* Children started with the ``'spawn'`` and ``'forkserver'`` start
+  methods of :py:mod:`multiprocessing` run a fresh interpreter, in which
+  a new :py:class:`~.LineProfiler` is set up before the main module is
+  imported.  If the collected profiler is also the one behind the
+  global :py:data:`line_profiler.profile` (as when running under
+  :command:`kernprof`), the new profiler replaces it there (and, with
+  ``builtin=True``, as ``builtins.profile``), so that the
+  ``@profile``-decorated functions are profiled; other functions
+  added to the parent profiler are not.
+
+Each child appends its timings to its own incremental ``.lprof`` log
+(see :py:func:`line_profiler.stats_file.append_stats`) in a directory
+shared with the parent, writing only the changes since its previous
+write: every ``interval`` seconds (if given), and upon exit, including
+the termination via :py:data:`signal.SIGTERM` of pool workers (e.g. by
+:py:meth:`multiprocessing.pool.Pool.terminate`).  Since a write is a
+single small append, collection costs about as little as the
+profiling itself, and the results of a child killed mid-write are only
+missing their latest increment.  The parent then merges the logs with
+its own results (see :py:meth:`WorkerCollector.get_stats`).
+
+Example:
+    >>> import concurrent.futures
+    >>> import multiprocessing
+    >>> from line_profiler import LineProfiler
+    >>>
+    >>>
+    >>> def func(n):
+    ...     return sum(range(n))
+    >>>
+    >>>
+    >>> prof = LineProfiler(func)
+    >>> ctx = multiprocessing.get_context('fork')  # doctest: +SKIP
+    >>> with prof.collect_workers() as collector:  # doctest: +SKIP
+    ...     with concurrent.futures.ProcessPoolExecutor(
+    ...         2, mp_context=ctx,
+    ...     ) as executor:
+    ...         results = list(executor.map(prof(func), range(10)))
+    ...     stats = collector.get_stats()
+    >>> collector.cleanup()  # doctest: +SKIP
+"""
+
+from __future__ import annotations
+
+import atexit
+import functools
+import glob
+import os
+import shutil
+import signal
+import tempfile
+import threading
+from os import PathLike
+from typing import TYPE_CHECKING, Any, List
+
+from .stats_file import append_stats
+
+if TYPE_CHECKING:  # pragma: no cover
+    from typing_extensions import Self
+
+    from .line_profiler import LineProfiler, LineStats
+
+
+WORKER_DIR_ENVVAR = 'LINE_PROFILER_WORKER_DIR'
+"""
+Environment variable which, if set, gives the default directory
+:py:class:`WorkerCollector` collects the worker logs in.
+"""
+
+_PREPARATION_KEY = 'line_profiler_workers'
+
+# Collectors active in this process
+_ACTIVE: List[WorkerCollector] = []
+# Writers of this process, if it is a worker
+_WRITERS: List[_WorkerWriter] = []
+_HOOKS_INSTALLED = False
+
+
+class WorkerCollector:
+    """
+    Collect the line-profiling results of the child processes started
+    while active (see :py:mod:`line_profiler.workers`).
+
+    Args:
+        prof (LineProfiler):
+            Profiler whose timings are collected from forked workers,
+            and whose setup spawned workers mirror
+        directory (str | os.PathLike[str] | None):
+            Directory to collect the worker logs in, which should be
+            empty; if not provided, it is taken from the environment
+            variable :envvar:`LINE_PROFILER_WORKER_DIR`, and failing
+            that a temporary directory is created (and removed by
+            :py:meth:`~.cleanup`)
+        interval (float | None):
+            If provided, the workers also write their results every
+            ``interval`` seconds, instead of only upon exit
+        builtin (bool):
+            Whether spawned workers also put their profiler in the
+            builtins as ``profile``, like :command:`kernprof` does
+    """
+
+    def __init__(
+        self,
+        prof: LineProfiler,
+        directory: PathLike[str] | str | None = None,
+        interval: float | None = None,
+        builtin: bool = False,
+    ) -> None:
+        if directory is None:
+            directory = os.environ.get(WORKER_DIR_ENVVAR) or None
+        self._owns_directory = directory is None
+        if directory is None:
+            directory = tempfile.mkdtemp(prefix='line-profiler-workers-')
+        else:
+            os.makedirs(directory, exist_ok=True)
+        self.prof = prof
+        self.directory = os.path.abspath(directory)
+        self.interval = interval or None
+        self.builtin = builtin
+
+    def __enter__(self) -> Self:
+        return self.start()
+
+    def __exit__(self, *_, **__) -> None:
+        self.stop()
+
+    def start(self) -> Self:
+        """
+        Start profiling the child processes started by this one.
+
+        Returns:
+            The instance
+        """
+        _install_hooks()
+        if self not in _ACTIVE:
+            _ACTIVE.append(self)
+        return self
+
+    def stop(self) -> None:
+        """
+        Stop profiling the child processes started from now on; those
+        already running still write their results.
+        """
+        try:
+            _ACTIVE.remove(self)
+        except ValueError:  # Not active
+            pass
+
+    def files(self) -> list[str]:
+        """
+        Returns:
+            The worker logs written so far
+        """
+        pattern = os.path.join(glob.escape(self.directory), 'worker-*.lprof')
+        return sorted(glob.glob(pattern))
+
+    def get_worker_stats(self) -> LineStats:
+        """
+        Returns:
+            The sum of the results written by the workers so far
+        """
+        from .line_profiler import LineStats
+
+        files = self.files()
+        if not files:
+            return LineStats({}, self.prof.timer_unit)
+        return LineStats.from_files(*files)
+
+    def get_stats(self) -> LineStats:
+        """
+        Returns:
+            The results of :py:attr:`~.prof` in this process merged
+            with those written by the workers so far
+        """
+        from .line_profiler import LineStats
+
+        return LineStats.from_stats_objects(
+            self.prof.get_stats(), self.get_worker_stats()
+        )
+
+    def cleanup(self) -> None:
+        """
+        Stop the instance and delete the worker logs (and the
+        directory, if it was created by the instance).
+        """
+        self.stop()
+        if self._owns_directory:
+            shutil.rmtree(self.directory, ignore_errors=True)
+            return
+        for fname in self.files():
+            try:
+                os.remove(fname)
+            except OSError:
+                pass
+
+    def _get_spawn_config(self) -> tuple[str, float | None, bool, bool]:
+        from .explicit_profiler import profile as global_profiler
+
+        return (
+            self.directory,
+            self.interval,
+            self.builtin,
+            global_profiler._profile is self.prof,
+        )
+
+
+class _WorkerWriter:
+    """
+    Append the results of a worker to its log in ``directory``.
+    """
+
+    def __init__(
+        self,
+        prof: LineProfiler,
+        directory: str,
+        interval: float | None = None,
+    ) -> None:
+        self.prof = prof
+        self.pid = os.getpid()
+        self.filename = os.path.join(directory, f'worker-{self.pid}.lprof')
+        self.interval = interval
+        self._lock = threading.Lock()
+        self._stopped = threading.Event()
+
+    def start(self) -> None:
+        # Note: `multiprocessing` workers exit through `os._exit()`,
+        # skipping the `atexit` hooks, but they do run the finalizers
+        # registered after their bootstrapping
+        atexit.register(self.flush)
+        try:
+            from multiprocessing import util
+        except ImportError:  # pragma: no cover
+            pass
+        else:
+            util.register_after_fork(self, _WorkerWriter._add_finalizer)
+        _install_sigterm_handler()
+        if self.interval:
+            thread = threading.Thread(
+                target=self._run, name='line-profiler-worker', daemon=True
+            )
+            thread.start()
+
+    def stop(self) -> None:
+        self._stopped.set()
+        atexit.unregister(self.flush)
+
+    def flush(self, timeout: float = -1) -> None:
+        """
+        Append the changes in the results since the last call to the
+        log.
+        """
+        if os.getpid() != self.pid:  # Inherited from the parent
+            return
+        if not self._lock.acquire(timeout=timeout):
+            return
+        try:
+            stats = self.prof.get_stats_delta()
+            if stats.timings:
+                append_stats(
+                    self.filename,
+                    stats.timings,
+                    stats.unit,
+                    overhead=stats.overhead,
+                    histograms=stats.histograms,
+                    thread_timings=stats.thread_timings,
+                    self_times=stats.self_times,
+                    counters=stats.counters,
+                    memory=stats.memory,
+                )
+        finally:
+            self._lock.release()
+
+    def _add_finalizer(self) -> None:
+        from multiprocessing import util
+
+        util.Finalize(None, self.flush, exitpriority=0)
+
+    def _run(self) -> None:
+        while not self._stopped.wait(self.interval):
+            self.flush()
+
+
+def _start_writer(
+    prof: LineProfiler, directory: str, interval: float | None
+) -> None:
+    writer = _WorkerWriter(prof, directory, interval)
+    _WRITERS.append(writer)
+    writer.start()
+
+
+def _after_fork_in_child() -> None:
+    # The writers (and their threads) belonged to the parent
+    for writer in _WRITERS:
+        writer.stop()
+    _WRITERS.clear()
+    for collector in _ACTIVE:
+        # Discard the timings inherited from the parent
+        collector.prof.get_stats_delta()
+        _start_writer(collector.prof, collector.directory, collector.interval)
+
+
+def _arm_spawned_worker(configs: list[tuple[Any, ...]]) -> None:
+    """
+    Set up profiling in a spawned worker; called while unpickling its
+    preparation data, i.e. before its main module is imported.
+    """
+    import builtins
+
+    from .explicit_profiler import profile as global_profiler
+    from .line_profiler import LineProfiler
+
+    for directory, interval, builtin, is_global in configs:
+        prof = LineProfiler()
+        if is_global:
+            global_profiler._kernprof_overwrite(prof)
+            if builtin:
+                builtins.__dict__['profile'] = prof
+        # Also profile the worker's own workers
+        WorkerCollector(prof, directory, interval, builtin).start()
+        _start_writer(prof, directory, interval)
+
+
+class _SpawnedWorkerSetup:
+    """
+    Entry in the preparation data of spawned workers, which sets up
+    profiling in the worker when unpickled (unknown entries are
+    otherwise ignored by :py:func:`multiprocessing.spawn.prepare`).
+    """
+
+    def __init__(self, configs: list[tuple[Any, ...]]) -> None:
+        self.configs = configs
+
+    def __reduce__(self):
+        return _arm_spawned_worker, (self.configs,)
+
+
+def _install_hooks() -> None:
+    global _HOOKS_INSTALLED
+    if _HOOKS_INSTALLED:
+        return
+    _HOOKS_INSTALLED = True
+    if hasattr(os, 'register_at_fork'):
+        os.register_at_fork(after_in_child=_after_fork_in_child)
+    try:
+        from multiprocessing import spawn
+    except ImportError:  # pragma: no cover
+        return
+    get_data = spawn.get_preparation_data
+
+    @functools.wraps(get_data)
+    def get_preparation_data(*args, **kwargs):
+        data = get_data(*args, **kwargs)
+        if _ACTIVE:
+            configs = [c._get_spawn_config() for c in _ACTIVE]
+            data[_PREPARATION_KEY] = _SpawnedWorkerSetup(configs)
+        return data
+
+    spawn.get_preparation_data = get_preparation_data
+
+
+def _install_sigterm_handler() -> None:
+    sigterm = getattr(signal, 'SIGTERM', None)
+    if sigterm is None or signal.getsignal(sigterm) is not signal.SIG_DFL:
+        # Don't override handlers set up by the code itself
+        return
+    try:
+        signal.signal(sigterm, _flush_and_terminate)
+    except ValueError:  # Not in the main thread
+        pass
+
+
+def _flush_and_terminate(signum, _) -> None:
+    # Note: if the main thread is itself in the middle of a flush,
+    # waiting for it would deadlock, so give up after a while
+    for writer in _WRITERS:
+        writer.flush(timeout=1)
+    signal.signal(signum, signal.SIG_DFL)
+    os.kill(os.getpid(), signum)
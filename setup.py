@@ -228,9 +228,25 @@ if __name__ == '__main__':
         # no need to try importing cython because an import
         # was already attempted in _choose_build_method
         import multiprocessing
+        import re
         from setuptools import Extension
+        from Cython import __version__ as cython_version
         from Cython.Build import cythonize
 
+        compiler_directives = {
+            'language_level': 3,
+            'infer_types': True,
+            'legacy_implicit_noexcept': True,
+            'linetrace': (
+                True if os.getenv('DEV') == 'true' else False
+            ),
+        }
+        # Don't re-enable the GIL when imported on free-threaded
+        # (PEP 703) builds; the directive is only known to Cython 3.1+
+        if tuple(int(part) for part in re.findall(
+                r'\d+', cython_version)[:2]) >= (3, 1):
+            compiler_directives['freethreading_compatible'] = True
+
         def run_cythonize(force=False):
             return cythonize(
                 Extension(
@@ -243,6 +259,12 @@ if __name__ == '__main__':
                     # force a recompile if this changes
                     depends=[
                         'line_profiler/_map_helpers.pxd',
+                        'line_profiler/thread_locals.h',
+                        'line_profiler/concurrent_tables.h',
+                        'line_profiler/sampling_clock.h',
+                        'line_profiler/histogram.h',
+                        'line_profiler/perf_counters.h',
+                        'line_profiler/alloc_hook.h',
                     ],
                     language='c++',
                     define_macros=[
@@ -252,14 +274,7 @@ if __name__ == '__main__':
                         )
                     ],
                 ),
-                compiler_directives={
-                    'language_level': 3,
-                    'infer_types': True,
-                    'legacy_implicit_noexcept': True,
-                    'linetrace': (
-                        True if os.getenv('DEV') == 'true' else False
-                    ),
-                },
+                compiler_directives=compiler_directives,
                 include_path=[
                     'line_profiler/python25.pxd',
                     'line_profiler/_map_helpers.pxd',
@@ -632,6 +632,14 @@ def test_autoprofile_script_with_prof_imports():
         ),
         (False, [], '--prof-imports', set()),
         (True, [], '--prof-imports', set()),
+        # With `--lazy-imports`, only the targets actually imported by
+        # the profiled code (i.e. not `.subpkg`) are profiled
+        (
+            False,
+            ['test_mod.submod1,test_mod.subpkg'],
+            '--lazy-imports',
+            {'add_one', 'add_operator'},
+        ),
     ],
 )
 def test_autoprofile_exec_package(
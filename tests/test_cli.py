@@ -1,9 +1,11 @@
 from __future__ import annotations
+import operator
 import re
 from argparse import ArgumentParser, HelpFormatter
 from contextlib import nullcontext
 from functools import partial
 from io import StringIO
+from os import makedirs
 from os.path import join
 from runpy import run_module
 from shlex import split
@@ -11,7 +13,7 @@ from sys import argv, executable, stderr
 from tempfile import TemporaryDirectory
 import pytest
 import ubelt as ub
-from line_profiler import LineProfiler
+from line_profiler import LineProfiler, LineStats
 from line_profiler.cli_utils import add_argument
 
 
@@ -260,6 +262,361 @@ def test_multiple_lprof_files(capsys):
         assert int(line.split()[1]) == checks.pop(suffix)
 
 
+def test_filter_lprof_files(capsys):
+    """
+    Test that we can restrict the output of ``python -m line_profiler``
+    to some of the profiled functions with ``--filter``.
+    """
+
+    def spam_func() -> int:
+        return 1  # Line: spam_func
+
+    def eggs_func() -> int:
+        return 2  # Line: eggs_func
+
+    def ham_func() -> int:
+        return 3  # Line: ham_func
+
+    prof = LineProfiler(spam_func, eggs_func, ham_func)
+    with prof:
+        spam_func()
+        eggs_func()
+        ham_func()
+
+    with TemporaryDirectory() as tmp_dpath:
+        stats = join(tmp_dpath, 'out.lprof')
+        prof.dump_stats(stats)
+        old_argv = argv.copy()
+        argv[:] = [
+            'line_profiler',
+            '-k',
+            '*ham_func',
+            '--filter=*/no_such_file.py',
+            stats,
+        ]
+        try:
+            run_module('line_profiler', run_name='__main__', alter_sys=True)
+        finally:
+            argv[:] = old_argv
+
+    out, _ = capsys.readouterr()
+    print(out, end='')
+    assert '# Line: spam_func' not in out
+    assert '# Line: eggs_func' not in out
+    assert '# Line: ham_func' in out
+
+
+def test_prune_lprof_files(capsys, monkeypatch):
+    """
+    Test that ``python -m line_profiler --top`` and ``--min-percent``
+    prune the functions shown, without reading the source of the pruned
+    ones.
+    """
+    from line_profiler import line_profiler as lp_module
+
+    def spam_func() -> int:
+        return 1  # Line: spam_func
+
+    def eggs_func() -> int:
+        return 2  # Line: eggs_func
+
+    def ham_func() -> int:
+        return 3  # Line: ham_func
+
+    # Fake the timings so that the ranking is unambiguous
+    timings = {}
+    first_linenos = {}
+    for func, time in (spam_func, 10), (eggs_func, 1000), (ham_func, 200):
+        code = func.__code__
+        key = code.co_filename, code.co_firstlineno, code.co_name
+        timings[key] = [(code.co_firstlineno + 1, 1, time)]
+        first_linenos[func.__name__] = code.co_firstlineno
+    stats = LineStats(timings, 1e-6)
+
+    sources_read = []
+
+    def get_code_block(filename, lineno):
+        sources_read.append(lineno)
+        return orig_get_code_block(filename, lineno)
+
+    orig_get_code_block = lp_module.get_code_block
+    monkeypatch.setattr(lp_module, 'get_code_block', get_code_block)
+    with TemporaryDirectory() as tmp_dpath:
+        fname = join(tmp_dpath, 'out.lprof')
+        stats.to_file(fname)
+        for flags, shown in [
+            (['--top', '1'], {'eggs_func'}),
+            (['--min-percent', '10'], {'eggs_func', 'ham_func'}),
+            (['-n', '2', '--min-percent=50'], {'eggs_func'}),
+        ]:
+            sources_read.clear()
+            old_argv = argv.copy()
+            argv[:] = ['line_profiler', *flags, fname]
+            try:
+                run_module(
+                    'line_profiler', run_name='__main__', alter_sys=True
+                )
+            finally:
+                argv[:] = old_argv
+            out, _ = capsys.readouterr()
+            # Note: don't print to the captured stdout, which is read
+            # again by the next iteration
+            print(out, end='', file=stderr)
+            for func in spam_func, eggs_func, ham_func:
+                name = func.__name__
+                assert (f'# Line: {name}' in out) == (name in shown)
+            assert f'Showing {len(shown)} of 3 functions' in out
+            # Note: the blocks may have been cached by an earlier run
+            assert set(sources_read) <= {first_linenos[n] for n in shown}
+
+
+@pytest.mark.parametrize('jobs', [1, 2])
+def test_merge_lprof_files(capsys, jobs):
+    """
+    Test that ``python -m line_profiler merge`` sums the files (given
+    directly, via directories, and via ``@``-files) in parallel into a
+    single binary ``.lprof`` file.
+    """
+    from line_profiler.merge import merge_files
+
+    spam = 'spam.py', 1, 'spam'
+    eggs = 'eggs.py', 10, 'eggs'
+    all_stats = []
+    for i in range(6):
+        # Mix the units to check the rescaling
+        unit = 1E-6 if i % 2 else 1E-7
+        all_stats.append(
+            LineStats(
+                {spam: [(2, i, 100 * i)], eggs: [(11, 1, 10), (12, i, 5)]},
+                unit,
+                thread_timings={'MainThread': {spam: [(2, i, 100 * i)]}},
+            )
+        )
+    expected = LineStats.from_stats_objects(*all_stats)
+
+    with TemporaryDirectory() as tmp_dpath:
+        files = []
+        for i, stats in enumerate(all_stats):
+            subdir = join(tmp_dpath, f'host{i % 3}')
+            makedirs(subdir, exist_ok=True)
+            files.append(join(subdir, f'worker{i}.lprof'))
+            stats.to_file(files[-1])
+        file_list = join(tmp_dpath, 'files.txt')
+        with open(file_list, mode='w') as f:
+            print(*files[2:4], sep='\n', file=f)
+        output = join(tmp_dpath, 'merged.lprof')
+        old_argv = argv.copy()
+        argv[:] = [
+            'line_profiler',
+            'merge',
+            f'--jobs={jobs}',
+            '-o',
+            output,
+            *files[:2],
+            '@' + file_list,
+            join(tmp_dpath, 'host1'),  # Files 1 and 4, (one) duplicate
+            files[5],
+        ]
+        try:
+            run_module('line_profiler', run_name='__main__', alter_sys=True)
+        finally:
+            argv[:] = old_argv
+        out, _ = capsys.readouterr()
+        print(out, end='', file=stderr)
+        assert 'merged results of 7 file(s)' in out
+        merged = LineStats.from_files(output)
+        # Note: a file given twice is counted twice
+        expected_merged = LineStats.from_stats_objects(
+            *all_stats, all_stats[1]
+        )
+        assert merged == expected_merged
+        assert merged.thread_timings == expected_merged.thread_timings
+        # Programmatic counterpart, with a filter
+        spam_only = merge_files(
+            files, jobs=jobs, select=partial(operator.contains, {spam})
+        )
+        assert spam_only.timings == {spam: expected.timings[spam]}
+
+
+def _decode_protobuf(data: bytes) -> dict[int, list[int | bytes]]:
+    """
+    Minimal protobuf decoder (of the varint and length-delimited wire
+    types) mapping the field numbers of a message to its values.
+    """
+    fields: dict[int, list[int | bytes]] = {}
+    pos = 0
+
+    def read_varint() -> int:
+        nonlocal pos
+        value = shift = 0
+        while True:
+            byte = data[pos]
+            pos += 1
+            value |= (byte & 0x7F) << shift
+            shift += 7
+            if not byte & 0x80:
+                return value
+
+    while pos < len(data):
+        key = read_varint()
+        field, wire_type = key >> 3, key & 7
+        if wire_type == 0:
+            value: int | bytes = read_varint()
+        else:
+            assert wire_type == 2
+            length = read_varint()
+            value, pos = data[pos : pos + length], pos + length
+        fields.setdefault(field, []).append(value)
+    return fields
+
+
+def _decode_packed(data: bytes) -> list[int]:
+    # Note: a packed field is just varints back to back
+    values, value, shift = [], 0, 0
+    for byte in data:
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            values.append(value)
+            value = shift = 0
+    return values
+
+
+def test_export_lprof_files():
+    """
+    Test that ``python -m line_profiler export`` writes pprof,
+    speedscope, and Chrome-trace files with the line timings.
+    """
+    import gzip
+    import json
+    from line_profiler.stats_file import append_stats
+
+    spam = 'spam.py', 1, 'spam'
+    eggs = 'eggs.py', 10, 'eggs'
+    stats = LineStats(
+        {spam: [(2, 3, 100)], eggs: [(11, 1, 10), (12, 2, 5)]},
+        1E-6,
+        thread_timings={'MainThread': {spam: [(2, 3, 100)]}},
+        self_times={spam: {2: 40}, eggs: {11: 10, 12: 5}},
+    )
+
+    def run(*args: str) -> None:
+        old_argv = argv.copy()
+        argv[:] = ['line_profiler', 'export', *args]
+        try:
+            run_module('line_profiler', run_name='__main__', alter_sys=True)
+        finally:
+            argv[:] = old_argv
+
+    with TemporaryDirectory() as tmp_dpath:
+        infile = join(tmp_dpath, 'in.lprof')
+        stats.to_file(infile)
+        # pprof
+        outfile = join(tmp_dpath, 'out.pb.gz')
+        run('-f', 'pprof', '-o', outfile, infile)
+        with open(outfile, mode='rb') as f:
+            profile = _decode_protobuf(gzip.decompress(f.read()))
+        strings = [s.decode() for s in profile[6]]
+        assert strings[0] == ''
+        sample_types = []
+        for message in profile[1]:
+            value_type = _decode_protobuf(message)
+            sample_types.append(
+                (strings[value_type[1][0]], strings[value_type[2][0]])
+            )
+        assert sample_types == [
+            ('hits', 'count'),
+            ('time', 'nanoseconds'),
+            ('self_time', 'nanoseconds'),
+        ]
+        functions = {}
+        for message in profile[5]:
+            function = _decode_protobuf(message)
+            functions[function[1][0]] = (
+                strings[function[4][0]],
+                function[5][0],
+                strings[function[2][0]],
+            )
+        locations = {}
+        for message in profile[4]:
+            location = _decode_protobuf(message)
+            line = _decode_protobuf(location[4][0])
+            locations[location[1][0]] = functions[line[1][0]], line[2][0]
+        samples = {}
+        for message in profile[2]:
+            sample = _decode_protobuf(message)
+            location_id, = _decode_packed(sample[1][0])
+            samples[locations[location_id]] = _decode_packed(sample[2][0])
+        assert samples == {
+            (spam, 2): [3, 100_000, 40_000],
+            (eggs, 11): [1, 10_000, 10_000],
+            (eggs, 12): [2, 5_000, 5_000],
+        }
+        # speedscope, only for `spam`
+        outfile = join(tmp_dpath, 'out.speedscope.json')
+        run('-f', 'speedscope', '-o', outfile, '-k', 'spam', infile)
+        with open(outfile) as f:
+            document = json.load(f)
+        frames = document['shared']['frames']
+        names = [p['name'] for p in document['profiles']]
+        assert names == ['Time', 'Self time', 'Time (MainThread)']
+        for profile, weight in zip(document['profiles'], [100, 40, 100]):
+            (stack,) = profile['samples']
+            assert [frames[i]['name'] for i in stack] == ['spam', 'spam:2']
+            assert profile['weights'] == [weight * 1000]
+        # Chrome trace of an incremental log
+        log = join(tmp_dpath, 'log.lprof')
+        for i, timestamp in enumerate([10.0, 11.0, 12.0], 1):
+            append_stats(
+                log, {spam: [(2, 1, 1000 * i)]}, 1E-6, timestamp=timestamp
+            )
+        outfile = join(tmp_dpath, 'trace.json')
+        run('-f', 'chrome', '-o', outfile, log)
+        with open(outfile) as f:
+            events = json.load(f)['traceEvents']
+        counters = [
+            (event['ts'], event['args']['line 2'])
+            for event in events
+            if event['ph'] == 'C'
+        ]
+        # The first interval is taken to be as long as the others
+        assert counters == [(0.0, 1.0), (1E6, 2.0), (2E6, 3.0), (3E6, 0.0)]
+
+
+def test_attach_live_files(capsys):
+    """
+    Test that ``python -m line_profiler --attach`` shows the results in
+    live-counter files, and returns once they are final.
+    """
+
+    def spam_func() -> int:
+        return 1  # Line: spam_func
+
+    def eggs_func() -> int:
+        return 2  # Line: eggs_func
+
+    profs = [LineProfiler(spam_func), LineProfiler(eggs_func)]
+    with TemporaryDirectory() as tmp_dpath:
+        files = []
+        for i, (prof, func) in enumerate(zip(profs, [spam_func, eggs_func])):
+            fname = join(tmp_dpath, f'out{i}.live')
+            with prof.publish_live(fname):
+                with prof:
+                    func()
+            files.append(fname)
+        old_argv = argv.copy()
+        argv[:] = ['line_profiler', '--attach', *files]
+        try:
+            run_module('line_profiler', run_name='__main__', alter_sys=True)
+        finally:
+            argv[:] = old_argv
+
+    out, _ = capsys.readouterr()
+    print(out, end='')
+    assert '# Line: spam_func' in out
+    assert '# Line: eggs_func' in out
+
+
 def test_version_agreement():
     """
     Ensure that line_profiler and kernprof have the same version info
@@ -1,6 +1,8 @@
 from __future__ import annotations
 import os
 import re
+import signal
+import socket
 import sys
 import tempfile
 from contextlib import ExitStack
@@ -602,6 +604,262 @@ def test_explicit_profile_with_customized_config():
         assert 'Function: fib' in proc.stdout  # With details
 
 
+def test_explicit_profile_switchable():
+    """
+    Test that with ``switchable = true``, the decorated functions are
+    profiled whenever they are called while the profiler is enabled,
+    regardless of whether it was when decorating them.
+    """
+    with tempfile.TemporaryDirectory() as tmp:
+        temp_dpath = ub.Path(tmp)
+
+        code = ub.codeblock(
+            """
+            import pickle
+            from line_profiler import profile
+
+            @profile
+            def func1(a):
+                return a + 1
+
+            # Pass-throughs while disabled
+            assert func1 is not func1.__wrapped__
+            assert func1.target is func1.__wrapped__
+            assert func1(1) == 2
+            assert pickle.loads(pickle.dumps(func1)) is func1
+
+            profile.enable(output_prefix='custom_output')
+            assert func1.target is not func1.__wrapped__
+
+            @profile
+            def func2(a):
+                return a + 1
+
+            class Spam:
+                @profile
+                def method(self, a):
+                    return a + 1
+
+            assert func1(1) == func2(1) == Spam().method(1) == 2
+            profile.disable()
+
+            @profile
+            def func3(a):
+                return a + 1
+
+            @profile
+            def func4(a):
+                return a + 1
+
+            assert func3.target is func3.__wrapped__
+            func4(1)  # Not profiled
+            profile.enable()
+            func3(1)
+            """
+        )
+        with ub.ChDir(temp_dpath):
+            script_fpath = ub.Path('script.py')
+            script_fpath.write_text(code)
+            toml = ub.Path('my_config.toml')
+            toml.write_text(
+                ub.codeblock("""
+        [tool.line_profiler.setup]
+        switchable = true
+
+        [tool.line_profiler.show]
+        details = true
+            """)
+            )
+            env = os.environ.copy()
+            env['LINE_PROFILER_RC'] = str(toml)
+            args = [sys.executable, os.fspath(script_fpath)]
+            proc = ub.cmd(args, env=env)
+            print(proc.stdout)
+            print(proc.stderr)
+            proc.check_returncode()
+
+        raw_output = (temp_dpath / 'custom_output.txt').read_text()
+        print(raw_output)
+        for func in 'func1', 'func2', 'method', 'func3':
+            assert re.search(rf'Function: (Spam\.)?{func} ', raw_output)
+        assert 'Function: func4' not in raw_output
+
+
+@pytest.mark.skipif(
+    not hasattr(signal, 'SIGUSR1'), reason='needs POSIX signals and sockets'
+)
+def test_explicit_profile_capture_trigger():
+    """
+    Test that the trigger configured in ``[tool.line_profiler.setup]``
+    starts time-bounded captures upon a signal or a control-socket
+    command, each of which is written to its own ``.lprof`` file and
+    only covers the calls made during it.
+    """
+    with tempfile.TemporaryDirectory() as tmp:
+        temp_dpath = ub.Path(tmp)
+
+        code = ub.codeblock(
+            """
+            import os
+            import signal
+            import time
+            from line_profiler import profile
+            from line_profiler.trigger import send_command
+
+            @profile
+            def func(a):
+                return a + 1
+
+            def wait_for_capture():
+                while profile._capture is not None:
+                    func(1)
+                    time.sleep(.01)
+
+            for _ in range(100):  # Not profiled
+                func(1)
+            assert func.target is func.__wrapped__
+            # Capture triggered by a signal
+            os.kill(os.getpid(), signal.SIGUSR1)
+            assert profile._capture is not None
+            assert send_command('ctl.sock', 'status').startswith('capturing')
+            assert send_command('ctl.sock', 'capture') == 'busy'
+            wait_for_capture()
+            assert func.target is func.__wrapped__
+            # Capture triggered via the control socket
+            time.sleep(1)  # Avoid clashing timestamps
+            reply = send_command('ctl.sock', 'capture 0.2')
+            assert reply.startswith('ok ') and reply.endswith('.lprof')
+            wait_for_capture()
+            assert send_command('ctl.sock', 'status') == 'idle'
+            assert os.path.exists(reply[3:])
+            """
+        )
+        with ub.ChDir(temp_dpath):
+            script_fpath = ub.Path('script.py')
+            script_fpath.write_text(code)
+            toml = ub.Path('my_config.toml')
+            toml.write_text(
+                ub.codeblock("""
+        [tool.line_profiler.setup]
+        trigger_signal = 'SIGUSR1'
+        trigger_socket = 'ctl.sock'
+        trigger_duration = 0.2
+
+        [tool.line_profiler.write]
+        output_prefix = 'capture'
+            """)
+            )
+            env = os.environ.copy()
+            env['LINE_PROFILER_RC'] = str(toml)
+            env.pop('LINE_PROFILE', None)
+            args = [sys.executable, os.fspath(script_fpath)]
+            proc = ub.cmd(args, env=env)
+            print(proc.stdout)
+            print(proc.stderr)
+            proc.check_returncode()
+
+        outputs = sorted(
+            name for name in os.listdir(temp_dpath) if name.endswith('.lprof')
+        )
+        # No output on exit, just that of the captures
+        assert len(outputs) == 2
+        from line_profiler import LineStats
+
+        for name in outputs:
+            assert re.fullmatch(r'capture_.+_[0-9]+\.lprof', name)
+            stats = LineStats.from_files(temp_dpath / name)
+            (entries,) = stats.timings.values()
+            ((_, nhits, _),) = entries
+            # Only the calls made during the capture
+            assert 0 < nhits < 100
+
+
+@pytest.mark.skipif(
+    not hasattr(socket, 'AF_UNIX'), reason='needs Unix-domain sockets'
+)
+def test_capture_trigger_only_replaces_sockets():
+    """
+    Test that the control socket of a trigger replaces a stale socket,
+    but not another file which happens to be at its path.
+    """
+    from line_profiler.trigger import CaptureTrigger, send_command
+
+    with tempfile.TemporaryDirectory() as tmp:
+        path = os.path.join(tmp, 'ctl.sock')
+        with open(path, 'w') as fobj:
+            fobj.write('spam')
+        trigger = CaptureTrigger(lambda duration: None, socket_path=path)
+        with pytest.raises(FileExistsError):
+            trigger.install()
+        with open(path) as fobj:
+            assert fobj.read() == 'spam'
+        os.remove(path)
+        # Stale socket (left bound by a dead process)
+        stale = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        stale.bind(path)
+        stale.close()
+        with trigger:
+            assert send_command(path, 'status') == 'idle'
+        assert not os.path.exists(path)
+
+
+@pytest.mark.skipif(not hasattr(os, 'fork'), reason='needs `os.fork()`')
+def test_explicit_profile_capture_keeps_delta_cursor():
+    """
+    Test that a capture doesn't take the deltas of
+    :py:meth:`LineProfiler.get_stats_delta` (e.g. those of an
+    incremental log) or vice versa, and that a child forked during a
+    capture doesn't stay stuck in it.
+    """
+    with tempfile.TemporaryDirectory() as tmp:
+        temp_dpath = ub.Path(tmp)
+
+        code = ub.codeblock(
+            """
+            import os
+            import time
+            from line_profiler import profile, LineStats
+
+            def get_nhits(stats):
+                (entries,) = stats.timings.values()
+                return sum(nhits for _, nhits, _ in entries)
+
+            profile.setup_config['switchable'] = True
+
+            @profile
+            def func(a):
+                return a + 1
+
+            filename = profile.capture(.5, output_prefix='capture')
+            for _ in range(10):
+                func(1)
+            # E.g. a snapshot of an incremental log
+            assert get_nhits(profile._profile.get_stats_delta()) == 10
+            pid = os.fork()
+            if not pid:  # Child
+                ok = profile._capture is None and not profile.enabled
+                os._exit(0 if ok else 1)
+            assert os.waitpid(pid, 0)[1] == 0
+            for _ in range(5):
+                func(1)
+            while profile._capture is not None:
+                time.sleep(.01)
+            assert get_nhits(LineStats.from_files(filename)) == 15
+            assert get_nhits(profile._profile.get_stats_delta()) == 5
+            """
+        )
+        with ub.ChDir(temp_dpath):
+            script_fpath = ub.Path('script.py')
+            script_fpath.write_text(code)
+            env = os.environ.copy()
+            env.pop('LINE_PROFILE', None)
+            args = [sys.executable, os.fspath(script_fpath)]
+            proc = ub.cmd(args, env=env)
+            print(proc.stdout)
+            print(proc.stderr)
+            proc.check_returncode()
+
+
 @pytest.mark.parametrize('reset_enable_count', [True, False])
 @pytest.mark.parametrize(
     'wrap_class, wrap_module',
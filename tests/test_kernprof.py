@@ -607,3 +607,154 @@ if __name__ == '__main__':
         python ./tests/test_kernprof.py
     """
     unittest.main()
+
+
+@pytest.mark.parametrize('per_thread', [False, True])
+def test_kernprof_incremental_output(per_thread):
+    """
+    Test that ``kernprof --incremental`` appends the periodic snapshots
+    to the output file, which still loads as the cumulative results
+    (including the per-thread ones with ``--per-thread``).
+    """
+    from line_profiler import load_stats
+    from line_profiler.stats_file import StatsLog
+
+    script = ub.codeblock(
+        """
+        import time
+
+
+        @profile
+        def tick():
+            time.sleep(.05)  # Sleep
+
+
+        start = time.perf_counter()
+        n = 0
+        while time.perf_counter() - start < 2.5:
+            tick()
+            n += 1
+        print(n)
+        """
+    )
+    with tempfile.TemporaryDirectory() as tmpdir:
+        script_file = os.path.join(tmpdir, 'script.py')
+        outfile = os.path.join(tmpdir, 'out.lprof')
+        with open(script_file, mode='w') as fobj:
+            fobj.write(script)
+        proc = subprocess.run(
+            [
+                sys.executable,
+                '-m',
+                'kernprof',
+                '-l',
+                '-i',
+                '1',
+                '--incremental',
+                *(['--per-thread'] if per_thread else []),
+                '-o',
+                outfile,
+                script_file,
+            ],
+            capture_output=True,
+            text=True,
+        )
+        print(proc.stdout)
+        print(proc.stderr, file=sys.stderr)
+        proc.check_returncode()
+        ncalls = int(proc.stdout.splitlines()[0])
+        with StatsLog(outfile) as log:
+            # At least one periodic snapshot, plus the final one
+            assert len(log) >= 2
+            assert log.timestamps == sorted(log.timestamps)
+            nhits = [
+                sum(nhits for _, nhits, _ in entries)
+                for timings in [log.get_timings(i) for i in range(len(log))]
+                for entries in timings.values()
+            ]
+        assert nhits == sorted(nhits)
+        stats = load_stats(outfile)
+    ((key, entries),) = stats.timings.items()
+    assert key[2] == 'tick'
+    assert [nhits for _, nhits, _ in entries] == [ncalls]
+    if per_thread:
+        ((name, thread_timings),) = stats.thread_timings.items()
+        assert name == 'MainThread'
+        assert [nhits for _, nhits, _ in thread_timings[key]] == [ncalls]
+    else:
+        assert not stats.thread_timings
+
+
+@pytest.mark.parametrize('start_method', ['fork', 'spawn'])
+def test_kernprof_workers(start_method):
+    """
+    Test that ``kernprof --workers`` merges the results of
+    :py:mod:`multiprocessing` workers into the output file.
+    """
+    import multiprocessing
+    from line_profiler import load_stats
+
+    if start_method not in multiprocessing.get_all_start_methods():
+        pytest.skip(f'start method {start_method!r} unavailable')
+    module = ub.codeblock(
+        """
+        from line_profiler import profile
+
+
+        @profile
+        def work(n):
+            total = 0
+            for i in range(n):
+                total += i
+            return total
+        """
+    )
+    script = ub.codeblock(
+        """
+        import multiprocessing
+        import sys
+
+        from workers_module import work
+
+
+        if __name__ == '__main__':
+            ctx = multiprocessing.get_context(sys.argv[1])
+            with ctx.Pool(2) as pool:
+                print(sum(pool.map(work, [10] * 8)))
+        """
+    )
+    with tempfile.TemporaryDirectory() as tmpdir:
+        for name, content in [
+            ('workers_module.py', module),
+            ('script.py', script),
+        ]:
+            with open(os.path.join(tmpdir, name), mode='w') as fobj:
+                fobj.write(content)
+        outfile = os.path.join(tmpdir, 'out.lprof')
+        proc = subprocess.run(
+            [
+                sys.executable,
+                '-m',
+                'kernprof',
+                '-l',
+                '--workers',
+                '-o',
+                outfile,
+                os.path.join(tmpdir, 'script.py'),
+                start_method,
+            ],
+            capture_output=True,
+            text=True,
+            cwd=tmpdir,
+        )
+        print(proc.stdout)
+        print(proc.stderr, file=sys.stderr)
+        proc.check_returncode()
+        assert int(proc.stdout.splitlines()[0]) == 8 * 45
+        stats = load_stats(outfile)
+    ((key, entries),) = stats.timings.items()
+    assert key[2] == 'work'
+    nhits = [nhits for _, nhits, _ in entries]
+    # 8 calls, with 10 iterations each
+    assert nhits[0] == nhits[-1] == 8
+    assert 8 * 10 in nhits
@@ -1,14 +1,18 @@
 from __future__ import annotations
 import asyncio
 import contextlib
+import dis
 import functools
 import gc
 import inspect
 import io
 import os
 import pickle
+import subprocess
 import sys
 import textwrap
+import threading
+import time
 import types
 from tempfile import TemporaryDirectory
 import pytest
@@ -161,6 +165,36 @@ def test_init():
     }
 
 
+def test_line_hashes():
+    """
+    Test that `LineProfiler.add_function()` registers one line hash
+    for each distinct line in the code object.
+    """
+    prof = LineProfiler()
+
+    def func(n):
+        total = 0
+        for i in range(n):
+            total += (
+                i
+                * 2
+            )
+        return total
+
+    prof.add_function(func)
+    (code,) = prof.code_hash_map
+    linenos = {lineno for _, lineno in dis.findlinestarts(code)}
+    if hasattr(code, 'co_lines'):
+        linenos.update(
+            -1 if lineno is None else lineno for *_, lineno in code.co_lines()
+        )
+    assert len(prof.code_hash_map[code]) == len(linenos)
+    with prof:
+        assert func(4) == 12
+    entries = prof.get_stats().timings[_line_profiler.label(code)]
+    assert {lineno for lineno, *_ in entries} <= linenos
+
+
 def test_last_time():
     """
     Test that `LineProfiler.c_last_time` and `LineProfiler.last_time`
@@ -937,6 +971,47 @@ def test_multiple_profilers_usage():
     assert t2['sum_n_cb'][2][1] == n
 
 
+def test_many_profilers_fan_out():
+    """
+    Test that when many profilers are active at once, each one interested
+    in a function records the same hits as it would alone, and the
+    others nothing, regardless of profilers coming and going.
+    """
+    def func(n):
+        x = 0
+        for i in range(n):
+            x += i
+        return x
+
+    def other():
+        return 1
+
+    # More than the new records stamped at once by the trace callback
+    interested = [LineProfiler(func) for _ in range(20)]
+    bystanders = [LineProfiler(other) for _ in range(3)]
+    # A profiler which registered `func`, but is gone by the time it
+    # runs
+    gone = LineProfiler(func)
+    del gone
+    gc.collect()
+    profilers = interested + bystanders
+    for prof in profilers:
+        prof.enable_by_count()
+    try:
+        func(10)
+    finally:
+        for prof in reversed(profilers):
+            prof.disable_by_count()
+
+    key = _line_profiler.label(func.__code__)
+    expected = [1, 11, 10, 1]
+    for prof in interested:
+        timings = prof.get_stats().timings[key]
+        assert [nhits for _, nhits, _ in timings] == expected
+    for prof in bystanders:
+        assert not prof.get_stats().timings.get(key)
+
+
 def test_duplicate_code_objects():
     """
     Test that results are correctly aggregated between duplicate code
@@ -971,6 +1046,39 @@ def test_duplicate_code_objects():
     assert entries[-2][1] == 10 + 20
 
 
+def test_identical_bytecode_code_objects_untouched():
+    """
+    Test that functions compiling down to the same bytecode are told
+    apart without their code objects being replaced.
+    """
+    prof = LineProfiler()
+
+    def func1(n):
+        x = 0
+        for n in range(1, n + 1):
+            x += n
+        return x
+
+    def func2(n):
+        x = 0
+        for n in range(1, n + 1):
+            x += n
+        return x
+
+    assert func1.__code__.co_code == func2.__code__.co_code
+    codes = func1.__code__, func2.__code__
+    wrappers = prof(func1), prof(func2)
+    assert func1.__code__ is codes[0]
+    assert func2.__code__ is codes[1]
+    assert len(set(prof.code_hash_map)) == 2
+    assert wrappers[0](3) == 6
+    assert wrappers[1](5) == 15
+    timings = prof.get_stats().timings
+    for code, nloops in zip(codes, (3, 5)):
+        entries = timings[_line_profiler.label(code)]
+        assert max(nhits for _, nhits, _ in entries) == nloops + 1
+
+
 @pytest.mark.parametrize('force_same_line_numbers', [True, False])
 @pytest.mark.parametrize(
     'ops',
@@ -1136,9 +1244,9 @@ def test_multiple_profilers_identical_bytecode(
 
 def test_aggregate_profiling_data_between_code_versions():
     """
-    Test that profiling data from previous versions of the code object
-    are preserved when another profiler causes the code object of a
-    function to be overwritten.
+    Test that profiling data gathered by a profiler are preserved
+    when another profiler starts profiling the same function, and that
+    the code object of the function is left alone.
     """
 
     def func(n):
@@ -1154,13 +1262,12 @@ def test_aggregate_profiling_data_between_code_versions():
     wrapper1 = prof1(func)
     assert wrapper1(10) == 10 * 11 // 2
     code = func.__code__
-    # Gather data with `@prof2`; the code object is overwritten here
+    # Gather data with `@prof2`
     wrapper2 = prof2(wrapper1)
-    assert func.__code__ != code
+    assert func.__code__ is code
     assert wrapper2(15) == 15 * 16 // 2
-    # Despite the overwrite of the code object, the old data should
-    # still remain, and be aggregated with the new data when calling
-    # `prof1.get_stats()`
+    # The old data should still remain, and be aggregated with the new
+    # data when calling `prof1.get_stats()`
     for prof, name, count in (prof1, 'prof1', 25), (prof2, 'prof2', 15):
         result = get_prof_stats(prof, name)
         loop_body = next(
@@ -1240,6 +1347,874 @@ def test_profiling_exception():
             assert line.split()[1] == str(nhits)
 
 
+def test_interleaved_generators():
+    """
+    Test that generators of the same function which take turns, or run
+    nested in one another, keep separate last-line records, and that
+    the time they spend suspended isn't counted.
+    """
+    delay = 0.015625
+
+    def gen(inner=None):
+        for _ in range(2):
+            if inner is None:
+                time.sleep(delay)  # Sleep
+            else:
+                next(inner)  # Inner
+            yield
+
+    prof = LineProfiler()
+    wrapped = prof(gen)
+    outers = [wrapped(wrapped()), wrapped(wrapped())]
+    for _ in range(2):
+        for outer in outers:
+            next(outer)
+        time.sleep(delay)  # The generators are suspended here
+
+    stats = prof.get_stats()
+    timings = stats.timings[_line_profiler.label(gen.__code__)]
+    first_lineno = gen.__code__.co_firstlineno
+    by_line = {
+        lineno - first_lineno: (nhits, t * stats.unit)
+        for lineno, nhits, t in timings
+    }
+    nhits_inner, time_inner = by_line[5]
+    nhits_sleep, time_sleep = by_line[3]
+    # Each of the 4 steps of the outer generators steps an inner one,
+    # and the outer line includes the time spent there
+    assert nhits_sleep == nhits_inner == 4
+    assert time_sleep >= 4 * delay
+    assert time_inner >= time_sleep
+    # The time spent suspended (`2 * delay` for each generator) isn't
+    # counted towards the other lines
+    time_total = sum(t for _, t in by_line.values())
+    assert time_total - time_sleep - time_inner < delay
+
+
+def test_coroutines_exclude_suspended_time():
+    """
+    Test that interleaved coroutines of the same function keep their
+    hits, and that the time they spend suspended isn't counted.
+    """
+    delay = 0.015625
+
+    async def coro(depth):
+        if depth:
+            return await coro_wrapped(depth - 1)  # Await
+        for _ in range(2):
+            await asyncio.sleep(delay)  # Sleep
+        return depth
+
+    async def main(ntasks):
+        return await asyncio.gather(*(coro_wrapped(1) for _ in range(ntasks)))
+
+    prof = LineProfiler()
+    coro_wrapped = prof(coro)
+    start = time.perf_counter()
+    assert asyncio.run(main(10)) == [0] * 10
+    elapsed = time.perf_counter() - start
+
+    stats = prof.get_stats()
+    timings = stats.timings[_line_profiler.label(coro.__code__)]
+    first_lineno = coro.__code__.co_firstlineno
+    nhits = {lineno - first_lineno: n for lineno, n, _ in timings}
+    assert nhits[3] == 10 * 3  # for
+    if not _line_profiler.USE_LEGACY_TRACE:
+        # (The legacy trace system may report the lines again upon
+        # resumption, depending on the Python version)
+        assert nhits[2] == 10  # Await
+        assert nhits[4] == 10 * 2  # Sleep
+    # The tasks spend most of the run suspended, concurrently; had that
+    # been counted, the total would exceed the run time many times over
+    total_time = sum(t for _, _, t in timings) * stats.unit
+    assert total_time < elapsed
+
+def test_multithreaded_profiling():
+    """
+    Test that the line timings from all threads are merged in
+    `LineProfiler.get_stats()`, and that the last-time records are kept
+    per thread.
+    """
+    prof = LineProfiler()
+
+    @prof
+    def func(n):
+        x = 0
+        for i in range(n):
+            x += i
+        return x
+
+    nthreads, ncalls, n = 4, 5, 10
+    last_times = []
+
+    def worker():
+        for _ in range(ncalls):
+            func(n)
+        # No data on this thread between the calls
+        last_times.append(prof.last_time)
+
+    for _ in range(nthreads):
+        thread = threading.Thread(target=worker)
+        thread.start()
+        thread.join()
+    # Nothing has been profiled on the main thread, and merely enabling
+    # and disabling the profiler there doesn't set up any data for it
+    prof.enable_by_count()
+    prof.disable_by_count()
+    with pytest.raises(KeyError, match='[Nn]o profiling data'):
+        prof.c_last_time
+    assert last_times == [{}] * nthreads
+    (timings,) = prof.get_stats().timings.values()
+    calls = nthreads * ncalls
+    assert [nhits for _, nhits, _ in timings] == [
+        calls, calls * (n + 1), calls * n, calls,
+    ]
+
+
+@pytest.mark.skipif(
+    _line_profiler.USE_LEGACY_TRACE,
+    reason='Legacy trace callbacks are only set on the enabling thread')
+def test_concurrent_profiling():
+    """
+    Test that threads running concurrently under a profiler enabled on
+    the main thread don't lose line hits, while the main thread adds
+    more functions and gathers stats.
+    """
+    prof = LineProfiler()
+
+    def func(n):
+        x = 0
+        for i in range(n):
+            x += i
+        return x
+
+    prof.add_function(func)
+    nthreads, ncalls, n = 4, 200, 10
+    barrier = threading.Barrier(nthreads + 1)
+
+    def worker():
+        barrier.wait()
+        for _ in range(ncalls):
+            func(n)
+
+    threads = [threading.Thread(target=worker) for _ in range(nthreads)]
+    for thread in threads:
+        thread.start()
+    with prof:
+        barrier.wait()
+        # Register enough distinct code blocks to grow the internal
+        # tables while the threads are running
+        for i in range(64):
+            namespace = {}
+            exec('def other():\n' + '    x = 0\n' * (i + 1), namespace)
+            prof.add_function(namespace['other'])
+            prof.get_stats()
+        for thread in threads:
+            thread.join()
+    timings = prof.get_stats().timings[_line_profiler.label(func.__code__)]
+    calls = nthreads * ncalls
+    assert [nhits for _, nhits, _ in timings] == [
+        calls, calls * (n + 1), calls * n, calls,
+    ]
+
+
+def test_sampling_by_count():
+    """
+    Test that with `sample_every`, the recorded hits are those of the
+    sampled line events scaled by the sampling weight.
+    """
+    prof = LineProfiler(sample_every=3)
+    assert prof.sample_every == 3
+    assert prof.sample_interval is None
+
+    @prof
+    def func(n):
+        x = 0
+        for i in range(n):
+            x += i
+        return x
+
+    ncalls, n = 30, 10
+    for _ in range(ncalls):
+        func(n)
+    (timings,) = prof.get_stats().timings.values()
+    nhits = [nhits for _, nhits, _ in timings]
+    # Each call has `2 * n + 3` line events, and we have a multiple of
+    # 3 of them in total
+    assert sum(nhits) == ncalls * (2 * n + 3)
+    assert all(nhits_line % 3 == 0 for nhits_line in nhits)
+    with pytest.raises(ValueError):
+        LineProfiler(sample_every=2, sample_interval=.1)
+    with pytest.raises(ValueError):
+        prof.sample_every = 0
+
+
+def test_sampling_by_time():
+    """
+    Test that with `sample_interval`, only some of the line events are
+    timed.
+    """
+    prof = LineProfiler(sample_interval=.001)
+    assert prof.sample_every is None
+    assert prof.sample_interval == pytest.approx(.001)
+
+    @prof
+    def func(duration):
+        start = time.perf_counter()
+        nloops = 0
+        while time.perf_counter() - start < duration:
+            nloops += 1
+        return nloops
+
+    nloops = func(.05)
+    (timings,) = prof.get_stats().timings.values()
+    total_hits = sum(nhits for _, nhits, _ in timings)
+    assert 0 < total_hits <= 3 * nloops + 6
+    # Switching modes
+    prof.sample_every = 2
+    assert prof.sample_interval is None
+
+
+def test_set_timer_errors():
+    """
+    Test that the timer can't be switched while profilers exist.
+    """
+    timer = _line_profiler.get_timer()
+    assert timer in ('system', 'tsc')
+    with pytest.raises(ValueError):
+        _line_profiler.set_timer('foo')
+    other = 'system' if timer == 'tsc' else 'tsc'
+    prof = LineProfiler()
+    with pytest.raises(RuntimeError, match='instances exist'):
+        _line_profiler.set_timer(other)
+    # No-op
+    assert _line_profiler.set_timer(timer) == timer
+    del prof
+
+
+@pytest.mark.parametrize('timer', ['system', 'tsc'])
+def test_timer_environment_variable(timer):
+    """
+    Test selecting the timer with `${LINE_PROFILER_TIMER}`, and that the
+    timings are consistent with the wall-clock time.
+    """
+    code = textwrap.dedent("""
+    import time
+    import warnings
+    from line_profiler import _line_profiler, LineProfiler
+
+
+    def func():
+        start = time.perf_counter()
+        while time.perf_counter() - start < .05:
+            pass
+
+
+    prof = LineProfiler()
+    prof.add_function(func)
+    with prof:
+        func()
+    (timings,) = prof.get_stats().timings.values()
+    total = sum(time for _, _, time in timings) * prof.timer_unit
+    print(_line_profiler.get_timer(), total)
+    """)
+    env = dict(os.environ, LINE_PROFILER_TIMER=timer)
+    proc = subprocess.run([sys.executable, '-c', code], env=env,
+                          capture_output=True, text=True)
+    proc.check_returncode()
+    selected, total = proc.stdout.split()
+    if selected != timer:
+        # Falling back is only allowed if the TSC is unusable, which
+        # must be warned about
+        assert timer == 'tsc'
+        assert 'falling back' in proc.stderr
+    assert .05 <= float(total) < 1
+
+
+def test_get_stats_agrees_with_code_map():
+    """
+    Test that `LineProfiler.get_stats()` reports the (sorted) line
+    timings in `LineProfiler.code_map`.
+    """
+    prof = LineProfiler()
+    f_wrapped = prof(f)
+    g_wrapped = prof(g)
+    with prof:
+        for i in range(3):
+            f_wrapped(i)
+        gen = g_wrapped(1)
+        next(gen)
+        gen.send(2)
+    timings = prof.get_stats().timings
+    for code, entries in prof.code_map.items():
+        expected = [
+            (entry['lineno'], entry['nhits'], entry['total_time'])
+            for entry in entries.values()
+        ]
+        assert all(entry['code'] is code for entry in entries.values())
+        assert timings[_line_profiler.label(code)] == sorted(expected)
+    entries_f = timings[_line_profiler.label(f.__code__)]
+    assert [nhits for _, nhits, _ in entries_f] == [3, 3]
+
+
+def test_get_stats_delta():
+    """
+    Test that `LineProfiler.get_stats_delta()` only reports the changes
+    since the last call, which sum up to `LineProfiler.get_stats()`.
+    """
+    prof = LineProfiler()
+    f_wrapped = prof(f)
+    g_wrapped = prof(g)
+    key_f = _line_profiler.label(f.__code__)
+    key_g = _line_profiler.label(g.__code__)
+
+    # The first snapshot lists all the functions
+    with prof:
+        f_wrapped(1)
+        f_wrapped(2)
+    delta1 = prof.get_stats_delta()
+    assert set(delta1.timings) == {key_f, key_g}
+    assert delta1.timings[key_g] == []
+    assert [nhits for _, nhits, _ in delta1.timings[key_f]] == [2, 2]
+
+    # Later snapshots only list the changed functions and lines
+    assert prof.get_stats_delta().timings == {}
+    with prof:
+        f_wrapped(3)
+    delta2 = prof.get_stats_delta()
+    assert list(delta2.timings) == [key_f]
+    assert [nhits for _, nhits, _ in delta2.timings[key_f]] == [1, 1]
+    assert delta1 + delta2 == prof.get_stats()
+    # `.get_stats()` doesn't interfere
+    with prof:
+        f_wrapped(4)
+    prof.get_stats()
+    delta3 = prof.get_stats_delta()
+    assert delta1 + delta2 + delta3 == prof.get_stats()
+
+
+def test_dump_stats_delta():
+    """
+    Test writing and reading back incremental `'.lprof'` logs.
+    """
+    from line_profiler.stats_file import StatsLog
+
+    prof = LineProfiler()
+    f_wrapped = prof(f)
+    with TemporaryDirectory() as tmpdir:
+        filename = os.path.join(tmpdir, 'log.lprof')
+        snapshots = []
+        for i in range(3):
+            with prof:
+                for _ in range(i):
+                    f_wrapped(i)
+            prof.dump_stats_delta(filename)
+            snapshots.append(prof.get_stats())
+        with StatsLog(filename) as log:
+            assert len(log) == 3
+            for i, stats in enumerate(snapshots):
+                assert LineStats(log.get_timings(i), log.unit) == stats
+        assert LineStats.from_files(filename) == snapshots[-1]
+
+
+def test_append_stats_after_torn_frame():
+    """
+    Test that a frame left half-written (header still zeroed) doesn't
+    hide the frames appended after it.
+    """
+    from line_profiler.stats_file import StatsLog, append_stats
+
+    key = 'spam.py', 1, 'foo'
+    with TemporaryDirectory() as tmpdir:
+        filename = os.path.join(tmpdir, 'log.lprof')
+        append_stats(filename, {key: [(2, 1, 10)]}, 1E-6)
+        with open(filename, 'ab') as f:
+            f.write(bytes(100))  # Torn frame
+        append_stats(filename, {key: [(2, 2, 5)]}, 1E-6)
+        with StatsLog(filename) as log:
+            assert len(log) == 2
+            assert log.get_timings() == {key: [(2, 3, 15)]}
+        # Also when the first frame is the torn one
+        with open(filename, 'wb') as f:
+            f.write(bytes(30))
+        append_stats(filename, {key: [(2, 2, 5)]}, 1E-6)
+        with StatsLog(filename) as log:
+            assert len(log) == 1
+            assert log.get_timings() == {key: [(2, 2, 5)]}
+        # Files which aren't `.lprof` files are left alone
+        with open(filename, 'wb') as f:
+            f.write(b'spam and eggs')
+        with pytest.raises(ValueError, match='not a binary'):
+            append_stats(filename, {key: [(2, 1, 1)]}, 1E-6)
+        with open(filename, 'rb') as f:
+            assert f.read() == b'spam and eggs'
+
+
+def test_overhead_calibration():
+    """
+    Test that the estimated overhead of the profiler is recorded in the
+    stats (and the files), and subtracted from the shown times on
+    request.
+    """
+    overhead = _line_profiler.calibrate_overhead()
+    assert 0 <= overhead < 1e-3
+    assert _line_profiler.calibrate_overhead() == overhead  # Cached
+    prof = LineProfiler()
+    f_wrapped = prof(f)
+    for i in range(100):
+        f_wrapped(i)
+    stats = prof.get_stats()
+    assert stats.overhead == prof.overhead == overhead
+    with TemporaryDirectory() as tmpdir:
+        filename = os.path.join(tmpdir, 'out.lprof')
+        stats.to_file(filename)
+        loaded = LineStats.from_files(filename)
+    # Note: the overhead is stored with single precision
+    assert loaded == stats
+    assert loaded.overhead == pytest.approx(overhead, rel=1e-6)
+    # The combined overhead is weighted by the hits
+    combined = stats + LineStats({}, stats.unit)
+    assert combined.overhead == pytest.approx(overhead)
+
+    with io.StringIO() as sio:
+        stats.print(sio, subtract_overhead=True)
+        output = sio.getvalue()
+    if overhead:
+        assert ('Profiler overhead subtracted: %g s' % overhead) in output
+    ((_, timings),) = stats.timings.items()
+    adjusted = [
+        max(time - nhits * overhead / stats.unit, 0)
+        for _, nhits, time in timings
+    ]
+    assert sum(adjusted) <= sum(time for _, _, time in timings)
+    assert ('Total time: %g s' % (sum(adjusted) * stats.unit)) in output
+
+
+def test_overhead_calibration_is_lazy(monkeypatch):
+    """
+    Test that the overhead of the profiler isn't measured upon enabling
+    it (or getting the stats), but only once it is needed.
+    """
+    monkeypatch.setattr(_line_profiler, '_OVERHEADS', {})
+    prof = LineProfiler()
+    f_wrapped = prof(f)
+    f_wrapped(1)
+    stats = prof.get_stats() + prof.get_stats()
+    assert not _line_profiler._OVERHEADS
+    assert stats.overhead == prof.overhead
+    assert len(_line_profiler._OVERHEADS) == 1
+    prof.overhead = 1e-7
+    assert prof.get_stats().overhead == 1e-7
+
+
+_KEY = 'spam.py', 1, 'foo'
+
+
+@pytest.mark.parametrize(
+    ('field', 'value', 'other', 'combined', 'columns', 'shown'),
+    [
+        pytest.param(
+            'histograms',
+            {_KEY: {2: (40, {30: 9, 40: 1}), 3: (5, {5: 1})}},
+            {_KEY: {2: (50, {50: 1})}},
+            {_KEY: {2: (50, {30: 9, 40: 1, 50: 1}), 3: (5, {5: 1})}},
+            ['p50', 'p99', 'Max'],
+            [],
+            id='histograms',
+        ),
+        pytest.param(
+            'thread_timings',
+            {'worker': {_KEY: [(2, 6, 200)]},
+             'MainThread': {_KEY: [(2, 4, 100), (3, 1, 5)]}},
+            {'worker': {_KEY: [(2, 1, 1)]}},
+            {'worker': {_KEY: [(2, 7, 201)]},
+             'MainThread': {_KEY: [(2, 4, 100), (3, 1, 5)]}},
+            [],
+            ['Per-thread breakdown', 'worker', 'MainThread'],
+            id='thread_timings',
+        ),
+        pytest.param(
+            'self_times',
+            {_KEY: {2: 250, 3: 5}},
+            {_KEY: {2: 1}},
+            {_KEY: {2: 251, 3: 5}},
+            ['Self Time'],
+            [],
+            id='self_times',
+        ),
+        pytest.param(
+            'counters',
+            {'cycles': {_KEY: {2: 1000, 3: 20}},
+             'cache-misses': {_KEY: {2: 7}}},
+            {'cycles': {_KEY: {2: 5}}},
+            {'cycles': {_KEY: {2: 1005, 3: 20}},
+             'cache-misses': {_KEY: {2: 7}}},
+            ['cycles', 'cache-misses'],
+            [],
+            id='counters',
+        ),
+        pytest.param(
+            'memory',
+            {_KEY: {2: (4, 4096, 1024), 3: (1, 64, 0)}},
+            {_KEY: {2: (1, 100, -1024)}},
+            {_KEY: {2: (5, 4196, 0), 3: (1, 64, 0)}},
+            ['Allocs', 'Allocated', 'Retained'],
+            ['4.0 KiB'],
+            id='memory',
+        ),
+    ],
+)
+def test_optional_stats(field, value, other, combined, columns, shown):
+    """
+    Test that each of the optional fields of `LineStats` is left empty
+    unless asked for, summed when combining stats, kept as is through
+    a file, and shown (only) when there is something to show.
+    """
+    assert not getattr(LineProfiler().get_stats(), field)
+
+    stats = LineStats({_KEY: [(2, 10, 300), (3, 1, 5)]}, 1E-6,
+                      **{field: value})
+    assert getattr(stats, field) == value
+    total = stats + LineStats({_KEY: [(2, 1, 1)]}, 1E-6, **{field: other})
+    assert getattr(total, field) == combined
+
+    with TemporaryDirectory() as tmpdir:
+        filename = os.path.join(tmpdir, 'out.lprof')
+        stats.to_file(filename)
+        loaded = LineStats.from_files(filename)
+    assert getattr(loaded, field) == value
+
+    with io.StringIO() as sio:
+        stats.print(sio)
+        output = sio.getvalue()
+    header = next(line for line in output.splitlines()
+                  if line.startswith('Line #'))
+    for before, after in zip(['% Time'] + columns, columns):
+        assert header.index(before) < header.index(after)
+    for text in shown:
+        assert text in output
+    with io.StringIO() as sio:
+        LineStats(stats.timings, stats.unit).print(sio)
+        assert (columns + shown)[0] not in sio.getvalue()
+
+
+def test_histograms():
+    """
+    Test that the histograms of the line durations agree with the
+    timings, and give percentiles within the longest hit.
+    """
+    from line_profiler import histograms as hist
+
+    prof = LineProfiler(histograms=True)
+    assert prof.histograms
+    assert not LineProfiler().histograms
+    f_wrapped = prof(f)
+    for i in range(50):
+        f_wrapped(i)
+    delta = prof.get_stats_delta()
+    for i in range(50):
+        f_wrapped(i)
+    stats = prof.get_stats()
+    ((key, timings),) = stats.timings.items()
+    line_hists = stats.histograms[key]
+    assert set(line_hists) == {lineno for lineno, _, _ in timings}
+    for lineno, nhits, time in timings:
+        max_time, counts = line_hists[lineno]
+        assert sum(counts.values()) == nhits
+        assert 0 <= max_time <= time
+        assert hist.percentile(counts, 50, max_time) <= max_time
+        # The deltas only cover the first half of the calls
+        delta_counts = delta.histograms[key][lineno][1]
+        assert sum(delta_counts.values()) == nhits // 2
+
+
+def test_per_thread_timings():
+    """
+    Test that the per-thread timings add up to the overall ones, and
+    are named after the threads.
+    """
+    prof = LineProfiler(per_thread=True)
+    assert prof.per_thread
+    f_wrapped = prof(f)
+    nthreads, ncalls = 3, 10
+
+    def worker():
+        for i in range(ncalls):
+            f_wrapped(i)
+
+    threads = [
+        threading.Thread(target=worker, name=f'worker-{i}')
+        for i in range(nthreads)
+    ]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    delta = prof.get_stats_delta()
+    worker()  # On the main thread
+    stats = prof.get_stats()
+    ((key, timings),) = stats.timings.items()
+    names = {thread.name for thread in threads} | {'MainThread'}
+    assert set(stats.thread_timings) == names
+    for name in names:
+        entries = stats.thread_timings[name][key]
+        assert [nhits for _, nhits, _ in entries] == [ncalls] * len(entries)
+    for lineno, nhits, time in timings:
+        per_thread = [
+            entry
+            for thread_timings in stats.thread_timings.values()
+            for entry in thread_timings[key]
+            if entry[0] == lineno
+        ]
+        assert sum(entry[1] for entry in per_thread) == nhits
+        assert sum(entry[2] for entry in per_thread) == time
+    # The deltas add up to the totals
+    assert 'MainThread' not in delta.thread_timings
+    assert (delta + prof.get_stats_delta()).thread_timings == (
+        stats.thread_timings)
+
+
+def test_exited_threads():
+    """
+    Test that the timings of the threads which have exited are kept
+    (and still broken down by thread) after their data is retired to
+    reuse their indices.
+    """
+    nthreads = 20
+    for per_thread in [False, True]:
+        prof = LineProfiler(per_thread=per_thread)
+        f_wrapped = prof(f)
+        # One at a time, so that each new thread retires its predecessor
+        for i in range(nthreads):
+            thread = threading.Thread(
+                target=f_wrapped, args=(i,), name=f'short-lived-{i}')
+            thread.start()
+            thread.join()
+        stats = prof.get_stats()
+        ((key, timings),) = stats.timings.items()
+        assert [nhits for _, nhits, _ in timings] == (
+            [nthreads] * len(timings))
+        if not per_thread:
+            assert not stats.thread_timings
+            continue
+        names = {f'short-lived-{i}' for i in range(nthreads)}
+        assert set(stats.thread_timings) == names
+        for name in names:
+            entries = stats.thread_timings[name][key]
+            assert [nhits for _, nhits, _ in entries] == [1] * len(entries)
+
+
+def test_self_times():
+    """
+    Test that the self times of the lines exclude (only) the time spent
+    in the profiled code they call.
+    """
+
+    def callee():
+        time.sleep(.02)
+
+    def caller():
+        x = 1
+        callee()  # Slow callee
+        time.sleep(.01)  # Slow itself
+        return x
+
+    prof = LineProfiler(self_time=True)
+    assert prof.self_time
+    assert not LineProfiler().self_time
+    caller_wrapped = prof(caller)
+    prof.add_callable(callee)
+    caller_wrapped()
+    delta = prof.get_stats_delta()
+    caller_wrapped()
+    stats = prof.get_stats()
+    first_lineno = caller.__code__.co_firstlineno
+    call_line, sleep_line = first_lineno + 2, first_lineno + 3
+    total_self = 0
+    for key, timings in stats.timings.items():
+        self_times = stats.self_times[key]
+        assert set(self_times) == {lineno for lineno, _, _ in timings}
+        for lineno, _, time_ in timings:
+            assert 0 <= self_times[lineno] <= time_
+            if key[2] == 'callee' or lineno != call_line:
+                # Nothing profiled is called from these lines
+                assert self_times[lineno] == time_
+        total_self += sum(self_times.values())
+    caller_key, = (key for key in stats.timings if key[2] == 'caller')
+    caller_times = {line: t for line, _, t in stats.timings[caller_key]}
+    caller_self_times = stats.self_times[caller_key]
+    # The time of the callee is excluded from the self time of the line
+    # calling it...
+    assert caller_self_times[call_line] < .5 * caller_times[call_line]
+    assert caller_self_times[call_line] < caller_self_times[sleep_line]
+    # ... so that the self times of all the lines add up to the total
+    # time of the outermost function
+    assert total_self == sum(caller_times.values())
+    # The deltas only cover the first call
+    for lineno, self_time in delta.self_times[caller_key].items():
+        assert self_time <= caller_self_times[lineno]
+
+
+def test_counters():
+    """
+    Test that the events to count are validated, and (where the counters
+    can be opened) that they are counted per line.
+    """
+    with pytest.raises(ValueError, match='unknown event'):
+        LineProfiler(counters=['cycles', 'spam'])
+    with pytest.raises(ValueError, match='duplicate'):
+        LineProfiler(counters=['cycles', 'cycles'])
+    with pytest.raises(ValueError, match='at most'):
+        LineProfiler(counters=_line_profiler.COUNTER_EVENTS)
+    assert LineProfiler().counters == ()
+
+    # The columns are widened to fit the names of the events
+    first_lineno = f.__code__.co_firstlineno
+    key = f.__code__.co_filename, first_lineno, f.__name__
+    stats = LineStats({key: [(first_lineno + 2, 10, 300)]}, 1E-6,
+                      counters={'cache-references': {key: {
+                          first_lineno + 2: 123}}})
+    with io.StringIO() as sio:
+        stats.print(sio)
+        lines = sio.getvalue().splitlines()
+    header = next(line for line in lines if line.startswith('Line #'))
+    row, = (line for line in lines if line.rstrip().endswith('y = x + 10'))
+    end = header.index('cache-references') + len('cache-references')
+    assert row[:end].endswith(' 123')
+    def_line, = (line for line in lines if line.endswith('def f(x):'))
+    assert header.index('Line Contents') == def_line.index('def f(x):')
+
+    try:
+        prof = LineProfiler(counters=['instructions'])
+    except OSError as e:
+        pytest.skip(f'hardware counters unavailable: {e}')
+    assert prof.counters == ('instructions',)
+
+    def func():
+        x = 0
+        for _ in range(10000):
+            x += 1
+        return x
+
+    func_wrapped = prof(func)
+    func_wrapped()
+    delta = prof.get_stats_delta()
+    func_wrapped()
+    stats = prof.get_stats()
+    func_key, = stats.timings
+    counts = stats.counters['instructions'][func_key]
+    assert set(counts) == {lineno for lineno, _, _ in stats.timings[func_key]}
+    assert all(count >= 0 for count in counts.values())
+    assert sum(counts.values()) > 0
+    for lineno, count in delta.counters['instructions'][func_key].items():
+        assert count <= counts[lineno]
+
+
+def test_memory():
+    """
+    Test that the blocks allocated by each line are charged to it, and
+    those it frees are subtracted from what it retains.
+    """
+    assert not LineProfiler().memory
+    prof = LineProfiler(memory=True)
+    assert prof.memory
+    nbytes = 8 * 100000
+
+    def func():
+        kept = [None] * 100000
+        dropped = [None] * 100000
+        del dropped
+        return kept
+
+    func_wrapped = prof(func)
+    first_lineno = func.__code__.co_firstlineno
+    results = [func_wrapped()]
+    delta = prof.get_stats_delta()
+    results.append(func_wrapped())
+    stats = prof.get_stats()
+    func_key, = stats.timings
+    memory = stats.memory[func_key]
+    nallocs, allocated, retained = memory[first_lineno + 1]
+    assert nallocs >= 2
+    assert allocated >= 2 * nbytes
+    assert retained >= 2 * nbytes
+    _, allocated, retained = memory[first_lineno + 2]
+    assert allocated >= 2 * nbytes
+    assert retained < nbytes
+    # The deltas add up to the totals
+    assert (delta + prof.get_stats_delta()).memory == stats.memory
+
+
+def test_publish_live():
+    """
+    Test that the live-counter file agrees with `.get_stats()` while
+    profiling, including after more functions are added.
+    """
+    from line_profiler.live import read_live
+
+    prof = LineProfiler()
+    f_wrapped = prof(f)
+    with TemporaryDirectory() as tmpdir:
+        filename = os.path.join(tmpdir, 'out.live')
+        # Note: only publish manually
+        with prof.publish_live(filename, interval=3600) as publisher:
+            publisher.publish()
+            snapshot = read_live(filename)
+            assert snapshot.pid == os.getpid()
+            assert snapshot.unit == prof.timer_unit
+            assert not snapshot.closed
+            assert LineStats(*snapshot[:2]) == prof.get_stats()
+            for _ in range(3):
+                f_wrapped(1)
+            publisher.publish()
+            snapshot = read_live(filename)
+            assert LineStats(*snapshot[:2]) == prof.get_stats()
+            # Adding a function changes the layout of the file
+            g_wrapped = prof(g)
+            for _ in range(3):
+                list(g_wrapped(1))
+            publisher.publish()
+            snapshot = read_live(filename)
+            assert LineStats(*snapshot[:2]) == prof.get_stats()
+            f_wrapped(2)
+        snapshot = read_live(filename)
+        assert snapshot.closed
+        assert LineStats(*snapshot[:2]) == prof.get_stats()
+        assert len(snapshot.timings) == 2
+
+
+@pytest.mark.skipif(not hasattr(os, 'fork'), reason='Requires `os.fork()`')
+def test_collect_workers_fork():
+    """
+    Test that the results of forked pool workers are collected, without
+    those inherited from the parent.
+    """
+    import multiprocessing
+
+    prof = LineProfiler(f)
+    ctx = multiprocessing.get_context('fork')
+    with TemporaryDirectory() as tmpdir:
+        with prof.collect_workers(tmpdir) as collector:
+            with prof:
+                f(0)
+                # Note: exiting the pool terminates the workers
+                with ctx.Pool(2) as pool:
+                    assert pool.map(f, range(10)) == list(range(10, 20))
+        assert 1 <= len(collector.files()) <= 2
+        worker_stats = collector.get_worker_stats()
+        stats = collector.get_stats()
+        collector.cleanup()
+        assert not collector.files()
+    for timings, ncalls in [
+        (prof.get_stats().timings, 1),
+        (worker_stats.timings, 10),
+        (stats.timings, 11),
+    ]:
+        ((key, entries),) = timings.items()
+        assert key[2] == 'f'
+        assert [nhits for _, nhits, _ in entries] == [ncalls] * 2
+
+
 @pytest.mark.parametrize('n', [1, 2])
 @pytest.mark.parametrize('legacy', [True, False])
 def test_load_stats_files(legacy, n):
@@ -1282,3 +2257,76 @@ def test_load_stats_files(legacy, n):
         stats_read = LineStats.from_files(*files)
     assert isinstance(stats_read, LineStats)
     assert stats_read == stats_combined
+
+
+@pytest.mark.parametrize('legacy', [True, False])
+def test_load_stats_files_selection(legacy):
+    """
+    Test loading a subset of the functions with
+    ``LineStats.from_files(..., select=...)``, from both binary and
+    pickled ``'.lprof'`` files.
+    """
+    stats = LineStats(
+        {
+            ('spam.py', 1, 'foo'): [(2, 3, 3600)],
+            ('spam.py', 10, 'bar'): [(11, 20, 1000), (12, 1, 10)],
+            ('eggs.py', 5, 'baz'): [],
+        },
+        1e-6,
+    )
+    with TemporaryDirectory() as tmpdir:
+        filename = os.path.join(tmpdir, 'stats.lprof')
+        if legacy:
+            with open(filename, mode='wb') as fobj:
+                pickle.dump(stats, fobj)
+        else:
+            stats.to_file(filename)
+        selected = LineStats.from_files(
+            filename, select=lambda key: key[0] == 'spam.py'
+        )
+    assert selected.unit == stats.unit
+    assert selected.timings == {
+        key: entries
+        for key, entries in stats.timings.items()
+        if key[0] == 'spam.py'
+    }
+
+
+def test_stats_file_format():
+    """
+    Test the layout and the version check of binary ``'.lprof'``
+    files.
+    """
+    from line_profiler import stats_file
+
+    timings = {
+        (os.fsdecode(b'/tmp/\xff.py'), 1, 'foo'): [(2, 2**40, -1)],
+        ('spam.py', 10, 'bar'): [(11, 20, 1000), (12, 1, 10)],
+    }
+    with TemporaryDirectory() as tmpdir:
+        filename = os.path.join(tmpdir, 'stats.lprof')
+        LineStats(timings, 1e-9).to_file(filename)
+        with open(filename, mode='rb') as fobj:
+            data = fobj.read()
+        header = stats_file.HEADER.unpack_from(data)
+        magic, version, _, nstrings, nfuncs, unit, start, *_ = header
+        assert (magic, version) == (stats_file.MAGIC, stats_file.VERSION)
+        assert (nstrings, nfuncs, unit) == (4, 2, 1e-9)
+        end = start + 3 * stats_file.RECORD.size
+        assert list(stats_file.RECORD.iter_unpack(data[start:end])) == [
+            (2, 2**40, -1),
+            (11, 20, 1000),
+            (12, 1, 10),
+        ]
+        with stats_file.StatsFile(filename) as stats:
+            assert dict(stats) == timings
+            assert ('spam.py', 10, 'foo') not in stats
+        # Files from newer versions of the format are rejected
+        with open(filename, mode='wb') as fobj:
+            fobj.write(
+                data[:8]
+                + (stats_file.VERSION + 1).to_bytes(2, 'little')
+                + data[10:]
+            )
+        with pytest.raises(ValueError, match='not supported'):
+            LineStats.from_files(filename)
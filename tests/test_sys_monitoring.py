@@ -7,7 +7,7 @@ from contextlib import AbstractContextManager, ExitStack
 from functools import partial
 from io import StringIO
 from itertools import count
-from types import CodeType, ModuleType
+from types import BuiltinFunctionType, CodeType, ModuleType
 from typing import (
     Any,
     Optional,
@@ -287,7 +287,8 @@ def sys_mon_cleanup(
         pytest.skip('No `sys.monitoring`')
     # Remember the callbacks
     event_ids = {
-        name: getattr(MON, name) for name in ('LINE', 'PY_RETURN', 'PY_YIELD')
+        name: getattr(MON, name)
+        for name in ('LINE', 'PY_RETURN', 'PY_YIELD', 'PY_RESUME')
     }
     callbacks = {
         name: MON.register_callback(event_id, None)
@@ -863,15 +864,16 @@ def test_local_event_preservation(
 ) -> None:
     """
     Check that existing :py:mod:`sys.monitoring` code-local events are
-    preserved when a profiler swaps out the callable's code object.
+    preserved when a profiler starts profiling the callable (whose code
+    object it leaves alone).
     """
     prof = LineProfiler(wrap_trace=True)
 
     @prof
     def func0(n: int) -> int:
         """
-        This function compiles down to the same bytecode as `func()` and
-        ensure that `prof` does bytecode padding with the latter later.
+        This function compiles down to the same bytecode as `func()`,
+        which `prof` must still tell apart from it.
         """
         x = 0
         for n in range(1, n + 1):
@@ -890,8 +892,8 @@ def test_local_event_preservation(
         orig_code = func.__code__
         orig_func, func = func, prof(func)
         code = orig_func.__code__
-        assert code is not orig_code, (
-            "`line_profiler` didn't overwrite the function's code object"
+        assert code is orig_code, (
+            "`line_profiler` overwrote the function's code object"
         )
 
     lines, first_lineno = inspect.getsourcelines(func)
@@ -915,8 +917,8 @@ def test_local_event_preservation(
                 profile()
             enable_line_events(code)
             if profile_when != 'before':
-                # If we're here, the code object of `func()` is swapped
-                # out after code-local events have been registered to it
+                # If we're here, `func()` is profiled after code-local
+                # events have been registered to its code object
                 profile()
             assert MON.get_current_callback() is callback
             assert func(n) == n * (n + 1) // 2
@@ -933,3 +935,116 @@ def test_local_event_preservation(
     )
     nhits = int(line.split()[1])
     assert nhits == n
+
+
+@pytest.mark.parametrize('wrap_trace', [True, False])
+def test_line_events_are_local(wrap_trace: bool) -> None:
+    """
+    Check that while profiling, the line events are only turned on for
+    the profiled code objects, and that the events are restored
+    afterwards.
+    """
+    prof = LineProfiler(wrap_trace=wrap_trace)
+    seen = []
+
+    def unprofiled() -> int:
+        return 1
+
+    def get_events() -> Tuple[int, int, int]:
+        return (
+            MON.get_events(),
+            MON.get_local_events(code),
+            MON.get_local_events(unprofiled.__code__),
+        )
+
+    def func() -> int:
+        x = unprofiled()
+        seen.append(get_events())
+        return x
+
+    wrapper = prof(func)
+    code = func.__code__
+    with restore_events():
+        disable_line_events()
+        global_events = MON.get_events()
+        local_events = MON.get_local_events(code)
+        assert wrapper() == 1
+        assert MON.get_events() == global_events
+        assert MON.get_local_events(code) == local_events
+    (global_during, local_during, unprofiled_during), = seen
+    assert not global_during & MON.LINE
+    assert local_during & MON.LINE
+    assert not unprofiled_during & MON.LINE
+    timings = prof.get_stats().timings[_line_profiler.label(code)]
+    assert [nhits for _, nhits, _ in timings] == [1, 1, 1]
+
+
+def test_disabling_drops_local_events(
+    monkeypatch: pytest.MonkeyPatch,
+) -> None:
+    """
+    Check that disabling a profiler while another stays active drops the
+    line events of the code only the former profiles, and that
+    :py:func:`sys.monitoring.restart_events` (which would re-enable the
+    locations DISABLE-d by all the tools) is never called.
+    """
+    restarts = []
+    monkeypatch.setattr(
+        sys.monitoring, 'restart_events', lambda: restarts.append(None)
+    )
+    prof1, prof2 = LineProfiler(), LineProfiler()
+
+    def func1() -> int:
+        return 1
+
+    def func2() -> int:
+        return 2
+
+    def func3() -> int:
+        return 3
+
+    prof1.add_function(func1)
+    prof2.add_function(func2)
+    code1 = func1.__code__
+    with restore_events():
+        disable_line_events()
+        local_events = MON.get_local_events(code1)
+        with prof2:
+            with prof1:
+                assert MON.get_local_events(code1) & MON.LINE
+                assert func1() == 1
+            assert MON.get_local_events(code1) == local_events
+            assert func1() == 1
+            assert func2() == 2
+            # Profiling more code doesn't restart the events either
+            prof2.add_function(func3)
+            assert func3() == 3
+    assert not restarts
+    timings = prof1.get_stats().timings[_line_profiler.label(code1)]
+    assert [nhits for _, nhits, _ in timings] == [1]
+    for func in func2, func3:
+        label = _line_profiler.label(func.__code__)
+        timings = prof2.get_stats().timings[label]
+        assert [nhits for _, nhits, _ in timings] == [1]
+
+
+def test_registered_callbacks_are_builtins() -> None:
+    """
+    Check that the callbacks registered with :py:mod:`sys.monitoring`
+    are builtins (which are called via vectorcall) bound to the
+    profiler's manager, and that they're removed afterwards.
+    """
+    prof = LineProfiler(wrap_trace=False)
+    seen = []
+
+    @prof
+    def func() -> None:
+        seen.append(MON.get_current_callback())
+
+    before = MON.get_current_callback()
+    func()
+    assert MON.get_current_callback() is before
+    callback, = seen
+    assert isinstance(callback, BuiltinFunctionType)
+    assert callback.__self__ is prof._manager
+    assert callback.__name__ == 'handle_line_event'